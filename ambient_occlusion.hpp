@@ -0,0 +1,242 @@
+/* This is a utility program that bakes the ambient occlusion of each vertex of a scene, so that the vertex shader
+can darken the creases and corners of a mesh without any cost at run time.
+From each vertex, rays are cast in directions spread over the hemisphere around its normal (more of them near
+the normal, as a diffuse surface receives light), against the triangles of the whole scene in the 4-wide BVH of
+path_tracer.hpp. A ray blocked within a given distance counts as occluded; the share of rays that are not
+blocked is stored as one byte per vertex, from 0 (fully occluded) to 255 (open). The vertices are baked on all
+the CPU cores, and the result is kept in a cache file so that it is only baked once per version of a 3D file.
+The following functions are provided.
+
+// The name of the cache file of the occlusion of a 3D file.
+string getOcclusionCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int rayCount, float distanceRatio)
+
+// Bake the occlusion of the vertices of the meshes that the instances are drawn from, against the triangles of
+// all the instances. The rays go distanceRatio times the diagonal of the scene. The meshes that are not the
+// source of an instance, or have no triangles, get an empty array.
+void bakeSceneOcclusion(const aiScene* scene, const vector<PickInstance>& instances, unsigned int rayCount, float distanceRatio,
+	vector<vector<unsigned char> >& occlusion)
+
+// Bake the occlusion of the source meshes i of the instances for which bakedMeshes[i] is true, still against the
+// triangles of all the instances, e.g. the meshes of a reloaded 3D file that have changed. occlusion must have
+// one array per mesh of the scene; the arrays of the other meshes are left as they are.
+void bakeMeshOcclusion(const aiScene* scene, const vector<PickInstance>& instances, const vector<bool>& bakedMeshes,
+	unsigned int rayCount, float distanceRatio, vector<vector<unsigned char> >& occlusion)
+
+// Write the occlusion of the meshes of a scene into a cache file. Returns false if the file cannot be written.
+bool writeOcclusionCache(const string& cacheFileName, const vector<vector<unsigned char> >& occlusion)
+
+// Read the occlusion of the meshes of a scene from a cache file. Returns false if there is no cache file or if
+// it does not match the meshes.
+bool readOcclusionCache(const string& cacheFileName, const aiScene* scene, vector<vector<unsigned char> >& occlusion)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp, ray_picking.hpp and
+path_tracer.hpp to be included first.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The vertices that one CPU core takes at a time.
+#define OCCLUSION_VERTEX_BLOCK_SIZE 256
+
+// The header at the beginning of an occlusion cache file. It is followed by the vertex count of each mesh
+// (0 for the meshes without occlusion), and then by the bytes of the meshes one after the other.
+struct OcclusionCacheHeader {
+	unsigned char identifier[12];       // OCCLUSION_CACHE_IDENTIFIER
+	unsigned int meshCount;
+	unsigned long long vertexCount;     // the vertices of all the meshes
+};
+
+const unsigned char OCCLUSION_CACHE_IDENTIFIER[12] = { 0xAB, 'A', 'O', 'C', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+//------------------------------------------------------------
+// The name of the cache file of the occlusion of a 3D file.
+string getOcclusionCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int rayCount, float distanceRatio) {
+	unsigned long long key = hashFileVersion(modelFileName);
+	key = hashBytes(&rayCount, sizeof(rayCount), key);
+	key = hashBytes(&distanceRatio, sizeof(distanceRatio), key);
+	return cacheDirectory + "/" + formatHash(key) + ".aoc";
+}
+
+//------------------------------------------------------------
+// The normal of each vertex of a mesh: its own if it has normals, and otherwise the sum of the normals of its
+// triangles, weighted by their areas.
+void getOcclusionNormals(const aiMesh* mesh, vector<aiVector3D>& normals) {
+	if (mesh->HasNormals()) {
+		normals.assign(mesh->mNormals, mesh->mNormals + mesh->mNumVertices);
+		return;
+	}
+	normals.assign(mesh->mNumVertices, aiVector3D(0.0f, 0.0f, 0.0f));
+	for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+		const aiFace& face = mesh->mFaces[f];
+		for (unsigned int k = 2; k < face.mNumIndices; k++) {
+			const aiVector3D& v0 = mesh->mVertices[face.mIndices[0]];
+			aiVector3D normal = (mesh->mVertices[face.mIndices[k - 1]] - v0) ^ (mesh->mVertices[face.mIndices[k]] - v0);
+			normals[face.mIndices[0]] += normal;
+			normals[face.mIndices[k - 1]] += normal;
+			normals[face.mIndices[k]] += normal;
+		}
+	}
+}
+
+// The occlusion of one vertex. The rays start a little above the surface, so that they do not hit the triangles
+// of the vertex itself. A vertex without a normal (e.g. of a point or a line) is open.
+unsigned char bakeVertexOcclusion(const PathTracer& tracer, const aiVector3D& position, const aiVector3D& normal, unsigned int vertex,
+	unsigned int rayCount, float maxDistance) {
+	float length = normal.Length();
+	if (!(length > 0)) {
+		return 255;
+	}
+	aiVector3D axis = normal * (1.0f / length);
+	aiVector3D origin = position + axis * (1e-3f * maxDistance);
+	unsigned int openCount = 0;
+	for (unsigned int r = 0; r < rayCount; r++) {
+		TracerRandom random = seedTracerRandom(vertex, r);
+		aiVector3D direction = sampleCosinePower(axis, 1.0f, random);
+		if (!traceAnyHit(tracer, makeTracerRay(origin, direction), maxDistance)) {
+			openCount++;
+		}
+	}
+	return (unsigned char) ((255 * openCount + rayCount / 2) / rayCount);
+}
+
+//------------------------------------------------------------
+// Bake the occlusion of the vertices of some of the meshes that the instances are drawn from. The vertices of all
+// the meshes are cut into blocks, so that a few large meshes keep all the CPU cores busy as well as many small ones.
+// A source mesh is baked where it is, so its copies share its occlusion.
+void bakeMeshOcclusion(const aiScene* scene, const vector<PickInstance>& instances, const vector<bool>& bakedMeshes,
+	unsigned int rayCount, float distanceRatio, vector<vector<unsigned char> >& occlusion) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	// The triangles of the scene are only needed if there is a mesh to bake.
+	bool hasBakedMesh = false;
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		hasBakedMesh = hasBakedMesh || bakedMeshes[instances[i].sourceMesh];
+	}
+	if (!hasBakedMesh) {
+		return;
+	}
+	PathTracer tracer;
+	buildTracerGeometry(scene, instances, tracer);
+	double buildMilliseconds = elapsedMilliseconds(startTime);
+	if (tracer.nodes.empty() || rayCount == 0) {
+		return;
+	}
+
+	// The diagonal of the scene is the diagonal of the boxes of the root's children together.
+	float sceneMin[3], sceneMax[3];
+	resetBox(sceneMin, sceneMax);
+	for (unsigned int i = 0; i < 4; i++) {
+		if (tracer.nodes[0].children[i] != BVH4_NO_CHILD) {
+			float childMin[3] = { tracer.nodes[0].boundsMin[0][i], tracer.nodes[0].boundsMin[1][i], tracer.nodes[0].boundsMin[2][i] };
+			float childMax[3] = { tracer.nodes[0].boundsMax[0][i], tracer.nodes[0].boundsMax[1][i], tracer.nodes[0].boundsMax[2][i] };
+			growBox(sceneMin, sceneMax, childMin, childMax);
+		}
+	}
+	float maxDistance = distanceRatio * (aiVector3D(sceneMax[0], sceneMax[1], sceneMax[2]) - aiVector3D(sceneMin[0], sceneMin[1], sceneMin[2])).Length();
+
+	vector<bool> baked(scene->mNumMeshes, false);
+	vector<vector<aiVector3D> > normals(scene->mNumMeshes);
+	vector<pair<unsigned int, unsigned int> > blocks;   // (mesh, first vertex)
+	unsigned long long vertexCount = 0;
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		unsigned int source = instances[i].sourceMesh;
+		const aiMesh* mesh = scene->mMeshes[source];
+		if (!bakedMeshes[source] || baked[source] || !mesh->HasPositions() || !mesh->HasFaces()) {
+			continue;
+		}
+		baked[source] = true;
+		occlusion[source].resize(mesh->mNumVertices);
+		getOcclusionNormals(mesh, normals[source]);
+		for (unsigned int first = 0; first < mesh->mNumVertices; first += OCCLUSION_VERTEX_BLOCK_SIZE) {
+			blocks.push_back(make_pair(source, first));
+		}
+		vertexCount += mesh->mNumVertices;
+	}
+
+	parallelFor((unsigned int) blocks.size(), [scene, &tracer, &blocks, &normals, &occlusion, rayCount, maxDistance](unsigned int b) {
+		unsigned int meshIndex = blocks[b].first;
+		const aiMesh* mesh = scene->mMeshes[meshIndex];
+		unsigned int end = min(blocks[b].second + OCCLUSION_VERTEX_BLOCK_SIZE, mesh->mNumVertices);
+		for (unsigned int v = blocks[b].second; v < end; v++) {
+			occlusion[meshIndex][v] = bakeVertexOcclusion(tracer, mesh->mVertices[v], normals[meshIndex][v], v, rayCount, maxDistance);
+		}
+	});
+
+	double milliseconds = elapsedMilliseconds(startTime);
+	cout << "Ambient occlusion: " << vertexCount << " vertices baked with " << rayCount << " rays each against " << tracer.triangles.size()
+		<< " triangles (BVH built in " << buildMilliseconds << " ms), " << vertexCount * rayCount / max(milliseconds - buildMilliseconds, 1e-3) / 1000.0
+		<< " M rays/s, " << milliseconds << " ms" << endl;
+}
+
+//------------------------------------------------------------
+// Bake the occlusion of all the meshes that the instances are drawn from.
+void bakeSceneOcclusion(const aiScene* scene, const vector<PickInstance>& instances, unsigned int rayCount, float distanceRatio,
+	vector<vector<unsigned char> >& occlusion) {
+	occlusion.assign(scene->mNumMeshes, vector<unsigned char>());
+	bakeMeshOcclusion(scene, instances, vector<bool>(scene->mNumMeshes, true), rayCount, distanceRatio, occlusion);
+}
+
+//------------------------------------------------------------
+// Write the occlusion of the meshes of a scene into a cache file.
+bool writeOcclusionCache(const string& cacheFileName, const vector<vector<unsigned char> >& occlusion) {
+	OcclusionCacheHeader header;
+	memcpy(header.identifier, OCCLUSION_CACHE_IDENTIFIER, 12);
+	header.meshCount = (unsigned int) occlusion.size();
+	header.vertexCount = 0;
+	for (unsigned int i = 0; i < occlusion.size(); i++) {
+		header.vertexCount += occlusion[i].size();
+	}
+
+	vector<unsigned char> file(sizeof(header) + sizeof(unsigned int) * header.meshCount + header.vertexCount);
+	memcpy(&file[0], &header, sizeof(header));
+	size_t offset = sizeof(header) + sizeof(unsigned int) * header.meshCount;
+	for (unsigned int i = 0; i < occlusion.size(); i++) {
+		unsigned int vertexCount = (unsigned int) occlusion[i].size();
+		memcpy(&file[sizeof(header) + sizeof(unsigned int) * i], &vertexCount, sizeof(unsigned int));
+		if (vertexCount > 0) {
+			memcpy(&file[offset], &occlusion[i][0], vertexCount);
+			offset += vertexCount;
+		}
+	}
+	return writeFile(cacheFileName, &file[0], file.size());
+}
+
+// Read the occlusion of the meshes of a scene from a cache file. Each mesh must have as many vertices as the
+// cache file says, or none.
+bool readOcclusionCache(const string& cacheFileName, const aiScene* scene, vector<vector<unsigned char> >& occlusion) {
+	MappedFile file;
+	if (!mapFile(cacheFileName, file)) {
+		return false;
+	}
+	const unsigned char* data = file.data;
+	OcclusionCacheHeader header;
+	bool valid = file.size >= sizeof(header);
+	if (valid) {
+		memcpy(&header, data, sizeof(header));
+		valid = memcmp(header.identifier, OCCLUSION_CACHE_IDENTIFIER, 12) == 0 && header.meshCount == scene->mNumMeshes
+			&& file.size == sizeof(header) + sizeof(unsigned int) * (unsigned long long) header.meshCount + header.vertexCount;
+	}
+
+	size_t offset = sizeof(header) + sizeof(unsigned int) * (valid ? header.meshCount : 0);
+	occlusion.assign(scene->mNumMeshes, vector<unsigned char>());
+	for (unsigned int i = 0; valid && i < scene->mNumMeshes; i++) {
+		unsigned int vertexCount;
+		memcpy(&vertexCount, data + sizeof(header) + sizeof(unsigned int) * i, sizeof(unsigned int));
+		if ((vertexCount != 0 && vertexCount != scene->mMeshes[i]->mNumVertices) || offset + vertexCount > file.size) {
+			valid = false;
+			break;
+		}
+		occlusion[i].assign(data + offset, data + offset + vertexCount);
+		offset += vertexCount;
+	}
+	unmapFile(file);
+	if (!valid) {
+		occlusion.assign(scene->mNumMeshes, vector<unsigned char>());
+	}
+	return valid;
+}
@@ -0,0 +1,494 @@
+/* This is a utility program that keeps the content of 3D files in a content-addressed store on disk, so that
+the meshes, materials and images that many 3D files share are stored and loaded once.
+Each mesh, material and embedded image of a scene is a blob, stored in a file named by the hash of its bytes:
+two 3D files that contain the same mesh refer to the same blob file. What belongs to one 3D file (the names,
+the material of each mesh and the node tree) is kept in its manifest, a small file that lists the hashes of its
+blobs. A 3D file that has a manifest is loaded from it and its blobs, without importing the 3D file again.
+The blobs use the layout of the optimized model files (see optimized_model.hpp), with float positions.
+The following functions are provided.
+
+// Store a scene: write the blobs that the store does not have yet, then the manifest of modelFileName.
+// Returns false if the scene cannot be stored, e.g. because it has lights, cameras, animations or bones,
+// which the store does not keep; such a 3D file is imported every time instead.
+bool storeScene(const aiScene* scene, const string& modelFileName, const string& storeDirectory,
+	AssetStoreStatistics& statistics)
+
+// Load a scene from the manifest of modelFileName and its blobs. Returns NULL if the 3D file has no up-to-date
+// manifest, or if a blob is missing or damaged. The first time a blob is loaded by the program, its bytes are
+// hashed again and checked against its name; a damaged blob is deleted, so the next storeScene() writes it again.
+// The caller owns the scene.
+aiScene* loadStoredScene(const string& modelFileName, const string& storeDirectory, AssetStoreStatistics& statistics)
+
+// Print what storeScene() or loadStoredScene() has done, and the dedup ratio of the whole store: the bytes of
+// the blobs that the manifests of the current versions of the 3D files refer to, divided by the bytes of their
+// blob files. The manifests of old versions and the blobs that only they refer to are counted apart.
+void printAssetStoreStatistics(const AssetStoreStatistics& statistics, const string& storeDirectory)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp, mesh_instancing.hpp,
+mesh_optimizer.hpp and optimized_model.hpp to be included first.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// What a blob holds. The type is the first 4 bytes of the blob, so blobs of different types never have the same hash.
+enum AssetType { ASSET_MESH = 1, ASSET_MATERIAL = 2, ASSET_IMAGE = 3 };
+
+// A blob, as the manifest refers to it.
+struct AssetReference {
+	unsigned long long hash;            // the hash of the bytes of the blob, which names its file
+	unsigned long long size;
+};
+
+// The manifest starts with this header. The references of the materials, the embedded textures and the meshes
+// follow it, then the name of the 3D file, the material index of each mesh, the names of the materials and the meshes, and the nodes in
+// depth-first order. Every block is padded to a multiple of 4 bytes.
+struct AssetManifestHeader {
+	unsigned char identifier[12];       // ASSET_MANIFEST_IDENTIFIER
+	unsigned int materialCount;
+	unsigned int textureCount;
+	unsigned int meshCount;
+	unsigned int reserved;
+};
+
+const unsigned char ASSET_MANIFEST_IDENTIFIER[12] = { 0xAB, 'A', 'S', 'M', ' ', '1', '2', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// What storeScene() or loadStoredScene() has done with one scene.
+struct AssetStoreStatistics {
+	bool stored;                        // true for storeScene(), false for loadStoredScene()
+	unsigned int blobCount;             // the blobs the scene refers to, once per reference
+	unsigned int newBlobCount;          // the blobs storeScene() has written, i.e. that were not in the store yet
+	unsigned long long blobBytes;
+	unsigned long long newBlobBytes;
+	unsigned long long verifiedBlobBytes; // the bytes loadStoredScene() has hashed again
+	double milliseconds;
+};
+
+//------------------------------------------------------------
+// The name of the manifest of a 3D file. Like the texture cache, the key covers the size and the
+// modification time of the 3D file, so a changed 3D file gets a new manifest.
+string getAssetManifestFileName(const string& modelFileName, const string& storeDirectory) {
+	return storeDirectory + "/" + formatHash(hashFileVersion(modelFileName)) + ".manifest";
+}
+
+//------------------------------------------------------------
+// The name of the file of a blob.
+string getAssetBlobFileName(unsigned long long hash, const string& storeDirectory) {
+	return storeDirectory + "/" + formatHash(hash) + ".blob";
+}
+
+//------------------------------------------------------------
+// The blob of a mesh: its header and its geometry, without its name and material, which are in the manifest.
+// Returns false if the mesh cannot be stored.
+bool serializeMesh(const aiMesh* mesh, vector<unsigned char>& blob) {
+	if (!canStoreMeshFaces(mesh)) {
+		cout << "serializeMesh(): a face of mesh " << mesh->mName.C_Str() << " has more than 255 indices" << endl;
+		return false;
+	}
+	appendUint32(blob, ASSET_MESH);
+	OptimizedMeshHeader header = getOptimizedMeshHeader(mesh, 0);
+	header.materialIndex = 0;
+	appendBlock(blob, &header, sizeof(header));
+	appendMeshGeometry(blob, mesh, header, 0);
+	return true;
+}
+
+//------------------------------------------------------------
+// Serialize the blob of the materials, embedded textures and meshes of a scene, counted in this order.
+// Texture paths stay relative to the 3D file, so materials that look the same in two 3D files share a blob.
+bool serializeAsset(const aiScene* scene, unsigned int index, vector<unsigned char>& blob) {
+	blob.clear();
+	if (index < scene->mNumMaterials) {
+		appendUint32(blob, ASSET_MATERIAL);
+		appendMaterialAppearance(blob, scene, scene->mMaterials[index], "");
+		return true;
+	}
+	index -= scene->mNumMaterials;
+	if (index < scene->mNumTextures) {
+		appendUint32(blob, ASSET_IMAGE);
+		appendTexture(blob, scene->mTextures[index]);
+		return true;
+	}
+	return serializeMesh(scene->mMeshes[index - scene->mNumTextures], blob);
+}
+
+//------------------------------------------------------------
+// Check that the store keeps everything in a scene: it has no lights, cameras, animations, bones or morph targets.
+// Otherwise print what it has and return false.
+bool canStoreScene(const aiScene* scene) {
+	unsigned int boneMeshCount = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		boneMeshCount += scene->mMeshes[i]->mNumBones > 0 || scene->mMeshes[i]->mNumAnimMeshes > 0;
+	}
+	if (scene->mNumLights == 0 && scene->mNumCameras == 0 && scene->mNumAnimations == 0 && boneMeshCount == 0) {
+		return true;
+	}
+	cout << "storeScene(): the scene has " << scene->mNumLights << " lights, " << scene->mNumCameras << " cameras, "
+		<< scene->mNumAnimations << " animations and " << boneMeshCount << " meshes with bones or morph targets, "
+		<< "which the asset store does not keep; it is not stored" << endl;
+	return false;
+}
+
+//------------------------------------------------------------
+// Store a scene. The blobs are serialized, hashed and written on all the CPU cores, one at a time per core, so
+// the whole scene is never held twice in memory. A blob that is already in the store is not written again.
+bool storeScene(const aiScene* scene, const string& modelFileName, const string& storeDirectory,
+	AssetStoreStatistics& statistics) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	memset(&statistics, 0, sizeof(statistics));
+	statistics.stored = true;
+	if (!canStoreScene(scene)) {
+		return false;
+	}
+	createDirectory(storeDirectory);
+
+	unsigned int assetCount = scene->mNumMaterials + scene->mNumTextures + scene->mNumMeshes;
+	vector<AssetReference> references(assetCount);
+	vector<unsigned char> written(assetCount, 0);
+	atomic<bool> failed(false);
+
+	// Two references to the same blob in one scene must not write the same file at the same time.
+	mutex claimMutex;
+	unordered_set<unsigned long long> claimedHashes;
+
+	parallelFor(assetCount, [&](unsigned int i) {
+		vector<unsigned char> blob;
+		if (failed || !serializeAsset(scene, i, blob)) {
+			failed = true;
+			return;
+		}
+		references[i].hash = hashBytes(blob.data(), blob.size());
+		references[i].size = blob.size();
+		{
+			lock_guard<mutex> lock(claimMutex);
+			if (!claimedHashes.insert(references[i].hash).second) {
+				return;
+			}
+		}
+
+		string blobFileName = getAssetBlobFileName(references[i].hash, storeDirectory);
+		unsigned long long fileSize = 0;
+		long long modificationTime = 0;
+		if (getFileInfo(blobFileName, fileSize, modificationTime) && fileSize == blob.size()) {
+			return;
+		}
+		if (!writeFile(blobFileName, blob.data(), blob.size())) {
+			failed = true;
+			return;
+		}
+		written[i] = 1;
+	});
+	if (failed) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < assetCount; i++) {
+		statistics.blobCount++;
+		statistics.blobBytes += references[i].size;
+		if (written[i]) {
+			statistics.newBlobCount++;
+			statistics.newBlobBytes += references[i].size;
+		}
+	}
+
+	// The manifest is written last, so that it never refers to a blob that is not in the store.
+	vector<unsigned char> manifest(sizeof(AssetManifestHeader), 0);
+	AssetManifestHeader header;
+	memcpy(header.identifier, ASSET_MANIFEST_IDENTIFIER, 12);
+	header.materialCount = scene->mNumMaterials;
+	header.textureCount = scene->mNumTextures;
+	header.meshCount = scene->mNumMeshes;
+	header.reserved = 0;
+	memcpy(&manifest[0], &header, sizeof(header));
+	appendBlock(manifest, references.data(), sizeof(AssetReference) * references.size());
+	appendString(manifest, modelFileName.c_str());
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		appendUint32(manifest, scene->mMeshes[i]->mMaterialIndex);
+	}
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiString name;
+		scene->mMaterials[i]->Get(AI_MATKEY_NAME, name);
+		appendString(manifest, name.C_Str());
+	}
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		appendString(manifest, scene->mMeshes[i]->mName.C_Str());
+	}
+	appendNode(manifest, scene->mRootNode);
+
+	if (!writeFile(getAssetManifestFileName(modelFileName, storeDirectory), manifest.data(), manifest.size())) {
+		return false;
+	}
+	statistics.milliseconds = elapsedMilliseconds(startTime);
+	return true;
+}
+
+//------------------------------------------------------------
+// Check if a blob has already been hashed again by this program, and remember that it has been if verified is true.
+// Once per program is enough to catch the blobs damaged on disk, without hashing every blob at every load.
+bool isAssetBlobVerified(unsigned long long hash, bool verified) {
+	static mutex verifiedMutex;
+	static unordered_set<unsigned long long> verifiedHashes;
+	lock_guard<mutex> lock(verifiedMutex);
+	if (verified) {
+		verifiedHashes.insert(hash);
+		return true;
+	}
+	return verifiedHashes.count(hash) > 0;
+}
+
+//------------------------------------------------------------
+// Map the file of a blob and check its size and type, and the hash of its bytes the first time it is opened.
+// verifiedBytes is the size of the blob if it has been hashed, else 0. Returns false if it is missing or damaged;
+// a blob whose hash does not match is deleted.
+bool openAssetBlob(const AssetReference& reference, AssetType type, const string& storeDirectory, MappedFile& file,
+	OptimizedModelReader& reader, unsigned long long& verifiedBytes) {
+	verifiedBytes = 0;
+	string blobFileName = getAssetBlobFileName(reference.hash, storeDirectory);
+	if (!mapFile(blobFileName, file)) {
+		return false;
+	}
+	reader.data = file.data;
+	reader.size = file.size;
+	reader.offset = 0;
+	reader.failed = false;
+	if (file.size != reference.size || readUint32(reader) != (unsigned int) type) {
+		unmapFile(file);
+		return false;
+	}
+	if (!isAssetBlobVerified(reference.hash, false)) {
+		if (hashBytes(file.data, file.size) != reference.hash) {
+			unmapFile(file);
+			remove(blobFileName.c_str());
+			return false;
+		}
+		isAssetBlobVerified(reference.hash, true);
+		verifiedBytes = file.size;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Read the references of a manifest and the name of its 3D file. Returns false if it is not a manifest.
+bool readAssetManifestHeader(OptimizedModelReader& reader, AssetManifestHeader& header, vector<AssetReference>& references,
+	string& modelFileName) {
+	readBlock(reader, &header, sizeof(header));
+	if (reader.failed || memcmp(header.identifier, ASSET_MANIFEST_IDENTIFIER, 12) != 0) {
+		return false;
+	}
+	unsigned long long assetCount = (unsigned long long) header.materialCount + header.textureCount + header.meshCount;
+	if (assetCount > (reader.size - reader.offset) / sizeof(AssetReference)) {
+		return false;
+	}
+	references.resize((size_t) assetCount);
+	readBlock(reader, references.data(), sizeof(AssetReference) * references.size());
+	modelFileName = readString(reader).C_Str();
+	return !reader.failed;
+}
+
+//------------------------------------------------------------
+// Load a scene from its manifest. The blobs are read on all the CPU cores.
+aiScene* loadStoredScene(const string& modelFileName, const string& storeDirectory, AssetStoreStatistics& statistics) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	memset(&statistics, 0, sizeof(statistics));
+
+	string manifestFileName = getAssetManifestFileName(modelFileName, storeDirectory);
+	MappedFile manifest;
+	if (!mapFile(manifestFileName, manifest)) {
+		return NULL;
+	}
+	OptimizedModelReader reader = { manifest.data, manifest.size, 0, false };
+	AssetManifestHeader header;
+	vector<AssetReference> references;
+	string storedFileName;
+	if (!readAssetManifestHeader(reader, header, references, storedFileName)) {
+		cout << "loadStoredScene(): " << manifestFileName << " is not a manifest" << endl;
+		unmapFile(manifest);
+		return NULL;
+	}
+	if (storedFileName != modelFileName) {
+		cout << "loadStoredScene(): " << manifestFileName << " is the manifest of " << storedFileName << endl;
+		unmapFile(manifest);
+		return NULL;
+	}
+
+	aiScene* scene = new aiScene();
+	scene->mNumMaterials = header.materialCount;
+	scene->mMaterials = new aiMaterial*[max(header.materialCount, 1u)];
+	for (unsigned int i = 0; i < header.materialCount; i++) {
+		scene->mMaterials[i] = new aiMaterial();
+	}
+	if (header.textureCount > 0) {
+		scene->mNumTextures = header.textureCount;
+		scene->mTextures = new aiTexture*[header.textureCount]();
+	}
+	if (header.meshCount > 0) {
+		scene->mNumMeshes = header.meshCount;
+		scene->mMeshes = new aiMesh*[header.meshCount];
+		for (unsigned int i = 0; i < header.meshCount; i++) {
+			scene->mMeshes[i] = new aiMesh();
+		}
+	}
+
+	// The names and the material indices come before the nodes, so they are read first.
+	for (unsigned int i = 0; i < header.meshCount; i++) {
+		scene->mMeshes[i]->mMaterialIndex = readUint32(reader);
+		if (scene->mMeshes[i]->mMaterialIndex >= header.materialCount) {
+			reader.failed = true;
+		}
+	}
+	for (unsigned int i = 0; i < header.materialCount && !reader.failed; i++) {
+		aiString name = readString(reader);
+		scene->mMaterials[i]->AddProperty(&name, AI_MATKEY_NAME);
+	}
+	for (unsigned int i = 0; i < header.meshCount && !reader.failed; i++) {
+		scene->mMeshes[i]->mName = readString(reader);
+	}
+	if (!reader.failed) {
+		scene->mRootNode = readNode(reader, header.meshCount, 0);
+	}
+	unmapFile(manifest);
+	if (!scene->mRootNode) {
+		cout << "loadStoredScene(): " << manifestFileName << " is damaged" << endl;
+		delete scene;
+		return NULL;
+	}
+
+	vector<unsigned char> loaded(references.size(), 0);
+	vector<unsigned long long> verifiedBytes(references.size(), 0);
+	parallelFor((unsigned int) references.size(), [&](unsigned int i) {
+		MappedFile blob;
+		OptimizedModelReader blobReader;
+		unsigned int index = i;
+		if (index < header.materialCount) {
+			if (openAssetBlob(references[i], ASSET_MATERIAL, storeDirectory, blob, blobReader, verifiedBytes[i])) {
+				readMaterialAppearance(blobReader, scene->mMaterials[index]);
+				loaded[i] = !blobReader.failed;
+				unmapFile(blob);
+			}
+			return;
+		}
+		index -= header.materialCount;
+		if (index < header.textureCount) {
+			if (openAssetBlob(references[i], ASSET_IMAGE, storeDirectory, blob, blobReader, verifiedBytes[i])) {
+				scene->mTextures[index] = readTexture(blobReader);
+				loaded[i] = !blobReader.failed;
+				unmapFile(blob);
+			}
+			return;
+		}
+		index -= header.textureCount;
+		if (openAssetBlob(references[i], ASSET_MESH, storeDirectory, blob, blobReader, verifiedBytes[i])) {
+			aiMesh* mesh = scene->mMeshes[index];
+			OptimizedMeshHeader meshHeader;
+			readBlock(blobReader, &meshHeader, sizeof(meshHeader));
+			mesh->mPrimitiveTypes = meshHeader.primitiveTypes;
+			loaded[i] = !blobReader.failed && readMeshGeometry(blobReader, mesh, meshHeader, 0);
+			unmapFile(blob);
+		}
+	});
+
+	for (unsigned int i = 0; i < references.size(); i++) {
+		if (!loaded[i]) {
+			cout << "loadStoredScene(): blob " << getAssetBlobFileName(references[i].hash, storeDirectory)
+				<< " is missing or damaged" << endl;
+			delete scene;
+			return NULL;
+		}
+		statistics.blobCount++;
+		statistics.blobBytes += references[i].size;
+		statistics.verifiedBlobBytes += verifiedBytes[i];
+	}
+	statistics.milliseconds = elapsedMilliseconds(startTime);
+	return scene;
+}
+
+//------------------------------------------------------------
+// Print what a scene has stored or loaded, and the dedup ratio of the whole store.
+// The whole store is listed for the ratio; the manifests are small and only their references are read.
+// A manifest is current if it is still the manifest of the 3D file it names: the manifests of the 3D files
+// that have changed since, and the blobs that nothing else refers to, would inflate the ratio.
+void printAssetStoreStatistics(const AssetStoreStatistics& statistics, const string& storeDirectory) {
+	if (statistics.stored) {
+		cout << "Asset store: stored " << statistics.blobCount << " blobs (" << statistics.blobBytes / (1024.0 * 1024.0)
+			<< " MB) in " << statistics.milliseconds << " ms; " << statistics.newBlobCount << " of them ("
+			<< statistics.newBlobBytes / (1024.0 * 1024.0) << " MB) were not in the store yet" << endl;
+	} else {
+		cout << "Asset store: loaded " << statistics.blobCount << " blobs (" << statistics.blobBytes / (1024.0 * 1024.0)
+			<< " MB) in " << statistics.milliseconds << " ms; " << statistics.verifiedBlobBytes / (1024.0 * 1024.0)
+			<< " MB of them were loaded for the first time and hashed again" << endl;
+	}
+
+	vector<string> fileNames;
+	listDirectory(storeDirectory, fileNames);
+	unsigned int manifestCount = 0, staleManifestCount = 0;
+	unsigned long long referencedBytes = 0;
+	unordered_set<unsigned long long> referencedHashes;
+	for (unsigned int i = 0; i < fileNames.size(); i++) {
+		const string& fileName = fileNames[i];
+		if (fileName.size() <= 9 || fileName.compare(fileName.size() - 9, 9, ".manifest") != 0) {
+			continue;
+		}
+		MappedFile manifest;
+		if (!mapFile(fileName, manifest)) {
+			continue;
+		}
+		OptimizedModelReader reader = { manifest.data, manifest.size, 0, false };
+		AssetManifestHeader header;
+		vector<AssetReference> references;
+		string modelFileName;
+		if (readAssetManifestHeader(reader, header, references, modelFileName)) {
+			string currentName = formatHash(hashFileVersion(modelFileName)) + ".manifest";
+			if (fileName.size() > currentName.size()
+				&& fileName.compare(fileName.size() - currentName.size(), currentName.size(), currentName) == 0) {
+				manifestCount++;
+				for (unsigned int j = 0; j < references.size(); j++) {
+					referencedBytes += references[j].size;
+					referencedHashes.insert(references[j].hash);
+				}
+			} else {
+				staleManifestCount++;
+			}
+		} else {
+			staleManifestCount++;
+		}
+		unmapFile(manifest);
+	}
+
+	unsigned int blobFileCount = 0, staleBlobFileCount = 0;
+	unsigned long long blobFileBytes = 0, staleBlobFileBytes = 0;
+	for (unsigned int i = 0; i < fileNames.size(); i++) {
+		const string& fileName = fileNames[i];
+		if (fileName.size() <= 21 || fileName.compare(fileName.size() - 5, 5, ".blob") != 0) {
+			continue;
+		}
+		unsigned long long fileSize = 0;
+		long long modificationTime = 0;
+		getFileInfo(fileName, fileSize, modificationTime);
+		unsigned long long hash = strtoull(fileName.substr(fileName.size() - 21, 16).c_str(), NULL, 16);
+		if (referencedHashes.count(hash)) {
+			blobFileCount++;
+			blobFileBytes += fileSize;
+		} else {
+			staleBlobFileCount++;
+			staleBlobFileBytes += fileSize;
+		}
+	}
+	cout << "Asset store: " << manifestCount << " manifests refer to " << referencedBytes / (1024.0 * 1024.0)
+		<< " MB of blobs, stored in " << blobFileCount << " blob files of " << blobFileBytes / (1024.0 * 1024.0)
+		<< " MB (dedup ratio " << (blobFileBytes > 0 ? (double) referencedBytes / blobFileBytes : 1.0) << ")" << endl;
+	if (staleManifestCount > 0 || staleBlobFileCount > 0) {
+		cout << "Asset store: " << staleManifestCount << " manifests of old versions of 3D files, and "
+			<< staleBlobFileCount << " blob files of " << staleBlobFileBytes / (1024.0 * 1024.0)
+			<< " MB that no current manifest refers to, are not counted" << endl;
+	}
+}
@@ -5,6 +5,11 @@ The following functions are provided.
 // Call this function after Assimp::Importer.ReadFile().
 void printAiSceneInfo(const aiScene* scene, AiScenePrintOption option);
 
+// Print a node tree from its scene graph (see scene_graph.hpp), indented by layer.
+void printSceneGraph(const SceneGraph& graph, unsigned int layer);
+
+This file requires file_utilities.hpp and scene_graph.hpp to be included first.
+
 Written by Ying Zhu
 Department of Computer Science
 Georgia State University
@@ -51,39 +56,44 @@ void printMatrix4x4(aiMatrix4x4 matrix, unsigned int layer = 0) {
 	cout << matrix.d1 << ", " << matrix.d2 << ", " << matrix.d3 << ", " << matrix.d4 << endl;
 }
 
-void printNodeTree(const aiNode* node, unsigned int layer) {
-	if (!node) {
-		cout << "printNodeTree(): null pointer" << endl;
-		return;
-	}
+// The node tree is printed from its scene graph, in depth-first order. The layer of each node is the layer
+// of its parent plus one.
+void printSceneGraph(const SceneGraph& graph, unsigned int layer) {
+	vector<unsigned int> layers(graph.nodeCount);
+	for (unsigned int i = 0; i < graph.nodeCount; i++) {
+		layers[i] = graph.parent[i] == SCENE_GRAPH_NO_PARENT ? layer : layers[graph.parent[i]] + 1;
+		indent(layers[i]);
 
-	indent(layer);
-
-	cout << "node: " << node->mName.C_Str();
-	if (node->mNumMeshes > 0) {
-		cout << "(Linked with mesh ";
+		cout << "node: " << getNodeName(graph, i);
+		if (graph.firstMesh[i + 1] > graph.firstMesh[i]) {
+			cout << "(Linked with mesh ";
 
-		for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-			cout << "#" << node->mMeshes[i] << " ";
+			for (unsigned int m = graph.firstMesh[i]; m < graph.firstMesh[i + 1]; m++) {
+				cout << "#" << graph.meshIndices[m] << " ";
+			}
+			cout << ')' << endl;
+		}
+		else {
+			cout << endl;
 		}
-		cout << ')' << endl;
-	}
-	else {
-		cout << endl;
-	}
-
-	indent(layer);
-	cout << "Transformation matrix" << endl;
-	printMatrix4x4(node->mTransformation, layer);
 
-	// indent(layer);
-	// cout << "Number of children " << node->mNumChildren << endl;
+		indent(layers[i]);
+		cout << "Transformation matrix" << endl;
+		printMatrix4x4(graph.transforms[graph.transformIndex[i]], layers[i]);
 
-	cout << endl;
+		cout << endl;
+	}
+}
 
-	for (unsigned int j = 0; j < node->mNumChildren; j++) {
-		printNodeTree(node->mChildren[j], layer + 1);
+void printNodeTree(const aiNode* node, unsigned int layer) {
+	if (!node) {
+		cout << "printNodeTree(): null pointer" << endl;
+		return;
 	}
+
+	SceneGraph graph;
+	buildSceneGraph(node, graph);
+	printSceneGraph(graph, layer);
 }
 
 void printAiSceneInfo(const aiScene* scene, AiScenePrintOption option = PRINT_AISCENE_SUMMARY) {
@@ -0,0 +1,408 @@
+/* This is a utility program that compresses RGBA8 images to the block-compressed texture formats
+supported by OpenGL: BC1 (DXT1), BC3 (DXT5), BC5 (RGTC2) and BC7 (BPTC).
+The following functions are provided.
+
+// Compress a whole RGBA8 image. The blocks are compressed in parallel.
+// out must hold compressedLevelSize(format, width, height) bytes.
+void encodeBlockCompressedImage(GLenum format, const unsigned char* pixels, unsigned int width, unsigned int height, unsigned char* out)
+
+// Compute the next mipmap level of an RGBA8 image with a 2x2 box filter.
+void downsampleImage(const unsigned char* pixels, unsigned int width, unsigned int height, vector<unsigned char>& result)
+
+// Check if any pixel of an RGBA8 image is not fully opaque.
+bool imageHasAlpha(const unsigned char* pixels, unsigned int width, unsigned int height)
+
+The encoders favor speed over quality: the endpoints are fitted along the principal axis of each block,
+and BC7 only uses mode 6 (one subset, RGBA endpoints, 4-bit indices).
+
+This file requires thread_utilities.hpp and texture_utilities.hpp to be included first.
+
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+//------------------------------------------------------------
+// Copy the 4x4 block at block coordinates (blockX, blockY) out of an RGBA8 image.
+// Pixels outside the image (when the size is not a multiple of 4) repeat the edge pixels.
+void fetchBlock(const unsigned char* pixels, unsigned int width, unsigned int height,
+	unsigned int blockX, unsigned int blockY, unsigned char block[64]) {
+	for (unsigned int y = 0; y < 4; y++) {
+		unsigned int pixelY = min(blockY * 4 + y, height - 1);
+		for (unsigned int x = 0; x < 4; x++) {
+			unsigned int pixelX = min(blockX * 4 + x, width - 1);
+			memcpy(block + (y * 4 + x) * 4, pixels + ((size_t) pixelY * width + pixelX) * 4, 4);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Fit a line through the colors of a block and return its two ends.
+// The line follows the principal axis of the colors, found by power iteration on the covariance matrix.
+// Only the first channelCount channels (3 for RGB, 4 for RGBA) are used.
+void findBlockEndpoints(const unsigned char block[64], int channelCount, float endpoint0[4], float endpoint1[4]) {
+	float mean[4] = { 0, 0, 0, 0 };
+	float minimum[4] = { 255, 255, 255, 255 };
+	float maximum[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channelCount; c++) {
+			float value = block[i * 4 + c];
+			mean[c] += value / 16.0f;
+			minimum[c] = min(minimum[c], value);
+			maximum[c] = max(maximum[c], value);
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int r = 0; r < channelCount; r++) {
+			for (int c = 0; c < channelCount; c++) {
+				covariance[r][c] += (block[i * 4 + r] - mean[r]) * (block[i * 4 + c] - mean[c]);
+			}
+		}
+	}
+
+	// Start from the diagonal of the bounding box, which is usually close to the principal axis.
+	float axis[4] = { 0, 0, 0, 0 };
+	for (int c = 0; c < channelCount; c++) {
+		axis[c] = maximum[c] - minimum[c];
+	}
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = { 0, 0, 0, 0 };
+		float length = 0;
+		for (int r = 0; r < channelCount; r++) {
+			for (int c = 0; c < channelCount; c++) {
+				next[r] += covariance[r][c] * axis[c];
+			}
+			length += next[r] * next[r];
+		}
+		if (length < 1e-6f) {
+			break;
+		}
+		length = sqrt(length);
+		for (int c = 0; c < channelCount; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float axisLength = 0;
+	for (int c = 0; c < channelCount; c++) {
+		axisLength += axis[c] * axis[c];
+	}
+	if (axisLength < 1e-6f) {
+		// All the pixels have the same color.
+		for (int c = 0; c < 4; c++) {
+			endpoint0[c] = endpoint1[c] = mean[c];
+		}
+		return;
+	}
+	axisLength = sqrt(axisLength);
+
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float projection = 0;
+		for (int c = 0; c < channelCount; c++) {
+			projection += (block[i * 4 + c] - mean[c]) * axis[c] / axisLength;
+		}
+		minProjection = min(minProjection, projection);
+		maxProjection = max(maxProjection, projection);
+	}
+
+	for (int c = 0; c < 4; c++) {
+		if (c < channelCount) {
+			endpoint0[c] = min(255.0f, max(0.0f, mean[c] + axis[c] / axisLength * minProjection));
+			endpoint1[c] = min(255.0f, max(0.0f, mean[c] + axis[c] / axisLength * maxProjection));
+		} else {
+			endpoint0[c] = endpoint1[c] = 255;
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Squared distance between two colors.
+int colorDistance(const int* a, const unsigned char* b, int channelCount) {
+	int distance = 0;
+	for (int c = 0; c < channelCount; c++) {
+		int difference = a[c] - b[c];
+		distance += difference * difference;
+	}
+	return distance;
+}
+
+//------------------------------------------------------------
+// Convert between 8-bit RGB and the 5:6:5 colors used by BC1.
+unsigned short packRGB565(const float color[3]) {
+	unsigned int r = (unsigned int) (color[0] * 31.0f / 255.0f + 0.5f);
+	unsigned int g = (unsigned int) (color[1] * 63.0f / 255.0f + 0.5f);
+	unsigned int b = (unsigned int) (color[2] * 31.0f / 255.0f + 0.5f);
+	return (unsigned short) ((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(unsigned short packed, int color[3]) {
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//------------------------------------------------------------
+// Compress a 4x4 block to BC1 (8 bytes): two 5:6:5 endpoints and 2-bit indices.
+// The endpoints are always ordered so that the block uses the 4-color mode.
+void encodeBC1Block(const unsigned char block[64], unsigned char out[8]) {
+	float endpoint0[4], endpoint1[4];
+	findBlockEndpoints(block, 3, endpoint0, endpoint1);
+
+	unsigned short color0 = packRGB565(endpoint1);
+	unsigned short color1 = packRGB565(endpoint0);
+	if (color0 < color1) {
+		swap(color0, color1);
+	}
+
+	int palette[4][3];
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	unsigned int indices = 0;
+	if (color0 != color1) {
+		for (int i = 0; i < 16; i++) {
+			int bestIndex = 0;
+			int bestDistance = colorDistance(palette[0], block + i * 4, 3);
+			for (int p = 1; p < 4; p++) {
+				int distance = colorDistance(palette[p], block + i * 4, 3);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					bestIndex = p;
+				}
+			}
+			indices |= (unsigned int) bestIndex << (2 * i);
+		}
+	}
+
+	memcpy(out, &color0, 2);
+	memcpy(out + 2, &color1, 2);
+	memcpy(out + 4, &indices, 4);
+}
+
+//------------------------------------------------------------
+// Compress one channel of a 4x4 block to BC4 (8 bytes): two 8-bit endpoints and 3-bit indices.
+// BC3 uses this for alpha and BC5 uses it for both red and green.
+void encodeBC4Block(const unsigned char block[64], int channel, unsigned char out[8]) {
+	int lowest = 255, highest = 0;
+	for (int i = 0; i < 16; i++) {
+		lowest = min(lowest, (int) block[i * 4 + channel]);
+		highest = max(highest, (int) block[i * 4 + channel]);
+	}
+
+	// highest > lowest selects the 8-value mode.
+	int palette[8];
+	palette[0] = highest;
+	palette[1] = lowest;
+	for (int k = 2; k < 8; k++) {
+		palette[k] = ((8 - k) * highest + (k - 1) * lowest) / 7;
+	}
+
+	unsigned long long indices = 0;
+	if (highest != lowest) {
+		for (int i = 0; i < 16; i++) {
+			int value = block[i * 4 + channel];
+			int bestIndex = 0;
+			int bestDistance = abs(palette[0] - value);
+			for (int k = 1; k < 8; k++) {
+				int distance = abs(palette[k] - value);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					bestIndex = k;
+				}
+			}
+			indices |= (unsigned long long) bestIndex << (3 * i);
+		}
+	}
+
+	out[0] = (unsigned char) highest;
+	out[1] = (unsigned char) lowest;
+	for (int b = 0; b < 6; b++) {
+		out[2 + b] = (unsigned char) (indices >> (8 * b));
+	}
+}
+
+//------------------------------------------------------------
+// Append the lowest bitCount bits of value to a 128-bit block, least significant bit first.
+void writeBits(unsigned char out[16], unsigned int& bitPosition, unsigned int value, unsigned int bitCount) {
+	for (unsigned int b = 0; b < bitCount; b++, bitPosition++) {
+		if (value & (1u << b)) {
+			out[bitPosition / 8] |= (unsigned char) (1u << (bitPosition % 8));
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Quantize an 8-bit RGBA endpoint to BC7 mode 6 (7 bits per channel plus a shared p-bit).
+// Both p-bit values are tried and the one with the smaller error is kept.
+void quantizeBC7Endpoint(const float endpoint[4], unsigned int quantized[4], unsigned int& pBit) {
+	float bestError = 1e30f;
+	for (unsigned int p = 0; p < 2; p++) {
+		unsigned int candidate[4];
+		float error = 0;
+		for (int c = 0; c < 4; c++) {
+			int value = (int) floor((endpoint[c] - p) / 2.0f + 0.5f);
+			candidate[c] = (unsigned int) min(127, max(0, value));
+			float difference = (float) ((candidate[c] << 1) | p) - endpoint[c];
+			error += difference * difference;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Compress a 4x4 block to BC7 mode 6 (16 bytes).
+void encodeBC7Block(const unsigned char block[64], unsigned char out[16]) {
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	float endpoint0[4], endpoint1[4];
+	findBlockEndpoints(block, 4, endpoint0, endpoint1);
+
+	unsigned int quantized[2][4];
+	unsigned int pBits[2];
+	quantizeBC7Endpoint(endpoint0, quantized[0], pBits[0]);
+	quantizeBC7Endpoint(endpoint1, quantized[1], pBits[1]);
+
+	int palette[16][4];
+	for (int k = 0; k < 16; k++) {
+		for (int c = 0; c < 4; c++) {
+			int value0 = (quantized[0][c] << 1) | pBits[0];
+			int value1 = (quantized[1][c] << 1) | pBits[1];
+			palette[k][c] = ((64 - weights[k]) * value0 + weights[k] * value1 + 32) >> 6;
+		}
+	}
+
+	unsigned int indices[16];
+	for (int i = 0; i < 16; i++) {
+		int bestIndex = 0;
+		int bestDistance = colorDistance(palette[0], block + i * 4, 4);
+		for (int k = 1; k < 16; k++) {
+			int distance = colorDistance(palette[k], block + i * 4, 4);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				bestIndex = k;
+			}
+		}
+		indices[i] = bestIndex;
+	}
+
+	// The most significant index bit of the first pixel is implied to be 0.
+	// If it is 1, swap the endpoints and invert the indices.
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; c++) {
+			swap(quantized[0][c], quantized[1][c]);
+		}
+		swap(pBits[0], pBits[1]);
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	unsigned int bitPosition = 0;
+	writeBits(out, bitPosition, 1u << 6, 7);     // mode 6
+	for (int c = 0; c < 4; c++) {
+		writeBits(out, bitPosition, quantized[0][c], 7);
+		writeBits(out, bitPosition, quantized[1][c], 7);
+	}
+	writeBits(out, bitPosition, pBits[0], 1);
+	writeBits(out, bitPosition, pBits[1], 1);
+	writeBits(out, bitPosition, indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writeBits(out, bitPosition, indices[i], 4);
+	}
+}
+
+//------------------------------------------------------------
+// Compress one 4x4 block in the given format.
+void encodeBlock(GLenum format, const unsigned char block[64], unsigned char* out) {
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		encodeBC1Block(block, out);
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		encodeBC4Block(block, 3, out);
+		encodeBC1Block(block, out + 8);
+		break;
+	case GL_COMPRESSED_RG_RGTC2:
+		encodeBC4Block(block, 0, out);
+		encodeBC4Block(block, 1, out + 8);
+		break;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		encodeBC7Block(block, out);
+		break;
+	default:
+		cout << "encodeBlock(): unsupported format " << format << endl;
+		break;
+	}
+}
+
+//------------------------------------------------------------
+// Compress a whole RGBA8 image. Each row of blocks is a separate work item for parallelFor().
+void encodeBlockCompressedImage(GLenum format, const unsigned char* pixels, unsigned int width, unsigned int height,
+	unsigned char* out) {
+	unsigned int blocksWide = (width + 3) / 4;
+	unsigned int blocksHigh = (height + 3) / 4;
+	unsigned int blockSize = compressedBlockSize(format);
+
+	parallelFor(blocksHigh, [&](unsigned int blockY) {
+		unsigned char block[64];
+		unsigned char* rowOut = out + (size_t) blockY * blocksWide * blockSize;
+		for (unsigned int blockX = 0; blockX < blocksWide; blockX++) {
+			fetchBlock(pixels, width, height, blockX, blockY, block);
+			encodeBlock(format, block, rowOut + blockX * blockSize);
+		}
+	});
+}
+
+//------------------------------------------------------------
+// Compute the next mipmap level of an RGBA8 image with a 2x2 box filter.
+// For odd sizes the last row or column is averaged with itself.
+void downsampleImage(const unsigned char* pixels, unsigned int width, unsigned int height, vector<unsigned char>& result) {
+	unsigned int newWidth = max(1u, width / 2);
+	unsigned int newHeight = max(1u, height / 2);
+	result.resize((size_t) newWidth * newHeight * 4);
+
+	for (unsigned int y = 0; y < newHeight; y++) {
+		unsigned int y0 = min(y * 2, height - 1);
+		unsigned int y1 = min(y * 2 + 1, height - 1);
+		for (unsigned int x = 0; x < newWidth; x++) {
+			unsigned int x0 = min(x * 2, width - 1);
+			unsigned int x1 = min(x * 2 + 1, width - 1);
+			for (unsigned int c = 0; c < 4; c++) {
+				unsigned int sum = pixels[((size_t) y0 * width + x0) * 4 + c] + pixels[((size_t) y0 * width + x1) * 4 + c]
+					+ pixels[((size_t) y1 * width + x0) * 4 + c] + pixels[((size_t) y1 * width + x1) * 4 + c];
+				result[((size_t) y * newWidth + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Check if any pixel of an RGBA8 image is not fully opaque.
+bool imageHasAlpha(const unsigned char* pixels, unsigned int width, unsigned int height) {
+	size_t pixelCount = (size_t) width * height;
+	for (size_t i = 0; i < pixelCount; i++) {
+		if (pixels[i * 4 + 3] != 255) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,638 @@
+/* This is a utility program that helps OpenGL programmers load binary PLY and STL files without copying them around.
+A binary little-endian PLY file and a binary STL file are little more than arrays of numbers. This loader
+memory-maps the file and builds the aiScene from it directly. When the vertices of a PLY file are stored as
+three floats each (and start on a 4-byte boundary), aiMesh::mVertices points into the mapped file, so the
+positions go from the file to glBufferSubData() without being copied at all. Otherwise the vertices are
+copied out of the file once, in parallel.
+STL files store three positions per triangle and no indices, so the loader joins the identical positions
+on the side: the corners are sorted into buckets by a hash of their position, and each bucket is deduplicated
+on its own thread.
+The faces of each mesh share one index array, instead of one small array per face.
+Other files (ASCII or big-endian PLY, ASCII STL, PLY files whose vertices are not fixed-size) are left to
+Assimp: the loader then returns NULL.
+The following functions are provided.
+
+// True if the file name ends in .ply or .stl (in any case).
+bool isBinaryMeshFileName(const string& fileName)
+
+// Load a binary little-endian PLY file or a binary STL file. Returns NULL if the file cannot be opened
+// or is in a form this loader does not support; the caller then loads it with Assimp.
+// The caller owns the scene, and must delete it with releaseScene().
+aiScene* loadBinaryMeshFile(const string& fileName)
+
+// Delete a scene, whichever loader made it. The mapped file of a scene from loadBinaryMeshFile()
+// (or the mapped memory of any scene that keeps it under MAPPED_SCENE_METADATA_KEY, e.g. a scene attached by
+// shared_scene.hpp) is unmapped, and the pointers into it are not deleted.
+void releaseScene(const aiScene* scene)
+
+This file requires the Assimp headers, file_utilities.hpp and thread_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The metadata key under which a scene keeps the MappedFile that its arrays point into, e.g. a scene made by
+// loadBinaryMeshFile(). releaseScene() does not delete those arrays.
+#define MAPPED_SCENE_METADATA_KEY "MappedSceneMemory"
+
+// PLY files with only vertices are point clouds. Below this many points each point gets a face so that it can
+// be drawn like any other mesh; larger point clouds are only drawn from the point cloud octree, without faces.
+#define BINARY_MESH_POINT_FACE_LIMIT 1000000
+
+// PLY headers longer than this are not accepted.
+#define PLY_MAX_HEADER_SIZE 65536
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+struct PlyProperty {
+	string name;
+	PlyType type;                // the item type of a list
+	bool isList;
+	PlyType countType;           // the type of the item count of a list
+	unsigned int offset;         // from the start of the element, for scalar properties before the first list
+};
+
+struct PlyElement {
+	string name;
+	unsigned int count;
+	vector<PlyProperty> properties;
+	bool fixedSize;              // true if the element has no list property
+	unsigned int size;           // bytes per element if fixedSize
+};
+
+//------------------------------------------------------------
+// True if the file name ends in .ply or .stl.
+bool isBinaryMeshFileName(const string& fileName) {
+	if (fileName.length() < 4) {
+		return false;
+	}
+	string extension = fileName.substr(fileName.length() - 4);
+	for (unsigned int i = 0; i < extension.length(); i++) {
+		extension[i] = (char) tolower((unsigned char) extension[i]);
+	}
+	return extension == ".ply" || extension == ".stl";
+}
+
+//------------------------------------------------------------
+// The PLY type of a type name, and its size in bytes.
+PlyType getPlyType(const string& name) {
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_INVALID;
+}
+
+unsigned int getPlyTypeSize(PlyType type) {
+	static const unsigned int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+	return sizes[type];
+}
+
+// Read a value of any PLY type. memcpy() is used because the values are not aligned in the file.
+double readPlyValue(const unsigned char* data, PlyType type) {
+	switch (type) {
+		case PLY_INT8: { int8_t v; memcpy(&v, data, 1); return v; }
+		case PLY_UINT8: { uint8_t v; memcpy(&v, data, 1); return v; }
+		case PLY_INT16: { int16_t v; memcpy(&v, data, 2); return v; }
+		case PLY_UINT16: { uint16_t v; memcpy(&v, data, 2); return v; }
+		case PLY_INT32: { int32_t v; memcpy(&v, data, 4); return v; }
+		case PLY_UINT32: { uint32_t v; memcpy(&v, data, 4); return v; }
+		case PLY_FLOAT32: { float v; memcpy(&v, data, 4); return v; }
+		case PLY_FLOAT64: { double v; memcpy(&v, data, 8); return v; }
+		default: return 0;
+	}
+}
+
+// Read a face index or a list count. Negative values become large ones, which fail the range check.
+unsigned int readPlyIndex(const unsigned char* data, PlyType type) {
+	if (type == PLY_INT32 || type == PLY_UINT32) {
+		uint32_t v;
+		memcpy(&v, data, 4);
+		return v;
+	}
+	double value = readPlyValue(data, type);
+	return value < 0 ? 0xFFFFFFFFu : (unsigned int) value;
+}
+
+//------------------------------------------------------------
+// Parse the header of a PLY file. Returns the offset of the first element, or 0 if the file is not a
+// binary little-endian PLY file.
+size_t parsePlyHeader(const unsigned char* data, size_t size, vector<PlyElement>& elements) {
+	size_t headerSize = min(size, (size_t) PLY_MAX_HEADER_SIZE);
+	string header((const char*) data, headerSize);
+	size_t headerEnd = header.find("end_header");
+	if (header.compare(0, 3, "ply") != 0 || headerEnd == string::npos) {
+		return 0;
+	}
+	size_t dataOffset = header.find('\n', headerEnd);
+	if (dataOffset == string::npos) {
+		return 0;
+	}
+
+	bool binaryLittleEndian = false;
+	size_t lineBegin = 0;
+	while (lineBegin < headerEnd) {
+		size_t lineEnd = header.find('\n', lineBegin);
+		string line = header.substr(lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd + 1;
+		if (!line.empty() && line[line.length() - 1] == '\r') {
+			line.erase(line.length() - 1);
+		}
+
+		vector<string> words;
+		size_t wordBegin = line.find_first_not_of(" \t");
+		while (wordBegin != string::npos) {
+			size_t wordEnd = line.find_first_of(" \t", wordBegin);
+			words.push_back(line.substr(wordBegin, wordEnd == string::npos ? string::npos : wordEnd - wordBegin));
+			wordBegin = wordEnd == string::npos ? string::npos : line.find_first_not_of(" \t", wordEnd);
+		}
+		if (words.empty()) {
+			continue;
+		}
+
+		if (words[0] == "format") {
+			binaryLittleEndian = words.size() >= 2 && words[1] == "binary_little_endian";
+		} else if (words[0] == "element" && words.size() >= 3) {
+			PlyElement element;
+			element.name = words[1];
+			element.count = (unsigned int) strtoul(words[2].c_str(), NULL, 10);
+			element.fixedSize = true;
+			element.size = 0;
+			elements.push_back(element);
+		} else if (words[0] == "property" && !elements.empty()) {
+			PlyElement& element = elements.back();
+			PlyProperty property;
+			property.isList = words.size() >= 5 && words[1] == "list";
+			property.countType = property.isList ? getPlyType(words[2]) : PLY_INVALID;
+			property.type = getPlyType(words[property.isList ? 3 : 1]);
+			property.name = words.back();
+			property.offset = element.size;
+			if (property.type == PLY_INVALID || (property.isList && property.countType == PLY_INVALID)) {
+				return 0;
+			}
+			if (property.isList) {
+				element.fixedSize = false;
+			} else if (element.fixedSize) {
+				element.size += getPlyTypeSize(property.type);
+			}
+			element.properties.push_back(property);
+		}
+	}
+	return binaryLittleEndian ? dataOffset + 1 : 0;
+}
+
+// The index of a property of an element by one of its usual names, or -1.
+int findPlyProperty(const PlyElement& element, const char* const* names) {
+	for (unsigned int i = 0; i < element.properties.size(); i++) {
+		for (unsigned int k = 0; names[k]; k++) {
+			if (element.properties[i].name == names[k]) {
+				return (int) i;
+			}
+		}
+	}
+	return -1;
+}
+
+//------------------------------------------------------------
+// Create a scene with one mesh, one default material and one node. The mapped file is kept in the metadata
+// of the scene (as a pointer), so that releaseScene() can find it however the scene is passed around.
+aiScene* createBinaryMeshScene(aiMesh* mesh, MappedFile* mappedFile, const string& fileName) {
+	aiScene* scene = new aiScene();
+
+	scene->mNumMaterials = 1;
+	scene->mMaterials = new aiMaterial*[1];
+	scene->mMaterials[0] = new aiMaterial();
+	aiString materialName(string(AI_DEFAULT_MATERIAL_NAME));
+	scene->mMaterials[0]->AddProperty(&materialName, AI_MATKEY_NAME);
+	aiColor3D diffuse(0.6f, 0.6f, 0.6f);
+	scene->mMaterials[0]->AddProperty(&diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+
+	scene->mNumMeshes = 1;
+	scene->mMeshes = new aiMesh*[1];
+	scene->mMeshes[0] = mesh;
+
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName = aiString(fileName.substr(fileName.find_last_of("/\\") + 1));
+	scene->mRootNode->mNumMeshes = 1;
+	scene->mRootNode->mMeshes = new unsigned int[1];
+	scene->mRootNode->mMeshes[0] = 0;
+
+	scene->mMetaData = aiMetadata::Alloc(1);
+	scene->mMetaData->Set(0, MAPPED_SCENE_METADATA_KEY, (uint64_t) (uintptr_t) mappedFile);
+	return scene;
+}
+
+// Check if a pointer points into mapped memory.
+bool isMappedPointer(const void* pointer, const unsigned char* data, size_t size) {
+	const unsigned char* address = (const unsigned char*) pointer;
+	return data && address >= data && address < data + size;
+}
+
+// Delete a mesh made by this loader (or by another loader that maps its data). The faces share one index
+// array, which belongs to the first face unless it is mapped, and the other arrays may point into the mapped
+// memory; so may the faces themselves.
+void deleteBinaryMesh(aiMesh* mesh, const unsigned char* fileData, size_t fileSize) {
+	if (isMappedPointer(mesh->mFaces, fileData, fileSize)) {
+		mesh->mFaces = NULL;
+	}
+	for (unsigned int k = 0; k < mesh->mNumFaces && mesh->mFaces; k++) {
+		if (k > 0 || isMappedPointer(mesh->mFaces[k].mIndices, fileData, fileSize)) {
+			mesh->mFaces[k].mIndices = NULL;
+		}
+	}
+	if (isMappedPointer(mesh->mVertices, fileData, fileSize)) {
+		mesh->mVertices = NULL;
+	}
+	if (isMappedPointer(mesh->mNormals, fileData, fileSize)) {
+		mesh->mNormals = NULL;
+	}
+	if (isMappedPointer(mesh->mTextureCoords[0], fileData, fileSize)) {
+		mesh->mTextureCoords[0] = NULL;
+	}
+	delete mesh;
+}
+
+// Give a mesh its faces. All the faces point into one index array of faceCount * indicesPerFace indices,
+// which belongs to the first face (releaseScene() takes the other pointers away before the mesh is deleted).
+unsigned int* allocateSharedFaces(aiMesh* mesh, unsigned int faceCount, unsigned int indicesPerFace) {
+	mesh->mNumFaces = faceCount;
+	if (faceCount == 0) {
+		return NULL;
+	}
+	mesh->mFaces = new aiFace[faceCount];
+	unsigned int* indices = new unsigned int[(size_t) faceCount * indicesPerFace];
+	parallelFor((faceCount + 65535) / 65536, [mesh, indices, faceCount, indicesPerFace](unsigned int block) {
+		unsigned int end = min(faceCount, (block + 1) * 65536);
+		for (unsigned int i = block * 65536; i < end; i++) {
+			mesh->mFaces[i].mNumIndices = indicesPerFace;
+			mesh->mFaces[i].mIndices = indices + (size_t) i * indicesPerFace;
+		}
+	});
+	return indices;
+}
+
+//------------------------------------------------------------
+// Load a binary little-endian PLY file.
+aiMesh* loadPlyMesh(const MappedFile& mappedFile, bool& positionsMapped) {
+	vector<PlyElement> elements;
+	size_t offset = parsePlyHeader(mappedFile.data, mappedFile.size, elements);
+	if (offset == 0) {
+		return NULL;
+	}
+
+	// Find where the vertices and the faces start. Only fixed-size elements can be skipped without reading them.
+	int vertexElement = -1, faceElement = -1;
+	size_t vertexOffset = 0, faceOffset = 0;
+	for (unsigned int i = 0; i < elements.size(); i++) {
+		if (elements[i].name == "vertex") {
+			vertexElement = (int) i;
+			vertexOffset = offset;
+		} else if (elements[i].name == "face") {
+			faceElement = (int) i;
+			faceOffset = offset;
+			break;
+		}
+		if (!elements[i].fixedSize) {
+			return NULL;
+		}
+		offset += (size_t) elements[i].count * elements[i].size;
+	}
+	if (vertexElement < 0 || vertexOffset + (size_t) elements[vertexElement].count * elements[vertexElement].size > mappedFile.size) {
+		return NULL;
+	}
+
+	const PlyElement& vertices = elements[vertexElement];
+	static const char* const xNames[] = { "x", NULL };
+	static const char* const yNames[] = { "y", NULL };
+	static const char* const zNames[] = { "z", NULL };
+	static const char* const uNames[] = { "s", "u", "texture_u", "texture_s", NULL };
+	static const char* const vNames[] = { "t", "v", "texture_v", "texture_t", NULL };
+	int x = findPlyProperty(vertices, xNames), y = findPlyProperty(vertices, yNames), z = findPlyProperty(vertices, zNames);
+	int u = findPlyProperty(vertices, uNames), v = findPlyProperty(vertices, vNames);
+	if (x < 0 || y < 0 || z < 0) {
+		return NULL;
+	}
+
+	aiMesh* mesh = new aiMesh();
+	mesh->mNumVertices = vertices.count;
+	const unsigned char* vertexData = mappedFile.data + vertexOffset;
+
+	// The positions can be used where they are if they are the only properties, as floats, in order.
+	positionsMapped = vertices.size == 12 && vertices.properties.size() == 3 && x == 0 && y == 1 && z == 2
+		&& vertices.properties[0].type == PLY_FLOAT32 && vertices.properties[1].type == PLY_FLOAT32
+		&& vertices.properties[2].type == PLY_FLOAT32 && vertexOffset % 4 == 0;
+	if (positionsMapped) {
+		mesh->mVertices = (aiVector3D*) vertexData;
+	} else {
+		mesh->mVertices = new aiVector3D[vertices.count];
+		bool hasTexCoords = u >= 0 && v >= 0;
+		if (hasTexCoords) {
+			mesh->mTextureCoords[0] = new aiVector3D[vertices.count];
+			mesh->mNumUVComponents[0] = 2;
+		}
+		const PlyProperty* properties = &vertices.properties[0];
+		parallelFor((vertices.count + 65535) / 65536, [&](unsigned int block) {
+			unsigned int end = min(vertices.count, (block + 1) * 65536);
+			for (unsigned int i = block * 65536; i < end; i++) {
+				const unsigned char* vertex = vertexData + (size_t) i * vertices.size;
+				mesh->mVertices[i] = aiVector3D((float) readPlyValue(vertex + properties[x].offset, properties[x].type),
+					(float) readPlyValue(vertex + properties[y].offset, properties[y].type),
+					(float) readPlyValue(vertex + properties[z].offset, properties[z].type));
+				if (hasTexCoords) {
+					mesh->mTextureCoords[0][i] = aiVector3D((float) readPlyValue(vertex + properties[u].offset, properties[u].type),
+						(float) readPlyValue(vertex + properties[v].offset, properties[v].type), 0);
+				}
+			}
+		});
+	}
+
+	// A file without faces is a point cloud.
+	if (faceElement < 0 || elements[faceElement].count == 0) {
+		mesh->mPrimitiveTypes = aiPrimitiveType_POINT;
+		if (vertices.count < BINARY_MESH_POINT_FACE_LIMIT) {
+			unsigned int* indices = allocateSharedFaces(mesh, vertices.count, 1);
+			for (unsigned int i = 0; i < vertices.count; i++) {
+				indices[i] = i;
+			}
+		}
+		return mesh;
+	}
+
+	// The faces must have one list of vertex indices and nothing else.
+	const PlyElement& faces = elements[faceElement];
+	static const char* const indexNames[] = { "vertex_indices", "vertex_index", NULL };
+	if (faces.properties.size() != 1 || !faces.properties[0].isList || findPlyProperty(faces, indexNames) != 0) {
+		deleteBinaryMesh(mesh, mappedFile.data, mappedFile.size);
+		return NULL;
+	}
+	PlyType countType = faces.properties[0].countType;
+	PlyType indexType = faces.properties[0].type;
+	unsigned int countSize = getPlyTypeSize(countType);
+	unsigned int indexSize = getPlyTypeSize(indexType);
+	const unsigned char* faceData = mappedFile.data + faceOffset;
+	const unsigned char* fileEnd = mappedFile.data + mappedFile.size;
+
+	// Most files have only triangles. Then every face has the same size and they can be read in parallel.
+	size_t triangleSize = countSize + 3 * indexSize;
+	bool onlyTriangles = faceOffset + (size_t) faces.count * triangleSize <= mappedFile.size;
+	if (onlyTriangles) {
+		vector<char> blockTriangles((faces.count + 65535) / 65536, 1);
+		parallelFor((unsigned int) blockTriangles.size(), [&](unsigned int block) {
+			unsigned int end = min(faces.count, (block + 1) * 65536);
+			for (unsigned int i = block * 65536; i < end && blockTriangles[block]; i++) {
+				blockTriangles[block] = readPlyIndex(faceData + (size_t) i * triangleSize, countType) == 3;
+			}
+		});
+		for (unsigned int block = 0; block < blockTriangles.size(); block++) {
+			onlyTriangles = onlyTriangles && blockTriangles[block];
+		}
+	}
+
+	bool valid = true;
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	if (onlyTriangles) {
+		unsigned int* indices = allocateSharedFaces(mesh, faces.count, 3);
+		vector<char> blockValid((faces.count + 65535) / 65536, 1);
+		parallelFor((unsigned int) blockValid.size(), [&](unsigned int block) {
+			unsigned int end = min(faces.count, (block + 1) * 65536);
+			for (unsigned int i = block * 65536; i < end; i++) {
+				const unsigned char* face = faceData + (size_t) i * triangleSize + countSize;
+				for (unsigned int k = 0; k < 3; k++) {
+					indices[3 * (size_t) i + k] = readPlyIndex(face + k * indexSize, indexType);
+					blockValid[block] = blockValid[block] && indices[3 * (size_t) i + k] < vertices.count;
+				}
+			}
+		});
+		for (unsigned int block = 0; block < blockValid.size(); block++) {
+			valid = valid && blockValid[block];
+		}
+	} else {
+		// Count the triangles of the polygons first, then split each polygon into a fan.
+		size_t triangleCount = 0;
+		const unsigned char* face = faceData;
+		for (unsigned int i = 0; i < faces.count && valid; i++) {
+			if (face + countSize > fileEnd) {
+				valid = false;
+				break;
+			}
+			unsigned int count = readPlyIndex(face, countType);
+			face += countSize + (size_t) count * indexSize;
+			valid = face <= fileEnd;
+			triangleCount += count >= 3 ? count - 2 : 0;
+		}
+
+		if (valid && triangleCount < 0xFFFFFFFFu) {
+			unsigned int* indices = allocateSharedFaces(mesh, (unsigned int) triangleCount, 3);
+			face = faceData;
+			for (unsigned int i = 0; i < faces.count; i++) {
+				unsigned int count = readPlyIndex(face, countType);
+				const unsigned char* corners = face + countSize;
+				for (unsigned int k = 2; k < count; k++) {
+					*indices++ = readPlyIndex(corners, indexType);
+					*indices++ = readPlyIndex(corners + (k - 1) * indexSize, indexType);
+					*indices++ = readPlyIndex(corners + k * indexSize, indexType);
+					valid = valid && indices[-3] < vertices.count && indices[-2] < vertices.count && indices[-1] < vertices.count;
+				}
+				face = corners + (size_t) count * indexSize;
+			}
+		} else {
+			valid = false;
+		}
+	}
+
+	if (!valid) {
+		cout << "loadBinaryMeshFile(): a face refers to a vertex that does not exist" << endl;
+		deleteBinaryMesh(mesh, mappedFile.data, mappedFile.size);
+		return NULL;
+	}
+	return mesh;
+}
+
+//------------------------------------------------------------
+// A corner of an STL triangle: the three floats of its position, with -0 made 0 so that it joins with 0.
+struct StlCorner {
+	uint32_t bits[3];
+};
+
+inline StlCorner readStlCorner(const unsigned char* triangles, size_t corner) {
+	StlCorner result;
+	memcpy(result.bits, triangles + (corner / 3) * 50 + 12 + (corner % 3) * 12, 12);
+	for (unsigned int c = 0; c < 3; c++) {
+		if (result.bits[c] == 0x80000000u) {
+			result.bits[c] = 0;
+		}
+	}
+	return result;
+}
+
+inline bool lessStlCorner(const StlCorner& a, const StlCorner& b) {
+	return a.bits[0] != b.bits[0] ? a.bits[0] < b.bits[0] : a.bits[1] != b.bits[1] ? a.bits[1] < b.bits[1] : a.bits[2] < b.bits[2];
+}
+
+inline bool equalStlCorner(const StlCorner& a, const StlCorner& b) {
+	return a.bits[0] == b.bits[0] && a.bits[1] == b.bits[1] && a.bits[2] == b.bits[2];
+}
+
+// Load a binary STL file: an 80-byte header, the number of triangles, and 50 bytes per triangle
+// (a normal, three positions and a 2-byte attribute).
+aiMesh* loadStlMesh(const MappedFile& mappedFile) {
+	if (mappedFile.size < 84) {
+		return NULL;
+	}
+	uint32_t triangleCount;
+	memcpy(&triangleCount, mappedFile.data + 80, 4);
+	if (mappedFile.size != 84 + (size_t) triangleCount * 50 || triangleCount == 0 || triangleCount > 0xFFFFFFFFu / 3) {
+		return NULL;
+	}
+	const unsigned char* triangles = mappedFile.data + 84;
+	unsigned int cornerCount = triangleCount * 3;
+
+	aiMesh* mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	unsigned int* indices = allocateSharedFaces(mesh, triangleCount, 3);
+
+	// Sort the corners into buckets by the hash of their position, one chunk of corners per thread.
+	unsigned int chunkCount = min(getWorkerThreadCount() * 4, max(cornerCount / 65536, 1u));
+	unsigned int bucketBits = 0;
+	while ((1u << bucketBits) < chunkCount * 4) {
+		bucketBits++;
+	}
+	unsigned int bucketCount = 1u << bucketBits;
+	vector<vector<vector<unsigned int> > > chunkBuckets(chunkCount, vector<vector<unsigned int> >(bucketCount));
+	parallelFor(chunkCount, [&](unsigned int chunk) {
+		unsigned int first = (unsigned int) ((unsigned long long) cornerCount * chunk / chunkCount);
+		unsigned int end = (unsigned int) ((unsigned long long) cornerCount * (chunk + 1) / chunkCount);
+		for (unsigned int i = first; i < end; i++) {
+			StlCorner corner = readStlCorner(triangles, i);
+			unsigned long long hash = hashBytes(corner.bits, sizeof(corner.bits));
+			chunkBuckets[chunk][bucketBits == 0 ? 0 : (unsigned int) (hash >> (64 - bucketBits))].push_back(i);
+		}
+	});
+
+	// Sort each bucket by position and count its distinct positions.
+	vector<vector<unsigned int> > buckets(bucketCount);
+	vector<unsigned int> bucketVertexCounts(bucketCount, 0);
+	parallelFor(bucketCount, [&](unsigned int bucket) {
+		vector<unsigned int>& corners = buckets[bucket];
+		for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+			corners.insert(corners.end(), chunkBuckets[chunk][bucket].begin(), chunkBuckets[chunk][bucket].end());
+			vector<unsigned int>().swap(chunkBuckets[chunk][bucket]);
+		}
+		sort(corners.begin(), corners.end(), [triangles](unsigned int a, unsigned int b) {
+			return lessStlCorner(readStlCorner(triangles, a), readStlCorner(triangles, b));
+		});
+		for (size_t i = 0; i < corners.size(); i++) {
+			if (i == 0 || !equalStlCorner(readStlCorner(triangles, corners[i - 1]), readStlCorner(triangles, corners[i]))) {
+				bucketVertexCounts[bucket]++;
+			}
+		}
+	});
+
+	// Each bucket's vertices follow the vertices of the buckets before it.
+	vector<unsigned int> bucketFirstVertex(bucketCount + 1, 0);
+	for (unsigned int bucket = 0; bucket < bucketCount; bucket++) {
+		bucketFirstVertex[bucket + 1] = bucketFirstVertex[bucket] + bucketVertexCounts[bucket];
+	}
+	mesh->mNumVertices = bucketFirstVertex[bucketCount];
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+
+	parallelFor(bucketCount, [&](unsigned int bucket) {
+		vector<unsigned int>& corners = buckets[bucket];
+		unsigned int vertex = bucketFirstVertex[bucket];
+		StlCorner previous;
+		for (size_t i = 0; i < corners.size(); i++) {
+			StlCorner corner = readStlCorner(triangles, corners[i]);
+			if (i == 0 || !equalStlCorner(previous, corner)) {
+				if (i > 0) {
+					vertex++;
+				}
+				memcpy(&mesh->mVertices[vertex], corner.bits, 12);
+				previous = corner;
+			}
+			indices[corners[i]] = vertex;
+		}
+		vector<unsigned int>().swap(corners);
+	});
+	return mesh;
+}
+
+//------------------------------------------------------------
+// Load a binary little-endian PLY file or a binary STL file.
+aiScene* loadBinaryMeshFile(const string& fileName) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	MappedFile* mappedFile = new MappedFile;
+	if (!mapFile(fileName, *mappedFile) || mappedFile->size == 0) {
+		cout << "loadBinaryMeshFile(): unable to read " << fileName << ", it is loaded by Assimp" << endl;
+		delete mappedFile;
+		return NULL;
+	}
+
+	size_t fileSize = mappedFile->size;
+	bool isPly = mappedFile->size >= 3 && memcmp(mappedFile->data, "ply", 3) == 0;
+	bool positionsMapped = false;
+	aiMesh* mesh = isPly ? loadPlyMesh(*mappedFile, positionsMapped) : loadStlMesh(*mappedFile);
+	if (!mesh) {
+		cout << "loadBinaryMeshFile(): " << fileName << " is not supported, it is loaded by Assimp" << endl;
+		unmapFile(*mappedFile);
+		delete mappedFile;
+		return NULL;
+	}
+
+	// The file stays mapped only if the mesh points into it.
+	if (!positionsMapped) {
+		unmapFile(*mappedFile);
+		delete mappedFile;
+		mappedFile = NULL;
+	}
+	aiScene* scene = createBinaryMeshScene(mesh, mappedFile, fileName);
+
+	double milliseconds = elapsedMilliseconds(startTime);
+	double megabytes = fileSize / (1024.0 * 1024.0);
+	cout << "Binary mesh loader: " << (isPly ? "PLY" : "STL") << " file with " << mesh->mNumVertices << " vertices and "
+		<< mesh->mNumFaces << " faces, positions " << (positionsMapped ? "used from the mapped file" : "copied")
+		<< ", loaded in " << milliseconds << " ms (" << megabytes * 1000.0 / max(milliseconds, 1e-3) << " MB/s)" << endl;
+	return scene;
+}
+
+//------------------------------------------------------------
+// Delete a scene, whichever loader made it.
+void releaseScene(const aiScene* scene) {
+	if (!scene) {
+		return;
+	}
+
+	uint64_t address = 0;
+	if (!scene->mMetaData || !scene->mMetaData->Get(MAPPED_SCENE_METADATA_KEY, address)) {
+		delete scene;
+		return;
+	}
+
+	MappedFile* mappedFile = (MappedFile*) (uintptr_t) address;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		deleteBinaryMesh(scene->mMeshes[i], mappedFile ? mappedFile->data : NULL, mappedFile ? mappedFile->size : 0);
+		scene->mMeshes[i] = NULL;
+	}
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		if (mappedFile && isMappedPointer(scene->mTextures[i]->pcData, mappedFile->data, mappedFile->size)) {
+			scene->mTextures[i]->pcData = NULL;
+		}
+	}
+	delete scene;
+
+	if (mappedFile) {
+		unmapFile(*mappedFile);
+		delete mappedFile;
+	}
+}
@@ -0,0 +1,410 @@
+/* This is a utility program that helps OpenGL programmers read large files and cache data on disk.
+The following functions are provided.
+
+// Map a whole file into memory (read only). Returns false if the file cannot be opened.
+bool mapFile(const string& fileName, MappedFile& mappedFile)
+
+// Release a file mapped by mapFile().
+void unmapFile(MappedFile& mappedFile)
+
+// Drop the pages of a range of a mapped file from the process. They are read again if they are touched again.
+void releaseFileRange(const MappedFile& mappedFile, size_t offset, size_t size)
+
+// Write a block of memory to a file. Returns false if the file cannot be written.
+bool writeFile(const string& fileName, const void* data, size_t size)
+
+// A name for the temporary file that a file is written into before it is renamed, unique to the calling
+// process and thread.
+string getTemporaryFileName(const string& fileName)
+
+// Rename a completely written temporary file to its final name, replacing the file there. The temporary
+// file is removed if the rename fails.
+bool replaceFile(const string& temporaryName, const string& fileName)
+
+// Check if a file exists, and get its size and last modification time.
+bool getFileInfo(const string& fileName, unsigned long long& size, long long& modificationTime)
+
+// Create a directory if it does not exist yet.
+void createDirectory(const string& directoryName)
+
+// The directory part of a file path, including the trailing separator ("" if there is none).
+string getDirectoryName(const string& fileName)
+
+// The files (not the subdirectories) of a directory, as paths that start with the directory name, sorted.
+// Returns false if directoryName is not a directory.
+bool listDirectory(const string& directoryName, vector<string>& fileNames)
+
+// The absolute path of an existing file or directory ("" if it does not exist).
+string getAbsolutePath(const string& fileName)
+
+// 64-bit FNV-1a hash of a block of memory. Pass the previous hash to hash several blocks in a row.
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long hash = FNV_OFFSET_BASIS)
+
+// Hash of the path, size and last modification time of a file (to the nanosecond where the file system keeps
+// it), which changes when the file is written. Hash the settings a cache file depends on after it, so that the key covers everything the file depends on.
+unsigned long long hashFileVersion(const string& fileName)
+
+// A hash as 16 hexadecimal digits, e.g. for the name of a cache file.
+string formatHash(unsigned long long hash)
+
+// Milliseconds elapsed since startTime.
+double elapsedMilliseconds(chrono::high_resolution_clock::time_point startTime)
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// A read-only memory mapping of a whole file.
+struct MappedFile {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+//------------------------------------------------------------
+// Map a whole file into memory. The pages are loaded by the operating system when they are
+// first touched, so mapping a file is cheap and nothing is copied into the process heap.
+bool mapFile(const string& fileName, MappedFile& mappedFile) {
+	mappedFile.data = NULL;
+	mappedFile.size = 0;
+
+#ifdef _WIN32
+	mappedFile.mappingHandle = NULL;
+	mappedFile.fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mappedFile.fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(mappedFile.fileHandle, &fileSize);
+	mappedFile.size = (size_t) fileSize.QuadPart;
+	if (mappedFile.size == 0) {
+		return true;
+	}
+
+	mappedFile.mappingHandle = CreateFileMappingA(mappedFile.fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappedFile.mappingHandle == NULL) {
+		CloseHandle(mappedFile.fileHandle);
+		return false;
+	}
+	mappedFile.data = (const unsigned char*) MapViewOfFile(mappedFile.mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	mappedFile.fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (mappedFile.fileDescriptor < 0) {
+		return false;
+	}
+
+	struct stat fileStatus;
+	fstat(mappedFile.fileDescriptor, &fileStatus);
+	mappedFile.size = (size_t) fileStatus.st_size;
+	if (mappedFile.size == 0) {
+		return true;
+	}
+
+	void* address = mmap(NULL, mappedFile.size, PROT_READ, MAP_PRIVATE, mappedFile.fileDescriptor, 0);
+	if (address == MAP_FAILED) {
+		close(mappedFile.fileDescriptor);
+		return false;
+	}
+	mappedFile.data = (const unsigned char*) address;
+#endif
+
+	if (!mappedFile.data) {
+		cout << "mapFile(): unable to map " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Release a file mapped by mapFile().
+void unmapFile(MappedFile& mappedFile) {
+#ifdef _WIN32
+	if (mappedFile.data) {
+		UnmapViewOfFile(mappedFile.data);
+	}
+	if (mappedFile.mappingHandle) {
+		CloseHandle(mappedFile.mappingHandle);
+	}
+	CloseHandle(mappedFile.fileHandle);
+#else
+	if (mappedFile.data) {
+		munmap((void*) mappedFile.data, mappedFile.size);
+	}
+	close(mappedFile.fileDescriptor);
+#endif
+	mappedFile.data = NULL;
+	mappedFile.size = 0;
+}
+
+//------------------------------------------------------------
+// Drop the pages of a range of a mapped file from the process, e.g. once the range has been uploaded.
+// Only the whole pages inside the range are dropped, so the neighboring ranges keep theirs.
+void releaseFileRange(const MappedFile& mappedFile, size_t offset, size_t size) {
+	if (!mappedFile.data || offset >= mappedFile.size) {
+		return;
+	}
+	size = min(size, mappedFile.size - offset);
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	size_t pageSize = systemInfo.dwPageSize;
+#else
+	size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+#endif
+	size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	// The last page of the file belongs to the range that ends the file.
+	size_t end = offset + size == mappedFile.size ? offset + size : (offset + size) / pageSize * pageSize;
+	if (end <= begin) {
+		return;
+	}
+#ifdef _WIN32
+	// Unlocking pages that are not locked removes them from the working set.
+	VirtualUnlock((LPVOID) (mappedFile.data + begin), end - begin);
+#else
+	madvise((void*) (mappedFile.data + begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+//------------------------------------------------------------
+// A name for a temporary file. It is named after the process and the thread, so that two writers of
+// the same file (e.g. two programs that fill the same cache) do not write into one temporary file.
+string getTemporaryFileName(const string& fileName) {
+#ifdef _WIN32
+	int processId = _getpid();
+#else
+	int processId = (int) getpid();
+#endif
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%d-%zx.tmp", processId, hash<thread::id>()(this_thread::get_id()));
+	return fileName + suffix;
+}
+
+//------------------------------------------------------------
+// Rename a temporary file to its final name.
+bool replaceFile(const string& temporaryName, const string& fileName) {
+#ifdef _WIN32
+	// rename() does not replace an existing file on Windows. Elsewhere it does, atomically.
+	remove(fileName.c_str());
+#endif
+	if (rename(temporaryName.c_str(), fileName.c_str()) != 0) {
+		remove(temporaryName.c_str());
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Write a block of memory to a file.
+// The data is written to a temporary file first and then renamed, so that a reader never
+// sees a half-written file (e.g. when two programs fill the same cache at the same time).
+// The temporary file is only renamed if all of it has been written.
+bool writeFile(const string& fileName, const void* data, size_t size) {
+	string temporaryName = getTemporaryFileName(fileName);
+	ofstream fileOut(temporaryName.c_str(), ios::binary);
+	if (!fileOut.good()) {
+		cout << "writeFile(): unable to create " << temporaryName << endl;
+		return false;
+	}
+	fileOut.write((const char*) data, size);
+	bool written = fileOut.good();
+	fileOut.close();
+	if (!written || fileOut.fail()) {
+		cout << "writeFile(): unable to write " << temporaryName << endl;
+		remove(temporaryName.c_str());
+		return false;
+	}
+
+	if (!replaceFile(temporaryName, fileName)) {
+		cout << "writeFile(): unable to rename " << temporaryName << endl;
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Check if a file exists, and get its size and last modification time.
+bool getFileInfo(const string& fileName, unsigned long long& size, long long& modificationTime) {
+	struct stat fileStatus;
+	if (stat(fileName.c_str(), &fileStatus) != 0) {
+		return false;
+	}
+	size = (unsigned long long) fileStatus.st_size;
+	modificationTime = (long long) fileStatus.st_mtime;
+	return true;
+}
+
+//------------------------------------------------------------
+// Create a directory if it does not exist yet.
+void createDirectory(const string& directoryName) {
+#ifdef _WIN32
+	_mkdir(directoryName.c_str());
+#else
+	mkdir(directoryName.c_str(), 0755);
+#endif
+}
+
+//------------------------------------------------------------
+// The directory part of a file path, including the trailing separator.
+// Both '/' and '\' are accepted as separators.
+string getDirectoryName(const string& fileName) {
+	size_t separator = fileName.find_last_of("/\\");
+	if (separator == string::npos) {
+		return "";
+	}
+	return fileName.substr(0, separator + 1);
+}
+
+//------------------------------------------------------------
+// The files of a directory, sorted by name so that the order does not depend on the file system.
+bool listDirectory(const string& directoryName, vector<string>& fileNames) {
+	fileNames.clear();
+	string prefix = directoryName;
+	if (!prefix.empty() && prefix[prefix.size() - 1] != '/' && prefix[prefix.size() - 1] != '\\') {
+		prefix += '/';
+	}
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((prefix + "*").c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	do {
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			fileNames.push_back(prefix + findData.cFileName);
+		}
+	} while (FindNextFileA(findHandle, &findData));
+	FindClose(findHandle);
+#else
+	DIR* directory = opendir(directoryName.c_str());
+	if (!directory) {
+		return false;
+	}
+	for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+		struct stat fileStatus;
+		string fileName = prefix + entry->d_name;
+		if (stat(fileName.c_str(), &fileStatus) == 0 && S_ISREG(fileStatus.st_mode)) {
+			fileNames.push_back(fileName);
+		}
+	}
+	closedir(directory);
+#endif
+	sort(fileNames.begin(), fileNames.end());
+	return true;
+}
+
+//------------------------------------------------------------
+// The absolute path of an existing file or directory.
+string getAbsolutePath(const string& fileName) {
+#ifdef _WIN32
+	char path[MAX_PATH];
+	if (!_fullpath(path, fileName.c_str(), MAX_PATH)) {
+		return "";
+	}
+#else
+	char path[PATH_MAX];
+	if (!realpath(fileName.c_str(), path)) {
+		return "";
+	}
+#endif
+	return path;
+}
+
+//------------------------------------------------------------
+// 64-bit FNV-1a hash. It is not cryptographic, but it is fast and good enough for cache keys.
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long hash = FNV_OFFSET_BASIS) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+//------------------------------------------------------------
+// The fraction of a second of the last modification time of a file, in nanoseconds (0 if it does not exist).
+// getFileInfo() only gives whole seconds, which do not tell apart two writes of the same size in one second.
+long long getFileModificationNanoseconds(const string& fileName) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes)) {
+		return 0;
+	}
+	unsigned long long ticks = ((unsigned long long) attributes.ftLastWriteTime.dwHighDateTime << 32)
+		| attributes.ftLastWriteTime.dwLowDateTime;
+	return (long long) (ticks % 10000000ULL) * 100;
+#else
+	struct stat fileStatus;
+	if (stat(fileName.c_str(), &fileStatus) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (long long) fileStatus.st_mtimespec.tv_nsec;
+#else
+	return (long long) fileStatus.st_mtim.tv_nsec;
+#endif
+#endif
+}
+
+//------------------------------------------------------------
+// Hash of the version of a file. A file that does not exist hashes as an empty file.
+unsigned long long hashFileVersion(const string& fileName) {
+	unsigned long long fileSize = 0;
+	long long modificationTime = 0;
+	getFileInfo(fileName, fileSize, modificationTime);
+	long long modificationNanoseconds = getFileModificationNanoseconds(fileName);
+
+	unsigned long long key = hashBytes(fileName.c_str(), fileName.length());
+	key = hashBytes(&fileSize, sizeof(fileSize), key);
+	key = hashBytes(&modificationTime, sizeof(modificationTime), key);
+	return hashBytes(&modificationNanoseconds, sizeof(modificationNanoseconds), key);
+}
+
+//------------------------------------------------------------
+// A hash as 16 hexadecimal digits.
+string formatHash(unsigned long long hash) {
+	char hashString[17];
+	snprintf(hashString, sizeof(hashString), "%016llx", hash);
+	return hashString;
+}
+
+//------------------------------------------------------------
+// Milliseconds elapsed since startTime.
+double elapsedMilliseconds(chrono::high_resolution_clock::time_point startTime) {
+	chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - startTime;
+	return elapsed.count();
+}
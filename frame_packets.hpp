@@ -0,0 +1,334 @@
+/* This is a utility program that helps OpenGL programmers take the CPU work of a frame (e.g. walking the node
+tree, animation, culling) off the thread that issues the OpenGL calls.
+A frame thread builds frame packets: everything the rendering thread needs to draw a frame (the draw list with
+the transform each mesh is drawn with, and the texture levels the view needs). Once a packet is handed over
+it is not changed, so the rendering thread reads it without locks while the frame thread builds the next one.
+The two threads exchange packets through a triple buffer: one packet is being built, one is
+being drawn, and the third is the latest finished one, which either thread swaps with its own through an atomic
+exchange. The frame thread builds one packet ahead and then waits, so it does not spin on packets nobody draws.
+The rendering thread draws the latest packet; if the frame thread has not finished a new one, it draws the
+same packet again rather than wait.
+The scene is read by the frame thread and changed by the rendering thread, so the rendering thread pauses the
+frame thread while it changes the scene. The packets built before the change are then dropped.
+The time each thread spends on a frame, and how much of it overlaps, is measured.
+The following functions are provided.
+
+// Start the frame thread. build(packet) fills a packet from the current scene; it runs on the frame thread
+// while the scene cannot change. If separateThread is false, no thread is started and takeFramePacket() calls
+// build() itself, e.g. to compare the two.
+void startFrameThread(FrameThread& frameThread, const function<void(FramePacket&)>& build, bool separateThread = true)
+
+// Wait until the frame thread is not reading the scene, and keep it from reading it (rendering thread only).
+void pauseFrameThread(FrameThread& frameThread)
+
+// Let the frame thread read the scene again. The packets built before pauseFrameThread() are not drawn.
+void resumeFrameThread(FrameThread& frameThread)
+
+// Take the latest packet to draw it (rendering thread only). The packet stays valid until the next call.
+const FramePacket& takeFramePacket(FrameThread& frameThread)
+
+// Mark the end of the frame of the packet taken last (rendering thread only), for the statistics.
+void finishFramePacket(FrameThread& frameThread)
+
+// Stop the frame thread.
+void stopFrameThread(FrameThread& frameThread)
+
+// Print the number of packets and frames, the time per frame of each thread and how much of it overlapped.
+void printFrameThreadStatistics(const FrameThread& frameThread)
+
+This file requires the Assimp headers and file_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// The packets of the triple buffer.
+#define FRAME_PACKET_COUNT 3
+
+// Set in FrameThread::latestPacket when the latest packet has not been taken by the rendering thread yet.
+#define FRAME_PACKET_FRESH 0x80000000u
+
+// One mesh to draw, with the transform it is drawn with.
+struct DrawItem {
+	unsigned int meshIndex;
+	aiMatrix4x4 transform;
+};
+
+// A streamed texture that is drawn in the frame, and the mipmap level it needs.
+struct TextureLevelRequest {
+	unsigned int texture;
+	float level;
+};
+
+// Everything the rendering thread needs to draw one frame. The vectors keep their capacity from one packet to
+// the next, so building a packet does not allocate memory once the first few have been built.
+struct FramePacket {
+	unsigned long long frameNumber;              // the packets are numbered in the order they are built
+	unsigned int sceneVersion;                   // see FrameThread::sceneVersion
+	vector<DrawItem> drawList;
+	vector<TextureLevelRequest> textureLevels;
+
+	chrono::high_resolution_clock::time_point buildStartTime;
+	chrono::high_resolution_clock::time_point buildEndTime;
+};
+
+// The time the rendering thread spent on one frame.
+struct FrameInterval {
+	chrono::high_resolution_clock::time_point startTime;
+	chrono::high_resolution_clock::time_point endTime;
+};
+
+struct FrameThread {
+	FramePacket packets[FRAME_PACKET_COUNT];
+	atomic<unsigned int> latestPacket;           // the index of the latest finished packet, and FRAME_PACKET_FRESH
+	unsigned int buildPacket;                    // frame thread only
+	unsigned int drawPacket;                     // rendering thread only
+
+	function<void(FramePacket&)> build;
+	thread builder;
+	bool running;
+
+	// The frame thread holds sceneMutex while it builds a packet, the rendering thread while it changes the scene.
+	// sceneVersion is incremented by each change; the packets of an older version are not drawn.
+	mutex sceneMutex;
+	atomic<unsigned int> sceneVersion;
+
+	// The frame thread waits on builderCondition for its latest packet to be taken, the rendering thread on
+	// drawerCondition for a packet of the current scene.
+	mutex waitMutex;
+	condition_variable builderCondition;
+	condition_variable drawerCondition;
+	bool stopping;
+
+	// The frames the rendering thread has drawn since it took its packet. When it takes the next one, the time
+	// the next one was built during them is the overlap of the two threads.
+	vector<FrameInterval> drawnFrames;
+	chrono::high_resolution_clock::time_point frameStartTime;
+
+	// Statistics. The packet counters are written by the frame thread, the others by the rendering thread.
+	atomic<unsigned long long> builtPacketCount;
+	atomic<unsigned long long> droppedPacketCount;   // replaced by a newer packet before they were taken
+	unsigned long long takenPacketCount;
+	double buildMilliseconds;                        // the time the packets that were taken took to build
+	unsigned long long stalePacketCount;             // built before a change of the scene
+	unsigned long long frameCount;
+	unsigned long long repeatedFrameCount;           // frames that drew the packet of the frame before
+	double frameMilliseconds;
+	double waitMilliseconds;
+	double overlapMilliseconds;
+};
+
+//------------------------------------------------------------
+// The time two intervals have in common, in milliseconds.
+double getOverlapMilliseconds(chrono::high_resolution_clock::time_point start0, chrono::high_resolution_clock::time_point end0,
+	chrono::high_resolution_clock::time_point start1, chrono::high_resolution_clock::time_point end1) {
+	chrono::high_resolution_clock::time_point start = max(start0, start1);
+	chrono::high_resolution_clock::time_point end = min(end0, end1);
+	if (end <= start) {
+		return 0;
+	}
+	return chrono::duration<double, milli>(end - start).count();
+}
+
+//------------------------------------------------------------
+// Fill a packet from the current scene. On the frame thread, the caller must hold sceneMutex.
+void buildFramePacket(FrameThread& frameThread, FramePacket& packet, unsigned long long frameNumber) {
+	packet.buildStartTime = chrono::high_resolution_clock::now();
+	packet.frameNumber = frameNumber;
+	packet.sceneVersion = frameThread.sceneVersion;
+	packet.drawList.clear();
+	packet.textureLevels.clear();
+	frameThread.build(packet);
+	packet.buildEndTime = chrono::high_resolution_clock::now();
+}
+
+//------------------------------------------------------------
+// The frame thread. It builds a packet, hands it over, and waits until the rendering thread has taken it or
+// the scene has changed.
+void frameThreadMain(FrameThread* frameThread) {
+	unsigned long long frameNumber = 0;
+	while (true) {
+		unsigned int builtVersion;
+		{
+			lock_guard<mutex> sceneLock(frameThread->sceneMutex);
+			FramePacket& packet = frameThread->packets[frameThread->buildPacket];
+			buildFramePacket(*frameThread, packet, frameNumber++);
+			builtVersion = packet.sceneVersion;
+		}
+		frameThread->builtPacketCount++;
+
+		// Hand the packet over, and take back the one it replaces. If that one was never taken, it is dropped.
+		unsigned int replaced = frameThread->latestPacket.exchange(frameThread->buildPacket | FRAME_PACKET_FRESH);
+		if (replaced & FRAME_PACKET_FRESH) {
+			frameThread->droppedPacketCount++;
+		}
+		frameThread->buildPacket = replaced & ~FRAME_PACKET_FRESH;
+
+		unique_lock<mutex> lock(frameThread->waitMutex);
+		frameThread->drawerCondition.notify_one();
+		frameThread->builderCondition.wait(lock, [frameThread, builtVersion] {
+			return frameThread->stopping || !(frameThread->latestPacket & FRAME_PACKET_FRESH) ||
+				frameThread->sceneVersion != builtVersion;
+		});
+		if (frameThread->stopping) {
+			break;
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Start the frame thread.
+void startFrameThread(FrameThread& frameThread, const function<void(FramePacket&)>& build, bool separateThread = true) {
+	frameThread.build = build;
+	frameThread.latestPacket = 0;
+	frameThread.drawPacket = 1;
+	frameThread.buildPacket = 2;
+	frameThread.sceneVersion = 0;
+	frameThread.stopping = false;
+	frameThread.builtPacketCount = 0;
+	frameThread.droppedPacketCount = 0;
+	frameThread.buildMilliseconds = 0;
+	frameThread.takenPacketCount = 0;
+	frameThread.stalePacketCount = 0;
+	frameThread.frameCount = 0;
+	frameThread.repeatedFrameCount = 0;
+	frameThread.frameMilliseconds = 0;
+	frameThread.waitMilliseconds = 0;
+	frameThread.overlapMilliseconds = 0;
+	frameThread.running = separateThread;
+	if (separateThread) {
+		frameThread.builder = thread(frameThreadMain, &frameThread);
+	}
+}
+
+//------------------------------------------------------------
+// Keep the frame thread from reading the scene. It finishes the packet it is building first.
+void pauseFrameThread(FrameThread& frameThread) {
+	frameThread.sceneMutex.lock();
+}
+
+//------------------------------------------------------------
+// Let the frame thread read the scene again, and wake it up to build a packet of the changed scene.
+void resumeFrameThread(FrameThread& frameThread) {
+	frameThread.sceneVersion++;
+	frameThread.sceneMutex.unlock();
+	lock_guard<mutex> lock(frameThread.waitMutex);
+	frameThread.builderCondition.notify_one();
+}
+
+//------------------------------------------------------------
+// Take the latest packet. The packet drawn in the frame before is kept if there is no new one, unless the scene
+// has changed since it was built; then the rendering thread waits for a packet of the current scene.
+// Without the frame thread, the packet is built here.
+const FramePacket& takeFramePacket(FrameThread& frameThread) {
+	frameThread.frameStartTime = chrono::high_resolution_clock::now();
+	frameThread.frameCount++;
+
+	if (!frameThread.running) {
+		FramePacket& packet = frameThread.packets[0];
+		buildFramePacket(frameThread, packet, frameThread.takenPacketCount++);
+		frameThread.buildMilliseconds += chrono::duration<double, milli>(packet.buildEndTime - packet.buildStartTime).count();
+		frameThread.builtPacketCount++;
+		return packet;
+	}
+
+	bool taken = false;
+	while (true) {
+		if (frameThread.latestPacket & FRAME_PACKET_FRESH) {
+			frameThread.drawPacket = frameThread.latestPacket.exchange(frameThread.drawPacket) & ~FRAME_PACKET_FRESH;
+			taken = true;
+			{
+				lock_guard<mutex> lock(frameThread.waitMutex);
+				frameThread.builderCondition.notify_one();
+			}
+			if (frameThread.packets[frameThread.drawPacket].sceneVersion != frameThread.sceneVersion) {
+				frameThread.stalePacketCount++;
+				continue;
+			}
+			break;
+		}
+		if (frameThread.takenPacketCount > 0 && !taken &&
+			frameThread.packets[frameThread.drawPacket].sceneVersion == frameThread.sceneVersion) {
+			frameThread.repeatedFrameCount++;
+			break;
+		}
+
+		unique_lock<mutex> lock(frameThread.waitMutex);
+		frameThread.drawerCondition.wait(lock, [&frameThread] {
+			return (frameThread.latestPacket & FRAME_PACKET_FRESH) != 0;
+		});
+	}
+
+	FramePacket& packet = frameThread.packets[frameThread.drawPacket];
+	if (taken) {
+		frameThread.takenPacketCount++;
+		frameThread.buildMilliseconds += chrono::duration<double, milli>(packet.buildEndTime - packet.buildStartTime).count();
+		for (unsigned int i = 0; i < frameThread.drawnFrames.size(); i++) {
+			frameThread.overlapMilliseconds += getOverlapMilliseconds(packet.buildStartTime, packet.buildEndTime,
+				frameThread.drawnFrames[i].startTime, frameThread.drawnFrames[i].endTime);
+		}
+		frameThread.drawnFrames.clear();
+	}
+	frameThread.waitMilliseconds += elapsedMilliseconds(frameThread.frameStartTime);
+	return packet;
+}
+
+//------------------------------------------------------------
+// The rendering thread is done with the frame.
+void finishFramePacket(FrameThread& frameThread) {
+	FrameInterval frame;
+	frame.startTime = frameThread.frameStartTime;
+	frame.endTime = chrono::high_resolution_clock::now();
+	frameThread.frameMilliseconds += chrono::duration<double, milli>(frame.endTime - frame.startTime).count();
+	if (frameThread.running) {
+		frameThread.drawnFrames.push_back(frame);
+	}
+}
+
+//------------------------------------------------------------
+// Stop the frame thread. It finishes the packet it is building first.
+void stopFrameThread(FrameThread& frameThread) {
+	if (!frameThread.running) {
+		return;
+	}
+	{
+		lock_guard<mutex> lock(frameThread.waitMutex);
+		frameThread.stopping = true;
+		frameThread.builderCondition.notify_one();
+	}
+	frameThread.builder.join();
+	frameThread.running = false;
+}
+
+//------------------------------------------------------------
+// Print the packet and frame counters. Without the frame thread, the packets are built within the frames,
+// so nothing overlaps.
+void printFrameThreadStatistics(const FrameThread& frameThread) {
+	unsigned long long builtPacketCount = frameThread.builtPacketCount;
+	double buildMilliseconds = frameThread.takenPacketCount > 0 ? frameThread.buildMilliseconds / frameThread.takenPacketCount : 0;
+	double frameMilliseconds = frameThread.frameCount > 0 ? frameThread.frameMilliseconds / frameThread.frameCount : 0;
+	double waitMilliseconds = frameThread.frameCount > 0 ? frameThread.waitMilliseconds / frameThread.frameCount : 0;
+	double overlapMilliseconds = frameThread.frameCount > 0 ? frameThread.overlapMilliseconds / frameThread.frameCount : 0;
+
+	cout << "---------- Frame thread ----------" << endl;
+	cout << (frameThread.running ? "Packets built on the frame thread: " : "Packets built on the rendering thread: ")
+		<< builtPacketCount << ", the ones drawn in " << buildMilliseconds << " ms each" << endl;
+	cout << "Packets drawn: " << frameThread.takenPacketCount << ", dropped: " << frameThread.droppedPacketCount
+		<< ", stale: " << frameThread.stalePacketCount << endl;
+	cout << "Frames: " << frameThread.frameCount << " (" << frameThread.repeatedFrameCount << " drew the packet of the frame before), "
+		<< frameMilliseconds << " ms each on the rendering thread, of which " << waitMilliseconds << " ms waiting for a packet" << endl;
+	if (frameThread.running) {
+		cout << "Overlap: " << overlapMilliseconds << " ms per frame, "
+			<< (frameThread.buildMilliseconds > 0 ? 100.0 * frameThread.overlapMilliseconds / frameThread.buildMilliseconds : 0)
+			<< "% of the build time is hidden behind the frames of the rendering thread" << endl;
+	}
+}
@@ -0,0 +1,243 @@
+/* This is a utility program that helps OpenGL programmers keep the geometry of many meshes in a few large buffer objects.
+A geometry pool is a set of buffer objects (e.g. one for positions and one for texture coordinates) whose ranges are
+handed out by a TLSF allocator. Adding or removing a mesh only allocates or frees a range: the buffer objects are
+created once and reused, instead of one glGenBuffers()/glBufferData() pair per mesh.
+The following functions are provided.
+
+// Create a pool with room for capacity units. unitSizes[i] is the size in bytes of one unit in buffer object i,
+// e.g. {12, 12} for a pool of vertices with a position and a texture coordinate stream.
+void createGeometryPool(GeometryPool& pool, unsigned int capacity, const vector<unsigned int>& unitSizes)
+
+// Allocate a range of units. The pool grows if there is no room. Returns the handle of the range.
+unsigned int allocateGeometry(GeometryPool& pool, unsigned int units)
+
+// Copy data into buffer object `stream` of a range.
+void uploadGeometry(GeometryPool& pool, unsigned int handle, unsigned int stream, const void* data, unsigned int units)
+
+// Free a range.
+void freeGeometry(GeometryPool& pool, unsigned int handle)
+
+// The offset (in units) of a range. It changes when the pool is compacted, so read it when drawing.
+unsigned int getGeometryOffset(const GeometryPool& pool, unsigned int handle)
+
+// Move ranges towards the start of the buffer objects, at most maxBytes per call. Returns the number of bytes moved.
+unsigned long long compactGeometryPool(GeometryPool& pool, unsigned long long maxBytes)
+
+// Delete the buffer objects of a pool.
+void deleteGeometryPool(GeometryPool& pool)
+
+// Print the size, free space and fragmentation of a pool.
+void printGeometryPoolStatistics(const GeometryPool& pool, const string& name)
+
+This file requires tlsf_allocator.hpp to be included first.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct GeometryPool {
+	TlsfAllocator allocator;
+	vector<GLuint> buffers;             // one buffer object per stream
+	vector<unsigned int> unitSizes;     // bytes per unit in each buffer object
+
+	// The buffer objects are replaced when the pool grows. The VAOs that use them must then be set up again.
+	bool buffersChanged;
+
+	// Compaction copies through this buffer object when the source and the destination overlap.
+	GLuint scratchBuffer;
+	unsigned long long scratchSize;
+
+	// Statistics
+	unsigned int growCount;
+	unsigned long long movedBytes;
+};
+
+//------------------------------------------------------------
+// Create a buffer object of the given size, without data.
+GLuint createPoolBuffer(unsigned long long size) {
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+//------------------------------------------------------------
+// Create a pool with room for capacity units.
+void createGeometryPool(GeometryPool& pool, unsigned int capacity, const vector<unsigned int>& unitSizes) {
+	if (capacity == 0) {
+		capacity = 1;
+	}
+
+	initTlsfAllocator(pool.allocator, capacity);
+	pool.unitSizes = unitSizes;
+	pool.buffers.resize(unitSizes.size());
+	for (unsigned int i = 0; i < unitSizes.size(); i++) {
+		pool.buffers[i] = createPoolBuffer((unsigned long long) capacity * unitSizes[i]);
+	}
+	pool.buffersChanged = true;
+	pool.scratchBuffer = 0;
+	pool.scratchSize = 0;
+	pool.growCount = 0;
+	pool.movedBytes = 0;
+
+	checkOpenGLError("createGeometryPool()");
+}
+
+//------------------------------------------------------------
+// Replace the buffer objects with larger ones and copy the old content on the GPU.
+void growGeometryPool(GeometryPool& pool, unsigned int newCapacity) {
+	unsigned int oldCapacity = pool.allocator.capacity;
+
+	for (unsigned int i = 0; i < pool.buffers.size(); i++) {
+		GLuint newBuffer = createPoolBuffer((unsigned long long) newCapacity * pool.unitSizes[i]);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, pool.buffers[i]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr) oldCapacity * pool.unitSizes[i]);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		glDeleteBuffers(1, &pool.buffers[i]);
+		pool.buffers[i] = newBuffer;
+	}
+
+	extendTlsfAllocator(pool.allocator, newCapacity);
+	pool.buffersChanged = true;
+	pool.growCount++;
+
+	checkOpenGLError("growGeometryPool()");
+}
+
+//------------------------------------------------------------
+// Allocate a range of units. If there is no free range large enough, the pool grows to at least
+// twice its size, so that adding meshes one at a time takes amortized constant time.
+unsigned int allocateGeometry(GeometryPool& pool, unsigned int units) {
+	if (units == 0) {
+		return TLSF_NO_BLOCK;
+	}
+
+	unsigned int handle = tlsfAllocate(pool.allocator, units);
+	if (handle == TLSF_NO_BLOCK) {
+		unsigned int capacity = pool.allocator.capacity;
+		unsigned int newCapacity = capacity * 2 > capacity + units ? capacity * 2 : capacity + units;
+		growGeometryPool(pool, newCapacity);
+		handle = tlsfAllocate(pool.allocator, units);
+	}
+	return handle;
+}
+
+//------------------------------------------------------------
+// Copy data into buffer object `stream` of a range.
+void uploadGeometry(GeometryPool& pool, unsigned int handle, unsigned int stream, const void* data, unsigned int units) {
+	if (handle == TLSF_NO_BLOCK) {
+		return;
+	}
+
+	unsigned int unitSize = pool.unitSizes[stream];
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffers[stream]);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) getTlsfOffset(pool.allocator, handle) * unitSize,
+		(GLsizeiptr) units * unitSize, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+//------------------------------------------------------------
+// Free a range. The space is reused by the next allocation; the buffer objects are kept.
+void freeGeometry(GeometryPool& pool, unsigned int handle) {
+	if (handle != TLSF_NO_BLOCK) {
+		tlsfFree(pool.allocator, handle);
+	}
+}
+
+//------------------------------------------------------------
+// The offset (in units) of a range.
+unsigned int getGeometryOffset(const GeometryPool& pool, unsigned int handle) {
+	return getTlsfOffset(pool.allocator, handle);
+}
+
+//------------------------------------------------------------
+// Move ranges towards the start of the buffer objects, so that the free space ends up in one piece.
+// The copies stay on the GPU (glCopyBufferSubData). Calling this function once per frame with a small
+// maxBytes spreads the work over several frames.
+unsigned long long compactGeometryPool(GeometryPool& pool, unsigned long long maxBytes) {
+	unsigned int bytesPerUnit = 0;
+	for (unsigned int i = 0; i < pool.unitSizes.size(); i++) {
+		bytesPerUnit += pool.unitSizes[i];
+	}
+	if (bytesPerUnit == 0) {
+		return 0;
+	}
+
+	unsigned long long maxUnits = maxBytes / bytesPerUnit;
+	if (maxUnits == 0) {
+		maxUnits = 1;
+	}
+	if (maxUnits > 0xFFFFFFFFu) {
+		maxUnits = 0xFFFFFFFFu;
+	}
+
+	unsigned int movedUnits = compactTlsfAllocator(pool.allocator, (unsigned int) maxUnits,
+		[&pool](unsigned int from, unsigned int to, unsigned int units) {
+		for (unsigned int i = 0; i < pool.buffers.size(); i++) {
+			GLintptr source = (GLintptr) from * pool.unitSizes[i];
+			GLintptr destination = (GLintptr) to * pool.unitSizes[i];
+			GLsizeiptr size = (GLsizeiptr) units * pool.unitSizes[i];
+
+			if (from < to + units) {
+				// The ranges overlap, which glCopyBufferSubData() does not allow within one buffer object.
+				// Copy through the scratch buffer.
+				if (pool.scratchSize < (unsigned long long) size) {
+					glDeleteBuffers(1, &pool.scratchBuffer);
+					pool.scratchBuffer = createPoolBuffer(size);
+					pool.scratchSize = size;
+				}
+				glBindBuffer(GL_COPY_READ_BUFFER, pool.buffers[i]);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, pool.scratchBuffer);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, 0, size);
+				glBindBuffer(GL_COPY_READ_BUFFER, pool.scratchBuffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffers[i]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, destination, size);
+			} else {
+				glBindBuffer(GL_COPY_READ_BUFFER, pool.buffers[i]);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffers[i]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, destination, size);
+			}
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	});
+
+	unsigned long long movedBytes = (unsigned long long) movedUnits * bytesPerUnit;
+	pool.movedBytes += movedBytes;
+	return movedBytes;
+}
+
+//------------------------------------------------------------
+// Delete the buffer objects of a pool.
+void deleteGeometryPool(GeometryPool& pool) {
+	if (!pool.buffers.empty()) {
+		glDeleteBuffers((GLsizei) pool.buffers.size(), &pool.buffers[0]);
+	}
+	glDeleteBuffers(1, &pool.scratchBuffer);
+	pool.buffers.clear();
+	pool.scratchBuffer = 0;
+	pool.scratchSize = 0;
+}
+
+//------------------------------------------------------------
+// Print the size, free space and fragmentation of a pool.
+void printGeometryPoolStatistics(const GeometryPool& pool, const string& name) {
+	TlsfStatistics statistics = getTlsfStatistics(pool.allocator);
+
+	cout << "---------- Geometry pool: " << name << " ----------" << endl;
+	cout << "Capacity: " << statistics.capacity << " units (grown " << pool.growCount << " times)" << endl;
+	cout << "Allocated: " << statistics.allocatedUnits << " units in " << statistics.allocationCount << " ranges" << endl;
+	cout << "Free: " << statistics.freeUnits << " units in " << statistics.freeBlockCount << " blocks, largest "
+		<< statistics.largestFreeBlock << endl;
+	cout << "Fragmentation: " << statistics.fragmentation * 100.0f << "%" << endl;
+	cout << "Moved by compaction: " << pool.movedBytes << " bytes" << endl;
+}
@@ -0,0 +1,333 @@
+/* This is a utility program that helps OpenGL programmers reload a 3D file while the program is running.
+A file watcher reports when the 3D file or one of its texture files has been written (inotify on Linux,
+modification times elsewhere). The 3D file is then imported again on a background thread, and the content
+of every mesh and embedded texture is hashed, so that the program only has to upload the ones that changed.
+The following functions are provided.
+
+// Start watching files. Returns false if the operating system's file notifications cannot be used
+// (the watcher then falls back to checking modification times).
+bool initFileWatcher(FileWatcher& watcher)
+
+// Add a file to the watcher. Files are only reported once they have been closed after writing, or
+// moved into place (which is how most exporters save).
+void watchFile(FileWatcher& watcher, const string& fileName)
+
+// The watched files that have changed since the last call. This function does not block.
+vector<string> pollChangedFiles(FileWatcher& watcher)
+
+// Stop watching files.
+void closeFileWatcher(FileWatcher& watcher)
+
+// Content hash of the geometry (positions, texture coordinates, faces) of a mesh.
+unsigned long long hashMesh(const aiMesh* mesh)
+
+// Content hash of an embedded texture.
+unsigned long long hashEmbeddedTexture(const aiTexture* texture)
+
+// Import a 3D file again on a background thread, hash its meshes and embedded textures, and then run
+// extraWork (e.g. baking changed texture files) on the same thread. If loadFile is given, it is tried first
+// (e.g. a faster loader for one file format); Assimp is used if it returns NULL.
+void startSceneReload(SceneReload& reload, const string& fileName, unsigned int importFlags, const function<void()>& extraWork,
+	const function<aiScene*(const string&)>& loadFile = function<aiScene*(const string&)>())
+
+// Check if a reload has finished. Once it has, the caller owns reload.scene (delete it when it is replaced).
+bool isSceneReloadDone(SceneReload& reload)
+
+// Wait for a running reload and throw its result away. Call this function before the program exits.
+// deleteScene deletes the scene, which loadFile may have made in a way that delete cannot undo (e.g. from a
+// mapped file); an empty function deletes it with delete.
+void stopSceneReload(SceneReload& reload, const function<void(const aiScene*)>& deleteScene)
+
+This file requires the Assimp headers, file_utilities.hpp and thread_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#endif
+
+using namespace std;
+
+// Without file notifications, the modification times are checked at most this often.
+#define FILE_WATCHER_POLL_MILLISECONDS 500
+
+struct FileWatcher {
+#ifdef __linux__
+	int inotifyDescriptor;                             // -1 if inotify cannot be used
+	unordered_map<int, string> watchedDirectories;     // watch descriptor -> directory name
+#endif
+	unordered_map<string, long long> watchedFiles;     // file name -> last modification time
+	chrono::high_resolution_clock::time_point lastPollTime;
+};
+
+struct SceneReload {
+	thread importer;
+	atomic<bool> done;
+	bool running;
+
+	string fileName;
+	const aiScene* scene;                         // NULL if the import failed
+	vector<unsigned long long> meshHashes;        // one per scene->mMeshes[]
+	vector<unsigned long long> textureHashes;     // one per scene->mTextures[]
+
+	chrono::high_resolution_clock::time_point startTime;
+	double importMilliseconds;
+};
+
+//------------------------------------------------------------
+// Start watching files.
+bool initFileWatcher(FileWatcher& watcher) {
+	watcher.watchedFiles.clear();
+	watcher.lastPollTime = chrono::high_resolution_clock::now();
+
+#ifdef __linux__
+	watcher.watchedDirectories.clear();
+	watcher.inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher.inotifyDescriptor < 0) {
+		cout << "initFileWatcher(): inotify is not available. Checking modification times instead." << endl;
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------
+// Add a file to the watcher.
+// inotify watches the directory rather than the file, because exporters often write a new file and
+// rename it over the old one, which would end a watch on the old file.
+void watchFile(FileWatcher& watcher, const string& fileName) {
+	if (watcher.watchedFiles.count(fileName)) {
+		return;
+	}
+
+	unsigned long long size = 0;
+	long long modificationTime = 0;
+	getFileInfo(fileName, size, modificationTime);
+	watcher.watchedFiles[fileName] = modificationTime;
+
+#ifdef __linux__
+	if (watcher.inotifyDescriptor < 0) {
+		return;
+	}
+
+	string directoryName = getDirectoryName(fileName);
+	if (directoryName.empty()) {
+		directoryName = "./";
+	}
+	for (unordered_map<int, string>::const_iterator it = watcher.watchedDirectories.begin(); it != watcher.watchedDirectories.end(); ++it) {
+		if (it->second == directoryName) {
+			return;
+		}
+	}
+
+	int watchDescriptor = inotify_add_watch(watcher.inotifyDescriptor, directoryName.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watchDescriptor < 0) {
+		cout << "watchFile(): unable to watch " << directoryName << endl;
+		return;
+	}
+	watcher.watchedDirectories[watchDescriptor] = directoryName;
+#endif
+}
+
+//------------------------------------------------------------
+// The watched files that have changed since the last call.
+vector<string> pollChangedFiles(FileWatcher& watcher) {
+	vector<string> changedFiles;
+
+#ifdef __linux__
+	if (watcher.inotifyDescriptor >= 0) {
+		// The buffer must be aligned for inotify_event, and hold at least one event with the longest name.
+		alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		while (true) {
+			ssize_t length = read(watcher.inotifyDescriptor, buffer, sizeof(buffer));
+			if (length <= 0) {
+				break;
+			}
+
+			for (char* pointer = buffer; pointer < buffer + length; ) {
+				const inotify_event* event = (const inotify_event*) pointer;
+				pointer += sizeof(inotify_event) + event->len;
+
+				unordered_map<int, string>::const_iterator directory = watcher.watchedDirectories.find(event->wd);
+				if (directory == watcher.watchedDirectories.end() || event->len == 0) {
+					continue;
+				}
+
+				// The file names were added with the directory name getDirectoryName() found, which is "" for
+				// files in the current directory.
+				string fileName = (directory->second == "./" ? string() : directory->second) + event->name;
+				if (watcher.watchedFiles.count(fileName) &&
+					find(changedFiles.begin(), changedFiles.end(), fileName) == changedFiles.end()) {
+					changedFiles.push_back(fileName);
+				}
+			}
+		}
+		return changedFiles;
+	}
+#endif
+
+	// Without file notifications, compare the modification times every now and then.
+	if (elapsedMilliseconds(watcher.lastPollTime) < FILE_WATCHER_POLL_MILLISECONDS) {
+		return changedFiles;
+	}
+	watcher.lastPollTime = chrono::high_resolution_clock::now();
+
+	for (unordered_map<string, long long>::iterator it = watcher.watchedFiles.begin(); it != watcher.watchedFiles.end(); ++it) {
+		unsigned long long size = 0;
+		long long modificationTime = 0;
+		if (getFileInfo(it->first, size, modificationTime) && modificationTime != it->second) {
+			it->second = modificationTime;
+			changedFiles.push_back(it->first);
+		}
+	}
+	return changedFiles;
+}
+
+//------------------------------------------------------------
+// Stop watching files.
+void closeFileWatcher(FileWatcher& watcher) {
+#ifdef __linux__
+	if (watcher.inotifyDescriptor >= 0) {
+		close(watcher.inotifyDescriptor);
+		watcher.inotifyDescriptor = -1;
+	}
+	watcher.watchedDirectories.clear();
+#endif
+	watcher.watchedFiles.clear();
+}
+
+//------------------------------------------------------------
+// Content hash of a mesh. Two meshes with the same hash have the same geometry in video memory, so the
+// geometry of one can be used for the other. The material is looked up when the mesh is drawn, so it is
+// not part of the hash: the same mesh with another material (e.g. in another 3D file) keeps its geometry.
+unsigned long long hashMesh(const aiMesh* mesh) {
+	unsigned long long hash = hashBytes(&mesh->mNumVertices, sizeof(mesh->mNumVertices));
+	if (mesh->HasPositions()) {
+		hash = hashBytes(mesh->mVertices, sizeof(aiVector3D) * mesh->mNumVertices, hash);
+	}
+	if (mesh->HasTextureCoords(0)) {
+		hash = hashBytes(mesh->mTextureCoords[0], sizeof(aiVector3D) * mesh->mNumVertices, hash);
+	}
+
+	hash = hashBytes(&mesh->mNumFaces, sizeof(mesh->mNumFaces), hash);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		hash = hashBytes(&face.mNumIndices, sizeof(face.mNumIndices), hash);
+		hash = hashBytes(face.mIndices, sizeof(unsigned int) * face.mNumIndices, hash);
+	}
+	return hash;
+}
+
+//------------------------------------------------------------
+// Content hash of an embedded texture. mHeight is 0 for compressed (e.g. PNG) data of mWidth bytes,
+// otherwise the texture is mWidth x mHeight aiTexel values.
+unsigned long long hashEmbeddedTexture(const aiTexture* texture) {
+	size_t size = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+	unsigned long long hash = hashBytes(&texture->mWidth, sizeof(texture->mWidth));
+	hash = hashBytes(&texture->mHeight, sizeof(texture->mHeight), hash);
+	return hashBytes(texture->pcData, size, hash);
+}
+
+//------------------------------------------------------------
+// The reload thread: import the file with loadFile or with its own importer, and hash the result.
+void sceneReloadMain(SceneReload* reload, unsigned int importFlags, function<void()> extraWork,
+	function<aiScene*(const string&)> loadFile) {
+	const aiScene* scene = loadFile ? loadFile(reload->fileName) : NULL;
+	if (!scene) {
+		Assimp::Importer importer;
+		scene = importer.ReadFile(reload->fileName, importFlags);
+		if (!scene) {
+			cout << "sceneReloadMain(): " << importer.GetErrorString() << endl;
+		} else {
+			// The scene now belongs to the caller, not to the importer that is about to be destroyed.
+			scene = importer.GetOrphanedScene();
+		}
+	}
+
+	if (scene) {
+		reload->meshHashes.resize(scene->mNumMeshes);
+		parallelFor(scene->mNumMeshes, [reload, scene](unsigned int i) {
+			reload->meshHashes[i] = hashMesh(scene->mMeshes[i]);
+		});
+		reload->textureHashes.resize(scene->mNumTextures);
+		for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+			reload->textureHashes[i] = hashEmbeddedTexture(scene->mTextures[i]);
+		}
+	}
+	reload->scene = scene;
+
+	if (extraWork) {
+		extraWork();
+	}
+
+	reload->importMilliseconds = elapsedMilliseconds(reload->startTime);
+	reload->done = true;
+}
+
+//------------------------------------------------------------
+// Import a 3D file again on a background thread.
+// fileName may be empty, to only run extraWork in the background.
+void startSceneReload(SceneReload& reload, const string& fileName, unsigned int importFlags, const function<void()>& extraWork,
+	const function<aiScene*(const string&)>& loadFile = function<aiScene*(const string&)>()) {
+	reload.fileName = fileName;
+	reload.scene = NULL;
+	reload.meshHashes.clear();
+	reload.textureHashes.clear();
+	reload.startTime = chrono::high_resolution_clock::now();
+	reload.importMilliseconds = 0.0;
+	reload.done = false;
+	reload.running = true;
+
+	if (fileName.empty()) {
+		reload.importer = thread([&reload, extraWork]() {
+			if (extraWork) {
+				extraWork();
+			}
+			reload.importMilliseconds = elapsedMilliseconds(reload.startTime);
+			reload.done = true;
+		});
+	} else {
+		reload.importer = thread(sceneReloadMain, &reload, importFlags, extraWork, loadFile);
+	}
+}
+
+//------------------------------------------------------------
+// Check if a reload has finished.
+bool isSceneReloadDone(SceneReload& reload) {
+	if (!reload.running || !reload.done) {
+		return false;
+	}
+	reload.importer.join();
+	reload.running = false;
+	return true;
+}
+
+//------------------------------------------------------------
+// Wait for a running reload and throw its result away.
+void stopSceneReload(SceneReload& reload, const function<void(const aiScene*)>& deleteScene) {
+	if (!reload.running) {
+		return;
+	}
+	reload.importer.join();
+	reload.running = false;
+	if (deleteScene) {
+		deleteScene(reload.scene);
+	} else {
+		delete reload.scene;
+	}
+	reload.scene = NULL;
+}
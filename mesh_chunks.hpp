@@ -0,0 +1,1127 @@
+/* This is a utility program that helps OpenGL programmers draw meshes that are too large to load.
+A city-scale scan may not fit in memory as an aiScene, let alone in video memory. This file converts a 3D file
+once into a cache file of spatial chunks, without holding more than a memory budget of it at a time, and then
+draws it by paging the chunks in and out of video memory.
+The conversion reads the triangles of the source in batches, from a memory-mapped binary PLY or STL file (or
+from an aiScene if the file has another format), and never keeps all of them: it first counts them in the cells
+of a grid, packs the cells into chunks of about chunkTriangles triangles along a Morton (Z-order) curve, and then
+builds as many chunks per pass over the source as fit in the memory budget. Each chunk stores its own joined
+vertices and 32-bit indices.
+Each chunk also stores up to levelCount - 1 coarser levels, made by clustering its vertices in ever coarser grids
+(a cluster hierarchy: each level has about a quarter of the triangles of the one below it). The cache file holds
+all the chunks' coarsest levels first and their full detail last, so that the model can be drawn from the first
+block of the file while the rest is still being read.
+At run time the cache file is memory-mapped, and a reader thread reads the levels from disk, coarsest first. The
+visible chunks are uploaded at the finest level that has been read, largest on the screen (i.e. closest to the
+camera) first, within a per-frame upload budget, and the pages of each chunk are dropped from the process once it
+is uploaded. The least recently drawn chunks are evicted to keep the uploaded chunks within a memory budget.
+The time from opening the file until each level is on the screen is printed.
+The following functions are provided.
+
+// Open a binary PLY file (with only triangles) or a binary STL file as a source of triangles.
+// Returns false if the file has another format.
+bool openMeshChunkSource(const string& fileName, MeshChunkSource& source)
+
+// Use the triangles of the meshes of a scene, moved by their node transforms, as a source. The scene must
+// stay alive while the source is used.
+void getSceneChunkSource(const aiScene* scene, MeshChunkSource& source)
+
+// Release the file of a source.
+void closeMeshChunkSource(MeshChunkSource& source)
+
+// The name of the cache file of the chunks of a 3D file.
+string getMeshChunkCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int chunkTriangles,
+	unsigned int levelCount)
+
+// Convert the triangles of a source into a cache file of chunks of about chunkTriangles triangles with up to
+// levelCount levels of detail (1 to MESH_CHUNK_MAX_LEVELS), using at most about memoryBudget bytes.
+// Returns false if the file cannot be written.
+bool buildMeshChunks(const MeshChunkSource& source, const string& cacheFileName, unsigned int chunkTriangles,
+	unsigned int levelCount, unsigned long long memoryBudget)
+
+// Map a cache file, create the buffer objects of its chunks and start reading its levels from disk.
+// positionLocation is the vPos attribute.
+bool openMeshChunks(MeshChunks& meshChunks, const string& cacheFileName, GLint positionLocation,
+	unsigned long long memoryBudget, unsigned long long uploadBudget)
+
+// Upload and draw the chunks this frame needs. The transform is passed to the vertex shader in the uniform
+// at transformLocation.
+void drawMeshChunks(MeshChunks& meshChunks, const aiMatrix4x4& transform, GLint transformLocation, int windowWidth,
+	int windowHeight)
+
+// True if the next frame will look better: the last frame needed chunks that could not be uploaded yet, or
+// finer levels are still being read.
+bool isMeshChunkStreaming(const MeshChunks& meshChunks)
+
+// Stop reading the levels, and release the buffer objects and the cache file of the chunks.
+void closeMeshChunks(MeshChunks& meshChunks)
+
+// Print the chunks, the uploaded chunks and the chunks drawn in the last frame.
+void printMeshChunkStatistics(const MeshChunks& meshChunks)
+
+This file requires thread_utilities.hpp, file_utilities.hpp, tlsf_allocator.hpp, geometry_pool.hpp,
+binary_mesh_loader.hpp (for the PLY and STL files) and point_cloud.hpp (for the Morton codes) to be included first.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// The source is read this many triangles at a time.
+#define MESH_CHUNK_BATCH_TRIANGLES 65536
+
+// The grid the triangles are counted in has at most 2^7 = 128 cells per axis.
+#define MESH_CHUNK_MAX_GRID_BITS 7
+
+// The memory a triangle takes while its chunk is built: its corners, its indices, the sort order and joined
+// vertices of its chunk, and its share of the coarser levels.
+#define MESH_CHUNK_BUILD_BYTES_PER_TRIANGLE 96
+
+// Each chunk has at most this many levels of detail. Level 0 is the full detail.
+#define MESH_CHUNK_MAX_LEVELS 6
+
+// A chunk gets no coarser level once a level has fewer triangles than this.
+#define MESH_CHUNK_MIN_LEVEL_TRIANGLES 64
+
+// The header at the beginning of a chunk cache file. The chunk table is at the end of the file.
+// The levels are stored one block per level, coarsest first: level l starts at levelOffsets[l] and ends where
+// level l - 1 starts (level 0 ends at the chunk table).
+struct MeshChunkHeader {
+	unsigned char identifier[12];       // MESH_CHUNK_IDENTIFIER
+	unsigned int chunkCount;
+	unsigned long long triangleCount;
+	unsigned long long chunkTableOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	unsigned int levelCount;
+	unsigned int reserved;
+	unsigned long long levelOffsets[MESH_CHUNK_MAX_LEVELS];
+};
+
+const unsigned char MESH_CHUNK_IDENTIFIER[12] = { 0xAB, 'M', 'C', 'K', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// One level of a chunk. The vertices (3 floats each) start at byteOffset, followed by the indices.
+struct MeshChunkLevel {
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned long long byteOffset;
+};
+
+// One entry of the chunk table. A chunk with fewer levels than the file uses its coarsest level for the
+// coarser ones; that level is stored in the coarsest block, so every chunk can be drawn once it has been read.
+struct MeshChunk {
+	float boundsMin[3];
+	float boundsMax[3];
+	MeshChunkLevel levels[MESH_CHUNK_MAX_LEVELS];
+};
+
+// The triangles a cache file is built from.
+struct MeshChunkSource {
+	unsigned long long triangleCount;
+
+	// Read the corners of triangles [first, first + count) into corners[] (9 floats per triangle).
+	// It is called from several threads at once.
+	function<void(unsigned long long first, unsigned int count, float* corners)> readTriangles;
+
+	MappedFile file;                    // file.data is NULL if the source is a scene
+};
+
+struct MeshChunks {
+	MappedFile file;
+	vector<MeshChunk> chunks;
+	unsigned long long triangleCount;
+	unsigned int levelCount;
+	unsigned long long levelOffsets[MESH_CHUNK_MAX_LEVELS + 1];     // the end of level 0 too
+
+	// The reader thread reads the blocks of the levels from disk, coarsest first. The levels from arrivedLevel
+	// up have been read (arrivedLevel is levelCount before the first one has been).
+	thread reader;
+	atomic<unsigned int> arrivedLevel;
+	atomic<bool> stopReader;
+	chrono::high_resolution_clock::time_point openTime;
+	double levelReadMilliseconds[MESH_CHUNK_MAX_LEVELS];
+	unsigned int shownLevel;            // the finest level the whole view has been drawn at, levelCount before
+
+	// The uploaded chunks: their vertices in vertexPool and their indices in indexPool, drawn through vao.
+	GeometryPool vertexPool;
+	GeometryPool indexPool;
+	GLuint vao;
+	GLint positionLocation;
+	vector<unsigned int> vertexRanges;  // TLSF_NO_BLOCK if the chunk is not uploaded
+	vector<unsigned int> indexRanges;
+	vector<unsigned int> residentLevels;// the level that is uploaded
+	vector<unsigned int> usedFrames;    // the last frame that drew the chunk
+	unsigned long long residentBytes;
+	unsigned long long memoryBudget;
+	unsigned long long uploadBudget;    // bytes per frame
+	unsigned int frame;
+	bool missingChunks;
+
+	// Statistics
+	unsigned int visibleChunkCount;
+	unsigned int drawnChunkCount;
+	unsigned long long drawnTriangleCount;
+	unsigned long long uploadedBytes;
+	unsigned int evictedChunkCount;
+};
+
+//------------------------------------------------------------
+// Release the file of a source.
+void closeMeshChunkSource(MeshChunkSource& source) {
+	if (source.file.data) {
+		unmapFile(source.file);
+	}
+	source.file.data = NULL;
+	source.readTriangles = function<void(unsigned long long, unsigned int, float*)>();
+	source.triangleCount = 0;
+}
+
+//------------------------------------------------------------
+// Open a binary STL file as a source of triangles: the corners of triangle t are at 84 + 50 * t + 12.
+bool openStlChunkSource(MeshChunkSource& source) {
+	uint32_t triangleCount;
+	if (source.file.size < 84) {
+		return false;
+	}
+	memcpy(&triangleCount, source.file.data + 80, 4);
+	if (source.file.size != 84 + (size_t) triangleCount * 50) {
+		return false;
+	}
+
+	const unsigned char* triangles = source.file.data + 84;
+	source.triangleCount = triangleCount;
+	source.readTriangles = [triangles](unsigned long long first, unsigned int count, float* corners) {
+		for (unsigned int i = 0; i < count; i++) {
+			memcpy(corners + 9 * (size_t) i, triangles + (first + i) * 50 + 12, 36);
+		}
+	};
+	return true;
+}
+
+// Open a binary little-endian PLY file whose faces are all triangles as a source of triangles.
+// The vertices are read from the file each time a triangle refers to them.
+bool openPlyChunkSource(MeshChunkSource& source) {
+	vector<PlyElement> elements;
+	size_t offset = parsePlyHeader(source.file.data, source.file.size, elements);
+	if (offset == 0) {
+		return false;
+	}
+
+	int vertexElement = -1, faceElement = -1;
+	size_t vertexOffset = 0, faceOffset = 0;
+	for (unsigned int i = 0; i < elements.size() && faceElement < 0; i++) {
+		if (elements[i].name == "vertex") {
+			vertexElement = (int) i;
+			vertexOffset = offset;
+		} else if (elements[i].name == "face") {
+			faceElement = (int) i;
+			faceOffset = offset;
+		} else if (!elements[i].fixedSize) {
+			return false;
+		}
+		offset += (size_t) elements[i].count * elements[i].size;
+	}
+	if (vertexElement < 0 || faceElement < 0 || vertexElement > faceElement || !elements[vertexElement].fixedSize
+		|| vertexOffset + (size_t) elements[vertexElement].count * elements[vertexElement].size > source.file.size) {
+		return false;
+	}
+
+	const PlyElement& vertices = elements[vertexElement];
+	const PlyElement& faces = elements[faceElement];
+	static const char* const xNames[] = { "x", NULL };
+	static const char* const yNames[] = { "y", NULL };
+	static const char* const zNames[] = { "z", NULL };
+	int x = findPlyProperty(vertices, xNames), y = findPlyProperty(vertices, yNames), z = findPlyProperty(vertices, zNames);
+	if (x < 0 || y < 0 || z < 0 || faces.properties.size() != 1 || !faces.properties[0].isList) {
+		return false;
+	}
+
+	// Only fixed-size triangles can be read in any order. Check every face and every index once.
+	PlyType countType = faces.properties[0].countType;
+	PlyType indexType = faces.properties[0].type;
+	unsigned int countSize = getPlyTypeSize(countType);
+	unsigned int indexSize = getPlyTypeSize(indexType);
+	size_t triangleSize = countSize + 3 * indexSize;
+	if (faceOffset + (size_t) faces.count * triangleSize > source.file.size) {
+		return false;
+	}
+	const unsigned char* faceData = source.file.data + faceOffset;
+	unsigned int vertexCount = vertices.count;
+	vector<char> blockValid((faces.count + 65535) / 65536, 1);
+	parallelFor((unsigned int) blockValid.size(), [&](unsigned int block) {
+		unsigned int end = min(faces.count, (block + 1) * 65536);
+		for (unsigned int i = block * 65536; i < end && blockValid[block]; i++) {
+			const unsigned char* face = faceData + (size_t) i * triangleSize;
+			blockValid[block] = readPlyIndex(face, countType) == 3 && readPlyIndex(face + countSize, indexType) < vertexCount
+				&& readPlyIndex(face + countSize + indexSize, indexType) < vertexCount
+				&& readPlyIndex(face + countSize + 2 * indexSize, indexType) < vertexCount;
+		}
+	});
+	for (unsigned int block = 0; block < blockValid.size(); block++) {
+		if (!blockValid[block]) {
+			return false;
+		}
+	}
+
+	const unsigned char* vertexData = source.file.data + vertexOffset;
+	unsigned int vertexSize = vertices.size;
+	PlyProperty position[3] = { vertices.properties[x], vertices.properties[y], vertices.properties[z] };
+	source.triangleCount = faces.count;
+	source.readTriangles = [=](unsigned long long first, unsigned int count, float* corners) {
+		for (unsigned int i = 0; i < count; i++) {
+			const unsigned char* face = faceData + (first + i) * triangleSize + countSize;
+			for (unsigned int k = 0; k < 3; k++) {
+				const unsigned char* vertex = vertexData + (size_t) readPlyIndex(face + k * indexSize, indexType) * vertexSize;
+				for (unsigned int c = 0; c < 3; c++) {
+					corners[9 * (size_t) i + 3 * k + c] = (float) readPlyValue(vertex + position[c].offset, position[c].type);
+				}
+			}
+		}
+	};
+	return true;
+}
+
+//------------------------------------------------------------
+// Open a binary PLY file (with only triangles) or a binary STL file as a source of triangles.
+bool openMeshChunkSource(const string& fileName, MeshChunkSource& source) {
+	source.triangleCount = 0;
+	source.file.data = NULL;
+	if (!isBinaryMeshFileName(fileName) || !mapFile(fileName, source.file)) {
+		source.file.data = NULL;
+		return false;
+	}
+
+	bool isPly = source.file.size >= 3 && memcmp(source.file.data, "ply", 3) == 0;
+	if (isPly ? openPlyChunkSource(source) : openStlChunkSource(source)) {
+		return true;
+	}
+	closeMeshChunkSource(source);
+	return false;
+}
+
+//------------------------------------------------------------
+// The triangles of one mesh drawn by one node, as a run of the triangles of a scene source.
+struct SceneTriangleRun {
+	const aiMesh* mesh;
+	aiMatrix4x4 transform;
+	vector<unsigned int> indices;       // 3 per triangle; polygons are split into fans
+	unsigned long long firstTriangle;
+};
+
+void collectSceneTriangleRuns(const aiScene* scene, const aiNode* node, const aiMatrix4x4& parentTransform,
+	vector<SceneTriangleRun>& runs, unsigned long long& triangleCount) {
+	aiMatrix4x4 transform = parentTransform * node->mTransformation;
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		if (!mesh->HasPositions() || !mesh->HasFaces()) {
+			continue;
+		}
+		SceneTriangleRun run;
+		run.mesh = mesh;
+		run.transform = transform;
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+			const aiFace& face = mesh->mFaces[f];
+			for (unsigned int k = 2; k < face.mNumIndices; k++) {
+				run.indices.push_back(face.mIndices[0]);
+				run.indices.push_back(face.mIndices[k - 1]);
+				run.indices.push_back(face.mIndices[k]);
+			}
+		}
+		if (run.indices.empty()) {
+			continue;
+		}
+		run.firstTriangle = triangleCount;
+		triangleCount += run.indices.size() / 3;
+		runs.push_back(run);
+	}
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		collectSceneTriangleRuns(scene, node->mChildren[i], transform, runs, triangleCount);
+	}
+}
+
+// Use the triangles of the meshes of a scene as a source.
+void getSceneChunkSource(const aiScene* scene, MeshChunkSource& source) {
+	source.triangleCount = 0;
+	source.file.data = NULL;
+	shared_ptr<vector<SceneTriangleRun> > runs(new vector<SceneTriangleRun>());
+	if (scene->mRootNode) {
+		collectSceneTriangleRuns(scene, scene->mRootNode, aiMatrix4x4(), *runs, source.triangleCount);
+	}
+
+	source.readTriangles = [runs](unsigned long long first, unsigned int count, float* corners) {
+		// Find the run of the first triangle; the runs are sorted by their first triangle.
+		size_t run = 0, last = runs->size();
+		while (last - run > 1) {
+			size_t middle = (run + last) / 2;
+			if ((*runs)[middle].firstTriangle <= first) {
+				run = middle;
+			} else {
+				last = middle;
+			}
+		}
+		for (unsigned int i = 0; i < count; i++) {
+			while ((first + i - (*runs)[run].firstTriangle) * 3 >= (*runs)[run].indices.size()) {
+				run++;
+			}
+			const SceneTriangleRun& triangles = (*runs)[run];
+			size_t triangle = (size_t) (first + i - triangles.firstTriangle);
+			for (unsigned int k = 0; k < 3; k++) {
+				aiVector3D position = triangles.transform * triangles.mesh->mVertices[triangles.indices[3 * triangle + k]];
+				for (unsigned int c = 0; c < 3; c++) {
+					corners[9 * (size_t) i + 3 * k + c] = position[c];
+				}
+			}
+		}
+	};
+}
+
+//------------------------------------------------------------
+// The name of the cache file of the chunks of a 3D file.
+string getMeshChunkCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int chunkTriangles,
+	unsigned int levelCount) {
+	unsigned long long key = hashFileVersion(modelFileName);
+	key = hashBytes(&chunkTriangles, sizeof(chunkTriangles), key);
+	key = hashBytes(&levelCount, sizeof(levelCount), key);
+	return cacheDirectory + "/" + formatHash(key) + ".mck";
+}
+
+//------------------------------------------------------------
+// Read all the triangles of a source, one batch per thread at a time. visit() is called on each batch with the
+// slot (0 to getWorkerThreadCount() - 1) of its thread; batchesDone() is called after each round of batches,
+// on the calling thread, so that the results of the slots can be merged in the order of the triangles.
+void scanMeshChunkSource(const MeshChunkSource& source,
+	const function<void(unsigned int slot, unsigned long long first, const float* corners, unsigned int count)>& visit,
+	const function<void()>& batchesDone) {
+	unsigned int slotCount = getWorkerThreadCount();
+	vector<vector<float> > corners(slotCount, vector<float>(9 * MESH_CHUNK_BATCH_TRIANGLES));
+	unsigned long long batchCount = (source.triangleCount + MESH_CHUNK_BATCH_TRIANGLES - 1) / MESH_CHUNK_BATCH_TRIANGLES;
+	for (unsigned long long firstBatch = 0; firstBatch < batchCount; firstBatch += slotCount) {
+		unsigned int roundBatches = (unsigned int) min((unsigned long long) slotCount, batchCount - firstBatch);
+		parallelFor(roundBatches, [&](unsigned int slot) {
+			unsigned long long first = (firstBatch + slot) * MESH_CHUNK_BATCH_TRIANGLES;
+			unsigned int count = (unsigned int) min((unsigned long long) MESH_CHUNK_BATCH_TRIANGLES, source.triangleCount - first);
+			source.readTriangles(first, count, &corners[slot][0]);
+			visit(slot, first, &corners[slot][0], count);
+		});
+		if (batchesDone) {
+			batchesDone();
+		}
+	}
+}
+
+// The grid cell (as a Morton code) of the centroid of a triangle.
+unsigned long long getMeshChunkCell(const float* corners, const float boundsMin[3], const float cellScale[3], unsigned int gridBits) {
+	unsigned int coordinates[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		float centroid = (corners[c] + corners[3 + c] + corners[6 + c]) / 3;
+		float cell = (centroid - boundsMin[c]) * cellScale[c];
+		coordinates[c] = cell <= 0 ? 0 : (unsigned int) min(cell, (float) ((1u << gridBits) - 1));
+	}
+	return getMortonCode(coordinates[0], coordinates[1], coordinates[2]);
+}
+
+// A corner as the bits of its position, with -0 made 0 so that it joins with 0.
+inline void getCornerBits(const float* corner, uint32_t bits[3]) {
+	memcpy(bits, corner, 12);
+	for (unsigned int c = 0; c < 3; c++) {
+		if (bits[c] == 0x80000000u) {
+			bits[c] = 0;
+		}
+	}
+}
+
+// Join the identical corners of the triangles of a chunk into vertices, in the order of their positions.
+// This is level 0 of the chunk.
+void buildMeshChunkGeometry(const vector<float>& corners, vector<float>& vertices, vector<unsigned int>& indices,
+	MeshChunk& chunk) {
+	unsigned int cornerCount = (unsigned int) (corners.size() / 3);
+	vector<unsigned int> order(cornerCount);
+	for (unsigned int i = 0; i < cornerCount; i++) {
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [&corners](unsigned int a, unsigned int b) {
+		uint32_t bitsA[3], bitsB[3];
+		getCornerBits(&corners[3 * (size_t) a], bitsA);
+		getCornerBits(&corners[3 * (size_t) b], bitsB);
+		return bitsA[0] != bitsB[0] ? bitsA[0] < bitsB[0] : bitsA[1] != bitsB[1] ? bitsA[1] < bitsB[1] : bitsA[2] < bitsB[2];
+	});
+
+	indices.resize(cornerCount);
+	vertices.clear();
+	uint32_t previous[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < cornerCount; i++) {
+		uint32_t bits[3];
+		getCornerBits(&corners[3 * (size_t) order[i]], bits);
+		if (i == 0 || memcmp(bits, previous, 12) != 0) {
+			vertices.insert(vertices.end(), &corners[3 * (size_t) order[i]], &corners[3 * (size_t) order[i]] + 3);
+			memcpy(previous, bits, 12);
+		}
+		indices[order[i]] = (unsigned int) (vertices.size() / 3 - 1);
+	}
+
+	chunk.levels[0].vertexCount = (unsigned int) (vertices.size() / 3);
+	chunk.levels[0].indexCount = cornerCount;
+	for (unsigned int c = 0; c < 3; c++) {
+		chunk.boundsMin[c] = 1e30f;
+		chunk.boundsMax[c] = -1e30f;
+	}
+	for (size_t i = 0; i < vertices.size(); i += 3) {
+		for (unsigned int c = 0; c < 3; c++) {
+			chunk.boundsMin[c] = min(chunk.boundsMin[c], vertices[i + c]);
+			chunk.boundsMax[c] = max(chunk.boundsMax[c], vertices[i + c]);
+		}
+	}
+}
+
+// Make a coarser level of a chunk by vertex clustering: the vertices in each cell of a grid of cellsPerAxis^3
+// cells over the chunk's bounds are replaced by their average, and the triangles that lose a side are dropped,
+// as are the copies of a triangle. The bounds of the chunk stay the bounds of every level, so neighboring chunks
+// meet on the cells of the same grid planes.
+void simplifyMeshChunk(const vector<float>& vertices, const vector<unsigned int>& indices, const MeshChunk& chunk,
+	unsigned int cellsPerAxis, vector<float>& coarseVertices, vector<unsigned int>& coarseIndices) {
+	float cellScale[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		float extent = chunk.boundsMax[c] - chunk.boundsMin[c];
+		cellScale[c] = extent > 0 ? cellsPerAxis / extent : 0;
+	}
+
+	unordered_map<unsigned long long, unsigned int> cellVertices;
+	vector<unsigned int> vertexClusters(vertices.size() / 3);
+	vector<double> sums;
+	vector<unsigned int> counts;
+	for (size_t i = 0; i < vertexClusters.size(); i++) {
+		unsigned long long cell = 0;
+		for (unsigned int c = 0; c < 3; c++) {
+			float coordinate = (vertices[3 * i + c] - chunk.boundsMin[c]) * cellScale[c];
+			cell = cell * cellsPerAxis + (coordinate <= 0 ? 0 : (unsigned int) min(coordinate, (float) (cellsPerAxis - 1)));
+		}
+		pair<unordered_map<unsigned long long, unsigned int>::iterator, bool> inserted =
+			cellVertices.insert(make_pair(cell, (unsigned int) counts.size()));
+		if (inserted.second) {
+			sums.insert(sums.end(), 3, 0.0);
+			counts.push_back(0);
+		}
+		unsigned int cluster = inserted.first->second;
+		vertexClusters[i] = cluster;
+		for (unsigned int c = 0; c < 3; c++) {
+			sums[3 * cluster + c] += vertices[3 * i + c];
+		}
+		counts[cluster]++;
+	}
+
+	coarseVertices.resize(sums.size());
+	for (size_t i = 0; i < sums.size(); i++) {
+		coarseVertices[i] = (float) (sums[i] / counts[i / 3]);
+	}
+
+	// A triangle is kept with its smallest index first, so that its copies (with the same winding) are equal.
+	vector<unsigned long long> triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned int a = vertexClusters[indices[i]], b = vertexClusters[indices[i + 1]], c = vertexClusters[indices[i + 2]];
+		if (a == b || b == c || a == c) {
+			continue;
+		}
+		while (a > b || a > c) {
+			unsigned int first = a;
+			a = b;
+			b = c;
+			c = first;
+		}
+		coarseIndices.push_back(a);
+		coarseIndices.push_back(b);
+		coarseIndices.push_back(c);
+	}
+	vector<unsigned int> order(coarseIndices.size() / 3);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [&coarseIndices](unsigned int x, unsigned int y) {
+		return lexicographical_compare(&coarseIndices[3 * x], &coarseIndices[3 * x] + 3, &coarseIndices[3 * y], &coarseIndices[3 * y] + 3);
+	});
+	vector<unsigned int> uniqueIndices;
+	for (unsigned int i = 0; i < order.size(); i++) {
+		if (i == 0 || !equal(&coarseIndices[3 * order[i]], &coarseIndices[3 * order[i]] + 3, &coarseIndices[3 * order[i - 1]])) {
+			uniqueIndices.insert(uniqueIndices.end(), &coarseIndices[3 * order[i]], &coarseIndices[3 * order[i]] + 3);
+		}
+	}
+	coarseIndices.swap(uniqueIndices);
+}
+
+// Make the coarser levels of a chunk from level 0, each with about a quarter of the triangles of the one
+// before it: a surface with n triangles covers about n / 2 cells of a grid, so the first grid has about
+// sqrt(n / 8) cells per axis and each level halves it. Returns the number of levels the chunk has.
+unsigned int buildMeshChunkLevels(MeshChunk& chunk, unsigned int levelCount, vector<vector<float> >& levelVertices,
+	vector<vector<unsigned int> >& levelIndices) {
+	unsigned int cellsPerAxis = 1;
+	while (2ull * (2 * cellsPerAxis) * (2 * cellsPerAxis) <= chunk.levels[0].indexCount / 3 / 4) {
+		cellsPerAxis *= 2;
+	}
+
+	unsigned int level = 1;
+	for (; level < levelCount && cellsPerAxis >= 2; level++, cellsPerAxis /= 2) {
+		if (chunk.levels[level - 1].indexCount / 3 < MESH_CHUNK_MIN_LEVEL_TRIANGLES) {
+			break;
+		}
+		simplifyMeshChunk(levelVertices[level - 1], levelIndices[level - 1], chunk, cellsPerAxis,
+			levelVertices[level], levelIndices[level]);
+		if (levelIndices[level].empty()) {
+			break;
+		}
+		chunk.levels[level].vertexCount = (unsigned int) (levelVertices[level].size() / 3);
+		chunk.levels[level].indexCount = (unsigned int) levelIndices[level].size();
+	}
+	return level;
+}
+
+//------------------------------------------------------------
+// Convert the triangles of a source into a cache file of chunks.
+// The source is read 2 + (number of passes) times: once for its bounds, once to count the triangles of each
+// grid cell, and once per pass to collect the triangles of the chunks built in that pass.
+bool buildMeshChunks(const MeshChunkSource& source, const string& cacheFileName, unsigned int chunkTriangles,
+	unsigned int levelCount, unsigned long long memoryBudget) {
+	if (source.triangleCount == 0) {
+		return false;
+	}
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	chunkTriangles = max(chunkTriangles, 1u);
+	levelCount = min(max(levelCount, 1u), (unsigned int) MESH_CHUNK_MAX_LEVELS);
+	unsigned int slotCount = getWorkerThreadCount();
+
+	// Find the bounds of the triangles.
+	vector<aiVector3D> slotMin(slotCount, aiVector3D(1e30f)), slotMax(slotCount, aiVector3D(-1e30f));
+	scanMeshChunkSource(source, [&](unsigned int slot, unsigned long long, const float* corners, unsigned int count) {
+		for (size_t i = 0; i < 3 * (size_t) count; i++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				slotMin[slot][c] = min(slotMin[slot][c], corners[3 * i + c]);
+				slotMax[slot][c] = max(slotMax[slot][c], corners[3 * i + c]);
+			}
+		}
+	}, function<void()>());
+
+	MeshChunkHeader header;
+	for (unsigned int c = 0; c < 3; c++) {
+		header.boundsMin[c] = 1e30f;
+		header.boundsMax[c] = -1e30f;
+		for (unsigned int slot = 0; slot < slotCount; slot++) {
+			header.boundsMin[c] = min(header.boundsMin[c], slotMin[slot][c]);
+			header.boundsMax[c] = max(header.boundsMax[c], slotMax[slot][c]);
+		}
+	}
+
+	// The grid has about 8 cells per chunk, so that the chunks can follow where the triangles are.
+	unsigned int gridBits = 0;
+	while (gridBits < MESH_CHUNK_MAX_GRID_BITS && (1ull << (3 * gridBits)) < 8 * source.triangleCount / chunkTriangles) {
+		gridBits++;
+	}
+	float cellScale[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		float extent = header.boundsMax[c] - header.boundsMin[c];
+		cellScale[c] = extent > 0 ? (1u << gridBits) / extent : 0;
+	}
+
+	// Count the triangles of each cell.
+	unsigned int cellCount = 1u << (3 * gridBits);
+	vector<vector<unsigned int> > slotCellCounts(slotCount, vector<unsigned int>(cellCount, 0));
+	scanMeshChunkSource(source, [&](unsigned int slot, unsigned long long, const float* corners, unsigned int count) {
+		for (unsigned int i = 0; i < count; i++) {
+			slotCellCounts[slot][getMeshChunkCell(corners + 9 * (size_t) i, header.boundsMin, cellScale, gridBits)]++;
+		}
+	}, function<void()>());
+	for (unsigned int slot = 1; slot < slotCount; slot++) {
+		for (unsigned int cell = 0; cell < cellCount; cell++) {
+			slotCellCounts[0][cell] += slotCellCounts[slot][cell];
+		}
+		vector<unsigned int>().swap(slotCellCounts[slot]);
+	}
+	const vector<unsigned int>& cellCounts = slotCellCounts[0];
+
+	// Pack the cells into chunks along the Morton curve, so that each chunk is a compact part of the model.
+	vector<unsigned int> cellChunks(cellCount, 0);
+	vector<unsigned long long> chunkTriangleCounts(1, 0);
+	for (unsigned int cell = 0; cell < cellCount; cell++) {
+		if (chunkTriangleCounts.back() > 0 && chunkTriangleCounts.back() + cellCounts[cell] > chunkTriangles) {
+			chunkTriangleCounts.push_back(0);
+		}
+		cellChunks[cell] = (unsigned int) chunkTriangleCounts.size() - 1;
+		chunkTriangleCounts.back() += cellCounts[cell];
+	}
+	unsigned int chunkCount = (unsigned int) chunkTriangleCounts.size();
+
+	// Each level is written to a file of its own first, and the files are joined, coarsest first, at the end.
+	vector<string> levelFileNames(levelCount);
+	vector<ofstream> levelFiles(levelCount);
+	vector<unsigned long long> levelFileSizes(levelCount, 0);
+	for (unsigned int level = 0; level < levelCount; level++) {
+		levelFileNames[level] = cacheFileName + ".level" + to_string(level);
+		levelFiles[level].open(levelFileNames[level].c_str(), ios::binary | ios::trunc);
+		if (!levelFiles[level].good()) {
+			cout << "buildMeshChunks(): unable to write " << levelFileNames[level] << endl;
+			return false;
+		}
+	}
+	vector<unsigned int> chunkLevelCounts(chunkCount);
+
+	// Build as many chunks per pass as fit in the memory budget (at least one).
+	vector<MeshChunk> chunks(chunkCount);
+	unsigned int passCount = 0;
+	for (unsigned int passBegin = 0; passBegin < chunkCount; passCount++) {
+		unsigned int passEnd = passBegin;
+		unsigned long long passBytes = 0;
+		while (passEnd < chunkCount && (passEnd == passBegin
+			|| passBytes + chunkTriangleCounts[passEnd] * MESH_CHUNK_BUILD_BYTES_PER_TRIANGLE <= memoryBudget)) {
+			passBytes += chunkTriangleCounts[passEnd] * MESH_CHUNK_BUILD_BYTES_PER_TRIANGLE;
+			passEnd++;
+		}
+
+		// Collect the corners of the triangles of this pass's chunks, in the order of the source.
+		vector<vector<float> > chunkCorners(passEnd - passBegin);
+		for (unsigned int chunk = passBegin; chunk < passEnd; chunk++) {
+			chunkCorners[chunk - passBegin].reserve(9 * (size_t) chunkTriangleCounts[chunk]);
+		}
+		vector<vector<pair<unsigned int, unsigned int> > > slotTriangles(slotCount);
+		vector<const float*> slotCorners(slotCount);
+		scanMeshChunkSource(source, [&](unsigned int slot, unsigned long long, const float* corners, unsigned int count) {
+			slotCorners[slot] = corners;
+			for (unsigned int i = 0; i < count; i++) {
+				unsigned int chunk = cellChunks[getMeshChunkCell(corners + 9 * (size_t) i, header.boundsMin, cellScale, gridBits)];
+				if (chunk >= passBegin && chunk < passEnd) {
+					slotTriangles[slot].push_back(make_pair(chunk - passBegin, i));
+				}
+			}
+		}, [&]() {
+			for (unsigned int slot = 0; slot < slotCount; slot++) {
+				for (size_t i = 0; i < slotTriangles[slot].size(); i++) {
+					const float* corners = slotCorners[slot] + 9 * (size_t) slotTriangles[slot][i].second;
+					vector<float>& destination = chunkCorners[slotTriangles[slot][i].first];
+					destination.insert(destination.end(), corners, corners + 9);
+				}
+				slotTriangles[slot].clear();
+			}
+		});
+
+		// Join the vertices of each chunk and make its coarser levels on its own thread, then write the chunks
+		// in order. The coarsest level of a chunk goes to the coarsest level file.
+		vector<vector<vector<float> > > chunkVertices(passEnd - passBegin, vector<vector<float> >(levelCount));
+		vector<vector<vector<unsigned int> > > chunkIndices(passEnd - passBegin, vector<vector<unsigned int> >(levelCount));
+		parallelFor(passEnd - passBegin, [&](unsigned int i) {
+			MeshChunk& chunk = chunks[passBegin + i];
+			buildMeshChunkGeometry(chunkCorners[i], chunkVertices[i][0], chunkIndices[i][0], chunk);
+			vector<float>().swap(chunkCorners[i]);
+			chunkLevelCounts[passBegin + i] = buildMeshChunkLevels(chunk, levelCount, chunkVertices[i], chunkIndices[i]);
+		});
+		for (unsigned int i = 0; i < passEnd - passBegin; i++) {
+			MeshChunk& chunk = chunks[passBegin + i];
+			unsigned int chunkLevelCount = chunkLevelCounts[passBegin + i];
+			for (unsigned int level = 0; level < chunkLevelCount; level++) {
+				unsigned int fileLevel = level + 1 == chunkLevelCount ? levelCount - 1 : level;
+				const vector<float>& vertices = chunkVertices[i][level];
+				const vector<unsigned int>& indices = chunkIndices[i][level];
+				chunk.levels[fileLevel] = chunk.levels[level];
+				chunk.levels[fileLevel].byteOffset = levelFileSizes[fileLevel];
+				levelFiles[fileLevel].write((const char*) &vertices[0], sizeof(float) * vertices.size());
+				levelFiles[fileLevel].write((const char*) &indices[0], sizeof(unsigned int) * indices.size());
+				levelFileSizes[fileLevel] += sizeof(float) * vertices.size() + sizeof(unsigned int) * indices.size();
+			}
+			for (unsigned int level = chunkLevelCount - 1; level < levelCount; level++) {
+				chunk.levels[level] = chunk.levels[levelCount - 1];
+			}
+		}
+		passBegin = passEnd;
+	}
+
+	// Join the level files after the header, coarsest first, and move the offsets of the chunks with them.
+	string temporaryName = getTemporaryFileName(cacheFileName);
+	ofstream fileOut(temporaryName.c_str(), ios::binary | ios::trunc);
+	MeshChunkHeader emptyHeader;
+	memset(&emptyHeader, 0, sizeof(emptyHeader));
+	fileOut.write((const char*) &emptyHeader, sizeof(emptyHeader));
+	unsigned long long fileOffset = sizeof(header);
+	header.reserved = 0;
+	memset(header.levelOffsets, 0, sizeof(header.levelOffsets));
+	vector<char> copyBuffer(1024 * 1024);
+	for (int level = (int) levelCount - 1; level >= 0; level--) {
+		levelFiles[level].close();
+		header.levelOffsets[level] = fileOffset;
+		ifstream levelIn(levelFileNames[level].c_str(), ios::binary);
+		while (levelIn.good()) {
+			levelIn.read(&copyBuffer[0], copyBuffer.size());
+			fileOut.write(&copyBuffer[0], levelIn.gcount());
+		}
+		levelIn.close();
+		remove(levelFileNames[level].c_str());
+		fileOffset += levelFileSizes[level];
+	}
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		for (unsigned int level = 0; level < levelCount; level++) {
+			unsigned int fileLevel = level + 1 >= chunkLevelCounts[i] ? levelCount - 1 : level;
+			chunks[i].levels[level].byteOffset += header.levelOffsets[fileLevel];
+		}
+	}
+
+	memcpy(header.identifier, MESH_CHUNK_IDENTIFIER, 12);
+	header.chunkCount = (unsigned int) chunks.size();
+	header.triangleCount = source.triangleCount;
+	header.chunkTableOffset = fileOffset;
+	header.levelCount = levelCount;
+	fileOut.write((const char*) &chunks[0], sizeof(MeshChunk) * chunks.size());
+	fileOut.seekp(0);
+	fileOut.write((const char*) &header, sizeof(header));
+	bool written = fileOut.good();
+	fileOut.close();
+	written = written && !fileOut.fail();
+	if (!written) {
+		remove(temporaryName.c_str());
+	}
+	if (!written || !replaceFile(temporaryName, cacheFileName)) {
+		cout << "buildMeshChunks(): unable to write " << cacheFileName << endl;
+		return false;
+	}
+
+	cout << "Mesh chunks: built " << header.chunkCount << " chunks of " << source.triangleCount << " triangles with "
+		<< levelCount << " levels in " << passCount << " passes (grid of " << (1u << gridBits) << "^3 cells) into "
+		<< cacheFileName << " in " << elapsedMilliseconds(startTime) << " ms" << endl;
+	for (int level = (int) levelCount - 1; level >= 0; level--) {
+		cout << "Mesh chunks: level " << level << " takes " << levelFileSizes[level] / (1024.0 * 1024.0) << " MB" << endl;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Point the vPos attribute of the chunks' VAO to the vertex pool, and the VAO's index buffer to the index pool.
+void setupMeshChunkVao(MeshChunks& meshChunks) {
+	glBindVertexArray(meshChunks.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, meshChunks.vertexPool.buffers[0]);
+	glEnableVertexAttribArray(meshChunks.positionLocation);
+	glVertexAttribPointer(meshChunks.positionLocation, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*) 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshChunks.indexPool.buffers[0]);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	meshChunks.vertexPool.buffersChanged = false;
+	meshChunks.indexPool.buffersChanged = false;
+}
+
+// The video memory a level of a chunk takes.
+unsigned long long getMeshChunkBytes(const MeshChunkLevel& level) {
+	return sizeof(float) * 3 * (unsigned long long) level.vertexCount + sizeof(unsigned int) * (unsigned long long) level.indexCount;
+}
+
+// Upload a level of a chunk from the mapped file, and drop its pages from the process. Returns the number of
+// bytes uploaded.
+unsigned long long uploadMeshChunk(MeshChunks& meshChunks, unsigned int chunkIndex, unsigned int levelIndex) {
+	const MeshChunkLevel& level = meshChunks.chunks[chunkIndex].levels[levelIndex];
+	const unsigned char* data = meshChunks.file.data + level.byteOffset;
+	meshChunks.vertexRanges[chunkIndex] = allocateGeometry(meshChunks.vertexPool, level.vertexCount);
+	uploadGeometry(meshChunks.vertexPool, meshChunks.vertexRanges[chunkIndex], 0, data, level.vertexCount);
+	meshChunks.indexRanges[chunkIndex] = allocateGeometry(meshChunks.indexPool, level.indexCount);
+	uploadGeometry(meshChunks.indexPool, meshChunks.indexRanges[chunkIndex], 0, data + sizeof(float) * 3 * level.vertexCount,
+		level.indexCount);
+	meshChunks.residentLevels[chunkIndex] = levelIndex;
+
+	unsigned long long bytes = getMeshChunkBytes(level);
+	releaseFileRange(meshChunks.file, (size_t) level.byteOffset, (size_t) bytes);
+	meshChunks.residentBytes += bytes;
+	meshChunks.uploadedBytes += bytes;
+	return bytes;
+}
+
+// Free the uploaded level of a chunk.
+void freeMeshChunk(MeshChunks& meshChunks, unsigned int chunkIndex) {
+	freeGeometry(meshChunks.vertexPool, meshChunks.vertexRanges[chunkIndex]);
+	freeGeometry(meshChunks.indexPool, meshChunks.indexRanges[chunkIndex]);
+	meshChunks.vertexRanges[chunkIndex] = TLSF_NO_BLOCK;
+	meshChunks.indexRanges[chunkIndex] = TLSF_NO_BLOCK;
+	meshChunks.residentBytes -= getMeshChunkBytes(meshChunks.chunks[chunkIndex].levels[meshChunks.residentLevels[chunkIndex]]);
+}
+
+// Read the blocks of the levels from disk, coarsest first, by touching each of their pages. The main thread
+// then uploads from pages that are already in memory, and never waits for the disk.
+void readMeshChunkLevels(MeshChunks* meshChunks) {
+	volatile unsigned char sum = 0;
+	for (int level = (int) meshChunks->levelCount - 1; level >= 0 && !meshChunks->stopReader; level--) {
+		for (unsigned long long offset = meshChunks->levelOffsets[level]; offset < meshChunks->levelOffsets[level + 1]; offset += 4096) {
+			sum += meshChunks->file.data[offset];
+		}
+		meshChunks->levelReadMilliseconds[level] = elapsedMilliseconds(meshChunks->openTime);
+		meshChunks->arrivedLevel = (unsigned int) level;
+	}
+}
+
+//------------------------------------------------------------
+// Map a cache file and create the buffer objects of its chunks. Nothing is uploaded until a frame needs it.
+bool openMeshChunks(MeshChunks& meshChunks, const string& cacheFileName, GLint positionLocation,
+	unsigned long long memoryBudget, unsigned long long uploadBudget) {
+	meshChunks.openTime = chrono::high_resolution_clock::now();
+	if (!mapFile(cacheFileName, meshChunks.file)) {
+		cout << "openMeshChunks(): unable to open " << cacheFileName << endl;
+		return false;
+	}
+
+	MeshChunkHeader header;
+	if (meshChunks.file.size < sizeof(header) || memcmp(meshChunks.file.data, MESH_CHUNK_IDENTIFIER, 12) != 0) {
+		cout << "openMeshChunks(): " << cacheFileName << " is not a valid chunk cache file" << endl;
+		unmapFile(meshChunks.file);
+		return false;
+	}
+	memcpy(&header, meshChunks.file.data, sizeof(header));
+	if (header.chunkCount == 0 || header.levelCount == 0 || header.levelCount > MESH_CHUNK_MAX_LEVELS
+		|| header.chunkTableOffset + header.chunkCount * sizeof(MeshChunk) > meshChunks.file.size) {
+		cout << "openMeshChunks(): " << cacheFileName << " is not a valid chunk cache file" << endl;
+		unmapFile(meshChunks.file);
+		return false;
+	}
+
+	meshChunks.chunks.resize(header.chunkCount);
+	memcpy(&meshChunks.chunks[0], meshChunks.file.data + header.chunkTableOffset, header.chunkCount * sizeof(MeshChunk));
+	meshChunks.triangleCount = header.triangleCount;
+	meshChunks.levelCount = header.levelCount;
+	memcpy(meshChunks.levelOffsets, header.levelOffsets, sizeof(header.levelOffsets));
+	meshChunks.levelOffsets[header.levelCount] = header.chunkTableOffset;
+	for (unsigned int level = 0; level < MESH_CHUNK_MAX_LEVELS; level++) {
+		meshChunks.levelReadMilliseconds[level] = 0;
+	}
+	meshChunks.shownLevel = header.levelCount;
+
+	meshChunks.positionLocation = positionLocation;
+	meshChunks.vertexRanges.assign(header.chunkCount, TLSF_NO_BLOCK);
+	meshChunks.indexRanges.assign(header.chunkCount, TLSF_NO_BLOCK);
+	meshChunks.residentLevels.assign(header.chunkCount, 0);
+	meshChunks.usedFrames.assign(header.chunkCount, 0);
+	meshChunks.residentBytes = 0;
+	meshChunks.memoryBudget = memoryBudget;
+	meshChunks.uploadBudget = uploadBudget;
+	meshChunks.frame = 0;
+	meshChunks.missingChunks = false;
+	meshChunks.visibleChunkCount = 0;
+	meshChunks.drawnChunkCount = 0;
+	meshChunks.drawnTriangleCount = 0;
+	meshChunks.uploadedBytes = 0;
+	meshChunks.evictedChunkCount = 0;
+
+	// The pools start at the size of the whole model or of the budget, whichever is smaller.
+	unsigned long long vertexCount = 0, indexCount = 0;
+	for (unsigned int i = 0; i < header.chunkCount; i++) {
+		vertexCount += meshChunks.chunks[i].levels[0].vertexCount;
+		indexCount += meshChunks.chunks[i].levels[0].indexCount;
+	}
+	double budgetShare = min(1.0, (double) memoryBudget / max(12 * vertexCount + 4 * indexCount, 1ull));
+	createGeometryPool(meshChunks.vertexPool, (unsigned int) (vertexCount * budgetShare), vector<unsigned int>(1, sizeof(float) * 3));
+	createGeometryPool(meshChunks.indexPool, (unsigned int) (indexCount * budgetShare), vector<unsigned int>(1, sizeof(unsigned int)));
+	glGenVertexArrays(1, &meshChunks.vao);
+	setupMeshChunkVao(meshChunks);
+
+	cout << "Mesh chunks: " << header.triangleCount << " triangles in " << header.chunkCount << " chunks with "
+		<< header.levelCount << " levels, " << (12 * vertexCount + 4 * indexCount) / (1024.0 * 1024.0)
+		<< " MB at full detail, opened in " << elapsedMilliseconds(meshChunks.openTime) << " ms" << endl;
+
+	meshChunks.arrivedLevel = header.levelCount;
+	meshChunks.stopReader = false;
+	meshChunks.reader = thread(readMeshChunkLevels, &meshChunks);
+	return true;
+}
+
+//------------------------------------------------------------
+// Project the bounds of a chunk. Returns false if the chunk is outside the view. pixelSize is the larger side
+// of its bounding rectangle on the screen, in pixels.
+bool projectMeshChunk(const MeshChunk& chunk, const aiMatrix4x4& transform, int windowWidth, int windowHeight,
+	float& pixelSize) {
+	aiVector3D screenMin(1e30f, 1e30f, 1e30f), screenMax(-1e30f, -1e30f, -1e30f);
+	for (unsigned int corner = 0; corner < 8; corner++) {
+		aiVector3D point((corner & 4) ? chunk.boundsMax[0] : chunk.boundsMin[0], (corner & 2) ? chunk.boundsMax[1] : chunk.boundsMin[1],
+			(corner & 1) ? chunk.boundsMax[2] : chunk.boundsMin[2]);
+		point = transform * point;
+		for (unsigned int c = 0; c < 3; c++) {
+			screenMin[c] = min(screenMin[c], point[c]);
+			screenMax[c] = max(screenMax[c], point[c]);
+		}
+	}
+	for (unsigned int c = 0; c < 3; c++) {
+		if (screenMax[c] < -1 || screenMin[c] > 1) {
+			return false;
+		}
+	}
+	pixelSize = max((screenMax.x - screenMin.x) * 0.5f * windowWidth, (screenMax.y - screenMin.y) * 0.5f * windowHeight);
+	return true;
+}
+
+// Evict the least recently drawn chunks until bytes more fit in the memory budget. The chunks already chosen
+// for this frame are never evicted. Returns false if they do not fit even then.
+bool evictMeshChunks(MeshChunks& meshChunks, unsigned long long bytes) {
+	if (meshChunks.residentBytes + bytes <= meshChunks.memoryBudget) {
+		return true;
+	}
+
+	vector<pair<unsigned int, unsigned int> > residentChunks;
+	for (unsigned int i = 0; i < meshChunks.chunks.size(); i++) {
+		if (meshChunks.vertexRanges[i] != TLSF_NO_BLOCK && meshChunks.usedFrames[i] != meshChunks.frame) {
+			residentChunks.push_back(make_pair(meshChunks.usedFrames[i], i));
+		}
+	}
+	sort(residentChunks.begin(), residentChunks.end());
+
+	for (unsigned int i = 0; i < residentChunks.size() && meshChunks.residentBytes + bytes > meshChunks.memoryBudget; i++) {
+		freeMeshChunk(meshChunks, residentChunks[i].second);
+		meshChunks.evictedChunkCount++;
+	}
+	return meshChunks.residentBytes + bytes <= meshChunks.memoryBudget;
+}
+
+//------------------------------------------------------------
+// Upload and draw the chunks this frame needs.
+// Each visible chunk is drawn at the finest level that has been read (the coarsest level is always allowed, as it
+// is the first block of the file). The visible chunks are taken largest on the screen first. A chunk that is not
+// uploaded yet, or that is uploaded at a coarser level, is uploaded if the per-frame upload budget allows it,
+// evicting chunks that this frame has not chosen; a chunk whose finer level does not fit keeps its coarser one,
+// and the chunks that do not fit at all are left out of this frame, so the nearest part of the model is always
+// the one that is drawn.
+void drawMeshChunks(MeshChunks& meshChunks, const aiMatrix4x4& transform, GLint transformLocation, int windowWidth,
+	int windowHeight) {
+	meshChunks.frame++;
+	meshChunks.missingChunks = false;
+	meshChunks.drawnChunkCount = 0;
+	meshChunks.drawnTriangleCount = 0;
+	unsigned int targetLevel = min((unsigned int) meshChunks.arrivedLevel, meshChunks.levelCount - 1);
+
+	vector<pair<float, unsigned int> > visibleChunks;
+	for (unsigned int i = 0; i < meshChunks.chunks.size(); i++) {
+		float pixelSize;
+		if (projectMeshChunk(meshChunks.chunks[i], transform, windowWidth, windowHeight, pixelSize)) {
+			visibleChunks.push_back(make_pair(-pixelSize, i));
+		}
+	}
+	sort(visibleChunks.begin(), visibleChunks.end());
+	meshChunks.visibleChunkCount = (unsigned int) visibleChunks.size();
+
+	vector<unsigned int> drawnChunks;
+	unsigned long long uploadedBytes = 0;
+	for (unsigned int i = 0; i < visibleChunks.size(); i++) {
+		unsigned int chunkIndex = visibleChunks[i].second;
+		const MeshChunk& chunk = meshChunks.chunks[chunkIndex];
+		meshChunks.usedFrames[chunkIndex] = meshChunks.frame;
+		bool resident = meshChunks.vertexRanges[chunkIndex] != TLSF_NO_BLOCK;
+		if (resident && chunk.levels[meshChunks.residentLevels[chunkIndex]].byteOffset == chunk.levels[targetLevel].byteOffset) {
+			// The chunk has no finer level of its own, or it is uploaded at the target level already.
+			meshChunks.residentLevels[chunkIndex] = targetLevel;
+		} else if (uploadedBytes >= meshChunks.uploadBudget) {
+			meshChunks.missingChunks = true;
+		} else {
+			unsigned long long bytes = getMeshChunkBytes(chunk.levels[targetLevel]);
+			unsigned long long oldBytes = resident ? getMeshChunkBytes(chunk.levels[meshChunks.residentLevels[chunkIndex]]) : 0;
+			if (evictMeshChunks(meshChunks, bytes > oldBytes ? bytes - oldBytes : 0)) {
+				if (resident) {
+					freeMeshChunk(meshChunks, chunkIndex);
+				}
+				uploadedBytes += uploadMeshChunk(meshChunks, chunkIndex, targetLevel);
+				resident = true;
+			}
+		}
+		if (resident) {
+			drawnChunks.push_back(chunkIndex);
+		}
+	}
+
+	// Uploading may have grown the pools and replaced their buffer objects.
+	if (meshChunks.vertexPool.buffersChanged || meshChunks.indexPool.buffersChanged) {
+		setupMeshChunkVao(meshChunks);
+	}
+
+	// aiMatrix4x4 is row-major, hence GL_TRUE.
+	glUniformMatrix4fv(transformLocation, 1, GL_TRUE, &transform.a1);
+	glBindVertexArray(meshChunks.vao);
+	unsigned int drawnLevel = 0;
+	for (unsigned int i = 0; i < drawnChunks.size(); i++) {
+		unsigned int chunkIndex = drawnChunks[i];
+		const MeshChunkLevel& level = meshChunks.chunks[chunkIndex].levels[meshChunks.residentLevels[chunkIndex]];
+		GLintptr indexOffset = (GLintptr) getGeometryOffset(meshChunks.indexPool, meshChunks.indexRanges[chunkIndex]) * sizeof(unsigned int);
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (GLvoid*) indexOffset,
+			(GLint) getGeometryOffset(meshChunks.vertexPool, meshChunks.vertexRanges[chunkIndex]));
+		meshChunks.drawnChunkCount++;
+		meshChunks.drawnTriangleCount += level.indexCount / 3;
+		drawnLevel = max(drawnLevel, meshChunks.residentLevels[chunkIndex]);
+	}
+	glBindVertexArray(0);
+
+	// Report when the whole view is first drawn at a finer level.
+	if (!meshChunks.missingChunks && drawnChunks.size() == visibleChunks.size() && drawnLevel < meshChunks.shownLevel) {
+		meshChunks.shownLevel = drawnLevel;
+		cout << "Mesh chunks: level " << drawnLevel << " on the screen after " << elapsedMilliseconds(meshChunks.openTime)
+			<< " ms (read from disk after " << meshChunks.levelReadMilliseconds[drawnLevel] << " ms)" << endl;
+	}
+}
+
+//------------------------------------------------------------
+// True if the next frame will look better: the last frame needed chunks that could not be uploaded yet, or
+// finer levels are still being read.
+bool isMeshChunkStreaming(const MeshChunks& meshChunks) {
+	return meshChunks.missingChunks || meshChunks.arrivedLevel > 0;
+}
+
+//------------------------------------------------------------
+// Stop reading the levels, and release the buffer objects and the cache file of the chunks.
+void closeMeshChunks(MeshChunks& meshChunks) {
+	meshChunks.stopReader = true;
+	if (meshChunks.reader.joinable()) {
+		meshChunks.reader.join();
+	}
+	glDeleteVertexArrays(1, &meshChunks.vao);
+	meshChunks.vao = 0;
+	deleteGeometryPool(meshChunks.vertexPool);
+	deleteGeometryPool(meshChunks.indexPool);
+	unmapFile(meshChunks.file);
+	meshChunks.chunks.clear();
+	meshChunks.vertexRanges.clear();
+	meshChunks.indexRanges.clear();
+	meshChunks.residentLevels.clear();
+	meshChunks.usedFrames.clear();
+}
+
+//------------------------------------------------------------
+// Print the chunks, the uploaded chunks and the chunks drawn in the last frame.
+void printMeshChunkStatistics(const MeshChunks& meshChunks) {
+	unsigned int residentChunkCount = 0;
+	for (unsigned int i = 0; i < meshChunks.vertexRanges.size(); i++) {
+		if (meshChunks.vertexRanges[i] != TLSF_NO_BLOCK) {
+			residentChunkCount++;
+		}
+	}
+
+	cout << "Mesh chunks: " << meshChunks.triangleCount << " triangles in " << meshChunks.chunks.size() << " chunks, "
+		<< residentChunkCount << " chunks uploaded (" << meshChunks.residentBytes / (1024.0 * 1024.0) << " of "
+		<< meshChunks.memoryBudget / (1024.0 * 1024.0) << " MB), " << meshChunks.drawnChunkCount << " of "
+		<< meshChunks.visibleChunkCount << " visible chunks (" << meshChunks.drawnTriangleCount << " triangles) drawn in the last frame" << endl;
+	cout << "Mesh chunks: " << meshChunks.uploadedBytes / (1024.0 * 1024.0) << " MB uploaded, "
+		<< meshChunks.evictedChunkCount << " chunks evicted" << endl;
+
+	for (unsigned int level = 0; level < meshChunks.levelCount; level++) {
+		unsigned long long triangleCount = 0;
+		unsigned int residentChunks = 0;
+		for (unsigned int i = 0; i < meshChunks.chunks.size(); i++) {
+			triangleCount += meshChunks.chunks[i].levels[level].indexCount / 3;
+			if (meshChunks.vertexRanges[i] != TLSF_NO_BLOCK && meshChunks.residentLevels[i] == level) {
+				residentChunks++;
+			}
+		}
+		cout << "Mesh chunks: level " << level << ": " << triangleCount << " triangles, "
+			<< (meshChunks.levelOffsets[level + 1] - meshChunks.levelOffsets[level]) / (1024.0 * 1024.0) << " MB, ";
+		if (meshChunks.arrivedLevel <= level) {
+			cout << "read after " << meshChunks.levelReadMilliseconds[level] << " ms, ";
+		} else {
+			cout << "not read yet, ";
+		}
+		cout << residentChunks << " chunks uploaded" << endl;
+	}
+}
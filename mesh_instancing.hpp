@@ -0,0 +1,275 @@
+/* This is a utility program that helps OpenGL programmers draw repeated geometry only once.
+CAD exports often store the same part (e.g. a bolt) many times as separate meshes, each with its vertices already
+moved to where the part goes. This file finds the meshes that are copies of another mesh up to a rigid transform
+(rotation and translation), so that only one of them is uploaded and the others are drawn as instances of it.
+Each mesh is first put in a canonical form: its centroid, a frame built from two of its vertices, and a hash of
+everything a rigid transform does not change (faces, texture coordinates, material). Meshes with the same hash
+are then compared exactly (faces, texture coordinates, material) and vertex by vertex with the transform that
+maps one frame onto the other, so that a hash collision never makes a mesh drawn with the geometry of another.
+The following functions are provided.
+
+// Compute the canonical form of a mesh.
+MeshCanonicalForm canonicalizeMesh(const aiMesh* mesh)
+
+// Find the rigid transform that maps the vertices of mesh a onto the vertices of mesh b (with the same indices).
+// Returns false if b is not a rigidly transformed copy of a, e.g. if its faces, texture coordinates or material differ.
+bool solveRigidTransform(const aiMesh* a, const MeshCanonicalForm& formA, const aiMesh* b, const MeshCanonicalForm& formB,
+	aiMatrix4x4& transform)
+
+// Find the meshes of a scene that are copies of an earlier mesh. Returns one entry per scene->mMeshes[].
+vector<MeshInstance> findMeshInstances(const aiScene* scene)
+
+// Print how many meshes are copies, the geometry they no longer take, and the draw calls per frame saved
+// when up to maxInstancesPerDraw instances are drawn by one call.
+void printMeshInstanceStatistics(const aiScene* scene, const vector<MeshInstance>& instances, unsigned int maxInstancesPerDraw)
+
+This file requires file_utilities.hpp, thread_utilities.hpp and mesh_primitives.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A vertex of a copy may be this far (relative to the size of the mesh) from where the transform puts it.
+#define MESH_INSTANCE_TOLERANCE 1e-4f
+
+struct MeshCanonicalForm {
+	bool valid;                  // false for meshes without positions or faces, which are never instanced
+	unsigned long long hash;     // faces, texture coordinates and material; not changed by a rigid transform
+	aiVector3D centroid;
+	unsigned int axisVertex;     // the vertex farthest from the centroid
+	unsigned int planeVertex;    // the vertex farthest from the line through the centroid and axisVertex
+	float radius;                // distance from the centroid to axisVertex
+};
+
+struct MeshInstance {
+	unsigned int sourceMesh;     // the mesh whose geometry is drawn; the mesh itself if it is not a copy
+	aiMatrix4x4 transform;       // maps the vertices of sourceMesh onto the vertices of this mesh
+};
+
+//------------------------------------------------------------
+// Compute the canonical form of a mesh.
+MeshCanonicalForm canonicalizeMesh(const aiMesh* mesh) {
+	MeshCanonicalForm form;
+	form.valid = mesh->HasPositions() && mesh->HasFaces();
+	form.hash = 0;
+	form.axisVertex = 0;
+	form.planeVertex = 0;
+	form.radius = 0;
+	if (!form.valid) {
+		return form;
+	}
+
+	form.hash = hashBytes(&mesh->mMaterialIndex, sizeof(mesh->mMaterialIndex));
+	form.hash = hashBytes(&mesh->mNumVertices, sizeof(mesh->mNumVertices), form.hash);
+	form.hash = hashBytes(&mesh->mNumFaces, sizeof(mesh->mNumFaces), form.hash);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		form.hash = hashBytes(&face.mNumIndices, sizeof(face.mNumIndices), form.hash);
+		form.hash = hashBytes(face.mIndices, sizeof(unsigned int) * face.mNumIndices, form.hash);
+	}
+	if (mesh->HasTextureCoords(0)) {
+		form.hash = hashBytes(mesh->mTextureCoords[0], sizeof(aiVector3D) * mesh->mNumVertices, form.hash);
+	}
+
+	// The centroid is summed in double precision, so that it does not depend on where the mesh is.
+	double sum[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			sum[c] += mesh->mVertices[i][c];
+		}
+	}
+	form.centroid = aiVector3D((float) (sum[0] / mesh->mNumVertices), (float) (sum[1] / mesh->mNumVertices),
+		(float) (sum[2] / mesh->mNumVertices));
+
+	float farthest = -1;
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		float distance = (mesh->mVertices[i] - form.centroid).SquareLength();
+		if (distance > farthest) {
+			farthest = distance;
+			form.axisVertex = i;
+		}
+	}
+	form.radius = sqrt(farthest);
+
+	aiVector3D axis = mesh->mVertices[form.axisVertex] - form.centroid;
+	if (form.radius > 0) {
+		axis /= form.radius;
+	}
+	farthest = -1;
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		float distance = (axis ^ (mesh->mVertices[i] - form.centroid)).SquareLength();
+		if (distance > farthest) {
+			farthest = distance;
+			form.planeVertex = i;
+		}
+	}
+	return form;
+}
+
+//------------------------------------------------------------
+// The orthonormal frame (as the columns of a matrix) built from the centroid and two vertices of a mesh.
+// If the mesh is a line or a point, any frame that contains the line will do; the comparison decides.
+aiMatrix3x3 getCanonicalFrame(const aiMesh* mesh, const aiVector3D& centroid, unsigned int axisVertex, unsigned int planeVertex) {
+	aiVector3D x = mesh->mVertices[axisVertex] - centroid;
+	if (x.SquareLength() == 0) {
+		x = aiVector3D(1, 0, 0);
+	}
+	x.Normalize();
+
+	aiVector3D y = mesh->mVertices[planeVertex] - centroid;
+	float length = y.SquareLength();
+	y -= x * (x * y);
+	if (y.SquareLength() <= 1e-10f * length) {
+		y = fabs(x.x) < 0.9f ? aiVector3D(1, 0, 0) : aiVector3D(0, 1, 0);
+		y -= x * (x * y);
+	}
+	y.Normalize();
+
+	aiVector3D z = x ^ y;
+	return aiMatrix3x3(x.x, y.x, z.x,
+		x.y, y.y, z.y,
+		x.z, y.z, z.z);
+}
+
+//------------------------------------------------------------
+// Check that two meshes have the same material, the same faces and the same texture coordinates, i.e. everything
+// that the hash of their canonical forms covers, compared exactly.
+bool haveSameTopology(const aiMesh* a, const aiMesh* b) {
+	if (a->mMaterialIndex != b->mMaterialIndex || a->mNumVertices != b->mNumVertices || a->mNumFaces != b->mNumFaces
+		|| a->HasTextureCoords(0) != b->HasTextureCoords(0)) {
+		return false;
+	}
+	for (unsigned int i = 0; i < a->mNumFaces; i++) {
+		const aiFace& faceA = a->mFaces[i];
+		const aiFace& faceB = b->mFaces[i];
+		if (faceA.mNumIndices != faceB.mNumIndices
+			|| memcmp(faceA.mIndices, faceB.mIndices, sizeof(unsigned int) * faceA.mNumIndices) != 0) {
+			return false;
+		}
+	}
+	return !a->HasTextureCoords(0)
+		|| memcmp(a->mTextureCoords[0], b->mTextureCoords[0], sizeof(aiVector3D) * a->mNumVertices) == 0;
+}
+
+//------------------------------------------------------------
+// Find the rigid transform that maps mesh a onto mesh b.
+// The frame of b is built from the same vertices as the frame of a, so the two frames correspond even if the
+// farthest vertex of b is a different one because of rounding. The transform is then checked on every vertex.
+bool solveRigidTransform(const aiMesh* a, const MeshCanonicalForm& formA, const aiMesh* b, const MeshCanonicalForm& formB,
+	aiMatrix4x4& transform) {
+	if (!formA.valid || !formB.valid || formA.hash != formB.hash || !haveSameTopology(a, b)) {
+		return false;
+	}
+	float tolerance = MESH_INSTANCE_TOLERANCE * max(formA.radius, 1e-6f);
+	if (fabs(formA.radius - formB.radius) > tolerance) {
+		return false;
+	}
+
+	aiMatrix3x3 frameA = getCanonicalFrame(a, formA.centroid, formA.axisVertex, formA.planeVertex);
+	aiMatrix3x3 frameB = getCanonicalFrame(b, formB.centroid, formA.axisVertex, formA.planeVertex);
+
+	// The frames are orthonormal, so the inverse of frameA is its transpose.
+	aiMatrix3x3 rotation = frameB * aiMatrix3x3(frameA).Transpose();
+	aiVector3D translation = formB.centroid - rotation * formA.centroid;
+
+	float toleranceSquared = tolerance * tolerance;
+	for (unsigned int i = 0; i < a->mNumVertices; i++) {
+		if ((rotation * a->mVertices[i] + translation - b->mVertices[i]).SquareLength() > toleranceSquared) {
+			return false;
+		}
+	}
+
+	transform = aiMatrix4x4(rotation);
+	transform.a4 = translation.x;
+	transform.b4 = translation.y;
+	transform.c4 = translation.z;
+	return true;
+}
+
+//------------------------------------------------------------
+// Find the meshes of a scene that are copies of an earlier mesh.
+// Meshes are only compared with the earlier meshes that have the same hash and are not copies themselves.
+vector<MeshInstance> findMeshInstances(const aiScene* scene) {
+	vector<MeshCanonicalForm> forms(scene->mNumMeshes);
+	parallelFor(scene->mNumMeshes, [&forms, scene](unsigned int i) {
+		forms[i] = canonicalizeMesh(scene->mMeshes[i]);
+	});
+
+	vector<MeshInstance> instances(scene->mNumMeshes);
+	unordered_map<unsigned long long, vector<unsigned int> > sources;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		instances[i].sourceMesh = i;
+		instances[i].transform = aiMatrix4x4();
+		if (!forms[i].valid) {
+			continue;
+		}
+
+		vector<unsigned int>& candidates = sources[forms[i].hash];
+		for (unsigned int j = 0; j < candidates.size(); j++) {
+			unsigned int candidate = candidates[j];
+			if (solveRigidTransform(scene->mMeshes[candidate], forms[candidate], scene->mMeshes[i], forms[i], instances[i].transform)) {
+				instances[i].sourceMesh = candidate;
+				break;
+			}
+		}
+		if (instances[i].sourceMesh == i) {
+			candidates.push_back(i);
+		}
+	}
+	return instances;
+}
+
+//------------------------------------------------------------
+// Count the times each mesh is referenced by a node, i.e. drawn per frame.
+void countMeshReferences(const aiNode* node, vector<unsigned int>& references) {
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		references[node->mMeshes[i]]++;
+	}
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		countMeshReferences(node->mChildren[i], references);
+	}
+}
+
+//------------------------------------------------------------
+// Print how many meshes are copies, the geometry they no longer take, and the draw calls per frame saved.
+void printMeshInstanceStatistics(const aiScene* scene, const vector<MeshInstance>& instances, unsigned int maxInstancesPerDraw) {
+	vector<unsigned int> references(scene->mNumMeshes, 0);
+	if (scene->mRootNode) {
+		countMeshReferences(scene->mRootNode, references);
+	}
+
+	unsigned int copyCount = 0;
+	unsigned long long savedBytes = 0;
+	vector<unsigned int> instanceCounts(scene->mNumMeshes, 0);
+	unsigned int drawCallsBefore = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		if (!mesh->HasPositions() || !mesh->HasFaces()) {
+			continue;
+		}
+		drawCallsBefore += references[i];
+		instanceCounts[instances[i].sourceMesh] += references[i];
+
+		if (instances[i].sourceMesh != i) {
+			copyCount++;
+			unsigned long long vertexBytes = sizeof(float) * 3 * mesh->mNumVertices;
+			savedBytes += (mesh->HasTextureCoords(0) ? 2 : 1) * vertexBytes
+				+ sizeof(unsigned int) * getPrimitiveRanges(mesh).indexCount;
+		}
+	}
+
+	unsigned int drawCallsAfter = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		drawCallsAfter += (instanceCounts[i] + maxInstancesPerDraw - 1) / maxInstancesPerDraw;
+	}
+
+	cout << "Instancing: " << copyCount << " of " << scene->mNumMeshes << " meshes are copies of another mesh, "
+		<< savedBytes / (1024.0 * 1024.0) << " MB of geometry saved, " << drawCallsBefore << " -> " << drawCallsAfter
+		<< " draw calls per frame" << endl;
+}
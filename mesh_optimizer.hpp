@@ -0,0 +1,583 @@
+/* This is a utility program that helps OpenGL programmers turn imported meshes into render-ready meshes.
+Assimp's post-processing (aiProcessPreset_TargetRealtime_Quality) already joins identical vertices and improves
+the vertex cache locality, but it does so on every load. This file has the optimization stages that a model
+goes through once, offline (see optimize_3d_obj.cc), before it is written into an optimized model file:
+- quantization: positions are snapped to a grid of 2^positionBits steps per axis in the bounds of their mesh,
+  and normals to 16-bit octahedral coordinates, which is how they are stored in the file;
+- welding: the vertices that are identical after quantization are joined;
+- vertex cache ordering: the triangles are reordered for the post-transform vertex cache (Forsyth's
+  linear-speed algorithm, with a 32-entry LRU cache model);
+- overdraw ordering: the triangles are cut into clusters where the cache starts over, and the clusters that
+  face away from the center of the mesh are drawn first, so that the surfaces in front hide more of the ones
+  behind them (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw");
+- vertex fetch ordering: the vertices are renumbered in the order the triangles first use them;
+- material deduplication: the materials that draw the same (diffuse color and texture) are joined.
+The following functions are provided.
+
+// Delete the vertex attributes that load_3d_obj.cc does not draw (tangents, colors, bones, extra texture
+// coordinates), so that the other stages only need to keep positions, normals and texture coordinates.
+void stripMesh(aiMesh* mesh)
+
+// Snap the positions of a mesh to a grid of 2^positionBits steps per axis in its bounds (positionBits 1 to 16,
+// or 0 to leave them alone), and the normals to 16-bit octahedral coordinates.
+void quantizeMesh(aiMesh* mesh, unsigned int positionBits)
+
+// Join the vertices of a mesh that have the same position, normal and texture coordinates.
+// Returns the number of vertices removed.
+unsigned int weldMesh(aiMesh* mesh)
+
+// Reorder the triangles of a mesh for the vertex cache, and then to reduce overdraw. Meshes that are not
+// made only of triangles are left alone. Returns false if the mesh was left alone.
+bool optimizeTriangleOrder(aiMesh* mesh)
+
+// Renumber the vertices of a mesh in the order its faces first use them. Unused vertices are removed.
+void optimizeVertexFetch(aiMesh* mesh)
+
+// The average number of vertices transformed per triangle with a FIFO cache of cacheSize vertices.
+float getAverageCacheMissRatio(const aiMesh* mesh, unsigned int cacheSize)
+
+// Join the materials of a scene that have the same diffuse color and diffuse texture. Returns the number of
+// materials removed.
+unsigned int removeDuplicateMaterials(aiScene* scene)
+
+// Encode a unit vector in 16-bit octahedral coordinates, and decode it.
+void encodeOctahedral(const aiVector3D& normal, short encoded[2])
+aiVector3D decodeOctahedral(const short encoded[2])
+
+This file requires the Assimp headers and file_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// The post-transform cache that the triangle order is made for. Forsyth's scores assume an LRU cache; the
+// statistics use a smaller FIFO cache, which is closer to the hardware.
+#define VERTEX_CACHE_SIZE 32
+#define VERTEX_CACHE_STATISTICS_SIZE 16
+
+// Overdraw clusters start where a triangle misses the statistics cache with all three of its vertices, but
+// never have fewer triangles than this, so that the cache order is kept within each cluster.
+#define OVERDRAW_MIN_CLUSTER_TRIANGLES 16
+
+//------------------------------------------------------------
+// Delete the vertex attributes that load_3d_obj.cc does not draw.
+void stripMesh(aiMesh* mesh) {
+	delete[] mesh->mTangents;
+	mesh->mTangents = NULL;
+	delete[] mesh->mBitangents;
+	mesh->mBitangents = NULL;
+	for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_COLOR_SETS; i++) {
+		delete[] mesh->mColors[i];
+		mesh->mColors[i] = NULL;
+	}
+	for (unsigned int i = 1; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; i++) {
+		delete[] mesh->mTextureCoords[i];
+		mesh->mTextureCoords[i] = NULL;
+		mesh->mNumUVComponents[i] = 0;
+	}
+	for (unsigned int i = 0; i < mesh->mNumBones; i++) {
+		delete mesh->mBones[i];
+	}
+	delete[] mesh->mBones;
+	mesh->mBones = NULL;
+	mesh->mNumBones = 0;
+	for (unsigned int i = 0; i < mesh->mNumAnimMeshes; i++) {
+		delete mesh->mAnimMeshes[i];
+	}
+	delete[] mesh->mAnimMeshes;
+	mesh->mAnimMeshes = NULL;
+	mesh->mNumAnimMeshes = 0;
+}
+
+//------------------------------------------------------------
+// Encode a unit vector in 16-bit octahedral coordinates: the vector is projected onto the octahedron
+// |x| + |y| + |z| = 1, and the lower half of the octahedron is folded over the upper half.
+void encodeOctahedral(const aiVector3D& normal, short encoded[2]) {
+	float length = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	float x = length > 0 ? normal.x / length : 0;
+	float y = length > 0 ? normal.y / length : 0;
+	if (normal.z < 0) {
+		float foldedX = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		float foldedY = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = (short) floor(max(-1.0f, min(1.0f, x)) * 32767 + 0.5f);
+	encoded[1] = (short) floor(max(-1.0f, min(1.0f, y)) * 32767 + 0.5f);
+}
+
+//------------------------------------------------------------
+// Decode a unit vector from 16-bit octahedral coordinates.
+aiVector3D decodeOctahedral(const short encoded[2]) {
+	float x = max(encoded[0] / 32767.0f, -1.0f);
+	float y = max(encoded[1] / 32767.0f, -1.0f);
+	float z = 1 - fabs(x) - fabs(y);
+	if (z < 0) {
+		float unfoldedX = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		float unfoldedY = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+	aiVector3D normal(x, y, z);
+	return normal.Normalize();
+}
+
+//------------------------------------------------------------
+// The bounds of the positions of a mesh.
+void getMeshBounds(const aiMesh* mesh, aiVector3D& boundsMin, aiVector3D& boundsMax) {
+	boundsMin = aiVector3D(1e30f);
+	boundsMax = aiVector3D(-1e30f);
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			boundsMin[c] = min(boundsMin[c], mesh->mVertices[i][c]);
+			boundsMax[c] = max(boundsMax[c], mesh->mVertices[i][c]);
+		}
+	}
+	if (mesh->mNumVertices == 0) {
+		boundsMin = boundsMax = aiVector3D(0);
+	}
+}
+
+//------------------------------------------------------------
+// The quantization step of each axis of the bounds of a mesh (0 if the bounds are flat along it).
+aiVector3D getQuantizationStep(const aiVector3D& boundsMin, const aiVector3D& boundsMax, unsigned int positionBits) {
+	aiVector3D step;
+	for (unsigned int c = 0; c < 3; c++) {
+		step[c] = (boundsMax[c] - boundsMin[c]) / ((1u << positionBits) - 1);
+	}
+	return step;
+}
+
+//------------------------------------------------------------
+// Snap the positions of a mesh to the quantization grid of its bounds, and the normals to 16-bit octahedral
+// coordinates, so that the vertices that the optimized model file cannot tell apart are welded.
+void quantizeMesh(aiMesh* mesh, unsigned int positionBits) {
+	if (positionBits > 0 && positionBits <= 16) {
+		aiVector3D boundsMin, boundsMax;
+		getMeshBounds(mesh, boundsMin, boundsMax);
+		aiVector3D step = getQuantizationStep(boundsMin, boundsMax, positionBits);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				if (step[c] > 0) {
+					float grid = floor((mesh->mVertices[i][c] - boundsMin[c]) / step[c] + 0.5f);
+					mesh->mVertices[i][c] = boundsMin[c] + grid * step[c];
+				} else {
+					mesh->mVertices[i][c] = boundsMin[c];
+				}
+			}
+		}
+	}
+
+	if (mesh->HasNormals()) {
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+			short encoded[2];
+			encodeOctahedral(mesh->mNormals[i], encoded);
+			mesh->mNormals[i] = decodeOctahedral(encoded);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Replace the vertex attributes of a mesh by the vertices listed in order[] (indices of the old vertices),
+// and the face indices by remap[] (the new index of each old vertex).
+void remapMeshVertices(aiMesh* mesh, const vector<unsigned int>& order, const vector<unsigned int>& remap) {
+	unsigned int vertexCount = (unsigned int) order.size();
+	aiVector3D** attributes[] = { &mesh->mVertices, &mesh->mNormals, &mesh->mTextureCoords[0] };
+	for (unsigned int a = 0; a < 3; a++) {
+		aiVector3D* oldValues = *attributes[a];
+		if (!oldValues) {
+			continue;
+		}
+		aiVector3D* newValues = new aiVector3D[vertexCount];
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			newValues[i] = oldValues[order[i]];
+		}
+		delete[] oldValues;
+		*attributes[a] = newValues;
+	}
+	mesh->mNumVertices = vertexCount;
+
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		aiFace& face = mesh->mFaces[i];
+		for (unsigned int k = 0; k < face.mNumIndices; k++) {
+			face.mIndices[k] = remap[face.mIndices[k]];
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Join the vertices of a mesh that have the same position, normal and texture coordinates.
+// The vertices are sorted by their attributes, so that identical vertices end up next to each other; the
+// first of each run is kept, in the original order.
+unsigned int weldMesh(aiMesh* mesh) {
+	unsigned int vertexCount = mesh->mNumVertices;
+	if (vertexCount == 0) {
+		return 0;
+	}
+
+	const unsigned int keySize = 8;
+	vector<float> keys((size_t) keySize * vertexCount, 0.0f);
+	for (unsigned int i = 0; i < vertexCount; i++) {
+		float* key = &keys[(size_t) keySize * i];
+		memcpy(key, &mesh->mVertices[i], sizeof(float) * 3);
+		if (mesh->mNormals) {
+			memcpy(key + 3, &mesh->mNormals[i], sizeof(float) * 3);
+		}
+		if (mesh->mTextureCoords[0]) {
+			memcpy(key + 6, &mesh->mTextureCoords[0][i], sizeof(float) * 2);
+		}
+		// -0 and 0 are the same vertex.
+		for (unsigned int k = 0; k < keySize; k++) {
+			key[k] += 0.0f;
+		}
+	}
+
+	vector<unsigned int> sorted(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++) {
+		sorted[i] = i;
+	}
+	sort(sorted.begin(), sorted.end(), [&keys](unsigned int a, unsigned int b) {
+		int order = memcmp(&keys[(size_t) keySize * a], &keys[(size_t) keySize * b], sizeof(float) * keySize);
+		return order < 0 || (order == 0 && a < b);
+	});
+
+	// Each vertex points to the first vertex with the same key.
+	vector<unsigned int> first(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++) {
+		bool same = i > 0 && memcmp(&keys[(size_t) keySize * sorted[i]], &keys[(size_t) keySize * sorted[i - 1]],
+			sizeof(float) * keySize) == 0;
+		first[sorted[i]] = same ? first[sorted[i - 1]] : sorted[i];
+	}
+
+	vector<unsigned int> order, remap(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++) {
+		if (first[i] == i) {
+			remap[i] = (unsigned int) order.size();
+			order.push_back(i);
+		} else {
+			remap[i] = remap[first[i]];
+		}
+	}
+	if (order.size() == vertexCount) {
+		return 0;
+	}
+	remapMeshVertices(mesh, order, remap);
+	return vertexCount - mesh->mNumVertices;
+}
+
+//------------------------------------------------------------
+// True if every face of a mesh is a triangle.
+bool isTriangleMesh(const aiMesh* mesh) {
+	if (mesh->mNumFaces == 0) {
+		return false;
+	}
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		if (mesh->mFaces[i].mNumIndices != 3) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// The score of a vertex in Forsyth's algorithm: vertices recently used (but not by the last triangle, which
+// gets a fixed score) and vertices with few triangles left are preferred.
+float getVertexCacheScore(int cachePosition, unsigned int remainingTriangles) {
+	if (remainingTriangles == 0) {
+		return -1;
+	}
+	float score = 0;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			score = 0.75f;
+		} else {
+			score = pow(1 - (cachePosition - 3) / (float) (VERTEX_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+	return score + 2.0f / sqrt((float) remainingTriangles);
+}
+
+//------------------------------------------------------------
+// Reorder triangles (3 indices each) for an LRU vertex cache of VERTEX_CACHE_SIZE vertices, with Forsyth's
+// linear-speed algorithm: the next triangle is the one with the best score among the triangles of the vertices
+// in the cache, or the next triangle not drawn yet if none of them is left.
+void optimizeVertexCache(vector<unsigned int>& indices, unsigned int vertexCount) {
+	unsigned int triangleCount = (unsigned int) (indices.size() / 3);
+
+	// The triangles of each vertex, as ranges of vertexTriangles[].
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++) {
+		remaining[indices[i]]++;
+	}
+	vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	}
+	vector<unsigned int> vertexTriangles(indices.size());
+	vector<unsigned int> filled(vertexCount, 0);
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		for (unsigned int k = 0; k < 3; k++) {
+			unsigned int v = indices[3 * t + k];
+			vertexTriangles[firstTriangle[v] + filled[v]++] = t;
+		}
+	}
+
+	vector<int> cachePositions(vertexCount, -1);
+	vector<float> vertexScores(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		vertexScores[v] = getVertexCacheScore(-1, remaining[v]);
+	}
+	vector<float> triangleScores(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+	}
+	vector<bool> drawn(triangleCount, false);
+
+	vector<unsigned int> output;
+	output.reserve(indices.size());
+	vector<unsigned int> cache, newCache;
+	unsigned int nextUndrawn = 0;
+	int bestTriangle = -1;
+	for (unsigned int step = 0; step < triangleCount; step++) {
+		if (bestTriangle < 0) {
+			while (drawn[nextUndrawn]) {
+				nextUndrawn++;
+			}
+			bestTriangle = (int) nextUndrawn;
+		}
+
+		// Draw the triangle: take it out of the lists of its vertices and move them to the front of the cache.
+		unsigned int t = (unsigned int) bestTriangle;
+		drawn[t] = true;
+		newCache.clear();
+		for (unsigned int k = 0; k < 3; k++) {
+			unsigned int v = indices[3 * t + k];
+			output.push_back(v);
+			unsigned int* triangles = &vertexTriangles[firstTriangle[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++) {
+				if (triangles[j] == t) {
+					triangles[j] = triangles[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+			if (find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+				newCache.push_back(v);
+			}
+		}
+		for (unsigned int i = 0; i < cache.size(); i++) {
+			unsigned int v = cache[i];
+			if (v != indices[3 * t] && v != indices[3 * t + 1] && v != indices[3 * t + 2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		// Update the scores of the vertices in the cache (and of those that just fell out of it), and of their
+		// triangles, and pick the best of those triangles.
+		bestTriangle = -1;
+		float bestScore = -1;
+		for (unsigned int i = 0; i < newCache.size(); i++) {
+			unsigned int v = newCache[i];
+			cachePositions[v] = i < VERTEX_CACHE_SIZE ? (int) i : -1;
+			float score = getVertexCacheScore(cachePositions[v], remaining[v]);
+			float change = score - vertexScores[v];
+			vertexScores[v] = score;
+			for (unsigned int j = 0; j < remaining[v]; j++) {
+				unsigned int triangle = vertexTriangles[firstTriangle[v] + j];
+				triangleScores[triangle] += change;
+				if (i < VERTEX_CACHE_SIZE && triangleScores[triangle] > bestScore) {
+					bestScore = triangleScores[triangle];
+					bestTriangle = (int) triangle;
+				}
+			}
+		}
+		if (newCache.size() > VERTEX_CACHE_SIZE) {
+			newCache.resize(VERTEX_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+	}
+	indices.swap(output);
+}
+
+//------------------------------------------------------------
+// Count the vertices transformed by a FIFO cache of cacheSize vertices for a list of indices.
+// If clusterStarts is given, it receives the triangles where all three vertices miss the cache.
+unsigned long long simulateVertexCache(const vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize,
+	vector<unsigned int>* clusterStarts = NULL) {
+	vector<unsigned long long> cachedAt(vertexCount, 0);   // the miss count when the vertex entered the cache, + 1
+	unsigned long long misses = 0;
+	for (size_t t = 0; t < indices.size() / 3; t++) {
+		unsigned int triangleMisses = 0;
+		for (unsigned int k = 0; k < 3; k++) {
+			unsigned int v = indices[3 * t + k];
+			if (cachedAt[v] == 0 || misses + 1 - cachedAt[v] >= cacheSize) {
+				misses++;
+				cachedAt[v] = misses;
+				triangleMisses++;
+			}
+		}
+		if (clusterStarts && triangleMisses == 3) {
+			clusterStarts->push_back((unsigned int) t);
+		}
+	}
+	return misses;
+}
+
+//------------------------------------------------------------
+// Reorder the clusters of a cache-ordered list of triangles so that the clusters facing away from the center
+// of the mesh come first: they are more likely to be in front of the rest of the mesh, whatever the view.
+void optimizeOverdraw(vector<unsigned int>& indices, const aiVector3D* positions, unsigned int vertexCount) {
+	unsigned int triangleCount = (unsigned int) (indices.size() / 3);
+	vector<unsigned int> flushes;
+	simulateVertexCache(indices, vertexCount, VERTEX_CACHE_STATISTICS_SIZE, &flushes);
+
+	vector<unsigned int> clusterStarts;
+	for (unsigned int i = 0; i < flushes.size(); i++) {
+		if (clusterStarts.empty() || flushes[i] >= clusterStarts.back() + OVERDRAW_MIN_CLUSTER_TRIANGLES) {
+			clusterStarts.push_back(flushes[i]);
+		}
+	}
+	if (clusterStarts.empty() || clusterStarts[0] != 0) {
+		clusterStarts.insert(clusterStarts.begin(), 0u);
+	}
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// The centroid and the (area-weighted) normal of each cluster, and the centroid of the mesh.
+	unsigned int clusterCount = (unsigned int) clusterStarts.size() - 1;
+	vector<aiVector3D> clusterCentroids(clusterCount), clusterNormals(clusterCount);
+	vector<float> clusterAreas(clusterCount, 0.0f);
+	aiVector3D meshCentroid(0);
+	float meshArea = 0;
+	for (unsigned int c = 0; c < clusterCount; c++) {
+		for (unsigned int t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const aiVector3D& a = positions[indices[3 * t]];
+			const aiVector3D& b = positions[indices[3 * t + 1]];
+			const aiVector3D& d = positions[indices[3 * t + 2]];
+			aiVector3D normal = (b - a) ^ (d - a);
+			float area = normal.Length();
+			clusterCentroids[c] += (a + b + d) * (area / 3);
+			clusterNormals[c] += normal;
+			clusterAreas[c] += area;
+		}
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterAreas[c];
+	}
+	if (meshArea > 0) {
+		meshCentroid /= meshArea;
+	}
+
+	vector<pair<float, unsigned int> > order(clusterCount);
+	for (unsigned int c = 0; c < clusterCount; c++) {
+		float score = 0;
+		if (clusterAreas[c] > 0 && clusterNormals[c].SquareLength() > 0) {
+			aiVector3D centroid = clusterCentroids[c] * (1 / clusterAreas[c]);
+			score = (centroid - meshCentroid) * clusterNormals[c].Normalize();
+		}
+		order[c] = make_pair(-score, c);
+	}
+	stable_sort(order.begin(), order.end());
+
+	vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (unsigned int i = 0; i < clusterCount; i++) {
+		unsigned int c = order[i].second;
+		output.insert(output.end(), indices.begin() + 3 * (size_t) clusterStarts[c], indices.begin() + 3 * (size_t) clusterStarts[c + 1]);
+	}
+	indices.swap(output);
+}
+
+//------------------------------------------------------------
+// Reorder the triangles of a mesh for the vertex cache, and then to reduce overdraw.
+bool optimizeTriangleOrder(aiMesh* mesh) {
+	if (!isTriangleMesh(mesh) || !mesh->HasPositions()) {
+		return false;
+	}
+
+	vector<unsigned int> indices(3 * (size_t) mesh->mNumFaces);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		memcpy(&indices[3 * (size_t) i], mesh->mFaces[i].mIndices, sizeof(unsigned int) * 3);
+	}
+	optimizeVertexCache(indices, mesh->mNumVertices);
+	optimizeOverdraw(indices, mesh->mVertices, mesh->mNumVertices);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		memcpy(mesh->mFaces[i].mIndices, &indices[3 * (size_t) i], sizeof(unsigned int) * 3);
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Renumber the vertices of a mesh in the order its faces first use them, so that the vertex fetches of
+// consecutive triangles are close together in memory.
+void optimizeVertexFetch(aiMesh* mesh) {
+	vector<unsigned int> order, remap(mesh->mNumVertices, ~0u);
+	order.reserve(mesh->mNumVertices);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		for (unsigned int k = 0; k < face.mNumIndices; k++) {
+			if (remap[face.mIndices[k]] == ~0u) {
+				remap[face.mIndices[k]] = (unsigned int) order.size();
+				order.push_back(face.mIndices[k]);
+			}
+		}
+	}
+	remapMeshVertices(mesh, order, remap);
+}
+
+//------------------------------------------------------------
+// The average number of vertices transformed per triangle (ACMR) with a FIFO cache of cacheSize vertices.
+// Returns 0 if the mesh is not made only of triangles.
+float getAverageCacheMissRatio(const aiMesh* mesh, unsigned int cacheSize) {
+	if (!isTriangleMesh(mesh)) {
+		return 0;
+	}
+	vector<unsigned int> indices(3 * (size_t) mesh->mNumFaces);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		memcpy(&indices[3 * (size_t) i], mesh->mFaces[i].mIndices, sizeof(unsigned int) * 3);
+	}
+	return (float) simulateVertexCache(indices, mesh->mNumVertices, cacheSize) / mesh->mNumFaces;
+}
+
+//------------------------------------------------------------
+// The hash of what a material draws with: its diffuse color and the path of its diffuse texture.
+unsigned long long hashMaterialAppearance(const aiMaterial* material) {
+	aiColor3D diffuse(0.0f, 0.0f, 0.0f);
+	material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+	aiString texturePath;
+	material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath);
+	unsigned long long hash = hashBytes(&diffuse, sizeof(diffuse));
+	return hashBytes(texturePath.C_Str(), texturePath.length, hash);
+}
+
+//------------------------------------------------------------
+// Join the materials of a scene that have the same diffuse color and diffuse texture, and point the meshes at
+// the first of each group.
+unsigned int removeDuplicateMaterials(aiScene* scene) {
+	vector<unsigned int> remap(scene->mNumMaterials);
+	vector<unsigned long long> hashes;
+	unsigned int keptCount = 0;
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		unsigned long long hash = hashMaterialAppearance(scene->mMaterials[i]);
+		unsigned int kept = (unsigned int) (find(hashes.begin(), hashes.end(), hash) - hashes.begin());
+		if (kept == hashes.size()) {
+			hashes.push_back(hash);
+			scene->mMaterials[keptCount++] = scene->mMaterials[i];
+		} else {
+			delete scene->mMaterials[i];
+		}
+		remap[i] = kept;
+	}
+
+	unsigned int removedCount = scene->mNumMaterials - keptCount;
+	scene->mNumMaterials = keptCount;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		scene->mMeshes[i]->mMaterialIndex = remap[scene->mMeshes[i]->mMaterialIndex];
+	}
+	return removedCount;
+}
@@ -0,0 +1,118 @@
+/* This is a utility program that helps OpenGL programmers draw meshes that mix points, lines and triangles.
+aiMesh::mPrimitiveTypes may contain more than one primitive type, and then the faces of a mesh do not all have
+the same number of indices. This file sorts the face indices of a mesh by primitive type with a counting sort,
+so that the points, the lines and the triangles each take one contiguous range of the index buffer. Each range
+is then drawn with one call in the matching mode (GL_POINTS, GL_LINES or GL_TRIANGLES).
+Polygons with more than three indices are split into a fan of triangles.
+The following functions are provided.
+
+// Count the indices of each primitive type of a mesh, and where each range starts.
+PrimitiveRanges getPrimitiveRanges(const aiMesh* mesh)
+
+// Copy the face indices of a mesh into indices[], sorted by primitive type. indices[] must have room for
+// ranges.indexCount indices.
+void sortFaceIndices(const aiMesh* mesh, const PrimitiveRanges& ranges, unsigned int* indices)
+
+// The OpenGL draw mode of a primitive type.
+GLenum getPrimitiveMode(unsigned int type)
+
+*/
+
+enum PrimitiveType { PRIMITIVE_POINTS, PRIMITIVE_LINES, PRIMITIVE_TRIANGLES, PRIMITIVE_TYPE_COUNT };
+
+struct PrimitiveRanges {
+	unsigned int first[PRIMITIVE_TYPE_COUNT];   // the first index of each range, in the order of PrimitiveType
+	unsigned int count[PRIMITIVE_TYPE_COUNT];   // the number of indices of each range
+	unsigned int indexCount;                    // all the indices of the mesh
+};
+
+//------------------------------------------------------------
+// The primitive type of a face, and the number of indices it adds to its range.
+// A polygon with n indices is drawn as n - 2 triangles.
+unsigned int getFacePrimitiveType(const aiFace& face, unsigned int& indexCount) {
+	if (face.mNumIndices == 1) {
+		indexCount = 1;
+		return PRIMITIVE_POINTS;
+	}
+	if (face.mNumIndices == 2) {
+		indexCount = 2;
+		return PRIMITIVE_LINES;
+	}
+	indexCount = face.mNumIndices < 3 ? 0 : 3 * (face.mNumIndices - 2);
+	return PRIMITIVE_TRIANGLES;
+}
+
+//------------------------------------------------------------
+// Count the indices of each primitive type of a mesh. This is the counting pass of the counting sort.
+PrimitiveRanges getPrimitiveRanges(const aiMesh* mesh) {
+	PrimitiveRanges ranges;
+	for (unsigned int type = 0; type < PRIMITIVE_TYPE_COUNT; type++) {
+		ranges.count[type] = 0;
+	}
+
+	// A mesh with only one primitive type does not need to look at every face.
+	unsigned int types = mesh->mPrimitiveTypes;
+	if (types == aiPrimitiveType_POINT || types == aiPrimitiveType_LINE || types == aiPrimitiveType_TRIANGLE) {
+		unsigned int indexCount;
+		unsigned int type = mesh->HasFaces() ? getFacePrimitiveType(mesh->mFaces[0], indexCount) : (unsigned int) PRIMITIVE_TRIANGLES;
+		ranges.count[type] = mesh->HasFaces() ? mesh->mNumFaces * indexCount : 0;
+	} else {
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+			unsigned int indexCount;
+			unsigned int type = getFacePrimitiveType(mesh->mFaces[i], indexCount);
+			ranges.count[type] += indexCount;
+		}
+	}
+
+	ranges.indexCount = 0;
+	for (unsigned int type = 0; type < PRIMITIVE_TYPE_COUNT; type++) {
+		ranges.first[type] = ranges.indexCount;
+		ranges.indexCount += ranges.count[type];
+	}
+	return ranges;
+}
+
+//------------------------------------------------------------
+// Copy the face indices of a mesh into indices[], sorted by primitive type.
+// This is the scatter pass of the counting sort: each face is written at the current end of its range,
+// so the faces of each type keep their order.
+void sortFaceIndices(const aiMesh* mesh, const PrimitiveRanges& ranges, unsigned int* indices) {
+	unsigned int next[PRIMITIVE_TYPE_COUNT];
+	for (unsigned int type = 0; type < PRIMITIVE_TYPE_COUNT; type++) {
+		next[type] = ranges.first[type];
+	}
+
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		unsigned int indexCount;
+		unsigned int type = getFacePrimitiveType(face, indexCount);
+		unsigned int* output = indices + next[type];
+		next[type] += indexCount;
+
+		if (type != PRIMITIVE_TRIANGLES) {
+			for (unsigned int k = 0; k < face.mNumIndices; k++) {
+				output[k] = face.mIndices[k];
+			}
+			continue;
+		}
+
+		// A triangle is a fan of one; a polygon is split around its first vertex.
+		for (unsigned int k = 2; k < face.mNumIndices; k++) {
+			*output++ = face.mIndices[0];
+			*output++ = face.mIndices[k - 1];
+			*output++ = face.mIndices[k];
+		}
+	}
+}
+
+//------------------------------------------------------------
+// The OpenGL draw mode of a primitive type.
+GLenum getPrimitiveMode(unsigned int type) {
+	if (type == PRIMITIVE_POINTS) {
+		return GL_POINTS;
+	}
+	if (type == PRIMITIVE_LINES) {
+		return GL_LINES;
+	}
+	return GL_TRIANGLES;
+}
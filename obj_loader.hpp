@@ -0,0 +1,810 @@
+/* This is a utility program that helps OpenGL programmers load large Wavefront OBJ files quickly.
+Assimp's OBJ importer reads a file one line at a time on one thread. This loader memory-maps the file, splits it
+into chunks at line boundaries and parses the chunks on all the threads, with its own number parsers. The chunks
+are then merged: one mesh per object (o or g) and material, as Assimp makes them, with the polygons split into
+triangles and the vertices that share a position and a texture coordinate joined, as aiProcess_Triangulate and
+aiProcess_JoinIdenticalVertices do. The meshes are also built in parallel, and a large mesh joins its vertices on
+all the threads. The faces of each mesh share one index array, as in binary_mesh_loader.hpp. The result is an
+ordinary aiScene, so the rest of the program does not know which loader made it.
+Files that use anything else (free-form curves and surfaces, points and lines, line continuations) are left to
+Assimp: the loader then returns NULL.
+The following functions are provided.
+
+// True if the file name ends in .obj (in any case).
+bool isObjFileName(const string& fileName)
+
+// Load an OBJ file and its MTL files. Returns NULL if the file cannot be opened or uses a feature this loader
+// does not support; the caller then loads it with Assimp. The caller owns the scene, and must delete it with
+// releaseScene() (see binary_mesh_loader.hpp).
+aiScene* loadObjFile(const string& fileName)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp and binary_mesh_loader.hpp to be
+included first.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Files are split into about this many bytes per chunk (but at least one chunk per thread).
+#define OBJ_CHUNK_SIZE (4 * 1024 * 1024)
+
+// A corner of a face without a texture coordinate.
+#define OBJ_NO_INDEX 0x7FFFFFFF
+
+// Meshes with at least this many triangles are built one at a time, each on all the threads. The smaller meshes
+// are built in parallel, one per thread.
+#define OBJ_PARALLEL_MESH_TRIANGLES (256 * 1024)
+
+// A mesh that is built on all the threads joins its vertices in this many partitions, chosen by the hash of the
+// position and texture coordinate, so that each thread joins whole partitions with a hash table of its own.
+#define OBJ_VERTEX_PARTITIONS 64
+
+// The triangles and vertices of a mesh are handed to the threads in blocks of this many.
+#define OBJ_BLOCK_SIZE 65536
+
+// Indices that count back from the end of the vertex list are stored relative to the start of their chunk,
+// minus this, so that they are negative even if they point into an earlier chunk.
+#define OBJ_RELATIVE_INDEX_BASE (1 << 30)
+
+// Where the faces of one object and material start within a chunk.
+struct ObjFaceRun {
+	size_t firstTriangle;
+	unsigned int object;         // the o and g lines before the run, counted from the start of the chunk
+	bool hasMaterial;            // false if the run continues the material of the previous chunk
+	string material;
+};
+
+// What one thread has parsed from its chunk. Indices that are relative to the end of the vertex list
+// (negative in the file) are stored as i - OBJ_RELATIVE_INDEX_BASE, where i counts from the start of the chunk.
+struct ObjChunk {
+	const char* begin;
+	const char* end;
+	vector<float> positions;     // 3 per vertex
+	vector<float> texCoords;     // 2 per texture coordinate
+	vector<int> positionIndices; // 3 per triangle
+	vector<int> texCoordIndices; // 3 per triangle; OBJ_NO_INDEX if the corner has no texture coordinate
+	vector<ObjFaceRun> runs;
+	vector<string> materialLibraries;
+	unsigned int objectCount;
+	string unsupported;          // the first keyword the loader cannot handle, if any
+	unsigned int unsupportedLine;
+};
+
+// One mesh of the scene: the runs of triangles that belong to it, as (chunk, first triangle, end triangle).
+struct ObjMeshSource {
+	unsigned int material;
+	vector<unsigned int> chunks;
+	vector<size_t> firstTriangles;
+	vector<size_t> endTriangles;
+	size_t triangleCount;
+};
+
+//------------------------------------------------------------
+// True if the file name ends in .obj.
+bool isObjFileName(const string& fileName) {
+	if (fileName.length() < 4) {
+		return false;
+	}
+	string extension = fileName.substr(fileName.length() - 4);
+	for (unsigned int i = 0; i < extension.length(); i++) {
+		extension[i] = (char) tolower((unsigned char) extension[i]);
+	}
+	return extension == ".obj";
+}
+
+//------------------------------------------------------------
+// Skip spaces and tabs.
+inline void skipObjSpaces(const char*& p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+}
+
+// Parse a decimal number such as -1.25e-3. This is what strtod() does, without the locale and without
+// the null-terminated string. Up to 19 significant digits are kept, which is more than a float needs.
+inline float parseObjFloat(const char*& p, const char* end) {
+	static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	skipObjSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa > 0;
+		} else {
+			exponent++;
+		}
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa > 0;
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negativeExponent = *p == '-';
+			p++;
+		}
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			value = min(value * 10 + (*p - '0'), 10000);
+			p++;
+		}
+		exponent += negativeExponent ? -value : value;
+	}
+
+	double result = (double) mantissa;
+	if (exponent < 0) {
+		result = exponent >= -22 ? result / powersOfTen[-exponent] : result * pow(10.0, exponent);
+	} else if (exponent > 0) {
+		result = exponent <= 22 ? result * powersOfTen[exponent] : result * pow(10.0, exponent);
+	}
+	return (float) (negative ? -result : result);
+}
+
+// Parse a face index such as 12 or -3. Returns false if there is no number.
+inline bool parseObjIndex(const char*& p, const char* end, int& index) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9') {
+		return false;
+	}
+	long long value = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		value = min(value * 10 + (*p - '0'), 0x7FFFFFFFLL);
+		p++;
+	}
+	index = (int) (negative ? -value : value);
+	return true;
+}
+
+// The rest of the line, without the spaces at either end.
+string getObjLineRest(const char* p, const char* end) {
+	skipObjSpaces(p, end);
+	const char* lineEnd = p;
+	while (lineEnd < end && *lineEnd != '\n') {
+		lineEnd++;
+	}
+	while (lineEnd > p && (lineEnd[-1] == ' ' || lineEnd[-1] == '\t' || lineEnd[-1] == '\r')) {
+		lineEnd--;
+	}
+	return string(p, lineEnd);
+}
+
+// Turn an index from the file into the form stored in ObjChunk: 0-based absolute, or relative to the start
+// of the chunk if the index counts back from the end.
+inline int storeObjIndex(int index, size_t chunkCount) {
+	if (index > 0) {
+		return index - 1;
+	}
+	return (int) chunkCount + index - OBJ_RELATIVE_INDEX_BASE;
+}
+
+//------------------------------------------------------------
+// Start a new run of faces, or change the run that has no faces yet.
+void startObjFaceRun(ObjChunk& chunk, bool newObject, const string* material) {
+	size_t triangleCount = chunk.positionIndices.size() / 3;
+	if (newObject) {
+		chunk.objectCount++;
+	}
+	if (chunk.runs.empty() || chunk.runs.back().firstTriangle != triangleCount) {
+		ObjFaceRun run;
+		run.firstTriangle = triangleCount;
+		run.object = chunk.objectCount;
+		run.hasMaterial = chunk.runs.empty() ? false : chunk.runs.back().hasMaterial;
+		run.material = chunk.runs.empty() ? string() : chunk.runs.back().material;
+		chunk.runs.push_back(run);
+	}
+	chunk.runs.back().object = chunk.objectCount;
+	if (material) {
+		chunk.runs.back().hasMaterial = true;
+		chunk.runs.back().material = *material;
+	}
+}
+
+// Parse the corners of a face line and add it as a fan of triangles.
+bool parseObjFace(ObjChunk& chunk, const char*& p, const char* end) {
+	int positions[3], texCoords[3];
+	unsigned int cornerCount = 0;
+	size_t positionCount = chunk.positions.size() / 3;
+	size_t texCoordCount = chunk.texCoords.size() / 2;
+
+	while (true) {
+		skipObjSpaces(p, end);
+		if (p >= end || *p == '\n' || *p == '\r' || *p == '#') {
+			break;
+		}
+
+		int position, texCoord = OBJ_NO_INDEX, normal;
+		if (!parseObjIndex(p, end, position) || position == 0) {
+			return false;
+		}
+		position = storeObjIndex(position, positionCount);
+		if (p < end && *p == '/') {
+			p++;
+			if (parseObjIndex(p, end, texCoord)) {
+				texCoord = storeObjIndex(texCoord, texCoordCount);
+			}
+			if (p < end && *p == '/') {
+				p++;
+				parseObjIndex(p, end, normal);
+			}
+		}
+
+		// The first corner is shared by all the triangles of the fan.
+		if (cornerCount < 3) {
+			positions[cornerCount] = position;
+			texCoords[cornerCount] = texCoord;
+		} else {
+			positions[1] = positions[2];
+			texCoords[1] = texCoords[2];
+			positions[2] = position;
+			texCoords[2] = texCoord;
+		}
+		cornerCount++;
+		if (cornerCount >= 3) {
+			for (unsigned int k = 0; k < 3; k++) {
+				chunk.positionIndices.push_back(positions[k]);
+				chunk.texCoordIndices.push_back(texCoords[k]);
+			}
+		}
+	}
+	return true;
+}
+
+// Parse the lines of a chunk.
+void parseObjChunk(ObjChunk& chunk) {
+	chunk.objectCount = 0;
+	chunk.unsupportedLine = 0;
+	startObjFaceRun(chunk, false, NULL);
+
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	unsigned int line = 0;
+	while (p < end) {
+		line++;
+		skipObjSpaces(p, end);
+		const char* keyword = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+			p++;
+		}
+		size_t keywordLength = p - keyword;
+
+		if (keywordLength == 0 || *keyword == '#') {
+			// An empty line or a comment.
+		} else if (keywordLength == 1 && *keyword == 'v') {
+			for (unsigned int c = 0; c < 3; c++) {
+				chunk.positions.push_back(parseObjFloat(p, end));
+			}
+		} else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+			chunk.texCoords.push_back(parseObjFloat(p, end));
+			skipObjSpaces(p, end);
+			chunk.texCoords.push_back(p < end && *p != '\n' && *p != '\r' ? parseObjFloat(p, end) : 0.0f);
+		} else if (keywordLength == 1 && *keyword == 'f') {
+			if (!parseObjFace(chunk, p, end)) {
+				chunk.unsupported = "malformed face";
+			}
+		} else if (keywordLength == 1 && (*keyword == 'o' || *keyword == 'g')) {
+			startObjFaceRun(chunk, true, NULL);
+		} else if (keywordLength == 6 && memcmp(keyword, "usemtl", 6) == 0) {
+			string material = getObjLineRest(p, end);
+			startObjFaceRun(chunk, false, &material);
+		} else if (keywordLength == 6 && memcmp(keyword, "mtllib", 6) == 0) {
+			chunk.materialLibraries.push_back(getObjLineRest(p, end));
+		} else if ((keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n') || (keywordLength == 1 && *keyword == 's')) {
+			// Normals are not used by this program, and smoothing groups only matter for normals.
+		} else {
+			chunk.unsupported = string(keyword, keywordLength);
+		}
+
+		if (!chunk.unsupported.empty()) {
+			chunk.unsupportedLine = line;
+			return;
+		}
+
+		// Go to the next line. A backslash at the end of a line continues it, which is not supported.
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n') {
+			lineEnd++;
+		}
+		const char* last = lineEnd;
+		while (last > p && (last[-1] == '\r' || last[-1] == ' ' || last[-1] == '\t')) {
+			last--;
+		}
+		if (last > p && last[-1] == '\\') {
+			chunk.unsupported = "line continuation";
+			chunk.unsupportedLine = line;
+			return;
+		}
+		p = lineEnd + 1;
+	}
+}
+
+//------------------------------------------------------------
+// Load the materials of an MTL file: the name, the diffuse color and the diffuse texture of each.
+// Texture file names are made relative to the OBJ file, as the rest of the program expects.
+void loadObjMaterialLibrary(const string& objFileName, const string& libraryName, vector<aiMaterial*>& materials,
+	unordered_map<string, unsigned int>& materialIndices) {
+	MappedFile mappedFile;
+	string fileName = getDirectoryName(objFileName) + libraryName;
+	if (!mapFile(fileName, mappedFile)) {
+		cout << "loadObjFile(): unable to open " << fileName << endl;
+		return;
+	}
+
+	const char* p = (const char*) mappedFile.data;
+	const char* end = p + mappedFile.size;
+	aiMaterial* material = NULL;
+	while (p < end) {
+		skipObjSpaces(p, end);
+		const char* keyword = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+			p++;
+		}
+		string name(keyword, p);
+
+		if (name == "newmtl") {
+			string materialName = getObjLineRest(p, end);
+			material = new aiMaterial();
+			aiString nameString(materialName);
+			material->AddProperty(&nameString, AI_MATKEY_NAME);
+			materialIndices[materialName] = (unsigned int) materials.size();
+			materials.push_back(material);
+		} else if (material && name == "Kd") {
+			aiColor3D color;
+			color.r = parseObjFloat(p, end);
+			color.g = parseObjFloat(p, end);
+			color.b = parseObjFloat(p, end);
+			material->AddProperty(&color, 1, AI_MATKEY_COLOR_DIFFUSE);
+		} else if (material && name == "map_Kd") {
+			// Options such as -s 1 1 1 come before the file name.
+			string rest = getObjLineRest(p, end);
+			size_t separator = rest.find_last_of(" \t");
+			aiString path(getDirectoryName(libraryName) + (separator == string::npos ? rest : rest.substr(separator + 1)));
+			material->AddProperty(&path, AI_MATKEY_TEXTURE_DIFFUSE(0));
+		}
+
+		while (p < end && *p != '\n') {
+			p++;
+		}
+		p++;
+	}
+	unmapFile(mappedFile);
+}
+
+//------------------------------------------------------------
+// Copy the corners of the triangles [first, end) of a mesh, counted over all its runs (runStarts[r] is the
+// first triangle of run r). With keys, the position and texture coordinate of each corner are packed into
+// keys[]; without, the position is written to indices[] as the vertex index.
+void gatherObjCorners(const vector<ObjChunk>& chunks, const ObjMeshSource& source, const vector<size_t>& runStarts,
+	size_t first, size_t end, unsigned int* indices, unsigned long long* keys) {
+	size_t r = upper_bound(runStarts.begin(), runStarts.end(), first) - runStarts.begin() - 1;
+	for (size_t triangle = first; triangle < end; r++) {
+		const ObjChunk& chunk = chunks[source.chunks[r]];
+		size_t runEnd = min(end, runStarts[r] + source.endTriangles[r] - source.firstTriangles[r]);
+		for (size_t t = source.firstTriangles[r] + triangle - runStarts[r]; triangle < runEnd; triangle++, t++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				unsigned int position = (unsigned int) chunk.positionIndices[3 * t + k];
+				if (keys) {
+					unsigned int texCoord = (unsigned int) chunk.texCoordIndices[3 * t + k];
+					keys[3 * triangle + k] = ((unsigned long long) position << 32) | texCoord;
+				} else {
+					indices[3 * triangle + k] = position;
+				}
+			}
+		}
+	}
+}
+
+// The hash of a corner key. The top bits choose the partition, and the bits from 20 up the slot of the hash table.
+inline unsigned long long hashObjCorner(unsigned long long key) {
+	return key * 0x9E3779B97F4A7C15ULL;
+}
+
+// Find the slot of a key in an open-addressing hash table, or the empty slot where it goes.
+inline size_t findObjCornerSlot(const vector<unsigned long long>& tableKeys, unsigned long long key) {
+	size_t mask = tableKeys.size() - 1;
+	size_t slot = (size_t) (hashObjCorner(key) >> 20) & mask;
+	while (tableKeys[slot] != key && tableKeys[slot] != ~0ULL) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Join the corners of one partition, which corners[] lists in increasing order (NULL for all the corners of the
+// mesh): firstCorners[c] is set to the first corner with the same key as corner c. The hash table starts at
+// twice the number of vertices expected, and doubles when it is half full.
+void joinObjCorners(const unsigned long long* keys, const unsigned int* corners, size_t cornerCount,
+	size_t expectedVertices, unsigned int* firstCorners) {
+	size_t tableSize = 16;
+	while (tableSize < expectedVertices * 2) {
+		tableSize *= 2;
+	}
+	vector<unsigned long long> tableKeys(tableSize, ~0ULL);
+	vector<unsigned int> tableCorners(tableSize);
+	size_t vertexCount = 0;
+
+	for (size_t i = 0; i < cornerCount; i++) {
+		unsigned int corner = corners ? corners[i] : (unsigned int) i;
+		unsigned long long key = keys[corner];
+		size_t slot = findObjCornerSlot(tableKeys, key);
+		if (tableKeys[slot] == ~0ULL) {
+			if (2 * (vertexCount + 1) > tableKeys.size()) {
+				vector<unsigned long long> oldKeys(tableKeys.size() * 2, ~0ULL);
+				vector<unsigned int> oldCorners(tableKeys.size() * 2);
+				oldKeys.swap(tableKeys);
+				oldCorners.swap(tableCorners);
+				for (size_t k = 0; k < oldKeys.size(); k++) {
+					if (oldKeys[k] != ~0ULL) {
+						size_t newSlot = findObjCornerSlot(tableKeys, oldKeys[k]);
+						tableKeys[newSlot] = oldKeys[k];
+						tableCorners[newSlot] = oldCorners[k];
+					}
+				}
+				slot = findObjCornerSlot(tableKeys, key);
+			}
+			tableKeys[slot] = key;
+			tableCorners[slot] = corner;
+			vertexCount++;
+		}
+		firstCorners[corner] = tableCorners[slot];
+	}
+}
+
+//------------------------------------------------------------
+// Build a mesh from its runs of triangles, on threadCount threads (0 for all of them). Each distinct pair of
+// position and texture coordinate becomes one vertex, numbered in the order the pairs first appear.
+// If the mesh uses every position of the file once, with no texture coordinates or with the texture
+// coordinate of the same index (which is how many exporters write f 1/1 2/2 3/3), the positions are
+// copied as they are and the face indices need no lookup.
+// Otherwise the corners are joined in four passes over blocks of triangles: the keys of the corners are
+// gathered, sorted into partitions by hash, and joined within each partition, which finds the first corner
+// of each vertex; then the first corners are numbered, and the other corners take the number of theirs.
+// The face indices double as the first corner of each corner until they are numbered.
+aiMesh* buildObjMesh(const vector<ObjChunk>& chunks, const ObjMeshSource& source, const vector<float>& positions,
+	const vector<float>& texCoords, bool identityVertices, unsigned int threadCount) {
+	aiMesh* mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mMaterialIndex = source.material;
+	unsigned int* indices = allocateSharedFaces(mesh, (unsigned int) source.triangleCount, 3);
+
+	vector<size_t> runStarts(source.chunks.size());
+	for (unsigned int r = 1; r < source.chunks.size(); r++) {
+		runStarts[r] = runStarts[r - 1] + source.endTriangles[r - 1] - source.firstTriangles[r - 1];
+	}
+	size_t triangleCount = source.triangleCount;
+	size_t cornerCount = 3 * triangleCount;
+	unsigned int blockCount = (unsigned int) ((triangleCount + OBJ_BLOCK_SIZE - 1) / OBJ_BLOCK_SIZE);
+
+	bool hasTexCoords = !texCoords.empty();
+	vector<unsigned int> vertexPositions, vertexTexCoords;
+
+	if (identityVertices) {
+		parallelFor(blockCount, [&](unsigned int block) {
+			gatherObjCorners(chunks, source, runStarts, (size_t) block * OBJ_BLOCK_SIZE,
+				min(triangleCount, (size_t) (block + 1) * OBJ_BLOCK_SIZE), indices, NULL);
+		}, threadCount);
+		mesh->mNumVertices = (unsigned int) (positions.size() / 3);
+	} else {
+		vector<unsigned long long> keys(cornerCount);
+		parallelFor(blockCount, [&](unsigned int block) {
+			gatherObjCorners(chunks, source, runStarts, (size_t) block * OBJ_BLOCK_SIZE,
+				min(triangleCount, (size_t) (block + 1) * OBJ_BLOCK_SIZE), NULL, &keys[0]);
+		}, threadCount);
+
+		// A mesh has no more vertices than corners, and usually about as many as the positions it uses.
+		size_t expectedVertices = min(cornerCount, positions.size() / 3);
+		unsigned int partitionCount = (threadCount == 0 ? getWorkerThreadCount() : threadCount) > 1 ? OBJ_VERTEX_PARTITIONS : 1;
+		if (partitionCount == 1) {
+			joinObjCorners(&keys[0], NULL, cornerCount, expectedVertices, indices);
+		} else {
+			// Count the corners of each partition in each block, then put them in order: by partition, then by block.
+			unsigned int partitionShift = 64 - 6;
+			vector<size_t> partitionStarts((size_t) blockCount * partitionCount + 1, 0);
+			parallelFor(blockCount, [&](unsigned int block) {
+				size_t* counts = &partitionStarts[(size_t) block * partitionCount + 1];
+				for (size_t c = 3 * (size_t) block * OBJ_BLOCK_SIZE; c < min(cornerCount, 3 * (size_t) (block + 1) * OBJ_BLOCK_SIZE); c++) {
+					counts[hashObjCorner(keys[c]) >> partitionShift]++;
+				}
+			}, threadCount);
+			vector<size_t> offsets((size_t) blockCount * partitionCount);
+			size_t offset = 0;
+			for (unsigned int p = 0; p < partitionCount; p++) {
+				for (unsigned int block = 0; block < blockCount; block++) {
+					offsets[(size_t) block * partitionCount + p] = offset;
+					offset += partitionStarts[(size_t) block * partitionCount + p + 1];
+				}
+			}
+			vector<unsigned int> partitionCorners(cornerCount);
+			parallelFor(blockCount, [&](unsigned int block) {
+				size_t* blockOffsets = &offsets[(size_t) block * partitionCount];
+				for (size_t c = 3 * (size_t) block * OBJ_BLOCK_SIZE; c < min(cornerCount, 3 * (size_t) (block + 1) * OBJ_BLOCK_SIZE); c++) {
+					partitionCorners[blockOffsets[hashObjCorner(keys[c]) >> partitionShift]++] = (unsigned int) c;
+				}
+			}, threadCount);
+
+			// After the scatter, the offsets of the last block are the ends of the partitions.
+			parallelFor(partitionCount, [&](unsigned int p) {
+				size_t begin = p == 0 ? 0 : offsets[(size_t) (blockCount - 1) * partitionCount + p - 1];
+				size_t end = offsets[(size_t) (blockCount - 1) * partitionCount + p];
+				joinObjCorners(&keys[0], &partitionCorners[begin], end - begin, expectedVertices / partitionCount + 1, indices);
+			}, threadCount);
+		}
+
+		// Number the first corners in order, block by block. A first corner keeps its number in keys[].
+		vector<size_t> firstVertices(blockCount + 1, 0);
+		parallelFor(blockCount, [&](unsigned int block) {
+			for (size_t c = 3 * (size_t) block * OBJ_BLOCK_SIZE; c < min(cornerCount, 3 * (size_t) (block + 1) * OBJ_BLOCK_SIZE); c++) {
+				firstVertices[block + 1] += indices[c] == c;
+			}
+		}, threadCount);
+		for (unsigned int block = 0; block < blockCount; block++) {
+			firstVertices[block + 1] += firstVertices[block];
+		}
+		mesh->mNumVertices = (unsigned int) firstVertices[blockCount];
+		vertexPositions.resize(mesh->mNumVertices);
+		vertexTexCoords.resize(mesh->mNumVertices);
+		parallelFor(blockCount, [&](unsigned int block) {
+			size_t vertex = firstVertices[block];
+			for (size_t c = 3 * (size_t) block * OBJ_BLOCK_SIZE; c < min(cornerCount, 3 * (size_t) (block + 1) * OBJ_BLOCK_SIZE); c++) {
+				if (indices[c] == c) {
+					vertexPositions[vertex] = (unsigned int) (keys[c] >> 32);
+					vertexTexCoords[vertex] = (unsigned int) keys[c];
+					keys[c] = vertex++;
+				}
+			}
+		}, threadCount);
+		parallelFor(blockCount, [&](unsigned int block) {
+			for (size_t c = 3 * (size_t) block * OBJ_BLOCK_SIZE; c < min(cornerCount, 3 * (size_t) (block + 1) * OBJ_BLOCK_SIZE); c++) {
+				indices[c] = (unsigned int) keys[indices[c]];
+			}
+		}, threadCount);
+	}
+
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	if (hasTexCoords) {
+		mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+		mesh->mNumUVComponents[0] = 2;
+	}
+	parallelFor((mesh->mNumVertices + OBJ_BLOCK_SIZE - 1) / OBJ_BLOCK_SIZE, [&](unsigned int block) {
+		unsigned int end = min(mesh->mNumVertices, (block + 1) * OBJ_BLOCK_SIZE);
+		for (unsigned int i = block * OBJ_BLOCK_SIZE; i < end; i++) {
+			unsigned int position = identityVertices ? i : vertexPositions[i];
+			mesh->mVertices[i] = aiVector3D(positions[3 * position], positions[3 * position + 1], positions[3 * position + 2]);
+			if (hasTexCoords) {
+				unsigned int texCoord = identityVertices ? i : vertexTexCoords[i];
+				mesh->mTextureCoords[0][i] = texCoord == OBJ_NO_INDEX || 2 * (size_t) texCoord >= texCoords.size() ? aiVector3D(0, 0, 0) :
+					aiVector3D(texCoords[2 * texCoord], texCoords[2 * texCoord + 1], 0);
+			}
+		}
+	}, threadCount);
+	return mesh;
+}
+
+//------------------------------------------------------------
+// Load an OBJ file and its MTL files.
+aiScene* loadObjFile(const string& fileName) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	MappedFile mappedFile;
+	if (!mapFile(fileName, mappedFile) || mappedFile.size == 0) {
+		cout << "loadObjFile(): unable to read " << fileName << ", it is loaded by Assimp" << endl;
+		return NULL;
+	}
+
+	// Split the file into chunks that start at the beginning of a line.
+	const char* fileBegin = (const char*) mappedFile.data;
+	const char* fileEnd = fileBegin + mappedFile.size;
+	unsigned int chunkCount = (unsigned int) max((size_t) getWorkerThreadCount(), mappedFile.size / OBJ_CHUNK_SIZE);
+	vector<ObjChunk> chunks(chunkCount);
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		const char* begin = fileBegin + mappedFile.size * i / chunkCount;
+		if (i > 0) {
+			while (begin < fileEnd && begin[-1] != '\n') {
+				begin++;
+			}
+		}
+		chunks[i].begin = begin;
+		if (i > 0) {
+			chunks[i - 1].end = begin;
+		}
+	}
+	chunks[chunkCount - 1].end = fileEnd;
+
+	parallelFor(chunkCount, [&chunks](unsigned int i) {
+		parseObjChunk(chunks[i]);
+	});
+	double parseMilliseconds = elapsedMilliseconds(startTime);
+
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		if (!chunks[i].unsupported.empty()) {
+			cout << "loadObjFile(): " << chunks[i].unsupported << " (in line " << chunks[i].unsupportedLine << " of chunk " << i
+				<< ") is not supported, the file is loaded by Assimp" << endl;
+			unmapFile(mappedFile);
+			return NULL;
+		}
+	}
+
+	// Merge the vertices of the chunks, and turn the face indices into indices of the merged arrays.
+	vector<size_t> firstPositions(chunkCount + 1, 0), firstTexCoords(chunkCount + 1, 0);
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		firstPositions[i + 1] = firstPositions[i] + chunks[i].positions.size() / 3;
+		firstTexCoords[i + 1] = firstTexCoords[i] + chunks[i].texCoords.size() / 2;
+	}
+	size_t positionCount = firstPositions[chunkCount];
+	size_t texCoordCount = firstTexCoords[chunkCount];
+	if (positionCount >= 0xFFFFFFFFu || texCoordCount >= OBJ_NO_INDEX) {
+		cout << "loadObjFile(): " << fileName << " has too many vertices, it is loaded by Assimp" << endl;
+		unmapFile(mappedFile);
+		return NULL;
+	}
+
+	vector<float> positions(positionCount * 3), texCoords(texCoordCount * 2);
+	vector<char> chunkValid(chunkCount, 1), chunkIdentity(chunkCount, 1);
+	parallelFor(chunkCount, [&](unsigned int i) {
+		ObjChunk& chunk = chunks[i];
+		if (!chunk.positions.empty()) {
+			memcpy(&positions[firstPositions[i] * 3], &chunk.positions[0], sizeof(float) * chunk.positions.size());
+		}
+		if (!chunk.texCoords.empty()) {
+			memcpy(&texCoords[firstTexCoords[i] * 2], &chunk.texCoords[0], sizeof(float) * chunk.texCoords.size());
+		}
+		vector<float>().swap(chunk.positions);
+		vector<float>().swap(chunk.texCoords);
+
+		for (size_t k = 0; k < chunk.positionIndices.size(); k++) {
+			int& position = chunk.positionIndices[k];
+			position = position < 0 ? (int) firstPositions[i] + position + OBJ_RELATIVE_INDEX_BASE : position;
+			if (position < 0 || (size_t) position >= positionCount) {
+				chunkValid[i] = 0;
+			}
+			int& texCoord = chunk.texCoordIndices[k];
+			if (texCoord != OBJ_NO_INDEX) {
+				texCoord = texCoord < 0 ? (int) firstTexCoords[i] + texCoord + OBJ_RELATIVE_INDEX_BASE : texCoord;
+				if (texCoord < 0 || (size_t) texCoord >= texCoordCount) {
+					chunkValid[i] = 0;
+				}
+			}
+			if (texCoord != OBJ_NO_INDEX && texCoord != position) {
+				chunkIdentity[i] = 0;
+			}
+		}
+	});
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		if (!chunkValid[i]) {
+			cout << "loadObjFile(): a face refers to a vertex that does not exist, the file is loaded by Assimp" << endl;
+			unmapFile(mappedFile);
+			return NULL;
+		}
+	}
+
+	// The materials. A run without a usemtl line before it uses the default material, as in Assimp.
+	vector<aiMaterial*> materials;
+	unordered_map<string, unsigned int> materialIndices;
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		for (unsigned int k = 0; k < chunks[i].materialLibraries.size(); k++) {
+			loadObjMaterialLibrary(fileName, chunks[i].materialLibraries[k], materials, materialIndices);
+		}
+	}
+	unsigned int defaultMaterial = (unsigned int) materials.size();
+	aiMaterial* material = new aiMaterial();
+	aiString defaultName(string(AI_DEFAULT_MATERIAL_NAME));
+	material->AddProperty(&defaultName, AI_MATKEY_NAME);
+	materials.push_back(material);
+
+	// Collect the runs of each (object, material) pair into one mesh, in the order they first appear.
+	vector<ObjMeshSource> sources;
+	unordered_map<unsigned long long, unsigned int> sourceIndices;
+	unsigned int objectBase = 0;
+	unsigned int currentMaterial = defaultMaterial;
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		const ObjChunk& chunk = chunks[i];
+		size_t triangleCount = chunk.positionIndices.size() / 3;
+		for (unsigned int r = 0; r < chunk.runs.size(); r++) {
+			const ObjFaceRun& run = chunk.runs[r];
+			if (run.hasMaterial) {
+				unordered_map<string, unsigned int>::iterator found = materialIndices.find(run.material);
+				currentMaterial = found == materialIndices.end() ? defaultMaterial : found->second;
+			}
+			size_t endTriangle = r + 1 < chunk.runs.size() ? chunk.runs[r + 1].firstTriangle : triangleCount;
+			if (endTriangle == run.firstTriangle) {
+				continue;
+			}
+
+			unsigned long long key = ((unsigned long long) (objectBase + run.object) << 32) | currentMaterial;
+			unordered_map<unsigned long long, unsigned int>::iterator found = sourceIndices.find(key);
+			if (found == sourceIndices.end()) {
+				found = sourceIndices.insert(make_pair(key, (unsigned int) sources.size())).first;
+				sources.push_back(ObjMeshSource());
+				sources.back().material = currentMaterial;
+				sources.back().triangleCount = 0;
+			}
+			ObjMeshSource& source = sources[found->second];
+			source.chunks.push_back(i);
+			source.firstTriangles.push_back(run.firstTriangle);
+			source.endTriangles.push_back(endTriangle);
+			source.triangleCount += endTriangle - run.firstTriangle;
+		}
+		objectBase += chunk.objectCount;
+	}
+
+	bool identityVertices = sources.size() == 1 && positionCount > 0;
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		identityVertices = identityVertices && chunkIdentity[i];
+	}
+	identityVertices = identityVertices && (texCoordCount == 0 || texCoordCount == positionCount);
+
+	aiScene* scene = new aiScene();
+	scene->mNumMaterials = (unsigned int) materials.size();
+	scene->mMaterials = new aiMaterial*[scene->mNumMaterials];
+	for (unsigned int i = 0; i < materials.size(); i++) {
+		scene->mMaterials[i] = materials[i];
+	}
+
+	// The large meshes are built one at a time on all the threads, then the others in parallel.
+	scene->mNumMeshes = (unsigned int) sources.size();
+	scene->mMeshes = scene->mNumMeshes > 0 ? new aiMesh*[scene->mNumMeshes] : NULL;
+	vector<unsigned int> smallMeshes;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		if (sources[i].triangleCount >= OBJ_PARALLEL_MESH_TRIANGLES) {
+			scene->mMeshes[i] = buildObjMesh(chunks, sources[i], positions, texCoords, identityVertices, 0);
+		} else {
+			smallMeshes.push_back(i);
+		}
+	}
+	parallelFor((unsigned int) smallMeshes.size(), [&](unsigned int i) {
+		unsigned int meshIndex = smallMeshes[i];
+		scene->mMeshes[meshIndex] = buildObjMesh(chunks, sources[meshIndex], positions, texCoords, identityVertices, 1);
+	});
+
+	// One node with all the meshes, named after the file as Assimp does.
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName = aiString(fileName.substr(fileName.find_last_of("/\\") + 1));
+	scene->mRootNode->mNumMeshes = scene->mNumMeshes;
+	scene->mRootNode->mMeshes = scene->mNumMeshes > 0 ? new unsigned int[scene->mNumMeshes] : NULL;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		scene->mRootNode->mMeshes[i] = i;
+	}
+
+	// The faces of each mesh share one index array. An entry without a mapped file tells releaseScene() so.
+	scene->mMetaData = aiMetadata::Alloc(1);
+	scene->mMetaData->Set(0, MAPPED_SCENE_METADATA_KEY, (uint64_t) 0);
+
+	double milliseconds = elapsedMilliseconds(startTime);
+	double megabytes = mappedFile.size / (1024.0 * 1024.0);
+	cout << "OBJ loader: " << megabytes << " MB parsed in " << parseMilliseconds << " ms (" << megabytes * 1000.0 / max(parseMilliseconds, 1e-3)
+		<< " MB/s) on " << getWorkerThreadCount() << " threads, " << scene->mNumMeshes << " meshes built in "
+		<< milliseconds - parseMilliseconds << " ms (" << megabytes * 1000.0 / max(milliseconds, 1e-3) << " MB/s overall)" << endl;
+
+	unmapFile(mappedFile);
+	return scene;
+}
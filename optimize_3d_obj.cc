@@ -0,0 +1,259 @@
+/*
+This program converts 3D files into optimized model files (.opm), so that load_3d_obj.cc does not have to import
+and post-process them every time it starts. Each 3D file is imported by Assimp once, with the same
+post-processing as load_3d_obj.cc, and then goes through the stages of mesh_optimizer.hpp: the meshes that are
+copies of another mesh are found, the materials that draw the same are joined, the positions and normals are
+quantized, identical vertices are welded, and the triangles and vertices are reordered for the vertex cache,
+for overdraw and for vertex fetch. The result is written with optimized_model.hpp, with 16-bit indices for the
+meshes that have at most 65536 vertices.
+A directory of 3D files is converted by a pool of jobs, one 3D file per job, on all the CPU cores.
+
+Usage: optimize_3d_obj [-p positionBits] <3D file or directory> [output directory]
+The optimized model file of "name.ext" is "name.ext.opm", in the output directory if one is given and next to
+the 3D file otherwise. positionBits is the quantization of the positions (1 to 16, or 0 to store floats; 16 by
+default).
+
+This program needs the following libraries to run:
+	Assimp
+
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+#include <GL/glew.h>
+
+#include "assimp/Importer.hpp"
+#include "assimp/PostProcess.h"
+#include "assimp/Scene.h"
+
+// These header files are shared with load_3d_obj.cc.
+#include "thread_utilities.hpp"
+#include "file_utilities.hpp"
+#include "mesh_primitives.hpp"
+#include "mesh_instancing.hpp"
+
+// This header file contains the optimization stages.
+#include "mesh_optimizer.hpp"
+
+// This header file writes the optimized model files that load_3d_obj.cc loads.
+#include "optimized_model.hpp"
+
+using namespace std;
+
+// The default quantization of the positions, in bits per axis.
+const unsigned int defaultPositionBits = 16;
+
+// What happened to one 3D file.
+struct ModelOptimization {
+	string inputFileName;
+	string outputFileName;
+	bool succeeded;
+	string error;
+
+	unsigned int meshCount;
+	unsigned int copyCount;                 // meshes stored as instances of another mesh
+	unsigned int removedMaterialCount;
+	unsigned int shortIndexMeshCount;       // meshes stored with 16-bit indices
+	unsigned long long verticesBefore;      // in all the meshes
+	unsigned long long verticesAfter;       // in the meshes that are not copies
+	unsigned long long triangleCount;       // in the meshes that are not copies and are made only of triangles
+	double cacheMissesBefore;               // vertices transformed by a FIFO cache in those triangles
+	double cacheMissesAfter;
+	unsigned long long inputBytes;
+	unsigned long long outputBytes;
+	double importMilliseconds;
+	double optimizeMilliseconds;
+	double writeMilliseconds;
+};
+
+// The output lines of the jobs are not mixed together.
+mutex outputMutex;
+
+//------------------------------------------------------------
+// Count the vertices, the triangles and the cache misses of the meshes that are not copies.
+void countMeshes(const aiScene* scene, const vector<MeshInstance>& instances, unsigned long long& vertexCount,
+	unsigned long long& triangleCount, double& cacheMisses) {
+	vertexCount = 0;
+	triangleCount = 0;
+	cacheMisses = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		if (instances[i].sourceMesh != i) {
+			continue;
+		}
+		vertexCount += mesh->mNumVertices;
+		float ratio = getAverageCacheMissRatio(mesh, VERTEX_CACHE_STATISTICS_SIZE);
+		if (ratio > 0) {
+			triangleCount += mesh->mNumFaces;
+			cacheMisses += (double) ratio * mesh->mNumFaces;
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Import, optimize and write one 3D file.
+void optimizeModelFile(ModelOptimization& result, unsigned int positionBits, const string& textureDirectory) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	long long modificationTime;
+	getFileInfo(result.inputFileName, result.inputBytes, modificationTime);
+
+	// Each job has its own importer. The scene is taken from it, so that the stages can change it.
+	Assimp::Importer importer;
+	if (!importer.ReadFile(result.inputFileName, aiProcessPreset_TargetRealtime_Quality)) {
+		result.error = importer.GetErrorString();
+		return;
+	}
+	aiScene* scene = importer.GetOrphanedScene();
+	result.importMilliseconds = elapsedMilliseconds(startTime);
+	startTime = chrono::high_resolution_clock::now();
+
+	result.meshCount = scene->mNumMeshes;
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		result.verticesBefore += scene->mMeshes[i]->mNumVertices;
+	}
+
+	// The materials are joined first, as a copy of a mesh must have the same material as the mesh.
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		stripMesh(scene->mMeshes[i]);
+	}
+	result.removedMaterialCount = removeDuplicateMaterials(scene);
+	vector<MeshInstance> instances = findMeshInstances(scene);
+	unsigned long long vertexCount;
+	countMeshes(scene, instances, vertexCount, result.triangleCount, result.cacheMissesBefore);
+
+	// Only the meshes that are not copies are optimized. The copies are made from them when the file is loaded.
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		aiMesh* mesh = scene->mMeshes[i];
+		if (instances[i].sourceMesh != i) {
+			result.copyCount++;
+			continue;
+		}
+		quantizeMesh(mesh, positionBits);
+		weldMesh(mesh);
+		optimizeTriangleOrder(mesh);
+		optimizeVertexFetch(mesh);
+		if (mesh->mNumVertices <= 65536) {
+			result.shortIndexMeshCount++;
+		}
+	}
+	countMeshes(scene, instances, result.verticesAfter, result.triangleCount, result.cacheMissesAfter);
+	result.optimizeMilliseconds = elapsedMilliseconds(startTime);
+	startTime = chrono::high_resolution_clock::now();
+
+	result.succeeded = writeOptimizedModel(scene, instances, result.outputFileName, positionBits, textureDirectory);
+	if (!result.succeeded) {
+		result.error = "unable to write " + result.outputFileName;
+	}
+	getFileInfo(result.outputFileName, result.outputBytes, modificationTime);
+	result.writeMilliseconds = elapsedMilliseconds(startTime);
+	delete scene;
+}
+
+//------------------------------------------------------------
+// Print what happened to one 3D file.
+void printModelOptimization(const ModelOptimization& result) {
+	if (!result.succeeded) {
+		cout << result.inputFileName << ": " << result.error << endl;
+		return;
+	}
+
+	cout << result.inputFileName << " -> " << result.outputFileName << endl;
+	cout << "    " << result.meshCount << " meshes (" << result.copyCount << " copies, " << result.shortIndexMeshCount
+		<< " with 16-bit indices), " << result.removedMaterialCount << " duplicate materials removed" << endl;
+	cout << "    vertices " << result.verticesBefore << " -> " << result.verticesAfter;
+	if (result.triangleCount > 0) {
+		cout << ", vertices per triangle (ACMR) " << result.cacheMissesBefore / result.triangleCount << " -> "
+			<< result.cacheMissesAfter / result.triangleCount;
+	}
+	cout << endl;
+	cout << "    " << result.inputBytes / (1024.0 * 1024.0) << " MB -> " << result.outputBytes / (1024.0 * 1024.0)
+		<< " MB; import " << result.importMilliseconds << " ms, optimize " << result.optimizeMilliseconds << " ms, write "
+		<< result.writeMilliseconds << " ms" << endl;
+}
+
+//------------------------------------------------------------
+// The part of a file path after the last separator.
+string getBaseName(const string& fileName) {
+	return fileName.substr(getDirectoryName(fileName).size());
+}
+
+int main(int argc, char** argv) {
+	unsigned int positionBits = defaultPositionBits;
+	vector<string> arguments;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "-p" && i + 1 < argc) {
+			positionBits = min((unsigned int) atoi(argv[++i]), 16u);
+		} else {
+			arguments.push_back(argv[i]);
+		}
+	}
+	if (arguments.empty() || arguments.size() > 2) {
+		cout << "Usage: optimize_3d_obj [-p positionBits] <3D file or directory> [output directory]" << endl;
+		return 1;
+	}
+
+	// Find the 3D files: the file that is given, or the files of the directory that Assimp can import.
+	vector<string> inputFileNames;
+	Assimp::Importer importer;
+	if (listDirectory(arguments[0], inputFileNames)) {
+		vector<string> modelFileNames;
+		for (unsigned int i = 0; i < inputFileNames.size(); i++) {
+			size_t dot = inputFileNames[i].find_last_of('.');
+			if (dot != string::npos && !isOptimizedModelFileName(inputFileNames[i])
+				&& importer.IsExtensionSupported(inputFileNames[i].substr(dot).c_str())) {
+				modelFileNames.push_back(inputFileNames[i]);
+			}
+		}
+		inputFileNames.swap(modelFileNames);
+	} else {
+		inputFileNames.push_back(arguments[0]);
+	}
+
+	// The texture paths are relative to the 3D file. They only need to change if the file is written elsewhere.
+	string outputDirectory;
+	if (arguments.size() == 2) {
+		createDirectory(arguments[1]);
+		outputDirectory = arguments[1];
+		if (outputDirectory[outputDirectory.size() - 1] != '/' && outputDirectory[outputDirectory.size() - 1] != '\\') {
+			outputDirectory += '/';
+		}
+	}
+
+	// The results are value-initialized, i.e. all their counters start at 0.
+	vector<ModelOptimization> results(inputFileNames.size());
+	for (unsigned int i = 0; i < results.size(); i++) {
+		results[i].inputFileName = inputFileNames[i];
+		results[i].outputFileName = (outputDirectory.empty() ? inputFileNames[i] : outputDirectory + getBaseName(inputFileNames[i]))
+			+ OPTIMIZED_MODEL_EXTENSION;
+	}
+
+	// The job pool: each worker takes the next 3D file until there are none left.
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	parallelFor((unsigned int) results.size(), [&results, &outputDirectory, positionBits](unsigned int i) {
+		string textureDirectory;
+		if (!outputDirectory.empty()) {
+			string inputDirectory = getDirectoryName(results[i].inputFileName);
+			textureDirectory = getAbsolutePath(inputDirectory.empty() ? "." : inputDirectory) + "/";
+		}
+		optimizeModelFile(results[i], positionBits, textureDirectory);
+
+		lock_guard<mutex> lock(outputMutex);
+		printModelOptimization(results[i]);
+	});
+
+	unsigned int succeededCount = 0;
+	unsigned long long inputBytes = 0, outputBytes = 0;
+	for (unsigned int i = 0; i < results.size(); i++) {
+		if (results[i].succeeded) {
+			succeededCount++;
+			inputBytes += results[i].inputBytes;
+			outputBytes += results[i].outputBytes;
+		}
+	}
+	cout << succeededCount << " of " << results.size() << " 3D files optimized by " << min(getWorkerThreadCount(), (unsigned int) max(results.size(), (size_t) 1))
+		<< " jobs in " << elapsedMilliseconds(startTime) << " ms, " << inputBytes / (1024.0 * 1024.0) << " MB -> "
+		<< outputBytes / (1024.0 * 1024.0) << " MB" << endl;
+	return succeededCount == results.size() ? 0 : 1;
+}
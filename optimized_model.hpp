@@ -0,0 +1,776 @@
+/* This is a utility program that helps OpenGL programmers load 3D files without importing them every time.
+An optimized model file (.opm) is written once by optimize_3d_obj.cc, after the model has been imported by Assimp
+and has gone through the stages of mesh_optimizer.hpp. It holds what load_3d_obj.cc draws and nothing else:
+the materials (name, diffuse, specular and emissive colors, shininess and diffuse texture), the embedded
+textures, the meshes, the node tree and the mesh instance table (see mesh_instancing.hpp). Loading it is a
+matter of copying arrays out of a memory-mapped file; no post-processing is left to do.
+Each mesh stores:
+- its positions as 16-bit integers in the bounds of the mesh (or as floats if they were not quantized);
+- its normals as 16-bit octahedral coordinates, and its first set of texture coordinates as two floats;
+- its indices as 16-bit integers if it has at most 65536 vertices, or as 32-bit integers otherwise.
+A mesh that is a copy of another mesh up to a rigid transform stores no geometry: it is made from the other
+mesh and the transform in the instance table when the file is loaded.
+The following functions are provided.
+
+// Check if a file name has the extension of an optimized model file (".opm").
+bool isOptimizedModelFileName(const string& fileName)
+
+// Write an optimized model file. instances has one entry per scene->mMeshes[] (see findMeshInstances()), and
+// positionBits is the quantization of the positions (see quantizeMesh(); 0 to store floats). Relative texture
+// file paths are prefixed by textureDirectory, so that they can be found from the directory of the file.
+// Returns false if the file cannot be written.
+bool writeOptimizedModel(const aiScene* scene, const vector<MeshInstance>& instances, const string& fileName,
+	unsigned int positionBits, const string& textureDirectory)
+
+// Load an optimized model file. Returns NULL if the file cannot be opened or is not an optimized model file.
+// The caller owns the scene.
+aiScene* loadOptimizedModelFile(const string& fileName)
+
+// Read the mesh instance table of an optimized model file, so that the copies do not have to be found again.
+// Returns false if the file cannot be read.
+bool loadOptimizedModelInstances(const string& fileName, vector<MeshInstance>& instances)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp, mesh_instancing.hpp and
+mesh_optimizer.hpp to be included first.
+*/
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define OPTIMIZED_MODEL_EXTENSION ".opm"
+
+// The flags of a mesh.
+#define OPTIMIZED_MESH_NORMALS 1
+#define OPTIMIZED_MESH_TEXCOORDS 2
+#define OPTIMIZED_MESH_SHORT_INDICES 4
+
+// The file starts with this header. The materials, the embedded textures and the meshes follow it, then the
+// instance table, then the nodes in depth-first order. Every block is padded to a multiple of 4 bytes.
+struct OptimizedModelHeader {
+	unsigned char identifier[12];       // OPTIMIZED_MODEL_IDENTIFIER
+	unsigned int materialCount;
+	unsigned int textureCount;
+	unsigned int meshCount;
+	unsigned int positionBits;          // 0 if the positions are floats
+	unsigned long long instanceTableOffset;
+};
+
+// The identifier is made to detect the file type and the usual file transfer corruptions (like the PNG signature).
+const unsigned char OPTIMIZED_MODEL_IDENTIFIER[12] = { 0xAB, 'O', 'P', 'M', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Each mesh starts with this header, followed by its name and, unless it is a copy, its vertices and faces.
+struct OptimizedMeshHeader {
+	unsigned int sourceMesh;            // the index of the mesh itself if it is not a copy
+	unsigned int materialIndex;
+	unsigned int primitiveTypes;
+	unsigned int vertexCount;
+	unsigned int faceCount;
+	unsigned int indexCount;
+	unsigned int faceSize;              // the indices of every face, or 0 if the size of each face is stored
+	unsigned int flags;                 // OPTIMIZED_MESH_NORMALS, OPTIMIZED_MESH_TEXCOORDS, OPTIMIZED_MESH_SHORT_INDICES
+	float boundsMin[3];                 // the quantization bounds of the positions
+	float boundsMax[3];
+};
+
+// A read cursor over a mapped file. Reading past the end sets failed and returns zeros.
+struct OptimizedModelReader {
+	const unsigned char* data;
+	size_t size;
+	size_t offset;
+	bool failed;
+};
+
+//------------------------------------------------------------
+// Check if a file name has the extension of an optimized model file.
+bool isOptimizedModelFileName(const string& fileName) {
+	size_t extensionLength = strlen(OPTIMIZED_MODEL_EXTENSION);
+	if (fileName.size() < extensionLength) {
+		return false;
+	}
+	string extension = fileName.substr(fileName.size() - extensionLength);
+	for (size_t i = 0; i < extension.size(); i++) {
+		extension[i] = (char) tolower(extension[i]);
+	}
+	return extension == OPTIMIZED_MODEL_EXTENSION;
+}
+
+//------------------------------------------------------------
+// Append a block to a file image, padded to a multiple of 4 bytes.
+void appendBlock(vector<unsigned char>& image, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	image.insert(image.end(), bytes, bytes + size);
+	image.resize((image.size() + 3) & ~(size_t) 3, 0);
+}
+
+void appendUint32(vector<unsigned char>& image, unsigned int value) {
+	appendBlock(image, &value, sizeof(value));
+}
+
+void appendString(vector<unsigned char>& image, const string& text) {
+	appendUint32(image, (unsigned int) text.size());
+	appendBlock(image, text.data(), text.size());
+}
+
+//------------------------------------------------------------
+// True if a material texture path refers to an embedded texture.
+bool isEmbeddedTexturePath(const aiScene* scene, const aiString& texturePath) {
+	if (texturePath.data[0] == '*') {
+		return true;
+	}
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		if (scene->mTextures[i]->mFilename.length > 0 && scene->mTextures[i]->mFilename == texturePath) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------
+// Append a color of a material, after a flag that tells whether the material has it.
+void appendMaterialColor(vector<unsigned char>& image, const aiMaterial* material, const char* key, unsigned int type,
+	unsigned int index) {
+	aiColor3D color(0.0f, 0.0f, 0.0f);
+	unsigned int hasColor = AI_SUCCESS == material->Get(key, type, index, color) ? 1 : 0;
+	appendUint32(image, hasColor);
+	appendBlock(image, &color, sizeof(color));
+}
+
+//------------------------------------------------------------
+// Append the diffuse, specular and emissive colors, the shininess and the diffuse texture path of a material.
+// Relative texture file paths are prefixed by textureDirectory; embedded texture paths are kept.
+void appendMaterialAppearance(vector<unsigned char>& image, const aiScene* scene, const aiMaterial* material,
+	const string& textureDirectory) {
+	appendMaterialColor(image, material, AI_MATKEY_COLOR_DIFFUSE);
+	appendMaterialColor(image, material, AI_MATKEY_COLOR_SPECULAR);
+	appendMaterialColor(image, material, AI_MATKEY_COLOR_EMISSIVE);
+	float shininess = 0.0f;
+	unsigned int hasShininess = AI_SUCCESS == material->Get(AI_MATKEY_SHININESS, shininess) ? 1 : 0;
+	appendUint32(image, hasShininess);
+	appendBlock(image, &shininess, sizeof(shininess));
+
+	aiString texturePath;
+	string path;
+	if (AI_SUCCESS == material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath)) {
+		path = texturePath.C_Str();
+		bool isAbsolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) || path.find(':') != string::npos;
+		if (!isAbsolute && !isEmbeddedTexturePath(scene, texturePath)) {
+			path = textureDirectory + path;
+		}
+	}
+	appendString(image, path);
+}
+
+//------------------------------------------------------------
+// Append an embedded texture.
+void appendTexture(vector<unsigned char>& image, const aiTexture* texture) {
+	appendUint32(image, texture->mWidth);
+	appendUint32(image, texture->mHeight);
+	char formatHint[12] = { 0 };
+	strncpy(formatHint, texture->achFormatHint, min(sizeof(formatHint), sizeof(texture->achFormatHint)) - 1);
+	appendBlock(image, formatHint, sizeof(formatHint));
+	appendString(image, texture->mFilename.C_Str());
+	size_t size = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+	appendBlock(image, texture->pcData, size);
+}
+
+//------------------------------------------------------------
+// The header of a mesh. faceSize is 0 if the faces do not all have the same number of indices.
+OptimizedMeshHeader getOptimizedMeshHeader(const aiMesh* mesh, unsigned int sourceMesh) {
+	OptimizedMeshHeader header;
+	header.sourceMesh = sourceMesh;
+	header.materialIndex = mesh->mMaterialIndex;
+	header.primitiveTypes = mesh->mPrimitiveTypes;
+	header.vertexCount = mesh->mNumVertices;
+	header.faceCount = mesh->mNumFaces;
+	header.indexCount = 0;
+	header.faceSize = mesh->mNumFaces > 0 ? mesh->mFaces[0].mNumIndices : 0;
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		header.indexCount += mesh->mFaces[i].mNumIndices;
+		if (mesh->mFaces[i].mNumIndices != header.faceSize || mesh->mFaces[i].mNumIndices > 255) {
+			header.faceSize = 0;
+		}
+	}
+	header.flags = (mesh->HasNormals() ? OPTIMIZED_MESH_NORMALS : 0) | (mesh->HasTextureCoords(0) ? OPTIMIZED_MESH_TEXCOORDS : 0)
+		| (mesh->mNumVertices <= 65536 ? OPTIMIZED_MESH_SHORT_INDICES : 0);
+	aiVector3D boundsMin, boundsMax;
+	getMeshBounds(mesh, boundsMin, boundsMax);
+	for (unsigned int c = 0; c < 3; c++) {
+		header.boundsMin[c] = boundsMin[c];
+		header.boundsMax[c] = boundsMax[c];
+	}
+	return header;
+}
+
+//------------------------------------------------------------
+// Check that every face of a mesh has at most 255 indices, as the face sizes are stored in one byte.
+bool canStoreMeshFaces(const aiMesh* mesh) {
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		if (mesh->mFaces[i].mNumIndices > 255) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Append the vertices and faces of a mesh.
+void appendMeshGeometry(vector<unsigned char>& image, const aiMesh* mesh, const OptimizedMeshHeader& header, unsigned int positionBits) {
+	unsigned int vertexCount = mesh->mNumVertices;
+	if (positionBits > 0) {
+		aiVector3D boundsMin(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		aiVector3D boundsMax(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		aiVector3D step = getQuantizationStep(boundsMin, boundsMax, positionBits);
+		vector<unsigned short> positions(3 * (size_t) vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				float grid = step[c] > 0 ? floor((mesh->mVertices[i][c] - boundsMin[c]) / step[c] + 0.5f) : 0;
+				positions[3 * (size_t) i + c] = (unsigned short) max(0.0f, min(65535.0f, grid));
+			}
+		}
+		appendBlock(image, positions.data(), sizeof(unsigned short) * positions.size());
+	} else {
+		vector<float> positions(3 * (size_t) vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				positions[3 * (size_t) i + c] = mesh->mVertices[i][c];
+			}
+		}
+		appendBlock(image, positions.data(), sizeof(float) * positions.size());
+	}
+
+	if (header.flags & OPTIMIZED_MESH_NORMALS) {
+		vector<short> normals(2 * (size_t) vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			encodeOctahedral(mesh->mNormals[i], &normals[2 * (size_t) i]);
+		}
+		appendBlock(image, normals.data(), sizeof(short) * normals.size());
+	}
+
+	if (header.flags & OPTIMIZED_MESH_TEXCOORDS) {
+		vector<float> texCoords(2 * (size_t) vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			texCoords[2 * (size_t) i] = mesh->mTextureCoords[0][i].x;
+			texCoords[2 * (size_t) i + 1] = mesh->mTextureCoords[0][i].y;
+		}
+		appendBlock(image, texCoords.data(), sizeof(float) * texCoords.size());
+	}
+
+	if (header.faceSize == 0) {
+		vector<unsigned char> faceSizes(mesh->mNumFaces);
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+			faceSizes[i] = (unsigned char) mesh->mFaces[i].mNumIndices;
+		}
+		appendBlock(image, faceSizes.data(), faceSizes.size());
+	}
+
+	vector<unsigned int> indices;
+	indices.reserve(header.indexCount);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		indices.insert(indices.end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + mesh->mFaces[i].mNumIndices);
+	}
+	if (header.flags & OPTIMIZED_MESH_SHORT_INDICES) {
+		vector<unsigned short> shortIndices(indices.begin(), indices.end());
+		appendBlock(image, shortIndices.data(), sizeof(unsigned short) * shortIndices.size());
+	} else {
+		appendBlock(image, indices.data(), sizeof(unsigned int) * indices.size());
+	}
+}
+
+//------------------------------------------------------------
+// Append a node and its children, depth first.
+void appendNode(vector<unsigned char>& image, const aiNode* node) {
+	appendString(image, node->mName.C_Str());
+	appendBlock(image, &node->mTransformation, sizeof(aiMatrix4x4));
+	appendUint32(image, node->mNumMeshes);
+	appendUint32(image, node->mNumChildren);
+	appendBlock(image, node->mMeshes, sizeof(unsigned int) * node->mNumMeshes);
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		appendNode(image, node->mChildren[i]);
+	}
+}
+
+//------------------------------------------------------------
+// Write an optimized model file. The whole file is put together in memory and written at once.
+bool writeOptimizedModel(const aiScene* scene, const vector<MeshInstance>& instances, const string& fileName,
+	unsigned int positionBits, const string& textureDirectory) {
+	positionBits = min(positionBits, 16u);
+	vector<unsigned char> image(sizeof(OptimizedModelHeader), 0);
+	OptimizedModelHeader header;
+	memcpy(header.identifier, OPTIMIZED_MODEL_IDENTIFIER, 12);
+	header.materialCount = scene->mNumMaterials;
+	header.textureCount = scene->mNumTextures;
+	header.meshCount = scene->mNumMeshes;
+	header.positionBits = positionBits;
+
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiString name;
+		scene->mMaterials[i]->Get(AI_MATKEY_NAME, name);
+		appendString(image, name.C_Str());
+		appendMaterialAppearance(image, scene, scene->mMaterials[i], textureDirectory);
+	}
+
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		appendTexture(image, scene->mTextures[i]);
+	}
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		OptimizedMeshHeader meshHeader = getOptimizedMeshHeader(mesh, instances[i].sourceMesh);
+		appendBlock(image, &meshHeader, sizeof(meshHeader));
+		appendString(image, mesh->mName.C_Str());
+
+		if (meshHeader.sourceMesh == i) {
+			if (!canStoreMeshFaces(mesh)) {
+				cout << "writeOptimizedModel(): a face of mesh " << i << " has more than 255 indices" << endl;
+				return false;
+			}
+			appendMeshGeometry(image, mesh, meshHeader, positionBits);
+		}
+	}
+
+	header.instanceTableOffset = image.size();
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		appendUint32(image, instances[i].sourceMesh);
+		appendBlock(image, &instances[i].transform, sizeof(aiMatrix4x4));
+	}
+
+	appendNode(image, scene->mRootNode);
+
+	memcpy(&image[0], &header, sizeof(header));
+	return writeFile(fileName, image.data(), image.size());
+}
+
+//------------------------------------------------------------
+// Read a block of a mapped file and move past its padding. Returns NULL if the file is too short.
+const unsigned char* readBlock(OptimizedModelReader& reader, size_t size) {
+	if (reader.failed || size > reader.size - reader.offset) {
+		reader.failed = true;
+		return NULL;
+	}
+	const unsigned char* block = reader.data + reader.offset;
+	reader.offset = min(reader.size, (reader.offset + size + 3) & ~(size_t) 3);
+	return block;
+}
+
+void readBlock(OptimizedModelReader& reader, void* destination, size_t size) {
+	const unsigned char* block = readBlock(reader, size);
+	if (block) {
+		memcpy(destination, block, size);
+	} else {
+		memset(destination, 0, size);
+	}
+}
+
+unsigned int readUint32(OptimizedModelReader& reader) {
+	unsigned int value;
+	readBlock(reader, &value, sizeof(value));
+	return value;
+}
+
+aiString readString(OptimizedModelReader& reader) {
+	unsigned int length = readUint32(reader);
+	const char* text = (const char*) readBlock(reader, length);
+	return aiString(text ? string(text, length) : string());
+}
+
+//------------------------------------------------------------
+// Read a node and its children. Returns NULL if the file is damaged.
+aiNode* readNode(OptimizedModelReader& reader, unsigned int meshCount, unsigned int depth) {
+	aiNode* node = new aiNode();
+	node->mName = readString(reader);
+	readBlock(reader, &node->mTransformation, sizeof(aiMatrix4x4));
+	unsigned int nodeMeshCount = readUint32(reader);
+	unsigned int childCount = readUint32(reader);
+	const unsigned int* meshes = (const unsigned int*) readBlock(reader, sizeof(unsigned int) * (size_t) nodeMeshCount);
+	if (reader.failed || depth > 1000 || childCount > (reader.size - reader.offset) / 16) {
+		delete node;
+		return NULL;
+	}
+
+	if (nodeMeshCount > 0) {
+		node->mNumMeshes = nodeMeshCount;
+		node->mMeshes = new unsigned int[nodeMeshCount];
+		memcpy(node->mMeshes, meshes, sizeof(unsigned int) * nodeMeshCount);
+		for (unsigned int i = 0; i < nodeMeshCount; i++) {
+			if (node->mMeshes[i] >= meshCount) {
+				delete node;
+				return NULL;
+			}
+		}
+	}
+
+	if (childCount > 0) {
+		node->mChildren = new aiNode*[childCount];
+		for (unsigned int i = 0; i < childCount; i++) {
+			aiNode* child = readNode(reader, meshCount, depth + 1);
+			if (!child) {
+				delete node;
+				return NULL;
+			}
+			child->mParent = node;
+			node->mChildren[node->mNumChildren++] = child;
+		}
+	}
+	return node;
+}
+
+//------------------------------------------------------------
+// Read what appendMaterialColor() has written into a material.
+void readMaterialColor(OptimizedModelReader& reader, aiMaterial* material, const char* key, unsigned int type,
+	unsigned int index) {
+	unsigned int hasColor = readUint32(reader);
+	aiColor3D color(0.0f, 0.0f, 0.0f);
+	readBlock(reader, &color, sizeof(color));
+	if (hasColor && !reader.failed) {
+		material->AddProperty(&color, 1, key, type, index);
+	}
+}
+
+//------------------------------------------------------------
+// Read what appendMaterialAppearance() has written into a material.
+void readMaterialAppearance(OptimizedModelReader& reader, aiMaterial* material) {
+	readMaterialColor(reader, material, AI_MATKEY_COLOR_DIFFUSE);
+	readMaterialColor(reader, material, AI_MATKEY_COLOR_SPECULAR);
+	readMaterialColor(reader, material, AI_MATKEY_COLOR_EMISSIVE);
+	unsigned int hasShininess = readUint32(reader);
+	float shininess = 0.0f;
+	readBlock(reader, &shininess, sizeof(shininess));
+	if (hasShininess && !reader.failed) {
+		material->AddProperty(&shininess, 1, AI_MATKEY_SHININESS);
+	}
+	aiString texturePath = readString(reader);
+	if (texturePath.length > 0) {
+		material->AddProperty(&texturePath, AI_MATKEY_TEXTURE_DIFFUSE(0));
+	}
+}
+
+//------------------------------------------------------------
+// Read an embedded texture. If the file is too short, reader.failed is set and the texture has no data.
+aiTexture* readTexture(OptimizedModelReader& reader) {
+	aiTexture* texture = new aiTexture();
+	texture->mWidth = readUint32(reader);
+	texture->mHeight = readUint32(reader);
+	char formatHint[12];
+	readBlock(reader, formatHint, sizeof(formatHint));
+	memset(texture->achFormatHint, 0, sizeof(texture->achFormatHint));
+	memcpy(texture->achFormatHint, formatHint, min(sizeof(formatHint), sizeof(texture->achFormatHint)) - 1);
+	texture->mFilename = readString(reader);
+	size_t size = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+	const unsigned char* data = readBlock(reader, size);
+	if (data) {
+		texture->pcData = new aiTexel[(size + sizeof(aiTexel) - 1) / sizeof(aiTexel)];
+		memcpy(texture->pcData, data, size);
+	}
+	return texture;
+}
+
+//------------------------------------------------------------
+// Give a mesh the faces of a list of indices.
+void createOptimizedMeshFaces(aiMesh* mesh, const unsigned char* faceSizes, unsigned int faceSize, const vector<unsigned int>& indices) {
+	mesh->mNumFaces = (unsigned int) (faceSizes ? mesh->mNumFaces : indices.size() / max(faceSize, 1u));
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	size_t next = 0;
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		aiFace& face = mesh->mFaces[i];
+		face.mNumIndices = faceSizes ? faceSizes[i] : faceSize;
+		face.mIndices = new unsigned int[face.mNumIndices];
+		memcpy(face.mIndices, &indices[next], sizeof(unsigned int) * face.mNumIndices);
+		next += face.mNumIndices;
+	}
+}
+
+//------------------------------------------------------------
+// The bytes that the vertices and faces of a mesh take in the file, with their padding.
+size_t getMeshGeometrySize(const OptimizedMeshHeader& header, unsigned int positionBits) {
+	size_t vertexCount = header.vertexCount;
+	size_t size = positionBits > 0 ? (sizeof(unsigned short) * 3 * vertexCount + 3) & ~(size_t) 3 : sizeof(float) * 3 * vertexCount;
+	if (header.flags & OPTIMIZED_MESH_NORMALS) {
+		size += sizeof(short) * 2 * vertexCount;
+	}
+	if (header.flags & OPTIMIZED_MESH_TEXCOORDS) {
+		size += sizeof(float) * 2 * vertexCount;
+	}
+	if (header.faceSize == 0) {
+		size += ((size_t) header.faceCount + 3) & ~(size_t) 3;
+	}
+	size_t indexSize = (header.flags & OPTIMIZED_MESH_SHORT_INDICES) ? sizeof(unsigned short) : sizeof(unsigned int);
+	return size + ((indexSize * header.indexCount + 3) & ~(size_t) 3);
+}
+
+//------------------------------------------------------------
+// Read the vertices and faces of a mesh. Returns false if the file is damaged.
+bool readMeshGeometry(OptimizedModelReader& reader, aiMesh* mesh, const OptimizedMeshHeader& header, unsigned int positionBits) {
+	unsigned int vertexCount = header.vertexCount;
+	if (vertexCount > (reader.size - reader.offset) / 4 || header.indexCount > (reader.size - reader.offset) / 2) {
+		return false;
+	}
+
+	mesh->mNumVertices = vertexCount;
+	mesh->mVertices = new aiVector3D[vertexCount];
+	if (positionBits > 0) {
+		aiVector3D boundsMin(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		aiVector3D boundsMax(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		aiVector3D step = getQuantizationStep(boundsMin, boundsMax, positionBits);
+		const unsigned char* positions = readBlock(reader, sizeof(unsigned short) * 3 * (size_t) vertexCount);
+		if (!positions) {
+			return false;
+		}
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			unsigned short grid[3];
+			memcpy(grid, positions + sizeof(grid) * i, sizeof(grid));
+			mesh->mVertices[i] = aiVector3D(boundsMin.x + grid[0] * step.x, boundsMin.y + grid[1] * step.y, boundsMin.z + grid[2] * step.z);
+		}
+	} else {
+		readBlock(reader, mesh->mVertices, sizeof(float) * 3 * (size_t) vertexCount);
+	}
+
+	if (header.flags & OPTIMIZED_MESH_NORMALS) {
+		const unsigned char* normals = readBlock(reader, sizeof(short) * 2 * (size_t) vertexCount);
+		if (!normals) {
+			return false;
+		}
+		mesh->mNormals = new aiVector3D[vertexCount];
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			short encoded[2];
+			memcpy(encoded, normals + sizeof(encoded) * i, sizeof(encoded));
+			mesh->mNormals[i] = decodeOctahedral(encoded);
+		}
+	}
+
+	if (header.flags & OPTIMIZED_MESH_TEXCOORDS) {
+		const unsigned char* texCoords = readBlock(reader, sizeof(float) * 2 * (size_t) vertexCount);
+		if (!texCoords) {
+			return false;
+		}
+		mesh->mNumUVComponents[0] = 2;
+		mesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+		for (unsigned int i = 0; i < vertexCount; i++) {
+			float uv[2];
+			memcpy(uv, texCoords + sizeof(uv) * i, sizeof(uv));
+			mesh->mTextureCoords[0][i] = aiVector3D(uv[0], uv[1], 0);
+		}
+	}
+
+	const unsigned char* faceSizes = NULL;
+	size_t faceIndexCount = 0;
+	if (header.faceSize == 0) {
+		faceSizes = readBlock(reader, header.faceCount);
+		if (!faceSizes) {
+			return false;
+		}
+		for (unsigned int i = 0; i < header.faceCount; i++) {
+			faceIndexCount += faceSizes[i];
+		}
+	} else {
+		faceIndexCount = (size_t) header.faceCount * header.faceSize;
+	}
+	if (faceIndexCount != header.indexCount) {
+		return false;
+	}
+
+	vector<unsigned int> indices(header.indexCount);
+	if (header.flags & OPTIMIZED_MESH_SHORT_INDICES) {
+		const unsigned char* shortIndices = readBlock(reader, sizeof(unsigned short) * (size_t) header.indexCount);
+		if (!shortIndices) {
+			return false;
+		}
+		for (unsigned int i = 0; i < header.indexCount; i++) {
+			unsigned short index;
+			memcpy(&index, shortIndices + sizeof(index) * i, sizeof(index));
+			indices[i] = index;
+		}
+	} else {
+		readBlock(reader, indices.data(), sizeof(unsigned int) * indices.size());
+	}
+	for (unsigned int i = 0; i < header.indexCount; i++) {
+		if (indices[i] >= vertexCount) {
+			return false;
+		}
+	}
+
+	mesh->mNumFaces = header.faceCount;
+	createOptimizedMeshFaces(mesh, faceSizes, header.faceSize, indices);
+	return !reader.failed;
+}
+
+//------------------------------------------------------------
+// Make a copy of a mesh, moved by a rigid transform.
+void copyMeshGeometry(aiMesh* mesh, const aiMesh* source, const aiMatrix4x4& transform) {
+	aiMatrix3x3 rotation(transform);
+	mesh->mNumVertices = source->mNumVertices;
+	mesh->mVertices = new aiVector3D[source->mNumVertices];
+	for (unsigned int i = 0; i < source->mNumVertices; i++) {
+		mesh->mVertices[i] = transform * source->mVertices[i];
+	}
+	if (source->mNormals) {
+		mesh->mNormals = new aiVector3D[source->mNumVertices];
+		for (unsigned int i = 0; i < source->mNumVertices; i++) {
+			mesh->mNormals[i] = rotation * source->mNormals[i];
+		}
+	}
+	if (source->mTextureCoords[0]) {
+		mesh->mNumUVComponents[0] = source->mNumUVComponents[0];
+		mesh->mTextureCoords[0] = new aiVector3D[source->mNumVertices];
+		memcpy(mesh->mTextureCoords[0], source->mTextureCoords[0], sizeof(aiVector3D) * source->mNumVertices);
+	}
+	mesh->mNumFaces = source->mNumFaces;
+	mesh->mFaces = new aiFace[source->mNumFaces];
+	for (unsigned int i = 0; i < source->mNumFaces; i++) {
+		mesh->mFaces[i].mNumIndices = source->mFaces[i].mNumIndices;
+		mesh->mFaces[i].mIndices = new unsigned int[source->mFaces[i].mNumIndices];
+		memcpy(mesh->mFaces[i].mIndices, source->mFaces[i].mIndices, sizeof(unsigned int) * source->mFaces[i].mNumIndices);
+	}
+}
+
+//------------------------------------------------------------
+// Read the instance table of a mapped optimized model file.
+bool readOptimizedModelInstances(const MappedFile& file, const OptimizedModelHeader& header, vector<MeshInstance>& instances) {
+	OptimizedModelReader reader = { file.data, file.size, 0, false };
+	if (header.instanceTableOffset > file.size) {
+		return false;
+	}
+	reader.offset = (size_t) header.instanceTableOffset;
+	instances.resize(header.meshCount);
+	for (unsigned int i = 0; i < header.meshCount; i++) {
+		instances[i].sourceMesh = readUint32(reader);
+		readBlock(reader, &instances[i].transform, sizeof(aiMatrix4x4));
+		if (instances[i].sourceMesh > i) {
+			return false;
+		}
+	}
+	return !reader.failed;
+}
+
+//------------------------------------------------------------
+// Map an optimized model file and check its header.
+bool openOptimizedModelFile(const string& fileName, MappedFile& file, OptimizedModelHeader& header) {
+	if (!mapFile(fileName, file)) {
+		cout << "loadOptimizedModelFile(): unable to open " << fileName << endl;
+		return false;
+	}
+	if (file.size < sizeof(header) || memcmp(file.data, OPTIMIZED_MODEL_IDENTIFIER, 12) != 0) {
+		cout << "loadOptimizedModelFile(): " << fileName << " is not an optimized model file" << endl;
+		unmapFile(file);
+		return false;
+	}
+	memcpy(&header, file.data, sizeof(header));
+	return true;
+}
+
+//------------------------------------------------------------
+// Read the instance table of an optimized model file.
+bool loadOptimizedModelInstances(const string& fileName, vector<MeshInstance>& instances) {
+	MappedFile file;
+	OptimizedModelHeader header;
+	if (!openOptimizedModelFile(fileName, file, header)) {
+		return false;
+	}
+	bool loaded = readOptimizedModelInstances(file, header, instances);
+	unmapFile(file);
+	return loaded;
+}
+
+//------------------------------------------------------------
+// Load an optimized model file. The meshes are read on all the threads, each from its own offset, after one
+// pass over the mesh headers; the copies are made from their source meshes afterwards.
+aiScene* loadOptimizedModelFile(const string& fileName) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	MappedFile file;
+	OptimizedModelHeader header;
+	if (!openOptimizedModelFile(fileName, file, header)) {
+		return NULL;
+	}
+	OptimizedModelReader reader = { file.data, file.size, sizeof(header), false };
+	aiScene* scene = new aiScene();
+
+	scene->mMaterials = new aiMaterial*[max(header.materialCount, 1u)];
+	for (unsigned int i = 0; i < header.materialCount && !reader.failed; i++) {
+		aiMaterial* material = new aiMaterial();
+		scene->mMaterials[scene->mNumMaterials++] = material;
+		aiString name = readString(reader);
+		material->AddProperty(&name, AI_MATKEY_NAME);
+		readMaterialAppearance(reader, material);
+	}
+
+	if (header.textureCount > 0) {
+		scene->mTextures = new aiTexture*[header.textureCount];
+	}
+	for (unsigned int i = 0; i < header.textureCount && !reader.failed; i++) {
+		scene->mTextures[scene->mNumTextures++] = readTexture(reader);
+	}
+
+	// Find where each mesh starts. The geometry is skipped here and read in parallel below.
+	vector<OptimizedMeshHeader> meshHeaders(header.meshCount);
+	vector<size_t> geometryOffsets(header.meshCount);
+	if (header.meshCount > 0) {
+		scene->mMeshes = new aiMesh*[header.meshCount];
+	}
+	for (unsigned int i = 0; i < header.meshCount && !reader.failed; i++) {
+		aiMesh* mesh = new aiMesh();
+		scene->mMeshes[scene->mNumMeshes++] = mesh;
+		OptimizedMeshHeader& meshHeader = meshHeaders[i];
+		readBlock(reader, &meshHeader, sizeof(meshHeader));
+		mesh->mName = readString(reader);
+		mesh->mMaterialIndex = meshHeader.materialIndex;
+		mesh->mPrimitiveTypes = meshHeader.primitiveTypes;
+		if (meshHeader.materialIndex >= header.materialCount || meshHeader.sourceMesh > i) {
+			reader.failed = true;
+		}
+		geometryOffsets[i] = reader.offset;
+		if (meshHeader.sourceMesh == i) {
+			readBlock(reader, getMeshGeometrySize(meshHeader, header.positionBits));
+		}
+	}
+	if (reader.failed || header.instanceTableOffset != reader.offset) {
+		cout << "loadOptimizedModelFile(): " << fileName << " is damaged" << endl;
+		unmapFile(file);
+		delete scene;
+		return NULL;
+	}
+
+	vector<bool> meshRead(header.meshCount, true);
+	parallelFor(header.meshCount, [&](unsigned int i) {
+		if (meshHeaders[i].sourceMesh == i) {
+			OptimizedModelReader meshReader = { file.data, file.size, geometryOffsets[i], false };
+			meshRead[i] = readMeshGeometry(meshReader, scene->mMeshes[i], meshHeaders[i], header.positionBits);
+		}
+	});
+
+	vector<MeshInstance> instances;
+	bool loaded = readOptimizedModelInstances(file, header, instances);
+	for (unsigned int i = 0; i < header.meshCount && loaded; i++) {
+		unsigned int source = instances[i].sourceMesh;
+		loaded = meshRead[i] && source == meshHeaders[i].sourceMesh && instances[source].sourceMesh == source;
+	}
+	if (loaded) {
+		parallelFor(header.meshCount, [&](unsigned int i) {
+			if (instances[i].sourceMesh != i) {
+				copyMeshGeometry(scene->mMeshes[i], scene->mMeshes[instances[i].sourceMesh], instances[i].transform);
+			}
+		});
+		reader.offset = (size_t) header.instanceTableOffset + (sizeof(unsigned int) + sizeof(aiMatrix4x4)) * header.meshCount;
+		scene->mRootNode = readNode(reader, header.meshCount, 0);
+		loaded = scene->mRootNode != NULL;
+	}
+	unmapFile(file);
+	if (!loaded) {
+		cout << "loadOptimizedModelFile(): " << fileName << " is damaged" << endl;
+		delete scene;
+		return NULL;
+	}
+
+	unsigned int copyCount = 0;
+	for (unsigned int i = 0; i < header.meshCount; i++) {
+		copyCount += instances[i].sourceMesh != i ? 1 : 0;
+	}
+	cout << "Optimized model loader: " << header.meshCount << " meshes (" << copyCount << " of them copies), "
+		<< header.materialCount << " materials and " << header.textureCount << " embedded textures loaded in "
+		<< elapsedMilliseconds(startTime) << " ms" << endl;
+	return scene;
+}
@@ -0,0 +1,730 @@
+/* This is a utility program that renders reference images of a scene on the CPU by path tracing.
+The triangles of the meshes that are drawn are moved by the transforms they are drawn with and kept in one
+array, with a BVH over them. The BVH is built with buildBvh() of ray_picking.hpp and then collapsed into a
+4-wide BVH: each node holds the boxes of up to 4 children side by side, so that a ray is tested against the 4
+of them at once with SSE. The materials give the diffuse, specular and emissive colors and the shininess; the
+point, directional and spot lights of the scene are sampled at every bounce, with a shadow ray each, and the
+rays that leave the scene see a constant environment.
+The image is split into tiles of 16x16 pixels, which the CPU cores take one at a time. Each pass adds samples
+to every pixel, so the image can be written after each pass and gets less noisy as passes are added.
+The following functions are provided.
+
+// Build the triangles and the 4-wide BVH of a path tracer from the instances of a scene. Each instance adds the
+// triangles of its source mesh, moved by its transform, with the material of its own mesh.
+void buildTracerGeometry(const aiScene* scene, const vector<PickInstance>& instances, PathTracer& tracer)
+
+// Check if a ray hits any triangle between origin and origin + tMax * direction.
+bool traceAnyHit(const PathTracer& tracer, const TracerRay& ray, float tMax)
+
+// Build the triangles, the 4-wide BVH, the materials and the lights of a path tracer from the instances of a
+// scene. lightTransforms gives the transform of each light of the scene.
+void buildPathTracer(const aiScene* scene, const vector<PickInstance>& instances, const vector<aiMatrix4x4>& lightTransforms, PathTracer& tracer)
+
+// Set the size of the image and clear it.
+void resetPathTracerImage(PathTracer& tracer, unsigned int width, unsigned int height)
+
+// Add samplesPerPixel samples to every pixel, on threadCount threads (0 for all the CPU cores).
+// Returns the time the pass took in milliseconds.
+double renderPathTracerPass(PathTracer& tracer, unsigned int samplesPerPixel, unsigned int threadCount = 0)
+
+// Write the image (the mean of the samples of each pixel) into a binary PPM file.
+bool writePathTracerImage(const PathTracer& tracer, const string& fileName)
+
+// Render a pass on 1, 2, 4, ... threads up to all the CPU cores, and print the samples per second of each.
+void benchmarkPathTracerScaling(PathTracer& tracer, unsigned int samplesPerPixel)
+
+// The memory the triangles, the BVH and the image of a path tracer take.
+unsigned long long getPathTracerMemorySize(const PathTracer& tracer)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp and ray_picking.hpp to be
+included first.
+*/
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// The size of the tiles that the CPU cores take one at a time.
+#define PATH_TRACER_TILE_SIZE 16
+
+// The child slot of a 4-wide BVH node that holds nothing.
+#define BVH4_NO_CHILD 0xFFFFFFFFu
+
+// The entries of the traversal stack: each level of the BVH leaves at most 3 siblings on it.
+#define BVH4_STACK_SIZE (3 * BVH_MAX_DEPTH + 4)
+
+// The rays that do not hit anything go this far.
+#define PATH_TRACER_FAR 1e20f
+
+// A node of a 4-wide BVH. The boxes are stored by axis, so that the 4 children of each axis are one SSE vector.
+struct Bvh4Node {
+	float boundsMin[3][4];
+	float boundsMax[3][4];
+	unsigned int children[4];    // the node of an inner child, or the first triangle of a leaf
+	unsigned int counts[4];      // the triangles of a leaf; 0 for an inner child
+};
+static_assert(sizeof(Bvh4Node) == 128, "a 4-wide BVH node takes two cache lines");
+
+// A triangle as the intersection test needs it.
+struct TracerTriangle {
+	aiVector3D vertex0;
+	aiVector3D edge1;
+	aiVector3D edge2;
+	unsigned int material;
+};
+
+struct TracerMaterial {
+	aiColor3D diffuse;
+	aiColor3D specular;
+	aiColor3D emissive;
+	float shininess;
+};
+
+struct TracerLight {
+	aiLightSourceType type;
+	aiVector3D position;
+	aiVector3D direction;        // the direction the light goes, for directional and spot lights
+	aiColor3D color;
+	float attenuationConstant;
+	float attenuationLinear;
+	float attenuationQuadratic;
+	float cosInnerCone;
+	float cosOuterCone;
+};
+
+struct PathTracer {
+	vector<Bvh4Node> nodes;              // nodes[0] is the root
+	vector<TracerTriangle> triangles;    // in the order of the leaves
+	vector<TracerMaterial> materials;
+	vector<TracerLight> lights;
+	aiColor3D environment;               // what the rays that leave the scene see
+	unsigned int maxBounces;
+
+	unsigned int width;
+	unsigned int height;
+	vector<float> accumulation;          // the sum of the samples of each pixel, 3 floats per pixel
+	unsigned int sampleCount;            // the samples of each pixel so far
+
+	double buildMilliseconds;
+	unsigned long long rayCount;         // all the rays traced so far, shadow rays included
+};
+
+// A ray, with what the box test needs precomputed. With SSE, each coordinate is repeated in the 4 lanes.
+struct TracerRay {
+	aiVector3D origin;
+	aiVector3D direction;
+	float inverseDirection[3];
+#ifdef RAY_PICKING_SSE
+	__m128 origin4[3];
+	__m128 inverseDirection4[3];
+#endif
+};
+
+// The random numbers of a pixel: a PCG32 generator.
+struct TracerRandom {
+	unsigned long long state;
+};
+
+//------------------------------------------------------------
+// Collapse a binary BVH into a 4-wide BVH. The children of a node are gathered by opening the inner child with
+// the largest box until there are 4; the leaves keep their range of primitives.
+void collapseBvh(const Bvh& bvh, vector<Bvh4Node>& nodes) {
+	nodes.clear();
+	if (bvh.nodes.empty()) {
+		return;
+	}
+	// A root that is a leaf becomes the only child of the root.
+	nodes.push_back(Bvh4Node());
+	vector<pair<unsigned int, unsigned int> > pending;   // (binary node, 4-wide node)
+	pending.push_back(make_pair(0u, 0u));
+	while (!pending.empty()) {
+		unsigned int binaryNode = pending.back().first;
+		unsigned int node = pending.back().second;
+		pending.pop_back();
+
+		unsigned int children[4];
+		unsigned int childCount = 1;
+		children[0] = binaryNode;
+		if (bvh.nodes[binaryNode].count == 0) {
+			children[0] = bvh.nodes[binaryNode].first;
+			children[1] = bvh.nodes[binaryNode].first + 1;
+			childCount = 2;
+		}
+		while (childCount < 4) {
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (unsigned int i = 0; i < childCount; i++) {
+				const BvhNode& child = bvh.nodes[children[i]];
+				float area = getBoxHalfArea(child.boundsMin, child.boundsMax);
+				if (child.count == 0 && area > largestArea) {
+					largest = (int) i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0) {
+				break;
+			}
+			unsigned int first = bvh.nodes[children[largest]].first;
+			children[largest] = first;
+			children[childCount++] = first + 1;
+		}
+
+		for (unsigned int i = 0; i < 4; i++) {
+			Bvh4Node& target = nodes[node];
+			if (i >= childCount) {
+				for (unsigned int k = 0; k < 3; k++) {
+					target.boundsMin[k][i] = 1e30f;
+					target.boundsMax[k][i] = -1e30f;
+				}
+				target.children[i] = BVH4_NO_CHILD;
+				target.counts[i] = 0;
+				continue;
+			}
+			const BvhNode& child = bvh.nodes[children[i]];
+			for (unsigned int k = 0; k < 3; k++) {
+				target.boundsMin[k][i] = child.boundsMin[k];
+				target.boundsMax[k][i] = child.boundsMax[k];
+			}
+			if (child.count > 0) {
+				target.children[i] = child.first;
+				target.counts[i] = child.count;
+			} else {
+				target.children[i] = (unsigned int) nodes.size();
+				target.counts[i] = 0;
+				pending.push_back(make_pair(children[i], (unsigned int) nodes.size()));
+				nodes.push_back(Bvh4Node());
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Read the colors of the materials. Assimp gives the materials without a color a gray diffuse color, and so
+// does this function.
+void setupTracerMaterials(const aiScene* scene, vector<TracerMaterial>& materials) {
+	materials.resize(max(scene->mNumMaterials, 1u));
+	for (unsigned int i = 0; i < materials.size(); i++) {
+		TracerMaterial& material = materials[i];
+		material.diffuse = aiColor3D(0.6f, 0.6f, 0.6f);
+		material.specular = aiColor3D(0.0f, 0.0f, 0.0f);
+		material.emissive = aiColor3D(0.0f, 0.0f, 0.0f);
+		material.shininess = 0.0f;
+		if (i < scene->mNumMaterials) {
+			const aiMaterial* sceneMaterial = scene->mMaterials[i];
+			sceneMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, material.diffuse);
+			sceneMaterial->Get(AI_MATKEY_COLOR_SPECULAR, material.specular);
+			sceneMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, material.emissive);
+			sceneMaterial->Get(AI_MATKEY_SHININESS, material.shininess);
+		}
+		material.shininess = max(material.shininess, 1.0f);
+	}
+}
+
+// Move the lights by their transforms. The ambient and area lights are left out.
+void setupTracerLights(const aiScene* scene, const vector<aiMatrix4x4>& lightTransforms, vector<TracerLight>& lights) {
+	lights.clear();
+	for (unsigned int i = 0; i < scene->mNumLights; i++) {
+		const aiLight* sceneLight = scene->mLights[i];
+		if (sceneLight->mType != aiLightSource_POINT && sceneLight->mType != aiLightSource_DIRECTIONAL
+			&& sceneLight->mType != aiLightSource_SPOT) {
+			continue;
+		}
+		TracerLight light;
+		light.type = sceneLight->mType;
+		light.position = lightTransforms[i] * sceneLight->mPosition;
+		light.direction = (aiMatrix3x3(lightTransforms[i]) * sceneLight->mDirection).Normalize();
+		light.color = sceneLight->mColorDiffuse;
+		light.attenuationConstant = sceneLight->mAttenuationConstant;
+		light.attenuationLinear = sceneLight->mAttenuationLinear;
+		light.attenuationQuadratic = sceneLight->mAttenuationQuadratic;
+		light.cosInnerCone = cos(sceneLight->mAngleInnerCone);
+		light.cosOuterCone = cos(sceneLight->mAngleOuterCone);
+		lights.push_back(light);
+	}
+}
+
+//------------------------------------------------------------
+// Build the triangles and the 4-wide BVH of a path tracer. Each instance adds the triangles of its source mesh,
+// moved by its transform, with the material of its own mesh. The triangles end up in the order of the leaves.
+void buildTracerGeometry(const aiScene* scene, const vector<PickInstance>& instances, PathTracer& tracer) {
+	vector<TracerTriangle> triangles;
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		const aiMesh* mesh = scene->mMeshes[instances[i].sourceMesh];
+		if (!mesh->HasPositions() || !mesh->HasFaces()) {
+			continue;
+		}
+		unsigned int material = scene->mNumMaterials > 0 ? scene->mMeshes[instances[i].meshIndex]->mMaterialIndex : 0;
+		const aiMatrix4x4& transform = instances[i].transform;
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+			const aiFace& face = mesh->mFaces[f];
+			for (unsigned int k = 2; k < face.mNumIndices; k++) {
+				TracerTriangle triangle;
+				triangle.vertex0 = transform * mesh->mVertices[face.mIndices[0]];
+				triangle.edge1 = transform * mesh->mVertices[face.mIndices[k - 1]] - triangle.vertex0;
+				triangle.edge2 = transform * mesh->mVertices[face.mIndices[k]] - triangle.vertex0;
+				triangle.material = material;
+				triangles.push_back(triangle);
+			}
+		}
+	}
+
+	unsigned int triangleCount = (unsigned int) triangles.size();
+	vector<BvhPrimitiveBox> boxes(triangleCount);
+	parallelFor((triangleCount + 65535) / 65536, [&triangles, &boxes, triangleCount](unsigned int block) {
+		for (unsigned int i = block * 65536; i < min(triangleCount, (block + 1) * 65536); i++) {
+			const TracerTriangle& triangle = triangles[i];
+			aiVector3D vertex1 = triangle.vertex0 + triangle.edge1, vertex2 = triangle.vertex0 + triangle.edge2;
+			resetBox(boxes[i].boundsMin, boxes[i].boundsMax);
+			growBox(boxes[i].boundsMin, boxes[i].boundsMax, &triangle.vertex0.x, &triangle.vertex0.x);
+			growBox(boxes[i].boundsMin, boxes[i].boundsMax, &vertex1.x, &vertex1.x);
+			growBox(boxes[i].boundsMin, boxes[i].boundsMax, &vertex2.x, &vertex2.x);
+		}
+	});
+	Bvh bvh;
+	buildBvh(boxes, bvh);
+	collapseBvh(bvh, tracer.nodes);
+
+	tracer.triangles.resize(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++) {
+		tracer.triangles[i] = triangles[bvh.primitives[i]];
+	}
+}
+
+// Build the geometry, the materials and the lights of a path tracer.
+void buildPathTracer(const aiScene* scene, const vector<PickInstance>& instances, const vector<aiMatrix4x4>& lightTransforms, PathTracer& tracer) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	buildTracerGeometry(scene, instances, tracer);
+	setupTracerMaterials(scene, tracer.materials);
+	setupTracerLights(scene, lightTransforms, tracer.lights);
+	tracer.rayCount = 0;
+	tracer.buildMilliseconds = elapsedMilliseconds(startTime);
+}
+
+//------------------------------------------------------------
+// Set the size of the image and clear it.
+void resetPathTracerImage(PathTracer& tracer, unsigned int width, unsigned int height) {
+	tracer.width = width;
+	tracer.height = height;
+	tracer.accumulation.assign(3 * (size_t) width * height, 0.0f);
+	tracer.sampleCount = 0;
+}
+
+//------------------------------------------------------------
+// Seed the random numbers of a sample from the pixel and the sample index, so that a pass gives the same
+// image however its tiles are spread across the cores.
+TracerRandom seedTracerRandom(unsigned int pixel, unsigned int sample) {
+	unsigned long long seed = ((unsigned long long) sample << 32 | pixel) + 0x9E3779B97F4A7C15ull;
+	seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+	seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+	TracerRandom random;
+	random.state = seed ^ (seed >> 31);
+	return random;
+}
+
+// A random number in [0, 1).
+inline float nextTracerRandom(TracerRandom& random) {
+	unsigned long long state = random.state;
+	random.state = state * 6364136223846793005ull + 1442695040888963407ull;
+	unsigned int xorShifted = (unsigned int) (((state >> 18) ^ state) >> 27);
+	unsigned int rotation = (unsigned int) (state >> 59);
+	unsigned int bits = (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+//------------------------------------------------------------
+TracerRay makeTracerRay(const aiVector3D& origin, const aiVector3D& direction) {
+	TracerRay ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	for (unsigned int k = 0; k < 3; k++) {
+		float d = direction[k];
+		ray.inverseDirection[k] = 1.0f / (fabs(d) > 1e-20f ? d : (d < 0 ? -1e-20f : 1e-20f));
+#ifdef RAY_PICKING_SSE
+		ray.origin4[k] = _mm_set1_ps(origin[k]);
+		ray.inverseDirection4[k] = _mm_set1_ps(ray.inverseDirection[k]);
+#endif
+	}
+	return ray;
+}
+
+// The slab test of the 4 boxes of a node. Returns a bit per child that the ray enters before tMax, and sets
+// tEnter[] to where it enters them. With SSE, each axis is done for the 4 children at once.
+inline unsigned int intersectBvh4Node(const Bvh4Node& node, const TracerRay& ray, float tMax, float tEnter[4]) {
+	unsigned int mask = 0;
+#ifdef RAY_PICKING_SSE
+	__m128 tNear = _mm_setzero_ps();
+	__m128 tFar = _mm_set1_ps(tMax);
+	for (unsigned int k = 0; k < 3; k++) {
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMin[k]), ray.origin4[k]), ray.inverseDirection4[k]);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMax[k]), ray.origin4[k]), ray.inverseDirection4[k]);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+	}
+	_mm_storeu_ps(tEnter, tNear);
+	mask = (unsigned int) _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+	for (unsigned int i = 0; i < 4; i++) {
+		float tNear = 0, tFar = tMax;
+		for (unsigned int k = 0; k < 3; k++) {
+			float t0 = (node.boundsMin[k][i] - ray.origin[k]) * ray.inverseDirection[k];
+			float t1 = (node.boundsMax[k][i] - ray.origin[k]) * ray.inverseDirection[k];
+			tNear = max(tNear, min(t0, t1));
+			tFar = min(tFar, max(t0, t1));
+		}
+		tEnter[i] = tNear;
+		mask |= (tNear <= tFar) << i;
+	}
+#endif
+	// The empty slots have inverted boxes, which the slabs cannot reject on their own.
+	for (unsigned int i = 0; i < 4; i++) {
+		if (node.children[i] == BVH4_NO_CHILD) {
+			mask &= ~(1u << i);
+		}
+	}
+	return mask;
+}
+
+// The Moller-Trumbore test of a triangle with its edges precomputed.
+inline bool intersectTracerTriangle(const TracerRay& ray, const TracerTriangle& triangle, float tMax, float& t) {
+	aiVector3D p = ray.direction ^ triangle.edge2;
+	float determinant = triangle.edge1 * p;
+	if (fabs(determinant) < 1e-20f) {
+		return false;
+	}
+	float inverseDeterminant = 1.0f / determinant;
+	aiVector3D s = ray.origin - triangle.vertex0;
+	float u = (s * p) * inverseDeterminant;
+	if (u < 0 || u > 1) {
+		return false;
+	}
+	aiVector3D q = s ^ triangle.edge1;
+	float v = (ray.direction * q) * inverseDeterminant;
+	if (v < 0 || u + v > 1) {
+		return false;
+	}
+	float hit = (triangle.edge2 * q) * inverseDeterminant;
+	if (hit <= 0 || hit >= tMax) {
+		return false;
+	}
+	t = hit;
+	return true;
+}
+
+//------------------------------------------------------------
+// Find the nearest triangle a ray hits before tMax. The children a node's boxes let through are pushed
+// farthest first, so that the nearest one is visited next. Returns false if there is none.
+bool traceNearestHit(const PathTracer& tracer, const TracerRay& ray, float& tMax, unsigned int& triangleIndex) {
+	if (tracer.nodes.empty()) {
+		return false;
+	}
+	unsigned int stackNodes[BVH4_STACK_SIZE];
+	unsigned int stackCounts[BVH4_STACK_SIZE];
+	float stackDistances[BVH4_STACK_SIZE];
+	unsigned int stackSize = 1;
+	stackNodes[0] = 0;
+	stackCounts[0] = 0;
+	stackDistances[0] = 0;
+	bool found = false;
+	while (stackSize > 0) {
+		stackSize--;
+		if (stackDistances[stackSize] > tMax) {
+			continue;
+		}
+		unsigned int current = stackNodes[stackSize];
+		unsigned int count = stackCounts[stackSize];
+		if (count > 0) {
+			for (unsigned int i = current; i < current + count; i++) {
+				float t;
+				if (intersectTracerTriangle(ray, tracer.triangles[i], tMax, t)) {
+					tMax = t;
+					triangleIndex = i;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		const Bvh4Node& node = tracer.nodes[current];
+		float tEnter[4];
+		unsigned int mask = intersectBvh4Node(node, ray, tMax, tEnter);
+		unsigned int first = stackSize;
+		for (unsigned int i = 0; i < 4; i++) {
+			if (mask & (1u << i)) {
+				// Insert the child so that the entries pushed for this node go from the farthest to the nearest.
+				unsigned int j = stackSize++;
+				while (j > first && stackDistances[j - 1] < tEnter[i]) {
+					stackNodes[j] = stackNodes[j - 1];
+					stackCounts[j] = stackCounts[j - 1];
+					stackDistances[j] = stackDistances[j - 1];
+					j--;
+				}
+				stackNodes[j] = node.children[i];
+				stackCounts[j] = node.counts[i];
+				stackDistances[j] = tEnter[i];
+			}
+		}
+	}
+	return found;
+}
+
+// Check if a ray hits any triangle before tMax (for the shadow rays). The first hit ends the search.
+bool traceAnyHit(const PathTracer& tracer, const TracerRay& ray, float tMax) {
+	if (tracer.nodes.empty()) {
+		return false;
+	}
+	unsigned int stackNodes[BVH4_STACK_SIZE];
+	unsigned int stackCounts[BVH4_STACK_SIZE];
+	unsigned int stackSize = 1;
+	stackNodes[0] = 0;
+	stackCounts[0] = 0;
+	while (stackSize > 0) {
+		stackSize--;
+		unsigned int current = stackNodes[stackSize];
+		unsigned int count = stackCounts[stackSize];
+		if (count > 0) {
+			for (unsigned int i = current; i < current + count; i++) {
+				float t;
+				if (intersectTracerTriangle(ray, tracer.triangles[i], tMax, t)) {
+					return true;
+				}
+			}
+			continue;
+		}
+
+		const Bvh4Node& node = tracer.nodes[current];
+		float tEnter[4];
+		unsigned int mask = intersectBvh4Node(node, ray, tMax, tEnter);
+		for (unsigned int i = 0; i < 4; i++) {
+			if (mask & (1u << i)) {
+				stackNodes[stackSize] = node.children[i];
+				stackCounts[stackSize] = node.counts[i];
+				stackSize++;
+			}
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------
+// Two directions perpendicular to a unit vector and to each other.
+void getTangentFrame(const aiVector3D& normal, aiVector3D& tangent, aiVector3D& bitangent) {
+	aiVector3D axis = fabs(normal.x) < 0.9f ? aiVector3D(1.0f, 0.0f, 0.0f) : aiVector3D(0.0f, 1.0f, 0.0f);
+	tangent = (axis ^ normal).Normalize();
+	bitangent = normal ^ tangent;
+}
+
+// A direction around axis, with a density proportional to pow(cos(angle), exponent); 1 gives the cosine
+// distribution of a diffuse surface.
+aiVector3D sampleCosinePower(const aiVector3D& axis, float exponent, TracerRandom& random) {
+	float cosTheta = pow(nextTracerRandom(random), 1.0f / (exponent + 1.0f));
+	float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+	float phi = 6.2831853f * nextTracerRandom(random);
+	aiVector3D tangent, bitangent;
+	getTangentFrame(axis, tangent, bitangent);
+	return tangent * (sinTheta * cos(phi)) + bitangent * (sinTheta * sin(phi)) + axis * cosTheta;
+}
+
+// The BRDF of a material (Lambert plus normalized Phong) times the cosine of the light direction.
+aiColor3D evaluateTracerMaterial(const TracerMaterial& material, const aiVector3D& normal, const aiVector3D& toLight, const aiVector3D& toViewer) {
+	float cosLight = normal * toLight;
+	aiVector3D reflection = normal * (2.0f * (normal * toViewer)) - toViewer;
+	float specular = pow(max(0.0f, reflection * toLight), material.shininess) * (material.shininess + 2.0f) / 6.2831853f;
+	float diffuse = 1.0f / 3.14159265f;
+	return aiColor3D((material.diffuse.r * diffuse + material.specular.r * specular) * cosLight,
+		(material.diffuse.g * diffuse + material.specular.g * specular) * cosLight,
+		(material.diffuse.b * diffuse + material.specular.b * specular) * cosLight);
+}
+
+// The light that arrives at a point from one light, or false if the point is behind the surface or in shadow.
+bool sampleTracerLight(const PathTracer& tracer, const TracerLight& light, const aiVector3D& position, const aiVector3D& normal,
+	aiVector3D& toLight, aiColor3D& radiance, unsigned long long& rayCount) {
+	float distance = PATH_TRACER_FAR;
+	float intensity = 1.0f;
+	if (light.type == aiLightSource_DIRECTIONAL) {
+		toLight = -light.direction;
+	} else {
+		toLight = light.position - position;
+		distance = toLight.Length();
+		if (distance <= 0) {
+			return false;
+		}
+		toLight /= distance;
+		float attenuation = light.attenuationConstant + light.attenuationLinear * distance + light.attenuationQuadratic * distance * distance;
+		intensity = attenuation > 0 ? 1.0f / attenuation : 1.0f;
+		if (light.type == aiLightSource_SPOT) {
+			float cosAngle = -(toLight * light.direction);
+			if (cosAngle <= light.cosOuterCone) {
+				return false;
+			}
+			if (cosAngle < light.cosInnerCone) {
+				float x = (cosAngle - light.cosOuterCone) / (light.cosInnerCone - light.cosOuterCone);
+				intensity *= x * x * (3.0f - 2.0f * x);
+			}
+		}
+	}
+	if (normal * toLight <= 0) {
+		return false;
+	}
+	rayCount++;
+	if (traceAnyHit(tracer, makeTracerRay(position, toLight), distance)) {
+		return false;
+	}
+	radiance = aiColor3D(light.color.r * intensity, light.color.g * intensity, light.color.b * intensity);
+	return true;
+}
+
+//------------------------------------------------------------
+// Follow one path from the camera, and return the light it brings back. At each hit, the emission of the
+// surface and the light of each light source are added; then the path goes on in a direction sampled from the
+// diffuse or the specular part of the material, and is ended at random once it has bounced a few times.
+aiColor3D tracePath(const PathTracer& tracer, TracerRay ray, float tMax, TracerRandom& random, unsigned long long& rayCount) {
+	aiColor3D radiance(0.0f, 0.0f, 0.0f);
+	aiColor3D throughput(1.0f, 1.0f, 1.0f);
+	for (unsigned int bounce = 0; bounce <= tracer.maxBounces; bounce++) {
+		unsigned int triangleIndex = 0;
+		rayCount++;
+		if (!traceNearestHit(tracer, ray, tMax, triangleIndex)) {
+			radiance = radiance + throughput * tracer.environment;
+			break;
+		}
+		const TracerTriangle& triangle = tracer.triangles[triangleIndex];
+		const TracerMaterial& material = tracer.materials[triangle.material];
+		radiance = radiance + throughput * material.emissive;
+
+		// The surface faces the ray. The next rays start a little above it, so that they do not hit it again.
+		aiVector3D normal = (triangle.edge1 ^ triangle.edge2).Normalize();
+		if (normal * ray.direction > 0) {
+			normal = -normal;
+		}
+		aiVector3D position = ray.origin + ray.direction * tMax;
+		float scale = max(max(fabs(position.x), fabs(position.y)), max(fabs(position.z), 1.0f));
+		position += normal * (1e-4f * scale);
+		aiVector3D toViewer = -ray.direction;
+
+		for (unsigned int i = 0; i < tracer.lights.size(); i++) {
+			aiVector3D toLight;
+			aiColor3D lightRadiance;
+			if (sampleTracerLight(tracer, tracer.lights[i], position, normal, toLight, lightRadiance, rayCount)) {
+				radiance = radiance + throughput * lightRadiance * evaluateTracerMaterial(material, normal, toLight, toViewer);
+			}
+		}
+
+		// Choose the diffuse or the specular part by how much light each reflects.
+		float diffuseWeight = max(max(material.diffuse.r, material.diffuse.g), material.diffuse.b);
+		float specularWeight = max(max(material.specular.r, material.specular.g), material.specular.b);
+		if (diffuseWeight + specularWeight <= 0) {
+			break;
+		}
+		float specularProbability = specularWeight / (diffuseWeight + specularWeight);
+		aiVector3D direction;
+		if (nextTracerRandom(random) < specularProbability) {
+			aiVector3D reflection = normal * (2.0f * (normal * toViewer)) - toViewer;
+			direction = sampleCosinePower(reflection, material.shininess, random);
+			float cosine = normal * direction;
+			if (cosine <= 0) {
+				break;
+			}
+			float weight = (material.shininess + 2.0f) / (material.shininess + 1.0f) * cosine / specularProbability;
+			throughput = throughput * material.specular * weight;
+		} else {
+			direction = sampleCosinePower(normal, 1.0f, random);
+			throughput = throughput * material.diffuse * (1.0f / (1.0f - specularProbability));
+		}
+
+		// Russian roulette: after 3 bounces, dim paths are ended, and the ones that go on are made brighter.
+		if (bounce >= 3) {
+			float survival = min(0.95f, max(max(throughput.r, throughput.g), throughput.b));
+			if (nextTracerRandom(random) >= survival) {
+				break;
+			}
+			throughput = throughput * (1.0f / survival);
+		}
+		ray = makeTracerRay(position, direction);
+		tMax = PATH_TRACER_FAR;
+	}
+	return radiance;
+}
+
+//------------------------------------------------------------
+// Add samplesPerPixel samples to every pixel. The camera is the one of load_3d_obj.cc: the meshes are drawn in
+// clip coordinates, so the rays go straight into the screen, from the near plane (z = -1) to the far plane
+// (z = 1), through a random point of their pixel.
+double renderPathTracerPass(PathTracer& tracer, unsigned int samplesPerPixel, unsigned int threadCount = 0) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	unsigned int tilesX = (tracer.width + PATH_TRACER_TILE_SIZE - 1) / PATH_TRACER_TILE_SIZE;
+	unsigned int tilesY = (tracer.height + PATH_TRACER_TILE_SIZE - 1) / PATH_TRACER_TILE_SIZE;
+	atomic<unsigned long long> rayCount(0);
+	parallelFor(tilesX * tilesY, [&tracer, &rayCount, tilesX, samplesPerPixel](unsigned int tile) {
+		unsigned long long tileRayCount = 0;
+		unsigned int x0 = (tile % tilesX) * PATH_TRACER_TILE_SIZE, y0 = (tile / tilesX) * PATH_TRACER_TILE_SIZE;
+		for (unsigned int y = y0; y < min(y0 + PATH_TRACER_TILE_SIZE, tracer.height); y++) {
+			for (unsigned int x = x0; x < min(x0 + PATH_TRACER_TILE_SIZE, tracer.width); x++) {
+				unsigned int pixel = y * tracer.width + x;
+				float* sum = &tracer.accumulation[3 * (size_t) pixel];
+				for (unsigned int s = 0; s < samplesPerPixel; s++) {
+					TracerRandom random = seedTracerRandom(pixel, tracer.sampleCount + s);
+					aiVector3D origin(2.0f * (x + nextTracerRandom(random)) / tracer.width - 1.0f,
+						1.0f - 2.0f * (y + nextTracerRandom(random)) / tracer.height, -1.0f);
+					aiColor3D color = tracePath(tracer, makeTracerRay(origin, aiVector3D(0.0f, 0.0f, 1.0f)), 2.0f, random, tileRayCount);
+					sum[0] += color.r;
+					sum[1] += color.g;
+					sum[2] += color.b;
+				}
+			}
+		}
+		rayCount += tileRayCount;
+	}, threadCount);
+	tracer.sampleCount += samplesPerPixel;
+	tracer.rayCount += rayCount;
+	return elapsedMilliseconds(startTime);
+}
+
+//------------------------------------------------------------
+// Write the image into a binary PPM file, in sRGB (approximated by a gamma of 2.2) and clamped to [0, 1].
+bool writePathTracerImage(const PathTracer& tracer, const string& fileName) {
+	char header[64];
+	int headerSize = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", tracer.width, tracer.height);
+	vector<unsigned char> file(header, header + headerSize);
+	float scale = tracer.sampleCount > 0 ? 1.0f / tracer.sampleCount : 0.0f;
+	for (size_t i = 0; i < tracer.accumulation.size(); i++) {
+		float value = pow(min(max(tracer.accumulation[i] * scale, 0.0f), 1.0f), 1.0f / 2.2f);
+		file.push_back((unsigned char) (value * 255.0f + 0.5f));
+	}
+	return writeFile(fileName, &file[0], file.size());
+}
+
+//------------------------------------------------------------
+// Render a pass on 1, 2, 4, ... threads up to all the CPU cores, and print the samples per second of each and
+// how much faster than 1 thread it is. The passes are added to the image like any other.
+void benchmarkPathTracerScaling(PathTracer& tracer, unsigned int samplesPerPixel) {
+	unsigned int maxThreadCount = getWorkerThreadCount();
+	double samples = (double) tracer.width * tracer.height * samplesPerPixel;
+	double singleThreadMilliseconds = 0;
+	cout << "Path tracer scaling, " << samplesPerPixel << " samples per pixel per pass:" << endl;
+	for (unsigned int threadCount = 1; ; threadCount = min(threadCount * 2, maxThreadCount)) {
+		unsigned long long raysBefore = tracer.rayCount;
+		double milliseconds = renderPathTracerPass(tracer, samplesPerPixel, threadCount);
+		if (threadCount == 1) {
+			singleThreadMilliseconds = milliseconds;
+		}
+		double speedup = singleThreadMilliseconds / milliseconds;
+		cout << "  " << threadCount << " threads: " << milliseconds << " ms, " << samples / milliseconds / 1000.0 << " M samples/s, "
+			<< (tracer.rayCount - raysBefore) / milliseconds / 1000.0 << " M rays/s, " << speedup << "x (" << 100.0 * speedup / threadCount
+			<< "% per thread)" << endl;
+		if (threadCount == maxThreadCount) {
+			break;
+		}
+	}
+}
+
+//------------------------------------------------------------
+// The memory the triangles, the BVH and the image of a path tracer take.
+unsigned long long getPathTracerMemorySize(const PathTracer& tracer) {
+	return sizeof(Bvh4Node) * (unsigned long long) tracer.nodes.size()
+		+ sizeof(TracerTriangle) * (unsigned long long) tracer.triangles.size()
+		+ sizeof(float) * (unsigned long long) tracer.accumulation.size();
+}
@@ -0,0 +1,719 @@
+/* This is a utility program that helps OpenGL programmers draw point clouds that are too large to upload.
+A LiDAR scan is imported by Assimp as meshes of aiPrimitiveType_POINT faces with hundreds of millions of points.
+This file sorts the points into an octree once and writes it to a cache file. Each node of the octree stores a
+subsample of the points below it (at most maxNodePoints), with 16-bit positions relative to the node's bounds,
+so a node takes 8 bytes per point instead of 12. The cache file is memory-mapped, and only the nodes a frame
+needs are uploaded: the octree is refined where its points are spread too thinly on the screen, until the
+points-per-frame budget is reached. The uploaded nodes are kept within a memory budget of their own.
+The octree is built in parallel: the points are first sorted into the cells of one level of the octree, and
+then the subtree of each cell is built on its own, from the points sorted along a Morton (Z-order) curve.
+The following functions are provided.
+
+// The name of the cache file of the point cloud of a 3D file.
+string getPointCloudCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int maxNodePoints)
+
+// Build the octree of the points of the meshes into a cache file, unless the file already exists.
+// Returns false if the file cannot be written.
+bool buildPointCloud(const vector<const aiMesh*>& meshes, const string& cacheFileName, unsigned int maxNodePoints)
+
+// Map a cache file and create the buffer objects of a point cloud. positionLocation is the vPos attribute.
+bool openPointCloud(PointCloud& cloud, const string& cacheFileName, GLint positionLocation,
+	unsigned long long memoryBudget, unsigned long long uploadBudget)
+
+// Select, upload and draw the nodes of a point cloud for this frame. The dequantizing transform of each node
+// is passed to the vertex shader in the uniform at transformLocation.
+void drawPointCloud(PointCloud& cloud, const aiMatrix4x4& transform, GLint transformLocation, int windowWidth,
+	int windowHeight, unsigned int pointBudget, float pointSpacing)
+
+// True if the last frame needed nodes that could not be uploaded yet, i.e. the next frame will look better.
+bool isPointCloudStreaming(const PointCloud& cloud)
+
+// Release the buffer objects and the cache file of a point cloud.
+void closePointCloud(PointCloud& cloud)
+
+// Print the size of the octree, the resident nodes and the points drawn in the last frame.
+void printPointCloudStatistics(const PointCloud& cloud)
+
+This file requires thread_utilities.hpp, file_utilities.hpp, tlsf_allocator.hpp and geometry_pool.hpp
+to be included first.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Bits per axis of the Morton codes, i.e. the deepest level of the octree.
+#define POINT_CLOUD_MORTON_BITS 21
+
+// The level whose cells are built in parallel. It has up to 8^3 = 512 cells.
+#define POINT_CLOUD_CELL_DEPTH 3
+
+// The header at the beginning of a point cloud cache file. The node table is at the end of the file.
+struct PointCloudHeader {
+	unsigned char identifier[12];       // POINT_CLOUD_IDENTIFIER
+	unsigned int nodeCount;
+	unsigned int rootNode;
+	unsigned int reserved;
+	unsigned long long nodeTableOffset;
+	unsigned long long pointCount;      // the points of all the meshes
+};
+
+const unsigned char POINT_CLOUD_IDENTIFIER[12] = { 0xAB, 'P', 'C', 'O', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// One entry of the node table. Nodes are cubes.
+struct PointCloudNode {
+	float boundsMin[3];
+	float size;
+	unsigned int pointCount;            // the points stored in this node, not in its subtree
+	unsigned int depth;
+	int children[8];                    // -1 if there is no child in that octant
+	unsigned long long byteOffset;      // where the quantized points of the node start in the file
+};
+
+// A position relative to the bounds of its node. The padding keeps each point on an 8-byte boundary.
+struct QuantizedPoint {
+	unsigned short x, y, z, padding;
+};
+
+struct PointCloud {
+	MappedFile file;
+	vector<PointCloudNode> nodes;
+	unsigned int rootNode;
+	unsigned long long pointCount;
+
+	// The uploaded nodes, in a pool of QuantizedPoint units drawn through vao.
+	GeometryPool pool;
+	GLuint vao;
+	GLint positionLocation;
+	vector<unsigned int> nodeRanges;    // TLSF_NO_BLOCK if the node is not uploaded
+	vector<unsigned int> usedFrames;    // the last frame that selected the node or one of its children
+	vector<unsigned int> refinedFrames; // the last frame that drew the children of the node instead of the node
+	vector<unsigned int> selectedNodes;
+	unsigned long long residentBytes;
+	unsigned long long memoryBudget;
+	unsigned long long uploadBudget;    // bytes per frame
+	unsigned int frame;
+	bool missingNodes;
+
+	// Statistics
+	unsigned int drawnNodeCount;
+	unsigned long long drawnPointCount;
+	unsigned long long uploadedBytes;
+	unsigned int evictedNodeCount;
+};
+
+//------------------------------------------------------------
+// The name of the cache file of the point cloud of a 3D file.
+string getPointCloudCacheFileName(const string& modelFileName, const string& cacheDirectory, unsigned int maxNodePoints) {
+	unsigned long long key = hashFileVersion(modelFileName);
+	key = hashBytes(&maxNodePoints, sizeof(maxNodePoints), key);
+	return cacheDirectory + "/" + formatHash(key) + ".pco";
+}
+
+//------------------------------------------------------------
+// Spread the lower 21 bits of v so that there are two zero bits between each of them.
+unsigned long long spreadMortonBits(unsigned long long v) {
+	v &= 0x1FFFFF;
+	v = (v | (v << 32)) & 0x1F00000000FFFFULL;
+	v = (v | (v << 16)) & 0x1F0000FF0000FFULL;
+	v = (v | (v << 8)) & 0x100F00F00F00F00FULL;
+	v = (v | (v << 4)) & 0x10C30C30C30C30C3ULL;
+	v = (v | (v << 2)) & 0x1249249249249249ULL;
+	return v;
+}
+
+// The octant of a child is (x << 2) | (y << 1) | z, so that the Morton code of a point is the path to it.
+unsigned long long getMortonCode(unsigned int x, unsigned int y, unsigned int z) {
+	return (spreadMortonBits(x) << 2) | (spreadMortonBits(y) << 1) | spreadMortonBits(z);
+}
+
+// The integer coordinates of the cell of a Morton code prefix with depth octants.
+void decodeMortonPrefix(unsigned long long prefix, unsigned int depth, unsigned int coordinates[3]) {
+	coordinates[0] = coordinates[1] = coordinates[2] = 0;
+	for (unsigned int level = 0; level < depth; level++) {
+		unsigned int octant = (unsigned int) (prefix >> (3 * (depth - 1 - level))) & 7;
+		coordinates[0] = (coordinates[0] << 1) | ((octant >> 2) & 1);
+		coordinates[1] = (coordinates[1] << 1) | ((octant >> 1) & 1);
+		coordinates[2] = (coordinates[2] << 1) | (octant & 1);
+	}
+}
+
+//------------------------------------------------------------
+// Everything the build of the octree shares between the threads.
+struct PointCloudBuilder {
+	vector<const aiMesh*> meshes;
+	vector<unsigned int> firstPoints;   // the index of the first point of each mesh
+	aiVector3D cubeMin;
+	float cubeSize;
+	unsigned int maxNodePoints;
+
+	// The nodes are written as soon as they are built, so the file and the node table are shared.
+	mutex fileMutex;
+	ofstream* fileOut;
+	unsigned long long fileOffset;
+	vector<PointCloudNode> nodes;
+	unsigned int maxDepth;
+};
+
+// The position of a point, by its index among the points of all the meshes.
+const aiVector3D& getBuilderPoint(const PointCloudBuilder& builder, unsigned int index) {
+	unsigned int mesh = (unsigned int) (upper_bound(builder.firstPoints.begin(), builder.firstPoints.end(), index)
+		- builder.firstPoints.begin()) - 1;
+	return builder.meshes[mesh]->mVertices[index - builder.firstPoints[mesh]];
+}
+
+// The Morton code of a point, with POINT_CLOUD_MORTON_BITS bits per axis.
+unsigned long long getPointMortonCode(const PointCloudBuilder& builder, const aiVector3D& point) {
+	const unsigned int cellCount = 1u << POINT_CLOUD_MORTON_BITS;
+	unsigned int coordinates[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		float position = (point[c] - builder.cubeMin[c]) / builder.cubeSize * cellCount;
+		coordinates[c] = position <= 0 ? 0 : min((unsigned int) position, cellCount - 1);
+	}
+	return getMortonCode(coordinates[0], coordinates[1], coordinates[2]);
+}
+
+// Set the bounds of a node from the cell coordinates at its depth.
+void setNodeBounds(const PointCloudBuilder& builder, PointCloudNode& node, unsigned int depth, const unsigned int coordinates[3]) {
+	node.size = builder.cubeSize / (float) (1u << depth);
+	for (unsigned int c = 0; c < 3; c++) {
+		node.boundsMin[c] = builder.cubeMin[c] + coordinates[c] * node.size;
+	}
+	node.depth = depth;
+	for (unsigned int k = 0; k < 8; k++) {
+		node.children[k] = -1;
+	}
+}
+
+// Quantize the points of a node and append them to the file. Returns the index of the node.
+unsigned int writePointCloudNode(PointCloudBuilder& builder, PointCloudNode& node, const vector<unsigned int>& points) {
+	vector<QuantizedPoint> quantized(points.size());
+	float scale = node.size > 0 ? 65535.0f / node.size : 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		const aiVector3D& point = getBuilderPoint(builder, points[i]);
+		unsigned short q[3];
+		for (unsigned int c = 0; c < 3; c++) {
+			float position = (point[c] - node.boundsMin[c]) * scale + 0.5f;
+			q[c] = (unsigned short) (position <= 0 ? 0 : min(position, 65535.0f));
+		}
+		quantized[i].x = q[0];
+		quantized[i].y = q[1];
+		quantized[i].z = q[2];
+		quantized[i].padding = 0;
+	}
+	node.pointCount = (unsigned int) points.size();
+
+	lock_guard<mutex> lock(builder.fileMutex);
+	node.byteOffset = builder.fileOffset;
+	if (!quantized.empty()) {
+		builder.fileOut->write((const char*) &quantized[0], sizeof(QuantizedPoint) * quantized.size());
+	}
+	builder.fileOffset += sizeof(QuantizedPoint) * quantized.size();
+	builder.nodes.push_back(node);
+	builder.maxDepth = max(builder.maxDepth, node.depth);
+	return (unsigned int) builder.nodes.size() - 1;
+}
+
+// Build the subtree of the points codes[begin, end), which are sorted by Morton code and share the first depth
+// octants. The children are written before their parent, so that the parent knows their indices.
+// The points of an inner node are every n-th point along the Morton curve, which spreads them over the node.
+unsigned int buildPointCloudNode(PointCloudBuilder& builder, const vector<pair<unsigned long long, unsigned int> >& codes,
+	size_t begin, size_t end, unsigned int depth, vector<unsigned int>& points) {
+	PointCloudNode node;
+	unsigned int coordinates[3];
+	decodeMortonPrefix(codes[begin].first >> (3 * (POINT_CLOUD_MORTON_BITS - depth)), depth, coordinates);
+	setNodeBounds(builder, node, depth, coordinates);
+
+	size_t count = end - begin;
+	points.clear();
+	if (count <= builder.maxNodePoints || depth == POINT_CLOUD_MORTON_BITS) {
+		for (size_t i = begin; i < end; i++) {
+			points.push_back(codes[i].second);
+		}
+		return writePointCloudNode(builder, node, points);
+	}
+
+	// The children are the runs of points with the same next octant.
+	unsigned int shift = 3 * (POINT_CLOUD_MORTON_BITS - depth - 1);
+	size_t childBegin = begin;
+	while (childBegin < end) {
+		unsigned int octant = (unsigned int) (codes[childBegin].first >> shift) & 7;
+		size_t childEnd = partition_point(codes.begin() + childBegin, codes.begin() + end,
+			[shift, octant](const pair<unsigned long long, unsigned int>& code) {
+			return ((code.first >> shift) & 7) <= octant;
+		}) - codes.begin();
+		node.children[octant] = (int) buildPointCloudNode(builder, codes, childBegin, childEnd, depth + 1, points);
+		childBegin = childEnd;
+	}
+
+	points.clear();
+	for (unsigned int k = 0; k < builder.maxNodePoints; k++) {
+		points.push_back(codes[begin + (size_t) k * count / builder.maxNodePoints].second);
+	}
+	return writePointCloudNode(builder, node, points);
+}
+
+//------------------------------------------------------------
+// Build the octree of the points of the meshes into a cache file.
+bool buildPointCloud(const vector<const aiMesh*>& meshes, const string& cacheFileName, unsigned int maxNodePoints) {
+	unsigned long long cacheFileSize = 0;
+	long long cacheModificationTime = 0;
+	if (getFileInfo(cacheFileName, cacheFileSize, cacheModificationTime)) {
+		return true;
+	}
+
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	PointCloudBuilder builder;
+	builder.meshes = meshes;
+	builder.maxNodePoints = max(maxNodePoints, 1u);
+	builder.maxDepth = 0;
+	unsigned int pointCount = 0;
+	for (unsigned int i = 0; i < meshes.size(); i++) {
+		builder.firstPoints.push_back(pointCount);
+		pointCount += meshes[i]->mNumVertices;
+	}
+	if (pointCount == 0) {
+		return false;
+	}
+
+	// Find the bounds of the points, one chunk per thread. The octree is a cube around them.
+	unsigned int chunkCount = min(getWorkerThreadCount() * 4, max(pointCount / 65536, 1u));
+	vector<aiVector3D> chunkMin(chunkCount, aiVector3D(1e30f, 1e30f, 1e30f));
+	vector<aiVector3D> chunkMax(chunkCount, aiVector3D(-1e30f, -1e30f, -1e30f));
+	parallelFor(chunkCount, [&](unsigned int chunk) {
+		unsigned int first = (unsigned int) ((unsigned long long) pointCount * chunk / chunkCount);
+		unsigned int end = (unsigned int) ((unsigned long long) pointCount * (chunk + 1) / chunkCount);
+		for (unsigned int i = first; i < end; i++) {
+			const aiVector3D& point = getBuilderPoint(builder, i);
+			for (unsigned int c = 0; c < 3; c++) {
+				chunkMin[chunk][c] = min(chunkMin[chunk][c], point[c]);
+				chunkMax[chunk][c] = max(chunkMax[chunk][c], point[c]);
+			}
+		}
+	});
+	aiVector3D boundsMin = chunkMin[0], boundsMax = chunkMax[0];
+	for (unsigned int chunk = 1; chunk < chunkCount; chunk++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			boundsMin[c] = min(boundsMin[c], chunkMin[chunk][c]);
+			boundsMax[c] = max(boundsMax[c], chunkMax[chunk][c]);
+		}
+	}
+	builder.cubeMin = boundsMin;
+	builder.cubeSize = max(max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y), boundsMax.z - boundsMin.z);
+	builder.cubeSize = builder.cubeSize > 0 ? builder.cubeSize * 1.0001f : 1.0f;
+
+	// Sort the point indices into the cells with a counting sort: each chunk counts its points per cell,
+	// and then writes them at its own offset within each cell.
+	const unsigned int cellCount = 1u << (3 * POINT_CLOUD_CELL_DEPTH);
+	const unsigned int cellShift = 3 * (POINT_CLOUD_MORTON_BITS - POINT_CLOUD_CELL_DEPTH);
+	vector<vector<unsigned int> > chunkCellCounts(chunkCount, vector<unsigned int>(cellCount, 0));
+	parallelFor(chunkCount, [&](unsigned int chunk) {
+		unsigned int first = (unsigned int) ((unsigned long long) pointCount * chunk / chunkCount);
+		unsigned int end = (unsigned int) ((unsigned long long) pointCount * (chunk + 1) / chunkCount);
+		for (unsigned int i = first; i < end; i++) {
+			chunkCellCounts[chunk][getPointMortonCode(builder, getBuilderPoint(builder, i)) >> cellShift]++;
+		}
+	});
+
+	vector<unsigned int> cellFirst(cellCount + 1, 0);
+	for (unsigned int cell = 0; cell < cellCount; cell++) {
+		unsigned int offset = cellFirst[cell];
+		for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+			unsigned int count = chunkCellCounts[chunk][cell];
+			chunkCellCounts[chunk][cell] = offset;
+			offset += count;
+		}
+		cellFirst[cell + 1] = offset;
+	}
+
+	vector<unsigned int> cellPoints(pointCount);
+	parallelFor(chunkCount, [&](unsigned int chunk) {
+		unsigned int first = (unsigned int) ((unsigned long long) pointCount * chunk / chunkCount);
+		unsigned int end = (unsigned int) ((unsigned long long) pointCount * (chunk + 1) / chunkCount);
+		for (unsigned int i = first; i < end; i++) {
+			cellPoints[chunkCellCounts[chunk][getPointMortonCode(builder, getBuilderPoint(builder, i)) >> cellShift]++] = i;
+		}
+	});
+	chunkCellCounts.clear();
+
+	createDirectory(getDirectoryName(cacheFileName));
+	string temporaryName = getTemporaryFileName(cacheFileName);
+	ofstream fileOut(temporaryName.c_str(), ios::binary);
+	if (!fileOut.good()) {
+		cout << "buildPointCloud(): unable to create " << temporaryName << endl;
+		return false;
+	}
+	PointCloudHeader header;
+	memset(&header, 0, sizeof(header));
+	fileOut.write((const char*) &header, sizeof(header));
+	builder.fileOut = &fileOut;
+	builder.fileOffset = sizeof(header);
+
+	// Build the subtree of each cell. Only one cell's Morton codes are in memory per thread.
+	// The points of each cell's root are kept to build the levels above the cells.
+	vector<int> levelNodes(cellCount, -1);
+	vector<vector<unsigned int> > levelPoints(cellCount);
+	vector<unsigned long long> levelPointCounts(cellCount, 0);
+	parallelFor(cellCount, [&](unsigned int cell) {
+		if (cellFirst[cell] == cellFirst[cell + 1]) {
+			return;
+		}
+		vector<pair<unsigned long long, unsigned int> > codes;
+		codes.reserve(cellFirst[cell + 1] - cellFirst[cell]);
+		for (unsigned int i = cellFirst[cell]; i < cellFirst[cell + 1]; i++) {
+			codes.push_back(make_pair(getPointMortonCode(builder, getBuilderPoint(builder, cellPoints[i])), cellPoints[i]));
+		}
+		sort(codes.begin(), codes.end());
+		levelNodes[cell] = (int) buildPointCloudNode(builder, codes, 0, codes.size(), POINT_CLOUD_CELL_DEPTH, levelPoints[cell]);
+		levelPointCounts[cell] = codes.size();
+	});
+	vector<unsigned int>().swap(cellPoints);
+
+	// Build the levels above the cells. Each child gives its parent a share of its points in proportion to
+	// the points in its subtree, so that dense cells stay dense in the coarse levels.
+	for (int depth = POINT_CLOUD_CELL_DEPTH - 1; depth >= 0; depth--) {
+		unsigned int parentCount = 1u << (3 * depth);
+		vector<int> parentNodes(parentCount, -1);
+		vector<vector<unsigned int> > parentPoints(parentCount);
+		vector<unsigned long long> parentPointCounts(parentCount, 0);
+		for (unsigned int parent = 0; parent < parentCount; parent++) {
+			PointCloudNode node;
+			unsigned int coordinates[3];
+			decodeMortonPrefix(parent, depth, coordinates);
+			setNodeBounds(builder, node, depth, coordinates);
+			for (unsigned int octant = 0; octant < 8; octant++) {
+				node.children[octant] = levelNodes[parent * 8 + octant];
+				parentPointCounts[parent] += levelPointCounts[parent * 8 + octant];
+			}
+			if (parentPointCounts[parent] == 0) {
+				continue;
+			}
+
+			vector<unsigned int>& points = parentPoints[parent];
+			for (unsigned int octant = 0; octant < 8; octant++) {
+				const vector<unsigned int>& childPoints = levelPoints[parent * 8 + octant];
+				size_t share = (size_t) (builder.maxNodePoints * levelPointCounts[parent * 8 + octant] / parentPointCounts[parent]);
+				share = min(max(share, (size_t) 1), childPoints.size());
+				for (size_t k = 0; k < share; k++) {
+					points.push_back(childPoints[k * childPoints.size() / share]);
+				}
+			}
+			parentNodes[parent] = (int) writePointCloudNode(builder, node, points);
+		}
+		levelNodes.swap(parentNodes);
+		levelPoints.swap(parentPoints);
+		levelPointCounts.swap(parentPointCounts);
+	}
+
+	memcpy(header.identifier, POINT_CLOUD_IDENTIFIER, 12);
+	header.nodeCount = (unsigned int) builder.nodes.size();
+	header.rootNode = (unsigned int) levelNodes[0];
+	header.nodeTableOffset = builder.fileOffset;
+	header.pointCount = pointCount;
+	fileOut.write((const char*) &builder.nodes[0], sizeof(PointCloudNode) * builder.nodes.size());
+	fileOut.seekp(0);
+	fileOut.write((const char*) &header, sizeof(header));
+	bool written = fileOut.good();
+	fileOut.close();
+	written = written && !fileOut.fail();
+	if (!written) {
+		remove(temporaryName.c_str());
+	}
+	if (!written || !replaceFile(temporaryName, cacheFileName)) {
+		cout << "buildPointCloud(): unable to write " << cacheFileName << endl;
+		return false;
+	}
+
+	cout << "Point cloud: built an octree of " << pointCount << " points (" << header.nodeCount << " nodes, depth "
+		<< builder.maxDepth << ") into " << cacheFileName << " in " << elapsedMilliseconds(startTime) << " ms" << endl;
+	return true;
+}
+
+//------------------------------------------------------------
+// Point the vPos attribute of the point cloud's VAO to its pool. The positions are unsigned shorts that
+// are converted to floats as they are (not normalized); the transform of each node scales them back.
+void setupPointCloudVao(PointCloud& cloud) {
+	glBindVertexArray(cloud.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, cloud.pool.buffers[0]);
+	glEnableVertexAttribArray(cloud.positionLocation);
+	glVertexAttribPointer(cloud.positionLocation, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(QuantizedPoint), (GLvoid*) 0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	cloud.pool.buffersChanged = false;
+}
+
+// Upload the points of a node from the mapped file. Returns the number of bytes uploaded.
+unsigned long long uploadPointCloudNode(PointCloud& cloud, unsigned int nodeIndex) {
+	const PointCloudNode& node = cloud.nodes[nodeIndex];
+	cloud.nodeRanges[nodeIndex] = allocateGeometry(cloud.pool, node.pointCount);
+	uploadGeometry(cloud.pool, cloud.nodeRanges[nodeIndex], 0, cloud.file.data + node.byteOffset, node.pointCount);
+
+	unsigned long long bytes = sizeof(QuantizedPoint) * (unsigned long long) node.pointCount;
+	cloud.residentBytes += bytes;
+	cloud.uploadedBytes += bytes;
+	return bytes;
+}
+
+//------------------------------------------------------------
+// Map a cache file and create the buffer objects of a point cloud. The root node is uploaded right away,
+// so that there is always something to draw.
+bool openPointCloud(PointCloud& cloud, const string& cacheFileName, GLint positionLocation,
+	unsigned long long memoryBudget, unsigned long long uploadBudget) {
+	if (!mapFile(cacheFileName, cloud.file)) {
+		cout << "openPointCloud(): unable to open " << cacheFileName << endl;
+		return false;
+	}
+
+	PointCloudHeader header;
+	if (cloud.file.size < sizeof(header) || memcmp(cloud.file.data, POINT_CLOUD_IDENTIFIER, 12) != 0) {
+		cout << "openPointCloud(): " << cacheFileName << " is not a valid point cloud cache file" << endl;
+		unmapFile(cloud.file);
+		return false;
+	}
+	memcpy(&header, cloud.file.data, sizeof(header));
+	if (header.nodeCount == 0 || header.rootNode >= header.nodeCount
+		|| header.nodeTableOffset + header.nodeCount * sizeof(PointCloudNode) > cloud.file.size) {
+		cout << "openPointCloud(): " << cacheFileName << " is not a valid point cloud cache file" << endl;
+		unmapFile(cloud.file);
+		return false;
+	}
+
+	cloud.nodes.resize(header.nodeCount);
+	memcpy(&cloud.nodes[0], cloud.file.data + header.nodeTableOffset, header.nodeCount * sizeof(PointCloudNode));
+	cloud.rootNode = header.rootNode;
+	cloud.pointCount = header.pointCount;
+
+	cloud.positionLocation = positionLocation;
+	cloud.nodeRanges.assign(header.nodeCount, TLSF_NO_BLOCK);
+	cloud.usedFrames.assign(header.nodeCount, 0);
+	cloud.refinedFrames.assign(header.nodeCount, 0);
+	cloud.selectedNodes.clear();
+	cloud.residentBytes = 0;
+	cloud.memoryBudget = memoryBudget;
+	cloud.uploadBudget = uploadBudget;
+	cloud.frame = 0;
+	cloud.missingNodes = false;
+	cloud.drawnNodeCount = 0;
+	cloud.drawnPointCount = 0;
+	cloud.uploadedBytes = 0;
+	cloud.evictedNodeCount = 0;
+
+	// The pool starts at the size of the whole octree or of the budget, whichever is smaller.
+	unsigned long long fileUnits = (header.nodeTableOffset - sizeof(header)) / sizeof(QuantizedPoint);
+	createGeometryPool(cloud.pool, (unsigned int) min(fileUnits, memoryBudget / sizeof(QuantizedPoint)),
+		vector<unsigned int>(1, sizeof(QuantizedPoint)));
+	glGenVertexArrays(1, &cloud.vao);
+	setupPointCloudVao(cloud);
+
+	uploadPointCloudNode(cloud, cloud.rootNode);
+	return true;
+}
+
+//------------------------------------------------------------
+// Project the bounds of a node. Returns false if the node is outside the view. pixelSize is the larger side
+// of its bounding rectangle on the screen, in pixels.
+bool projectPointCloudNode(const PointCloudNode& node, const aiMatrix4x4& transform, int windowWidth, int windowHeight,
+	float& pixelSize) {
+	aiVector3D screenMin(1e30f, 1e30f, 1e30f), screenMax(-1e30f, -1e30f, -1e30f);
+	for (unsigned int corner = 0; corner < 8; corner++) {
+		aiVector3D point(node.boundsMin[0] + ((corner >> 2) & 1) * node.size, node.boundsMin[1] + ((corner >> 1) & 1) * node.size,
+			node.boundsMin[2] + (corner & 1) * node.size);
+		point = transform * point;
+		for (unsigned int c = 0; c < 3; c++) {
+			screenMin[c] = min(screenMin[c], point[c]);
+			screenMax[c] = max(screenMax[c], point[c]);
+		}
+	}
+	for (unsigned int c = 0; c < 3; c++) {
+		if (screenMax[c] < -1 || screenMin[c] > 1) {
+			return false;
+		}
+	}
+	pixelSize = max((screenMax.x - screenMin.x) * 0.5f * windowWidth, (screenMax.y - screenMin.y) * 0.5f * windowHeight);
+	return true;
+}
+
+// The distance between neighboring points of a node on the screen, in pixels, if its points cover its bounds.
+float getPointCloudNodeSpacing(const PointCloudNode& node, float pixelSize) {
+	return pixelSize / sqrt((float) max(node.pointCount, 1u));
+}
+
+// Evict the least recently used nodes until the uploaded nodes fit in the memory budget again.
+// The nodes used in this frame and the root are never evicted.
+void evictPointCloudNodes(PointCloud& cloud) {
+	if (cloud.residentBytes <= cloud.memoryBudget) {
+		return;
+	}
+
+	vector<pair<unsigned int, unsigned int> > residentNodes;
+	for (unsigned int i = 0; i < cloud.nodes.size(); i++) {
+		if (cloud.nodeRanges[i] != TLSF_NO_BLOCK && cloud.usedFrames[i] != cloud.frame && i != cloud.rootNode) {
+			residentNodes.push_back(make_pair(cloud.usedFrames[i], i));
+		}
+	}
+	sort(residentNodes.begin(), residentNodes.end());
+
+	for (unsigned int i = 0; i < residentNodes.size() && cloud.residentBytes > cloud.memoryBudget; i++) {
+		unsigned int nodeIndex = residentNodes[i].second;
+		freeGeometry(cloud.pool, cloud.nodeRanges[nodeIndex]);
+		cloud.nodeRanges[nodeIndex] = TLSF_NO_BLOCK;
+		cloud.residentBytes -= sizeof(QuantizedPoint) * (unsigned long long) cloud.nodes[nodeIndex].pointCount;
+		cloud.evictedNodeCount++;
+	}
+}
+
+//------------------------------------------------------------
+// Select, upload and draw the nodes of a point cloud for this frame.
+// The nodes whose points are spread widest on the screen are refined first. A node is replaced by its visible
+// children only if they all fit in the point budget and are uploaded, so the selection never has holes;
+// children that are not uploaded yet are uploaded within the per-frame upload budget.
+void drawPointCloud(PointCloud& cloud, const aiMatrix4x4& transform, GLint transformLocation, int windowWidth,
+	int windowHeight, unsigned int pointBudget, float pointSpacing) {
+	cloud.frame++;
+	cloud.missingNodes = false;
+	cloud.selectedNodes.clear();
+	cloud.drawnNodeCount = 0;
+	cloud.drawnPointCount = 0;
+
+	float pixelSize;
+	const PointCloudNode& root = cloud.nodes[cloud.rootNode];
+	if (!projectPointCloudNode(root, transform, windowWidth, windowHeight, pixelSize)) {
+		return;
+	}
+	cloud.usedFrames[cloud.rootNode] = cloud.frame;
+	cloud.selectedNodes.push_back(cloud.rootNode);
+	unsigned long long selectedPoints = root.pointCount;
+	unsigned long long uploadedBytes = 0;
+
+	priority_queue<pair<float, unsigned int> > refineQueue;
+	refineQueue.push(make_pair(getPointCloudNodeSpacing(root, pixelSize), cloud.rootNode));
+	while (!refineQueue.empty()) {
+		float spacing = refineQueue.top().first;
+		unsigned int nodeIndex = refineQueue.top().second;
+		refineQueue.pop();
+		if (spacing <= pointSpacing) {
+			continue;
+		}
+
+		const PointCloudNode& node = cloud.nodes[nodeIndex];
+		unsigned int visibleChildren[8];
+		float childSpacings[8];
+		unsigned int visibleChildCount = 0;
+		unsigned long long childPoints = 0;
+		for (unsigned int octant = 0; octant < 8; octant++) {
+			int child = node.children[octant];
+			float childPixelSize;
+			if (child >= 0 && projectPointCloudNode(cloud.nodes[child], transform, windowWidth, windowHeight, childPixelSize)) {
+				childSpacings[visibleChildCount] = getPointCloudNodeSpacing(cloud.nodes[child], childPixelSize);
+				visibleChildren[visibleChildCount++] = (unsigned int) child;
+				childPoints += cloud.nodes[child].pointCount;
+			}
+		}
+		if (visibleChildCount == 0 || selectedPoints - node.pointCount + childPoints > pointBudget) {
+			continue;
+		}
+
+		bool childrenUploaded = true;
+		for (unsigned int i = 0; i < visibleChildCount; i++) {
+			unsigned int child = visibleChildren[i];
+			cloud.usedFrames[child] = cloud.frame;
+			if (cloud.nodeRanges[child] != TLSF_NO_BLOCK) {
+				continue;
+			}
+			if (uploadedBytes < cloud.uploadBudget) {
+				uploadedBytes += uploadPointCloudNode(cloud, child);
+			} else {
+				childrenUploaded = false;
+				cloud.missingNodes = true;
+			}
+		}
+		if (!childrenUploaded) {
+			continue;
+		}
+
+		cloud.refinedFrames[nodeIndex] = cloud.frame;
+		selectedPoints = selectedPoints - node.pointCount + childPoints;
+		for (unsigned int i = 0; i < visibleChildCount; i++) {
+			cloud.selectedNodes.push_back(visibleChildren[i]);
+			refineQueue.push(make_pair(childSpacings[i], visibleChildren[i]));
+		}
+	}
+
+	// Uploading may have grown the pool and replaced its buffer object.
+	if (cloud.pool.buffersChanged) {
+		setupPointCloudVao(cloud);
+	}
+
+	// Each node is drawn with the transform that turns its quantized positions back into positions.
+	// aiMatrix4x4 is row-major, hence GL_TRUE.
+	glBindVertexArray(cloud.vao);
+	for (unsigned int i = 0; i < cloud.selectedNodes.size(); i++) {
+		unsigned int nodeIndex = cloud.selectedNodes[i];
+		if (cloud.refinedFrames[nodeIndex] == cloud.frame) {
+			continue;
+		}
+		const PointCloudNode& node = cloud.nodes[nodeIndex];
+		aiMatrix4x4 dequantize;
+		aiMatrix4x4::Scaling(aiVector3D(node.size / 65535.0f), dequantize);
+		dequantize.a4 = node.boundsMin[0];
+		dequantize.b4 = node.boundsMin[1];
+		dequantize.c4 = node.boundsMin[2];
+		aiMatrix4x4 nodeTransform = transform * dequantize;
+
+		glUniformMatrix4fv(transformLocation, 1, GL_TRUE, &nodeTransform.a1);
+		glDrawArrays(GL_POINTS, getGeometryOffset(cloud.pool, cloud.nodeRanges[nodeIndex]), node.pointCount);
+		cloud.drawnNodeCount++;
+		cloud.drawnPointCount += node.pointCount;
+	}
+	glBindVertexArray(0);
+
+	evictPointCloudNodes(cloud);
+}
+
+//------------------------------------------------------------
+// True if the last frame needed nodes that could not be uploaded yet.
+bool isPointCloudStreaming(const PointCloud& cloud) {
+	return cloud.missingNodes;
+}
+
+//------------------------------------------------------------
+// Release the buffer objects and the cache file of a point cloud.
+void closePointCloud(PointCloud& cloud) {
+	glDeleteVertexArrays(1, &cloud.vao);
+	cloud.vao = 0;
+	deleteGeometryPool(cloud.pool);
+	unmapFile(cloud.file);
+	cloud.nodes.clear();
+	cloud.nodeRanges.clear();
+	cloud.usedFrames.clear();
+	cloud.refinedFrames.clear();
+	cloud.selectedNodes.clear();
+}
+
+//------------------------------------------------------------
+// Print the size of the octree, the resident nodes and the points drawn in the last frame.
+void printPointCloudStatistics(const PointCloud& cloud) {
+	unsigned int residentNodeCount = 0;
+	for (unsigned int i = 0; i < cloud.nodeRanges.size(); i++) {
+		if (cloud.nodeRanges[i] != TLSF_NO_BLOCK) {
+			residentNodeCount++;
+		}
+	}
+
+	cout << "Point cloud: " << cloud.pointCount << " points in " << cloud.nodes.size() << " nodes, "
+		<< residentNodeCount << " nodes uploaded (" << cloud.residentBytes / (1024.0 * 1024.0) << " of "
+		<< cloud.memoryBudget / (1024.0 * 1024.0) << " MB), " << cloud.drawnPointCount << " points in "
+		<< cloud.drawnNodeCount << " nodes drawn in the last frame" << endl;
+	cout << "Point cloud: " << cloud.uploadedBytes / (1024.0 * 1024.0) << " MB uploaded, "
+		<< cloud.evictedNodeCount << " nodes evicted" << endl;
+}
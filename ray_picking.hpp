@@ -0,0 +1,685 @@
+/* This is a utility program that finds the mesh under the mouse by casting a ray into the scene.
+Each mesh that is drawn from its own geometry gets a bounding volume hierarchy (BVH) of its triangles, and the
+instances that are drawn (a mesh with the transform it is drawn with) get a BVH of their own over them, whose
+leaves point to the BVHs of the meshes. A ray is tested against the boxes of the top-level BVH, then, moved into
+the coordinates of each instance it reaches, against the boxes and triangles of the BVH of its mesh. The nearer
+child of a node is visited first, and the boxes farther than the nearest hit so far are skipped, so a ray tests
+a few dozen boxes and triangles even in a mesh of millions of triangles.
+The BVHs are built top-down with the surface area heuristic (SAH): the primitives of a node are sorted into
+a few bins along each axis by their centroids, and the node is split where the areas of the two sides times
+their primitive counts add up to the least. The binning of large nodes runs on all the CPU cores, and so do
+the subtrees below the first few levels. Each node takes 32 bytes: its box, and either its first child (the
+second child follows it) or its range of primitives.
+The following functions are provided.
+
+// Build the BVH of a set of boxes. bvh.primitives lists the box indices in the order the leaves use them.
+void buildBvh(const vector<BvhPrimitiveBox>& boxes, Bvh& bvh)
+
+// Build the BVH of the triangles of a mesh (polygons are split into fans; points and lines are not picked).
+void buildMeshBvh(const aiMesh* mesh, MeshBvh& meshBvh)
+
+// Build the BVHs of the meshes of a scene that instances use, and the top-level BVH of the instances.
+void buildPickScene(const aiScene* scene, const vector<PickInstance>& instances, PickScene& pickScene)
+
+// Find the nearest triangle that a ray hits between origin and origin + direction (t from 0 to 1).
+PickResult pickScene(const PickScene& pickScene, const aiVector3D& origin, const aiVector3D& direction)
+
+// The memory the BVHs of a pick scene take.
+unsigned long long getPickSceneMemorySize(const PickScene& pickScene)
+
+This file requires the Assimp headers, file_utilities.hpp and thread_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RAY_PICKING_SSE
+#endif
+
+using namespace std;
+
+// The number of bins per axis of the SAH, and the most primitives a leaf may have when splitting would cost more.
+#define BVH_BIN_COUNT 16
+#define BVH_MAX_LEAF_SIZE 8
+
+// The deepest node of a BVH. Traversal keeps a stack of this size; deeper nodes are made leaves.
+#define BVH_MAX_DEPTH 64
+
+// Nodes with more primitives than this are binned on all the CPU cores.
+#define BVH_PARALLEL_BINNING_SIZE 65536
+
+#define PICK_NO_MESH 0xFFFFFFFFu
+
+struct BvhNode {
+	float boundsMin[3];
+	unsigned int first;          // the first child of an inner node, or the first primitive of a leaf
+	float boundsMax[3];
+	unsigned int count;          // the number of primitives of a leaf; 0 for an inner node
+};
+static_assert(sizeof(BvhNode) == 32, "a BVH node takes 32 bytes");
+
+struct BvhPrimitiveBox {
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct Bvh {
+	vector<BvhNode> nodes;       // nodes[0] is the root
+	vector<unsigned int> primitives;
+};
+
+// The BVH of the triangles of a mesh. The triangles are stored in the order of the leaves, so a leaf is a range
+// of them; triangleFaces[] gives the face each triangle comes from.
+struct MeshBvh {
+	const aiMesh* mesh;
+	Bvh bvh;
+	vector<unsigned int> triangles;      // 3 vertex indices per triangle
+	vector<unsigned int> triangleFaces;
+};
+
+// A mesh as it is drawn: the geometry of sourceMesh, moved by transform.
+struct PickInstance {
+	unsigned int meshIndex;
+	unsigned int sourceMesh;
+	aiMatrix4x4 transform;
+};
+
+struct PickScene {
+	vector<MeshBvh> meshBvhs;                // one per scene->mMeshes[]; empty for the meshes no instance uses
+	vector<PickInstance> instances;
+	vector<aiMatrix4x4> inverseTransforms;   // one per instance
+	Bvh instanceBvh;
+	unsigned long long triangleCount;
+	double buildMilliseconds;
+};
+
+struct PickResult {
+	unsigned int meshIndex;      // PICK_NO_MESH if the ray hits nothing
+	unsigned int faceIndex;
+	float t;                     // the hit is at origin + t * direction
+	aiVector3D position;
+	unsigned int boxTests;
+	unsigned int triangleTests;
+};
+
+// A ray, with what the box test needs precomputed.
+struct PickRay {
+	aiVector3D origin;
+	aiVector3D direction;
+	float inverseDirection[3];
+#ifdef RAY_PICKING_SSE
+	__m128 origin4;
+	__m128 inverseDirection4;
+#endif
+};
+
+//------------------------------------------------------------
+// Half the surface area of a box, which is all the SAH needs.
+float getBoxHalfArea(const float boundsMin[3], const float boundsMax[3]) {
+	float dx = boundsMax[0] - boundsMin[0], dy = boundsMax[1] - boundsMin[1], dz = boundsMax[2] - boundsMin[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+void resetBox(float boundsMin[3], float boundsMax[3]) {
+	for (unsigned int k = 0; k < 3; k++) {
+		boundsMin[k] = 1e30f;
+		boundsMax[k] = -1e30f;
+	}
+}
+
+void growBox(float boundsMin[3], float boundsMax[3], const float otherMin[3], const float otherMax[3]) {
+	for (unsigned int k = 0; k < 3; k++) {
+		boundsMin[k] = min(boundsMin[k], otherMin[k]);
+		boundsMax[k] = max(boundsMax[k], otherMax[k]);
+	}
+}
+
+//------------------------------------------------------------
+// What the builder shares between the nodes: the boxes, their centroids and the primitive order.
+struct BvhBuilder {
+	const vector<BvhPrimitiveBox>* boxes;
+	vector<float> centroids;     // 3 per box
+	vector<unsigned int>* primitives;
+};
+
+// The bounds of a range of primitives and of their centroids, on all the CPU cores if the range is large.
+void getBvhRangeBounds(const BvhBuilder& builder, unsigned int first, unsigned int count, BvhNode& node, float centroidMin[3], float centroidMax[3]) {
+	unsigned int blockCount = count > BVH_PARALLEL_BINNING_SIZE ? min(getWorkerThreadCount() * 4, count / 16384) : 1;
+	vector<float> blockBounds(12 * blockCount);
+	auto boundBlock = [&builder, &blockBounds, first, count, blockCount](unsigned int block) {
+		float* bounds = &blockBounds[12 * block];
+		resetBox(bounds, bounds + 3);
+		resetBox(bounds + 6, bounds + 9);
+		unsigned int begin = first + (unsigned int) ((unsigned long long) count * block / blockCount);
+		unsigned int end = first + (unsigned int) ((unsigned long long) count * (block + 1) / blockCount);
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int primitive = (*builder.primitives)[i];
+			const BvhPrimitiveBox& box = (*builder.boxes)[primitive];
+			growBox(bounds, bounds + 3, box.boundsMin, box.boundsMax);
+			const float* centroid = &builder.centroids[3 * primitive];
+			growBox(bounds + 6, bounds + 9, centroid, centroid);
+		}
+	};
+	if (blockCount > 1) {
+		parallelFor(blockCount, boundBlock);
+	} else {
+		boundBlock(0);
+	}
+
+	resetBox(node.boundsMin, node.boundsMax);
+	resetBox(centroidMin, centroidMax);
+	for (unsigned int block = 0; block < blockCount; block++) {
+		const float* bounds = &blockBounds[12 * block];
+		growBox(node.boundsMin, node.boundsMax, bounds, bounds + 3);
+		growBox(centroidMin, centroidMax, bounds + 6, bounds + 9);
+	}
+}
+
+// The bins of one axis.
+struct BvhBins {
+	unsigned int counts[BVH_BIN_COUNT];
+	float boundsMin[BVH_BIN_COUNT][3];
+	float boundsMax[BVH_BIN_COUNT][3];
+};
+
+// The bin of a centroid. The partition uses the same function, so it agrees with the bins.
+inline unsigned int getBvhBin(float centroid, float centroidMin, float binScale) {
+	int bin = (int) ((centroid - centroidMin) * binScale);
+	return (unsigned int) max(0, min(bin, BVH_BIN_COUNT - 1));
+}
+
+//------------------------------------------------------------
+// Find the best SAH split of a range of primitives. Returns false if the range should be a leaf.
+bool findBvhSplit(const BvhBuilder& builder, unsigned int first, unsigned int count, const BvhNode& node,
+	const float centroidMin[3], const float centroidMax[3], unsigned int& splitAxis, unsigned int& splitBin) {
+	float binScales[3];
+	for (unsigned int k = 0; k < 3; k++) {
+		float extent = centroidMax[k] - centroidMin[k];
+		binScales[k] = extent > 0 ? BVH_BIN_COUNT / extent : 0;
+	}
+
+	// Each block of primitives fills its own bins, and the bins of the blocks are added up.
+	unsigned int blockCount = count > BVH_PARALLEL_BINNING_SIZE ? min(getWorkerThreadCount() * 4, count / 16384) : 1;
+	vector<BvhBins> blockBins(3 * blockCount);
+	auto binBlock = [&builder, &blockBins, &binScales, centroidMin, first, count, blockCount](unsigned int block) {
+		BvhBins* bins = &blockBins[3 * block];
+		for (unsigned int k = 0; k < 3; k++) {
+			for (unsigned int b = 0; b < BVH_BIN_COUNT; b++) {
+				bins[k].counts[b] = 0;
+				resetBox(bins[k].boundsMin[b], bins[k].boundsMax[b]);
+			}
+		}
+		unsigned int begin = first + (unsigned int) ((unsigned long long) count * block / blockCount);
+		unsigned int end = first + (unsigned int) ((unsigned long long) count * (block + 1) / blockCount);
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int primitive = (*builder.primitives)[i];
+			const BvhPrimitiveBox& box = (*builder.boxes)[primitive];
+			for (unsigned int k = 0; k < 3; k++) {
+				unsigned int b = getBvhBin(builder.centroids[3 * primitive + k], centroidMin[k], binScales[k]);
+				bins[k].counts[b]++;
+				growBox(bins[k].boundsMin[b], bins[k].boundsMax[b], box.boundsMin, box.boundsMax);
+			}
+		}
+	};
+	if (blockCount > 1) {
+		parallelFor(blockCount, binBlock);
+		for (unsigned int block = 1; block < blockCount; block++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				for (unsigned int b = 0; b < BVH_BIN_COUNT; b++) {
+					blockBins[k].counts[b] += blockBins[3 * block + k].counts[b];
+					growBox(blockBins[k].boundsMin[b], blockBins[k].boundsMax[b], blockBins[3 * block + k].boundsMin[b], blockBins[3 * block + k].boundsMax[b]);
+				}
+			}
+		}
+	} else {
+		binBlock(0);
+	}
+
+	// Sweep the bins from the right to get the area and count of each right side, then from the left.
+	float bestCost = 1e30f;
+	for (unsigned int k = 0; k < 3; k++) {
+		if (binScales[k] == 0) {
+			continue;
+		}
+		const BvhBins& bins = blockBins[k];
+		float rightCosts[BVH_BIN_COUNT];
+		float sideMin[3], sideMax[3];
+		resetBox(sideMin, sideMax);
+		unsigned int sideCount = 0;
+		for (unsigned int b = BVH_BIN_COUNT - 1; b > 0; b--) {
+			sideCount += bins.counts[b];
+			growBox(sideMin, sideMax, bins.boundsMin[b], bins.boundsMax[b]);
+			rightCosts[b] = sideCount > 0 ? sideCount * getBoxHalfArea(sideMin, sideMax) : 0;
+		}
+		resetBox(sideMin, sideMax);
+		sideCount = 0;
+		for (unsigned int b = 1; b < BVH_BIN_COUNT; b++) {
+			sideCount += bins.counts[b - 1];
+			growBox(sideMin, sideMax, bins.boundsMin[b - 1], bins.boundsMax[b - 1]);
+			if (sideCount == 0 || sideCount == count) {
+				continue;
+			}
+			float cost = sideCount * getBoxHalfArea(sideMin, sideMax) + rightCosts[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				splitAxis = k;
+				splitBin = b;
+			}
+		}
+	}
+
+	// A split costs one box test more than the leaf, counted in triangle tests of the whole node.
+	float leafCost = count * getBoxHalfArea(node.boundsMin, node.boundsMax);
+	if (bestCost >= 1e30f) {
+		return false;
+	}
+	return count > BVH_MAX_LEAF_SIZE || bestCost + getBoxHalfArea(node.boundsMin, node.boundsMax) < leafCost;
+}
+
+//------------------------------------------------------------
+// Split a range of primitives, and return the size of the left side. Ranges that cannot be split by their
+// centroids (e.g. many copies of one triangle) are split in the middle, so that their leaves stay small.
+unsigned int splitBvhRange(const BvhBuilder& builder, unsigned int first, unsigned int count, const BvhNode& node,
+	const float centroidMin[3], const float centroidMax[3], bool& leaf) {
+	leaf = false;
+	unsigned int splitAxis = 0, splitBin = 0;
+	if (!findBvhSplit(builder, first, count, node, centroidMin, centroidMax, splitAxis, splitBin)) {
+		leaf = count <= BVH_MAX_LEAF_SIZE;
+		return count / 2;
+	}
+
+	float extent = centroidMax[splitAxis] - centroidMin[splitAxis];
+	float binScale = BVH_BIN_COUNT / extent;
+	unsigned int* begin = &(*builder.primitives)[first];
+	unsigned int* middle = partition(begin, begin + count, [&builder, splitAxis, splitBin, centroidMin, binScale](unsigned int primitive) {
+		return getBvhBin(builder.centroids[3 * primitive + splitAxis], centroidMin[splitAxis], binScale) < splitBin;
+	});
+	unsigned int leftCount = (unsigned int) (middle - begin);
+	return leftCount == 0 || leftCount == count ? count / 2 : leftCount;
+}
+
+// A node that still has to be built: its range of primitives and its depth. Its bounds are in the node.
+struct BvhBuildTask {
+	unsigned int node;
+	unsigned int first;
+	unsigned int count;
+	unsigned int depth;
+};
+
+// Split a node into two children appended to nodes[], or make it a leaf. Returns false for a leaf.
+bool splitBvhNode(const BvhBuilder& builder, vector<BvhNode>& nodes, const BvhBuildTask& task, BvhBuildTask children[2]) {
+	BvhNode& node = nodes[task.node];
+	float centroidMin[3], centroidMax[3];
+	getBvhRangeBounds(builder, task.first, task.count, node, centroidMin, centroidMax);
+
+	bool leaf = task.count <= 1 || task.depth + 1 >= BVH_MAX_DEPTH;
+	unsigned int leftCount = leaf ? 0 : splitBvhRange(builder, task.first, task.count, node, centroidMin, centroidMax, leaf);
+	if (leaf) {
+		node.first = task.first;
+		node.count = task.count;
+		return false;
+	}
+
+	unsigned int left = (unsigned int) nodes.size();
+	nodes[task.node].first = left;
+	nodes[task.node].count = 0;
+	nodes.resize(nodes.size() + 2);
+	BvhBuildTask leftTask = { left, task.first, leftCount, task.depth + 1 };
+	BvhBuildTask rightTask = { left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 };
+	children[0] = leftTask;
+	children[1] = rightTask;
+	return true;
+}
+
+// Build the subtree of a node, depth first, into nodes[].
+void buildBvhSubtree(const BvhBuilder& builder, vector<BvhNode>& nodes, const BvhBuildTask& root) {
+	vector<BvhBuildTask> stack(1, root);
+	while (!stack.empty()) {
+		BvhBuildTask task = stack.back();
+		stack.pop_back();
+		BvhBuildTask children[2];
+		if (splitBvhNode(builder, nodes, task, children)) {
+			stack.push_back(children[1]);
+			stack.push_back(children[0]);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Build the BVH of a set of boxes. The first levels are split here, with parallel binning, until there are
+// enough subtrees of moderate size; the subtrees are then built on all the CPU cores into arrays of their own,
+// which are appended to the nodes at the end.
+void buildBvh(const vector<BvhPrimitiveBox>& boxes, Bvh& bvh) {
+	unsigned int primitiveCount = (unsigned int) boxes.size();
+	bvh.nodes.clear();
+	bvh.primitives.clear();
+	if (primitiveCount == 0) {
+		return;
+	}
+	bvh.nodes.assign(1, BvhNode());
+	bvh.primitives.resize(primitiveCount);
+	for (unsigned int i = 0; i < primitiveCount; i++) {
+		bvh.primitives[i] = i;
+	}
+	BvhBuilder builder;
+	builder.boxes = &boxes;
+	builder.primitives = &bvh.primitives;
+	builder.centroids.resize(3 * (size_t) primitiveCount);
+	for (unsigned int i = 0; i < primitiveCount; i++) {
+		for (unsigned int k = 0; k < 3; k++) {
+			builder.centroids[3 * i + k] = 0.5f * (boxes[i].boundsMin[k] + boxes[i].boundsMax[k]);
+		}
+	}
+
+	unsigned int subtreeSize = max(4096u, primitiveCount / (8 * getWorkerThreadCount()));
+	BvhBuildTask rootTask = { 0, 0, primitiveCount, 0 };
+	vector<BvhBuildTask> pending(1, rootTask);
+	vector<BvhBuildTask> subtrees;
+	while (!pending.empty()) {
+		BvhBuildTask task = pending.back();
+		pending.pop_back();
+		if (task.count <= subtreeSize) {
+			subtrees.push_back(task);
+			continue;
+		}
+		BvhBuildTask children[2];
+		if (splitBvhNode(builder, bvh.nodes, task, children)) {
+			pending.push_back(children[0]);
+			pending.push_back(children[1]);
+		}
+	}
+	if (subtrees.empty()) {
+		return;
+	}
+
+	// Each subtree starts with its root at 0 and its own child indices.
+	vector<vector<BvhNode> > subtreeNodes(subtrees.size());
+	parallelFor((unsigned int) subtrees.size(), [&builder, &subtrees, &subtreeNodes](unsigned int i) {
+		subtreeNodes[i].assign(1, BvhNode());
+		BvhBuildTask root = subtrees[i];
+		root.node = 0;
+		buildBvhSubtree(builder, subtreeNodes[i], root);
+	});
+
+	for (unsigned int i = 0; i < subtrees.size(); i++) {
+		const vector<BvhNode>& nodes = subtreeNodes[i];
+		unsigned int offset = (unsigned int) bvh.nodes.size() - 1;
+		BvhNode root = nodes[0];
+		if (root.count == 0) {
+			root.first += offset;
+		}
+		bvh.nodes[subtrees[i].node] = root;
+		for (unsigned int j = 1; j < nodes.size(); j++) {
+			BvhNode node = nodes[j];
+			if (node.count == 0) {
+				node.first += offset;
+			}
+			bvh.nodes.push_back(node);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Build the BVH of the triangles of a mesh. The triangles are reordered as the leaves use them, so that the
+// triangles of a leaf are next to each other in memory.
+void buildMeshBvh(const aiMesh* mesh, MeshBvh& meshBvh) {
+	meshBvh.mesh = mesh;
+	vector<unsigned int> triangles, triangleFaces;
+	for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+		const aiFace& face = mesh->mFaces[f];
+		for (unsigned int k = 2; k < face.mNumIndices; k++) {
+			triangles.push_back(face.mIndices[0]);
+			triangles.push_back(face.mIndices[k - 1]);
+			triangles.push_back(face.mIndices[k]);
+			triangleFaces.push_back(f);
+		}
+	}
+
+	unsigned int triangleCount = (unsigned int) triangleFaces.size();
+	vector<BvhPrimitiveBox> boxes(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++) {
+		resetBox(boxes[i].boundsMin, boxes[i].boundsMax);
+		for (unsigned int k = 0; k < 3; k++) {
+			const aiVector3D& vertex = mesh->mVertices[triangles[3 * i + k]];
+			growBox(boxes[i].boundsMin, boxes[i].boundsMax, &vertex.x, &vertex.x);
+		}
+	}
+	buildBvh(boxes, meshBvh.bvh);
+
+	meshBvh.triangles.resize(triangles.size());
+	meshBvh.triangleFaces.resize(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++) {
+		unsigned int triangle = meshBvh.bvh.primitives[i];
+		memcpy(&meshBvh.triangles[3 * i], &triangles[3 * triangle], sizeof(unsigned int) * 3);
+		meshBvh.triangleFaces[i] = triangleFaces[triangle];
+	}
+	meshBvh.bvh.primitives.clear();
+	meshBvh.bvh.primitives.shrink_to_fit();
+}
+
+//------------------------------------------------------------
+// Build the BVHs of the meshes the instances use, and the top-level BVH over the instances. Small meshes are
+// built side by side on all the CPU cores; each large mesh is built on all the CPU cores by itself.
+void buildPickScene(const aiScene* scene, const vector<PickInstance>& instances, PickScene& pickScene) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	pickScene.meshBvhs.assign(scene->mNumMeshes, MeshBvh());
+	pickScene.instances.clear();
+	pickScene.triangleCount = 0;
+
+	vector<bool> used(scene->mNumMeshes, false);
+	vector<unsigned int> smallMeshes, largeMeshes;
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		unsigned int source = instances[i].sourceMesh;
+		const aiMesh* mesh = scene->mMeshes[source];
+		if (!used[source] && mesh->HasPositions() && mesh->HasFaces()) {
+			used[source] = true;
+			(mesh->mNumFaces > BVH_PARALLEL_BINNING_SIZE ? largeMeshes : smallMeshes).push_back(source);
+		}
+	}
+	parallelFor((unsigned int) smallMeshes.size(), [scene, &pickScene, &smallMeshes](unsigned int i) {
+		buildMeshBvh(scene->mMeshes[smallMeshes[i]], pickScene.meshBvhs[smallMeshes[i]]);
+	});
+	for (unsigned int i = 0; i < largeMeshes.size(); i++) {
+		buildMeshBvh(scene->mMeshes[largeMeshes[i]], pickScene.meshBvhs[largeMeshes[i]]);
+	}
+
+	// The box of an instance is the box of the 8 corners of its mesh's root box, moved by its transform.
+	// The instances of meshes without triangles (points and lines) are left out.
+	vector<BvhPrimitiveBox> boxes;
+	pickScene.inverseTransforms.clear();
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		const PickInstance& instance = instances[i];
+		const MeshBvh& meshBvh = pickScene.meshBvhs[instance.sourceMesh];
+		if (meshBvh.bvh.nodes.empty()) {
+			continue;
+		}
+		pickScene.instances.push_back(instance);
+		pickScene.triangleCount += meshBvh.triangleFaces.size();
+		const BvhNode& root = meshBvh.bvh.nodes[0];
+		BvhPrimitiveBox box;
+		resetBox(box.boundsMin, box.boundsMax);
+		for (unsigned int corner = 0; corner < 8; corner++) {
+			aiVector3D point(corner & 1 ? root.boundsMax[0] : root.boundsMin[0], corner & 2 ? root.boundsMax[1] : root.boundsMin[1],
+				corner & 4 ? root.boundsMax[2] : root.boundsMin[2]);
+			point = instance.transform * point;
+			growBox(box.boundsMin, box.boundsMax, &point.x, &point.x);
+		}
+		boxes.push_back(box);
+		pickScene.inverseTransforms.push_back(aiMatrix4x4(instance.transform).Inverse());
+	}
+	buildBvh(boxes, pickScene.instanceBvh);
+	pickScene.buildMilliseconds = elapsedMilliseconds(startTime);
+}
+
+//------------------------------------------------------------
+// Make a ray. A direction of 0 along an axis gets a very large inverse, so that the slabs still work.
+PickRay makePickRay(const aiVector3D& origin, const aiVector3D& direction) {
+	PickRay ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	for (unsigned int k = 0; k < 3; k++) {
+		float d = direction[k];
+		ray.inverseDirection[k] = 1.0f / (fabs(d) > 1e-20f ? d : (d < 0 ? -1e-20f : 1e-20f));
+	}
+#ifdef RAY_PICKING_SSE
+	ray.origin4 = _mm_set_ps(0, origin.z, origin.y, origin.x);
+	ray.inverseDirection4 = _mm_set_ps(0, ray.inverseDirection[2], ray.inverseDirection[1], ray.inverseDirection[0]);
+#endif
+	return ray;
+}
+
+// The slab test of a node's box. Returns the t where the ray enters the box, or a value above tMax if it misses.
+// With SSE, the three axes are done at once; the fourth lane holds first or count and is left out.
+inline float intersectBvhNode(const BvhNode& node, const PickRay& ray, float tMax) {
+#ifdef RAY_PICKING_SSE
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMin), ray.origin4), ray.inverseDirection4);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMax), ray.origin4), ray.inverseDirection4);
+	__m128 tNear = _mm_min_ps(t0, t1);
+	__m128 tFar = _mm_max_ps(t0, t1);
+	tNear = _mm_max_ss(_mm_max_ss(tNear, _mm_shuffle_ps(tNear, tNear, 1)), _mm_shuffle_ps(tNear, tNear, 2));
+	tFar = _mm_min_ss(_mm_min_ss(tFar, _mm_shuffle_ps(tFar, tFar, 1)), _mm_shuffle_ps(tFar, tFar, 2));
+	float tEnter = max(_mm_cvtss_f32(tNear), 0.0f);
+	float tExit = min(_mm_cvtss_f32(tFar), tMax);
+#else
+	float tEnter = 0, tExit = tMax;
+	for (unsigned int k = 0; k < 3; k++) {
+		float t0 = (node.boundsMin[k] - ray.origin[k]) * ray.inverseDirection[k];
+		float t1 = (node.boundsMax[k] - ray.origin[k]) * ray.inverseDirection[k];
+		tEnter = max(tEnter, min(t0, t1));
+		tExit = min(tExit, max(t0, t1));
+	}
+#endif
+	return tEnter <= tExit ? tEnter : 1e30f;
+}
+
+// The Moller-Trumbore test of a triangle. Returns true and sets t if the ray hits it between 0 and tMax.
+inline bool intersectTriangle(const PickRay& ray, const aiVector3D& v0, const aiVector3D& v1, const aiVector3D& v2, float tMax, float& t) {
+	aiVector3D edge1 = v1 - v0;
+	aiVector3D edge2 = v2 - v0;
+	aiVector3D p = ray.direction ^ edge2;
+	float determinant = edge1 * p;
+	if (fabs(determinant) < 1e-20f) {
+		return false;
+	}
+	float inverseDeterminant = 1.0f / determinant;
+	aiVector3D s = ray.origin - v0;
+	float u = (s * p) * inverseDeterminant;
+	if (u < 0 || u > 1) {
+		return false;
+	}
+	aiVector3D q = s ^ edge1;
+	float v = (ray.direction * q) * inverseDeterminant;
+	if (v < 0 || u + v > 1) {
+		return false;
+	}
+	float hit = (edge2 * q) * inverseDeterminant;
+	if (hit < 0 || hit >= tMax) {
+		return false;
+	}
+	t = hit;
+	return true;
+}
+
+// Walk a BVH, nearer child first, and call testLeaf(first, count, tMax) for each leaf the ray reaches.
+// testLeaf lowers tMax when it finds a nearer hit.
+template <class LeafTest>
+void traverseBvh(const Bvh& bvh, const PickRay& ray, float& tMax, unsigned int& boxTests, LeafTest testLeaf) {
+	if (bvh.nodes.empty()) {
+		return;
+	}
+	boxTests++;
+	if (intersectBvhNode(bvh.nodes[0], ray, tMax) > tMax) {
+		return;
+	}
+	unsigned int stack[BVH_MAX_DEPTH];
+	unsigned int stackSize = 0;
+	unsigned int current = 0;
+	while (true) {
+		const BvhNode& node = bvh.nodes[current];
+		if (node.count > 0) {
+			testLeaf(node.first, node.count, tMax);
+		} else {
+			float tLeft = intersectBvhNode(bvh.nodes[node.first], ray, tMax);
+			float tRight = intersectBvhNode(bvh.nodes[node.first + 1], ray, tMax);
+			boxTests += 2;
+			unsigned int nearChild = tLeft <= tRight ? node.first : node.first + 1;
+			float tNear = min(tLeft, tRight), tFar = max(tLeft, tRight);
+			if (tNear <= tMax) {
+				if (tFar <= tMax) {
+					stack[stackSize++] = nearChild == node.first ? node.first + 1 : node.first;
+				}
+				current = nearChild;
+				continue;
+			}
+		}
+		// Pop the next node that the ray may still reach before the nearest hit.
+		bool found = false;
+		while (stackSize > 0 && !found) {
+			current = stack[--stackSize];
+			boxTests++;
+			found = intersectBvhNode(bvh.nodes[current], ray, tMax) <= tMax;
+		}
+		if (!found) {
+			return;
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Find the nearest triangle that a ray hits. The ray is moved into the coordinates of each instance it reaches;
+// the transforms are affine, so t means the same there.
+PickResult pickScene(const PickScene& pickScene, const aiVector3D& origin, const aiVector3D& direction) {
+	PickResult result;
+	result.meshIndex = PICK_NO_MESH;
+	result.faceIndex = 0;
+	result.t = 1.0f;
+	result.boxTests = 0;
+	result.triangleTests = 0;
+
+	PickRay ray = makePickRay(origin, direction);
+	float tMax = 1.0f;
+	traverseBvh(pickScene.instanceBvh, ray, tMax, result.boxTests, [&](unsigned int first, unsigned int count, float& instanceTMax) {
+		for (unsigned int i = first; i < first + count; i++) {
+			unsigned int instanceIndex = pickScene.instanceBvh.primitives[i];
+			const PickInstance& instance = pickScene.instances[instanceIndex];
+			const aiMatrix4x4& inverse = pickScene.inverseTransforms[instanceIndex];
+			const MeshBvh& meshBvh = pickScene.meshBvhs[instance.sourceMesh];
+			const aiVector3D* vertices = meshBvh.mesh->mVertices;
+			PickRay meshRay = makePickRay(inverse * origin, aiMatrix3x3(inverse) * direction);
+
+			traverseBvh(meshBvh.bvh, meshRay, instanceTMax, result.boxTests, [&](unsigned int firstTriangle, unsigned int triangleCount, float& meshTMax) {
+				for (unsigned int j = firstTriangle; j < firstTriangle + triangleCount; j++) {
+					const unsigned int* triangle = &meshBvh.triangles[3 * j];
+					float t;
+					result.triangleTests++;
+					if (intersectTriangle(meshRay, vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]], meshTMax, t)) {
+						meshTMax = t;
+						result.meshIndex = instance.meshIndex;
+						result.faceIndex = meshBvh.triangleFaces[j];
+					}
+				}
+			});
+		}
+	});
+	result.t = tMax;
+	result.position = origin + tMax * direction;
+	return result;
+}
+
+//------------------------------------------------------------
+// The memory the BVHs of a pick scene take.
+unsigned long long getPickSceneMemorySize(const PickScene& pickScene) {
+	unsigned long long size = sizeof(BvhNode) * (unsigned long long) pickScene.instanceBvh.nodes.size()
+		+ sizeof(unsigned int) * (unsigned long long) pickScene.instanceBvh.primitives.size()
+		+ (sizeof(PickInstance) + sizeof(aiMatrix4x4)) * (unsigned long long) pickScene.instances.size();
+	for (unsigned int i = 0; i < pickScene.meshBvhs.size(); i++) {
+		const MeshBvh& meshBvh = pickScene.meshBvhs[i];
+		size += sizeof(BvhNode) * (unsigned long long) meshBvh.bvh.nodes.size()
+			+ sizeof(unsigned int) * ((unsigned long long) meshBvh.triangles.size() + meshBvh.triangleFaces.size());
+	}
+	return size;
+}
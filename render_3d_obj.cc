@@ -0,0 +1,138 @@
+/*
+This program renders a reference image of a 3D file on the CPU, with the path tracer of path_tracer.hpp, so that
+the output of load_3d_obj.cc can be checked on machines without a GPU. The 3D file is imported by Assimp with the
+same post-processing as load_3d_obj.cc, and the image has the same view: the meshes are in clip coordinates,
+seen straight along the z axis, and the rays that miss them see the clear color of load_3d_obj.cc (white).
+The diffuse, specular and emissive colors of the materials and the point, directional and spot lights of the
+3D file are used; the textures are not. Like the meshes, which load_3d_obj.cc draws in their own coordinates,
+the lights are placed in their own coordinates: the node transforms are not applied to either.
+The image is rendered in passes that double the samples per pixel, and written after each pass, so a partial
+result is on disk early. The samples per second of each pass are printed, and with -c, how they scale with the
+number of CPU cores.
+
+Usage: render_3d_obj [-w width] [-h height] [-s samples] [-b bounces] [-e environment] [-c] <3D file> [image file]
+The image is a binary PPM file, "name.ext.ppm" next to the 3D file if no image file is given. The defaults are
+512x512 pixels, 64 samples per pixel, 4 bounces and an environment brightness of 1.
+
+This program needs the following libraries to run:
+	Assimp
+
+*/
+
+#include <cstdlib>
+#include <iostream>
+
+#include "assimp/Importer.hpp"
+#include "assimp/PostProcess.h"
+#include "assimp/Scene.h"
+
+// These header files are shared with load_3d_obj.cc.
+#include "thread_utilities.hpp"
+#include "file_utilities.hpp"
+#include "scene_graph.hpp"
+#include "ray_picking.hpp"
+
+// This header file contains the path tracer.
+#include "path_tracer.hpp"
+
+using namespace std;
+
+// The defaults of the options.
+const unsigned int defaultImageWidth = 512;
+const unsigned int defaultImageHeight = 512;
+const unsigned int defaultSampleCount = 64;
+const unsigned int defaultBounceCount = 4;
+
+//------------------------------------------------------------
+// The meshes as load_3d_obj.cc draws them: each mesh that a node uses, once, in its own coordinates.
+vector<PickInstance> getDrawnMeshes(const aiScene* scene, const SceneGraph& graph) {
+	vector<bool> added(scene->mNumMeshes, false);
+	vector<PickInstance> instances;
+	for (unsigned int i = 0; i < graph.meshIndices.size(); i++) {
+		unsigned int meshIndex = graph.meshIndices[i];
+		if (!added[meshIndex]) {
+			added[meshIndex] = true;
+			PickInstance instance;
+			instance.meshIndex = meshIndex;
+			instance.sourceMesh = meshIndex;
+			instances.push_back(instance);
+		}
+	}
+	return instances;
+}
+
+// The transform of each light. The lights stay in their own coordinates, like the meshes (see getDrawnMeshes()),
+// so that both are in the same space; the transforms of their nodes would only move the lights.
+vector<aiMatrix4x4> getLightTransforms(const aiScene* scene) {
+	return vector<aiMatrix4x4>(scene->mNumLights, aiMatrix4x4());
+}
+
+int main(int argc, char** argv) {
+	unsigned int width = defaultImageWidth, height = defaultImageHeight;
+	unsigned int sampleCount = defaultSampleCount, bounceCount = defaultBounceCount;
+	float environment = 1.0f;
+	bool benchmarkScaling = false;
+	vector<string> arguments;
+	for (int i = 1; i < argc; i++) {
+		string argument = argv[i];
+		if (argument == "-c") {
+			benchmarkScaling = true;
+		} else if (argument.size() == 2 && argument[0] == '-' && i + 1 < argc) {
+			const char* value = argv[++i];
+			switch (argument[1]) {
+				case 'w': width = max(atoi(value), 1); break;
+				case 'h': height = max(atoi(value), 1); break;
+				case 's': sampleCount = max(atoi(value), 1); break;
+				case 'b': bounceCount = (unsigned int) max(atoi(value), 0); break;
+				case 'e': environment = (float) atof(value); break;
+			}
+		} else {
+			arguments.push_back(argument);
+		}
+	}
+	if (arguments.empty() || arguments.size() > 2) {
+		cout << "Usage: render_3d_obj [-w width] [-h height] [-s samples] [-b bounces] [-e environment] [-c] <3D file> [image file]" << endl;
+		return 1;
+	}
+	string imageFileName = arguments.size() == 2 ? arguments[1] : arguments[0] + ".ppm";
+
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(arguments[0], aiProcessPreset_TargetRealtime_Quality);
+	if (!scene) {
+		cout << arguments[0] << ": " << importer.GetErrorString() << endl;
+		return 1;
+	}
+	cout << arguments[0] << ": imported in " << elapsedMilliseconds(startTime) << " ms" << endl;
+
+	SceneGraph graph;
+	buildSceneGraph(scene->mRootNode, graph);
+	PathTracer tracer;
+	tracer.environment = aiColor3D(environment, environment, environment);
+	tracer.maxBounces = bounceCount;
+	buildPathTracer(scene, getDrawnMeshes(scene, graph), getLightTransforms(scene), tracer);
+	resetPathTracerImage(tracer, width, height);
+	cout << tracer.triangles.size() << " triangles, " << tracer.nodes.size() << " BVH nodes, " << tracer.lights.size() << " lights, "
+		<< getPathTracerMemorySize(tracer) / (1024.0 * 1024.0) << " MB, built in " << tracer.buildMilliseconds << " ms on "
+		<< getWorkerThreadCount() << " threads" << endl;
+
+	// Each pass brings the samples per pixel to the next power of two (or to sampleCount).
+	double totalMilliseconds = 0;
+	while (tracer.sampleCount < sampleCount) {
+		unsigned int passSamples = min(max(tracer.sampleCount, 1u), sampleCount - tracer.sampleCount);
+		unsigned long long raysBefore = tracer.rayCount;
+		double milliseconds = renderPathTracerPass(tracer, passSamples);
+		totalMilliseconds += milliseconds;
+		bool written = writePathTracerImage(tracer, imageFileName);
+		cout << "  " << tracer.sampleCount << " samples per pixel: pass of " << milliseconds << " ms, "
+			<< (double) width * height * passSamples / milliseconds / 1000.0 << " M samples/s, "
+			<< (tracer.rayCount - raysBefore) / milliseconds / 1000.0 << " M rays/s" << (written ? "" : " (the image cannot be written)") << endl;
+	}
+	cout << imageFileName << ": " << width << "x" << height << ", " << tracer.sampleCount << " samples per pixel in "
+		<< totalMilliseconds << " ms" << endl;
+
+	if (benchmarkScaling) {
+		benchmarkPathTracerScaling(tracer, max(1u, sampleCount / 16));
+	}
+	return 0;
+}
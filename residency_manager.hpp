@@ -0,0 +1,342 @@
+/* This is a utility program that keeps the meshes and textures in video memory within a budget.
+Every buffer and texture allocation is tracked in bytes, together with the frame in which a draw last used it.
+When the budget is exceeded, the least recently used resources are evicted; they are uploaded again
+from the CPU copy (e.g. the aiScene object or the texture cache) the next time a draw needs them.
+The following functions are provided.
+
+// Set the budget in bytes and the functions that upload and release a resource.
+// uploadResource(type, index) must upload the resource and return its size in bytes.
+void initResidencyManager(ResidencyManager& manager, unsigned long long budget,
+	function<unsigned long long(ResourceType, unsigned int)> uploadResource,
+	function<void(ResourceType, unsigned int)> releaseResource)
+
+// Start tracking a resource that is already in video memory. Resources not used in this frame are evicted
+// if it takes the resident resources over the budget.
+void registerResource(ResidencyManager& manager, ResourceType type, unsigned int index, unsigned long long bytes)
+
+// Start tracking a resource that is not in video memory, e.g. one that did not fit in the budget when the
+// scene was loaded. It is uploaded the first time a draw uses it.
+void registerEvictedResource(ResidencyManager& manager, ResourceType type, unsigned int index, unsigned long long bytes)
+
+// Evict the least recently used resources that are not used in this frame until bytes more fit in the budget.
+// Returns false if they do not fit even so; the caller can then defer the upload.
+bool makeResidencyRoom(ResidencyManager& manager, unsigned long long bytes)
+
+// Stop tracking a resource, e.g. before it is deleted. The resource itself is not released.
+void unregisterResource(ResidencyManager& manager, ResourceType type, unsigned int index)
+
+// Call this function at the beginning of every frame. Evicts resources if the budget is exceeded.
+void beginResidencyFrame(ResidencyManager& manager)
+
+// Call this function before a draw uses a resource. The resource is uploaded again if it has been evicted.
+// Resources that were never registered are ignored.
+void useResource(ResidencyManager& manager, ResourceType type, unsigned int index)
+
+// The size in bytes of all the levels of a texture object, as reported by OpenGL.
+unsigned long long getTextureMemorySize(GLuint texture)
+
+// Print the residency, eviction and re-upload counters.
+void printResidencyStatistics(const ResidencyManager& manager)
+
+*/
+
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+enum ResourceType { RESOURCE_MESH, RESOURCE_TEXTURE };
+
+// A tracked resource. The resources form a doubly linked list in order of use, most recent first.
+struct TrackedResource {
+	ResourceType type;
+	unsigned int index;              // the mesh index or the texture object
+	unsigned long long bytes;
+	unsigned long long lastUsedFrame;
+	bool resident;
+	int previous;                    // more recently used, -1 for the head of the list
+	int next;                        // less recently used, -1 for the tail of the list
+};
+
+struct ResidencyManager {
+	vector<TrackedResource> resources;
+	unordered_map<unsigned long long, unsigned int> resourceIds;   // (type, index) -> position in resources
+	int mostRecent;
+	int leastRecent;
+
+	unsigned long long budget;
+	unsigned long long residentBytes;
+	unsigned int residentCount;
+	unsigned long long frame;
+
+	function<unsigned long long(ResourceType, unsigned int)> uploadResource;
+	function<void(ResourceType, unsigned int)> releaseResource;
+
+	// Statistics
+	unsigned int evictionCount;
+	unsigned long long evictedBytes;
+	unsigned int reuploadCount;
+	unsigned long long reuploadedBytes;
+	unsigned int overBudgetFrames;
+	unsigned long long lastOverBudgetFrame;
+};
+
+//------------------------------------------------------------
+// The key of a resource in resourceIds.
+unsigned long long getResourceKey(ResourceType type, unsigned int index) {
+	return ((unsigned long long) type << 32) | index;
+}
+
+//------------------------------------------------------------
+// Set the budget and the functions that upload and release a resource.
+void initResidencyManager(ResidencyManager& manager, unsigned long long budget,
+	function<unsigned long long(ResourceType, unsigned int)> uploadResource,
+	function<void(ResourceType, unsigned int)> releaseResource) {
+	manager.resources.clear();
+	manager.resourceIds.clear();
+	manager.mostRecent = -1;
+	manager.leastRecent = -1;
+	manager.budget = budget;
+	manager.residentBytes = 0;
+	manager.residentCount = 0;
+	manager.frame = 0;
+	manager.uploadResource = uploadResource;
+	manager.releaseResource = releaseResource;
+	manager.evictionCount = 0;
+	manager.evictedBytes = 0;
+	manager.reuploadCount = 0;
+	manager.reuploadedBytes = 0;
+	manager.overBudgetFrames = 0;
+	manager.lastOverBudgetFrame = ~0ULL;   // no frame yet, so that frame 0 is counted too
+}
+
+//------------------------------------------------------------
+// Take a resource out of the list.
+void unlinkResource(ResidencyManager& manager, int id) {
+	TrackedResource& resource = manager.resources[id];
+	if (resource.previous >= 0) {
+		manager.resources[resource.previous].next = resource.next;
+	} else {
+		manager.mostRecent = resource.next;
+	}
+	if (resource.next >= 0) {
+		manager.resources[resource.next].previous = resource.previous;
+	} else {
+		manager.leastRecent = resource.previous;
+	}
+	resource.previous = resource.next = -1;
+}
+
+//------------------------------------------------------------
+// Put a resource at the head (most recently used end) of the list.
+void linkResourceAsMostRecent(ResidencyManager& manager, int id) {
+	TrackedResource& resource = manager.resources[id];
+	resource.previous = -1;
+	resource.next = manager.mostRecent;
+	if (manager.mostRecent >= 0) {
+		manager.resources[manager.mostRecent].previous = id;
+	} else {
+		manager.leastRecent = id;
+	}
+	manager.mostRecent = id;
+}
+
+//------------------------------------------------------------
+// Add a resource to the list as the most recently used one. Returns false if it is already tracked.
+bool trackResource(ResidencyManager& manager, ResourceType type, unsigned int index, unsigned long long bytes, bool resident) {
+	unsigned long long key = getResourceKey(type, index);
+	if (manager.resourceIds.count(key)) {
+		return false;
+	}
+
+	TrackedResource resource;
+	resource.type = type;
+	resource.index = index;
+	resource.bytes = bytes;
+	resource.lastUsedFrame = manager.frame;
+	resource.resident = resident;
+	resource.previous = resource.next = -1;
+
+	int id = (int) manager.resources.size();
+	manager.resources.push_back(resource);
+	manager.resourceIds[key] = id;
+	linkResourceAsMostRecent(manager, id);
+
+	if (resident) {
+		manager.residentBytes += bytes;
+		manager.residentCount++;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Count the frame as over budget, once per frame.
+void countOverBudgetFrame(ResidencyManager& manager) {
+	if (manager.lastOverBudgetFrame != manager.frame) {
+		manager.overBudgetFrames++;
+		manager.lastOverBudgetFrame = manager.frame;
+	}
+}
+
+//------------------------------------------------------------
+// Stop tracking a resource. The last entry of resources[] is moved into its place.
+void unregisterResource(ResidencyManager& manager, ResourceType type, unsigned int index) {
+	unordered_map<unsigned long long, unsigned int>::iterator found = manager.resourceIds.find(getResourceKey(type, index));
+	if (found == manager.resourceIds.end()) {
+		return;
+	}
+
+	int id = found->second;
+	manager.resourceIds.erase(found);
+	unlinkResource(manager, id);
+	if (manager.resources[id].resident) {
+		manager.residentBytes -= manager.resources[id].bytes;
+		manager.residentCount--;
+	}
+
+	int last = (int) manager.resources.size() - 1;
+	if (id != last) {
+		TrackedResource& moved = manager.resources[id];
+		moved = manager.resources[last];
+		if (moved.previous >= 0) {
+			manager.resources[moved.previous].next = id;
+		} else {
+			manager.mostRecent = id;
+		}
+		if (moved.next >= 0) {
+			manager.resources[moved.next].previous = id;
+		} else {
+			manager.leastRecent = id;
+		}
+		manager.resourceIds[getResourceKey(moved.type, moved.index)] = id;
+	}
+	manager.resources.pop_back();
+}
+
+//------------------------------------------------------------
+// Evict least recently used resources until neededBytes more fit in the budget.
+// Resources used in the current frame are never evicted, because the frame still draws them.
+// Returns false if there is not enough room even so.
+bool makeResidencyRoom(ResidencyManager& manager, unsigned long long neededBytes) {
+	int id = manager.leastRecent;
+	while (manager.residentBytes + neededBytes > manager.budget && id >= 0) {
+		TrackedResource& resource = manager.resources[id];
+		int moreRecent = resource.previous;
+
+		if (resource.lastUsedFrame == manager.frame) {
+			// Everything from here on was used in this frame.
+			break;
+		}
+
+		if (resource.resident) {
+			manager.releaseResource(resource.type, resource.index);
+			resource.resident = false;
+			manager.residentBytes -= resource.bytes;
+			manager.residentCount--;
+			manager.evictionCount++;
+			manager.evictedBytes += resource.bytes;
+		}
+		id = moreRecent;
+	}
+	return manager.residentBytes + neededBytes <= manager.budget;
+}
+
+//------------------------------------------------------------
+// Start tracking a resource that is already in video memory. The resource itself is used in this frame
+// (it has just been uploaded), so only older resources are evicted to make room for it.
+void registerResource(ResidencyManager& manager, ResourceType type, unsigned int index, unsigned long long bytes) {
+	if (trackResource(manager, type, index, bytes, true) && !makeResidencyRoom(manager, 0)) {
+		countOverBudgetFrame(manager);
+	}
+}
+
+//------------------------------------------------------------
+// Start tracking a resource that is not in video memory. useResource() uploads it.
+void registerEvictedResource(ResidencyManager& manager, ResourceType type, unsigned int index, unsigned long long bytes) {
+	trackResource(manager, type, index, bytes, false);
+}
+
+//------------------------------------------------------------
+// Call this function at the beginning of every frame.
+// The resources registered during the previous frame may have taken the resident bytes over the
+// budget, and none of them is in use at this point, so this is where the budget is enforced again.
+void beginResidencyFrame(ResidencyManager& manager) {
+	manager.frame++;
+	if (manager.residentBytes > manager.budget) {
+		makeResidencyRoom(manager, 0);
+	}
+}
+
+//------------------------------------------------------------
+// Call this function before a draw uses a resource.
+void useResource(ResidencyManager& manager, ResourceType type, unsigned int index) {
+	unordered_map<unsigned long long, unsigned int>::const_iterator found = manager.resourceIds.find(getResourceKey(type, index));
+	if (found == manager.resourceIds.end()) {
+		return;
+	}
+
+	int id = found->second;
+	TrackedResource& resource = manager.resources[id];
+
+	if (!resource.resident) {
+		if (!makeResidencyRoom(manager, resource.bytes)) {
+			// The resources of this frame alone exceed the budget. Draw it anyway.
+			countOverBudgetFrame(manager);
+		}
+		resource.bytes = manager.uploadResource(resource.type, resource.index);
+		resource.resident = true;
+		manager.residentBytes += resource.bytes;
+		manager.residentCount++;
+		manager.reuploadCount++;
+		manager.reuploadedBytes += resource.bytes;
+	}
+
+	resource.lastUsedFrame = manager.frame;
+	if (manager.mostRecent != id) {
+		unlinkResource(manager, id);
+		linkResourceAsMostRecent(manager, id);
+	}
+}
+
+//------------------------------------------------------------
+// The size in bytes of all the levels of a texture object.
+unsigned long long getTextureMemorySize(GLuint texture) {
+	unsigned long long bytes = 0;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	for (GLint level = 0; level < 16; level++) {
+		GLint width = 0, height = 0, compressed = GL_FALSE;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		if (width == 0 || height == 0) {
+			continue;
+		}
+
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed) {
+			GLint compressedSize = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+			bytes += compressedSize;
+		} else {
+			// This program only creates 8-bit RGBA textures.
+			bytes += (unsigned long long) width * height * 4;
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return bytes;
+}
+
+//------------------------------------------------------------
+// Print the residency, eviction and re-upload counters.
+void printResidencyStatistics(const ResidencyManager& manager) {
+	cout << "---------- Video memory residency ----------" << endl;
+	cout << "Frame: " << manager.frame << endl;
+	cout << "Resident resources: " << manager.residentCount << " of " << manager.resources.size() << endl;
+	cout << "Resident bytes: " << manager.residentBytes << " of " << manager.budget << endl;
+	cout << "Evictions: " << manager.evictionCount << " (" << manager.evictedBytes << " bytes)" << endl;
+	cout << "Re-uploads: " << manager.reuploadCount << " (" << manager.reuploadedBytes << " bytes)" << endl;
+	cout << "Frames over budget: " << manager.overBudgetFrames << endl;
+}
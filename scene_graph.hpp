@@ -0,0 +1,497 @@
+/* This is a utility program that keeps the node tree of a scene in a compact form, so that it can be walked quickly.
+An aiNode keeps its name in a 1 KB aiString, its children in an array of pointers and its meshes in an array
+of its own, so walking the node tree touches several scattered allocations per node. A SceneGraph keeps the
+same tree as arrays with one entry per node (a structure of arrays), in depth-first order: the children of a
+node follow it, and its subtree is the range of nodes that starts at it. A walk of the whole tree is then a
+loop over the arrays, and a parent always comes before its children.
+The names are interned: each different name is stored once, in a name table with a flat hash map (open
+addressing, linear probing) from a name to its id, and each node has the id of its name. A node is then found
+by its name with one hash lookup instead of the recursive string comparisons of aiNode::FindNode(). The
+cameras, lights, bones and animation channels of a scene are bound to their nodes this way once it is loaded.
+The following functions are provided.
+
+// Add a name to a name table, if it is not there yet, and return its id.
+unsigned int internName(SceneNameTable& table, const char* name, unsigned int length)
+
+// The id of a name in a name table, or SCENE_NAME_NOT_FOUND.
+unsigned int findName(const SceneNameTable& table, const char* name, unsigned int length)
+
+// Build the scene graph of a node tree (usually scene->mRootNode).
+void buildSceneGraph(const aiNode* rootNode, SceneGraph& graph)
+
+// The first child of a node and the node after its subtree (its next sibling, if it has one).
+// Both are graph.nodeCount if there is none.
+unsigned int getFirstChild(const SceneGraph& graph, unsigned int node)
+unsigned int getSubtreeEnd(const SceneGraph& graph, unsigned int node)
+
+// The name of a node.
+const char* getNodeName(const SceneGraph& graph, unsigned int node)
+
+// The first node (in depth-first order, as aiNode::FindNode()) with a name, or SCENE_GRAPH_NO_NODE.
+unsigned int findSceneNode(const SceneGraph& graph, const aiString& name)
+
+// Find the nodes of the cameras, lights, bones and animation channels of a scene.
+void bindSceneNodes(const aiScene* scene, const SceneGraph& graph, SceneNodeBindings& bindings)
+
+// Accumulate the node transformations from the root, one matrix per node.
+void computeWorldTransforms(const SceneGraph& graph, vector<aiMatrix4x4>& worldTransforms)
+
+// The memory a scene graph takes, and the memory the aiNode tree it was built from takes.
+unsigned long long getSceneGraphMemorySize(const SceneGraph& graph)
+unsigned long long getNodeTreeMemorySize(const aiNode* node)
+
+// Build a random node tree of nodeCount nodes, and compare walking it as aiNodes with walking its scene graph.
+void benchmarkSceneGraph(unsigned int nodeCount)
+
+// Build a rig of boneCount bones and an animation of channelCount channels, and compare binding the channels
+// with aiNode::FindNode() and with findSceneNode().
+void benchmarkNameLookup(unsigned int boneCount, unsigned int channelCount)
+
+This file requires the Assimp headers and file_utilities.hpp to be included first.
+*/
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define SCENE_GRAPH_NO_PARENT 0xFFFFFFFFu
+#define SCENE_GRAPH_NO_NODE 0xFFFFFFFFu
+#define SCENE_NAME_NOT_FOUND 0xFFFFFFFFu
+
+// The different names of a scene. slots is the hash map: its size is a power of two, at least twice the
+// number of names, and each slot holds a name id + 1, or 0 if it is empty.
+struct SceneNameTable {
+	vector<unsigned int> offsets;           // the name with id n is characters[offsets[n] .. offsets[n] + lengths[n])
+	vector<unsigned int> lengths;
+	vector<unsigned int> hashes;            // the hash of each name, so that growing the map does not hash them again
+	vector<char> characters;                // the names, each ended by a 0
+	vector<unsigned int> slots;
+};
+
+struct SceneGraph {
+	unsigned int nodeCount;
+	vector<unsigned int> parent;            // SCENE_GRAPH_NO_PARENT for the root
+	vector<unsigned int> subtreeSize;       // the subtree of node i is [i, i + subtreeSize[i]), the node included
+	vector<unsigned int> firstMesh;         // the meshes of node i are meshIndices[firstMesh[i] .. firstMesh[i + 1])
+	vector<unsigned int> meshIndices;       // indices in scene->mMeshes[]
+	vector<unsigned int> transformIndex;    // index in transforms[]; 0 for the nodes whose transformation is the identity
+	vector<aiMatrix4x4> transforms;         // transforms[0] is the identity
+	vector<unsigned int> nameId;            // id in names
+	SceneNameTable names;
+	vector<unsigned int> nodeOfName;        // the first node with each name id
+};
+
+// The nodes of the parts of a scene that refer to a node by name. SCENE_GRAPH_NO_NODE if there is no such node.
+struct SceneNodeBindings {
+	vector<unsigned int> cameraNodes;               // one per scene->mCameras[]
+	vector<unsigned int> lightNodes;                // one per scene->mLights[]
+	vector<vector<unsigned int> > boneNodes;        // one list per scene->mMeshes[], one node per bone
+	vector<vector<unsigned int> > channelNodes;     // one list per scene->mAnimations[], one node per channel
+	unsigned int boundCount;
+	unsigned int unboundCount;
+};
+
+//------------------------------------------------------------
+// The slot where a name is, or the empty slot where it would go.
+unsigned int findNameSlot(const SceneNameTable& table, const char* name, unsigned int length, unsigned int hash) {
+	unsigned int mask = (unsigned int) table.slots.size() - 1;
+	for (unsigned int slot = hash & mask; ; slot = (slot + 1) & mask) {
+		unsigned int id = table.slots[slot];
+		if (id == 0) {
+			return slot;
+		}
+		id--;
+		if (table.hashes[id] == hash && table.lengths[id] == length && memcmp(&table.characters[table.offsets[id]], name, length) == 0) {
+			return slot;
+		}
+	}
+}
+
+// The hash of a name. The low bits pick the slot, so the 64-bit hash is folded.
+unsigned int hashName(const char* name, unsigned int length) {
+	unsigned long long hash = hashBytes(name, length);
+	return (unsigned int) (hash ^ (hash >> 32));
+}
+
+//------------------------------------------------------------
+// Add a name to a name table. The map doubles when it would be more than half full.
+unsigned int internName(SceneNameTable& table, const char* name, unsigned int length) {
+	unsigned int hash = hashName(name, length);
+	if (!table.slots.empty()) {
+		unsigned int slot = findNameSlot(table, name, length, hash);
+		if (table.slots[slot] != 0) {
+			return table.slots[slot] - 1;
+		}
+	}
+
+	unsigned int id = (unsigned int) table.offsets.size();
+	table.offsets.push_back((unsigned int) table.characters.size());
+	table.lengths.push_back(length);
+	table.hashes.push_back(hash);
+	table.characters.insert(table.characters.end(), name, name + length);
+	table.characters.push_back(0);
+
+	if (2 * table.offsets.size() > table.slots.size()) {
+		table.slots.assign(max((size_t) 16, 2 * table.slots.size()), 0);
+		unsigned int mask = (unsigned int) table.slots.size() - 1;
+		for (unsigned int i = 0; i < table.offsets.size(); i++) {
+			unsigned int slot = table.hashes[i] & mask;
+			while (table.slots[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			table.slots[slot] = i + 1;
+		}
+	} else {
+		table.slots[findNameSlot(table, name, length, hash)] = id + 1;
+	}
+	return id;
+}
+
+//------------------------------------------------------------
+// The id of a name in a name table.
+unsigned int findName(const SceneNameTable& table, const char* name, unsigned int length) {
+	if (table.slots.empty()) {
+		return SCENE_NAME_NOT_FOUND;
+	}
+	unsigned int slot = findNameSlot(table, name, length, hashName(name, length));
+	return table.slots[slot] == 0 ? SCENE_NAME_NOT_FOUND : table.slots[slot] - 1;
+}
+
+//------------------------------------------------------------
+// Build the scene graph of a node tree. The tree is walked with a stack of its own, so that deep trees do not
+// overflow the call stack.
+void buildSceneGraph(const aiNode* rootNode, SceneGraph& graph) {
+	graph = SceneGraph();
+	graph.nodeCount = 0;
+	graph.transforms.push_back(aiMatrix4x4());
+	graph.firstMesh.push_back(0);
+	if (!rootNode) {
+		return;
+	}
+
+	vector<pair<const aiNode*, unsigned int> > stack(1, make_pair(rootNode, SCENE_GRAPH_NO_PARENT));
+	while (!stack.empty()) {
+		const aiNode* node = stack.back().first;
+		unsigned int parent = stack.back().second;
+		stack.pop_back();
+		unsigned int index = graph.nodeCount++;
+
+		graph.parent.push_back(parent);
+		graph.subtreeSize.push_back(1);
+		graph.meshIndices.insert(graph.meshIndices.end(), node->mMeshes, node->mMeshes + node->mNumMeshes);
+		graph.firstMesh.push_back((unsigned int) graph.meshIndices.size());
+		if (node->mTransformation.IsIdentity()) {
+			graph.transformIndex.push_back(0);
+		} else {
+			graph.transformIndex.push_back((unsigned int) graph.transforms.size());
+			graph.transforms.push_back(node->mTransformation);
+		}
+
+		// The first node with a name is the one aiNode::FindNode() finds.
+		unsigned int nameId = internName(graph.names, node->mName.C_Str(), (unsigned int) node->mName.length);
+		if (nameId == graph.nodeOfName.size()) {
+			graph.nodeOfName.push_back(index);
+		}
+		graph.nameId.push_back(nameId);
+
+		// The children are pushed in reverse, so that the first child is visited first.
+		for (unsigned int j = node->mNumChildren; j > 0; j--) {
+			stack.push_back(make_pair(node->mChildren[j - 1], index));
+		}
+	}
+
+	// A node comes after its parent, so adding each subtree to its parent backwards sums them up.
+	for (unsigned int i = graph.nodeCount; i > 1; i--) {
+		graph.subtreeSize[graph.parent[i - 1]] += graph.subtreeSize[i - 1];
+	}
+}
+
+//------------------------------------------------------------
+// The first child of a node directly follows it.
+unsigned int getFirstChild(const SceneGraph& graph, unsigned int node) {
+	return graph.subtreeSize[node] > 1 ? node + 1 : graph.nodeCount;
+}
+
+unsigned int getSubtreeEnd(const SceneGraph& graph, unsigned int node) {
+	return node + graph.subtreeSize[node];
+}
+
+//------------------------------------------------------------
+// The name of a node.
+const char* getNodeName(const SceneGraph& graph, unsigned int node) {
+	return &graph.names.characters[graph.names.offsets[graph.nameId[node]]];
+}
+
+//------------------------------------------------------------
+// The first node with a name.
+unsigned int findSceneNode(const SceneGraph& graph, const aiString& name) {
+	unsigned int nameId = findName(graph.names, name.C_Str(), (unsigned int) name.length);
+	return nameId == SCENE_NAME_NOT_FOUND ? SCENE_GRAPH_NO_NODE : graph.nodeOfName[nameId];
+}
+
+// Find the node of one name, and count whether it was found.
+unsigned int bindSceneNode(const SceneGraph& graph, const aiString& name, SceneNodeBindings& bindings) {
+	unsigned int node = findSceneNode(graph, name);
+	if (node == SCENE_GRAPH_NO_NODE) {
+		bindings.unboundCount++;
+	} else {
+		bindings.boundCount++;
+	}
+	return node;
+}
+
+//------------------------------------------------------------
+// Find the nodes of the cameras, lights, bones and animation channels of a scene.
+void bindSceneNodes(const aiScene* scene, const SceneGraph& graph, SceneNodeBindings& bindings) {
+	bindings = SceneNodeBindings();
+	bindings.boundCount = 0;
+	bindings.unboundCount = 0;
+
+	bindings.cameraNodes.resize(scene->mNumCameras);
+	for (unsigned int i = 0; i < scene->mNumCameras; i++) {
+		bindings.cameraNodes[i] = bindSceneNode(graph, scene->mCameras[i]->mName, bindings);
+	}
+	bindings.lightNodes.resize(scene->mNumLights);
+	for (unsigned int i = 0; i < scene->mNumLights; i++) {
+		bindings.lightNodes[i] = bindSceneNode(graph, scene->mLights[i]->mName, bindings);
+	}
+	bindings.boneNodes.resize(scene->mNumMeshes);
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		bindings.boneNodes[i].resize(mesh->mNumBones);
+		for (unsigned int j = 0; j < mesh->mNumBones; j++) {
+			bindings.boneNodes[i][j] = bindSceneNode(graph, mesh->mBones[j]->mName, bindings);
+		}
+	}
+	bindings.channelNodes.resize(scene->mNumAnimations);
+	for (unsigned int i = 0; i < scene->mNumAnimations; i++) {
+		const aiAnimation* animation = scene->mAnimations[i];
+		bindings.channelNodes[i].resize(animation->mNumChannels);
+		for (unsigned int j = 0; j < animation->mNumChannels; j++) {
+			bindings.channelNodes[i][j] = bindSceneNode(graph, animation->mChannels[j]->mNodeName, bindings);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// Accumulate the node transformations from the root. The parent of a node is done before the node.
+void computeWorldTransforms(const SceneGraph& graph, vector<aiMatrix4x4>& worldTransforms) {
+	worldTransforms.resize(graph.nodeCount);
+	for (unsigned int i = 0; i < graph.nodeCount; i++) {
+		unsigned int parent = graph.parent[i];
+		if (parent == SCENE_GRAPH_NO_PARENT) {
+			worldTransforms[i] = graph.transforms[graph.transformIndex[i]];
+		} else if (graph.transformIndex[i] == 0) {
+			worldTransforms[i] = worldTransforms[parent];
+		} else {
+			worldTransforms[i] = worldTransforms[parent] * graph.transforms[graph.transformIndex[i]];
+		}
+	}
+}
+
+//------------------------------------------------------------
+// The memory a scene graph takes, counted from the capacities of its arrays.
+unsigned long long getSceneGraphMemorySize(const SceneGraph& graph) {
+	return sizeof(graph) + sizeof(unsigned int) * ((unsigned long long) graph.parent.capacity() + graph.subtreeSize.capacity()
+		+ graph.firstMesh.capacity() + graph.meshIndices.capacity() + graph.transformIndex.capacity() + graph.nameId.capacity()
+		+ graph.nodeOfName.capacity() + graph.names.offsets.capacity() + graph.names.lengths.capacity() + graph.names.hashes.capacity()
+		+ graph.names.slots.capacity()) + sizeof(aiMatrix4x4) * (unsigned long long) graph.transforms.capacity()
+		+ graph.names.characters.capacity();
+}
+
+// The memory an aiNode tree takes: the nodes, their child pointer arrays and their mesh index arrays.
+unsigned long long getNodeTreeMemorySize(const aiNode* node) {
+	unsigned long long size = 0;
+	vector<const aiNode*> stack(1, node);
+	while (!stack.empty()) {
+		node = stack.back();
+		stack.pop_back();
+		size += sizeof(aiNode) + sizeof(aiNode*) * (unsigned long long) node->mNumChildren + sizeof(unsigned int) * (unsigned long long) node->mNumMeshes;
+		stack.insert(stack.end(), node->mChildren, node->mChildren + node->mNumChildren);
+	}
+	return size;
+}
+
+//------------------------------------------------------------
+// Walk an aiNode tree the way the draw list used to be built: recursively, accumulating the transformations.
+void walkNodeTree(const aiNode* node, const aiMatrix4x4& parentTransform, double& checksum) {
+	aiMatrix4x4 transform = parentTransform * node->mTransformation;
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		checksum += transform.a4 + node->mMeshes[i];
+	}
+	for (unsigned int j = 0; j < node->mNumChildren; j++) {
+		walkNodeTree(node->mChildren[j], transform, checksum);
+	}
+}
+
+// Walk a scene graph the same way.
+void walkSceneGraph(const SceneGraph& graph, vector<aiMatrix4x4>& worldTransforms, double& checksum) {
+	computeWorldTransforms(graph, worldTransforms);
+	for (unsigned int i = 0; i < graph.nodeCount; i++) {
+		for (unsigned int m = graph.firstMesh[i]; m < graph.firstMesh[i + 1]; m++) {
+			checksum += worldTransforms[i].a4 + graph.meshIndices[m];
+		}
+	}
+}
+
+// Build a random node tree: each node is a child of a random earlier node, so the tree is about 2 ln(nodeCount)
+// deep and its nodes are allocated in another order than a depth-first walk visits them, as in imported files.
+// Half of the nodes have a mesh and a quarter have a transformation.
+void benchmarkSceneGraph(unsigned int nodeCount) {
+	if (nodeCount == 0) {
+		return;
+	}
+	unsigned int random = 12345;
+	vector<unsigned int> parents(nodeCount, SCENE_GRAPH_NO_PARENT);
+	vector<unsigned int> childCounts(nodeCount, 0);
+	for (unsigned int i = 1; i < nodeCount; i++) {
+		random = random * 1664525u + 1013904223u;
+		parents[i] = (random >> 8) % i;
+		childCounts[parents[i]]++;
+	}
+	vector<aiNode*> nodes(nodeCount);
+	for (unsigned int i = 0; i < nodeCount; i++) {
+		aiNode* node = new aiNode();
+		node->mName = aiString("node" + to_string(i % 1000));
+		if (i % 2 == 0) {
+			node->mNumMeshes = 1;
+			node->mMeshes = new unsigned int[1];
+			node->mMeshes[0] = i % 97;
+		}
+		if (i % 4 == 1) {
+			node->mTransformation.a4 = 0.001f * (i % 13);
+		}
+		if (childCounts[i] > 0) {
+			node->mChildren = new aiNode*[childCounts[i]];
+		}
+		nodes[i] = node;
+	}
+	for (unsigned int i = 1; i < nodeCount; i++) {
+		aiNode* parent = nodes[parents[i]];
+		nodes[i]->mParent = parent;
+		parent->mChildren[parent->mNumChildren++] = nodes[i];
+	}
+
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	SceneGraph graph;
+	buildSceneGraph(nodes[0], graph);
+	double buildMilliseconds = elapsedMilliseconds(startTime);
+
+	// The best of a few walks, so that the first touch of the memory is not counted.
+	const unsigned int walkCount = 5;
+	double nodeTreeMilliseconds = 1e30, sceneGraphMilliseconds = 1e30;
+	double nodeTreeChecksum = 0, sceneGraphChecksum = 0;
+	vector<aiMatrix4x4> worldTransforms;
+	for (unsigned int w = 0; w < walkCount; w++) {
+		nodeTreeChecksum = 0;
+		startTime = chrono::high_resolution_clock::now();
+		walkNodeTree(nodes[0], aiMatrix4x4(), nodeTreeChecksum);
+		nodeTreeMilliseconds = min(nodeTreeMilliseconds, elapsedMilliseconds(startTime));
+
+		sceneGraphChecksum = 0;
+		startTime = chrono::high_resolution_clock::now();
+		walkSceneGraph(graph, worldTransforms, sceneGraphChecksum);
+		sceneGraphMilliseconds = min(sceneGraphMilliseconds, elapsedMilliseconds(startTime));
+	}
+
+	unsigned long long nodeTreeBytes = getNodeTreeMemorySize(nodes[0]);
+	unsigned long long sceneGraphBytes = getSceneGraphMemorySize(graph);
+	cout << "Scene graph benchmark: " << nodeCount << " nodes, " << graph.names.offsets.size() << " different names, built in "
+		<< buildMilliseconds << " ms" << endl;
+	cout << "    aiNode tree: walked in " << nodeTreeMilliseconds << " ms, " << nodeTreeBytes / (1024.0 * 1024.0) << " MB" << endl;
+	cout << "    scene graph: walked in " << sceneGraphMilliseconds << " ms, " << sceneGraphBytes / (1024.0 * 1024.0)
+		<< " MB (+ " << sizeof(aiMatrix4x4) * (unsigned long long) nodeCount / (1024.0 * 1024.0) << " MB of world transforms)" << endl;
+	cout << "    " << nodeTreeMilliseconds / max(sceneGraphMilliseconds, 1e-6) << " times as fast, "
+		<< (double) nodeTreeBytes / max(sceneGraphBytes, 1ULL) << " times smaller"
+		<< (nodeTreeChecksum == sceneGraphChecksum ? "" : " (the walks do not agree)") << endl;
+
+	// Deleting the root deletes the whole tree.
+	delete nodes[0];
+}
+
+//------------------------------------------------------------
+// Build a rig of boneCount bones (each a child of a random earlier bone, under a root and a mesh node) and an
+// animation whose channels refer to the bones, and bind the channels both ways. The bone names share a long
+// prefix, as the names of exported rigs do.
+void benchmarkNameLookup(unsigned int boneCount, unsigned int channelCount) {
+	if (boneCount == 0) {
+		return;
+	}
+	unsigned int random = 12345;
+	vector<aiNode*> bones(boneCount);
+	vector<unsigned int> childCounts(boneCount, 0);
+	vector<unsigned int> parents(boneCount, 0);
+	for (unsigned int i = 1; i < boneCount; i++) {
+		random = random * 1664525u + 1013904223u;
+		parents[i] = (random >> 8) % i;
+		childCounts[parents[i]]++;
+	}
+	for (unsigned int i = 0; i < boneCount; i++) {
+		bones[i] = new aiNode();
+		bones[i]->mName = aiString("Armature|mixamorig:Bone_" + to_string(i));
+		if (childCounts[i] > 0) {
+			bones[i]->mChildren = new aiNode*[childCounts[i]];
+		}
+	}
+	for (unsigned int i = 1; i < boneCount; i++) {
+		aiNode* parent = bones[parents[i]];
+		bones[i]->mParent = parent;
+		parent->mChildren[parent->mNumChildren++] = bones[i];
+	}
+	aiNode* rootNode = new aiNode();
+	rootNode->mName = aiString("RootNode");
+	rootNode->mNumChildren = 2;
+	rootNode->mChildren = new aiNode*[2];
+	rootNode->mChildren[0] = new aiNode();
+	rootNode->mChildren[0]->mName = aiString("Armature|mixamorig:Body");
+	rootNode->mChildren[0]->mParent = rootNode;
+	rootNode->mChildren[1] = bones[0];
+	bones[0]->mParent = rootNode;
+
+	vector<aiString> channelNames(channelCount);
+	for (unsigned int i = 0; i < channelCount; i++) {
+		channelNames[i] = aiString("Armature|mixamorig:Bone_" + to_string((i * 7919u) % boneCount));
+	}
+
+	// The best of a few bindings of all the channels.
+	const unsigned int repeatCount = 5;
+	double findNodeMilliseconds = 1e30, hashMilliseconds = 1e30, buildMilliseconds = 1e30;
+	unsigned int findNodeMismatches = 0;
+	vector<const aiNode*> findNodeResults(channelCount);
+	vector<unsigned int> hashResults(channelCount);
+	SceneGraph graph;
+	for (unsigned int r = 0; r < repeatCount; r++) {
+		chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < channelCount; i++) {
+			findNodeResults[i] = rootNode->FindNode(channelNames[i]);
+		}
+		findNodeMilliseconds = min(findNodeMilliseconds, elapsedMilliseconds(startTime));
+
+		startTime = chrono::high_resolution_clock::now();
+		buildSceneGraph(rootNode, graph);
+		buildMilliseconds = min(buildMilliseconds, elapsedMilliseconds(startTime));
+
+		startTime = chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < channelCount; i++) {
+			hashResults[i] = findSceneNode(graph, channelNames[i]);
+		}
+		hashMilliseconds = min(hashMilliseconds, elapsedMilliseconds(startTime));
+	}
+	for (unsigned int i = 0; i < channelCount; i++) {
+		if (hashResults[i] == SCENE_GRAPH_NO_NODE || !findNodeResults[i]
+			|| strcmp(getNodeName(graph, hashResults[i]), findNodeResults[i]->mName.C_Str()) != 0) {
+			findNodeMismatches++;
+		}
+	}
+
+	cout << "Name lookup benchmark: " << boneCount << " bones, " << channelCount << " channels" << endl;
+	cout << "    aiNode::FindNode(): " << findNodeMilliseconds << " ms" << endl;
+	cout << "    hash map: " << hashMilliseconds << " ms (+ " << buildMilliseconds << " ms to build the scene graph once), "
+		<< findNodeMilliseconds / max(hashMilliseconds, 1e-6) << " times as fast"
+		<< (findNodeMismatches == 0 ? "" : " (the lookups do not agree)") << endl;
+
+	delete rootNode;
+}
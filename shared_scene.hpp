@@ -0,0 +1,476 @@
+/* This is a utility program that lets several processes on one computer draw the same 3D file from one copy of it.
+The first process that loads a 3D file publishes it: the vertices, normals, texture coordinates, faces and
+embedded texture data of the scene are copied into a named shared-memory segment, in the form the aiScene arrays
+have in memory. The other processes attach to the segment read-only, and their aiMesh and aiTexture objects point
+into it, so the geometry is uploaded straight from the shared pages and is in memory once per computer, not once
+per process. Only the small objects (the meshes, materials and nodes themselves) are made by each process.
+An aiFace holds a pointer, so the face arrays are only valid at the address where the publisher mapped the
+segment. A process that attaches asks for the same address; if it gets another one, it makes its own face
+arrays, which point into the shared index arrays.
+The following functions are provided.
+
+// The name of the segment of a 3D file. It depends on the path, the size and the modification time of the file.
+string getSharedSceneName(const string& modelFileName)
+
+// Publish a scene under a segment name. Returns the scene attached to the new segment (the caller can then
+// delete its own copy), or NULL if the segment already exists or cannot be created.
+aiScene* publishSharedScene(const aiScene* scene, const string& segmentName)
+
+// Attach to a published scene. Returns NULL if no process has published it (completely) yet.
+// Delete the scene with releaseScene() (see binary_mesh_loader.hpp); that unmaps the segment.
+aiScene* attachSharedScene(const string& segmentName)
+
+// Remove the name of a segment published by this process, so that no other process attaches to it any more.
+// The processes that have attached keep their mapping. (On Windows, the name goes with the last mapping anyway.)
+void unpublishSharedScene(const string& segmentName)
+
+This file requires the Assimp headers, file_utilities.hpp, thread_utilities.hpp, mesh_optimizer.hpp,
+optimized_model.hpp and binary_mesh_loader.hpp to be included first.
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// The segment starts with this header. The description (the materials, the embedded texture headers, the mesh
+// names and the nodes, in the layout of an optimized model file) follows it, then the mesh table, then the arrays.
+struct SharedSceneHeader {
+	unsigned char identifier[12];       // SHARED_SCENE_IDENTIFIER
+	unsigned int ready;                 // set by the publisher once the whole segment has been written
+	unsigned long long size;
+	unsigned long long baseAddress;     // where the publisher mapped the segment, i.e. where the face arrays are valid
+	unsigned int materialCount;
+	unsigned int textureCount;
+	unsigned int meshCount;
+	unsigned int reserved;
+	unsigned long long descriptionOffset;
+	unsigned long long meshTableOffset;
+};
+
+// One entry of the mesh table. An offset of 0 means the mesh does not have that array.
+struct SharedMeshEntry {
+	unsigned int materialIndex;
+	unsigned int primitiveTypes;
+	unsigned int vertexCount;
+	unsigned int faceCount;
+	unsigned int uvComponents;
+	unsigned int reserved;
+	unsigned long long indexCount;
+	unsigned long long vertexOffset;    // aiVector3D[vertexCount]
+	unsigned long long normalOffset;    // aiVector3D[vertexCount]
+	unsigned long long texCoordOffset;  // aiVector3D[vertexCount]
+	unsigned long long indexOffset;     // unsigned int[indexCount], the indices of all the faces in order
+	unsigned long long faceOffset;      // aiFace[faceCount], pointing into the index array at baseAddress
+};
+
+const unsigned char SHARED_SCENE_IDENTIFIER[12] = { 0xAB, 'S', 'H', 'S', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+//------------------------------------------------------------
+// The name of the segment of a 3D file. POSIX names start with a slash and have no other.
+string getSharedSceneName(const string& modelFileName) {
+	return "/load_3d_obj_" + formatHash(hashFileVersion(modelFileName));
+}
+
+//------------------------------------------------------------
+// Reserve a range of the segment, aligned to 8 bytes.
+unsigned long long reserveSharedRange(unsigned long long& size, unsigned long long bytes) {
+	unsigned long long offset = (size + 7) & ~7ULL;
+	size = offset + bytes;
+	return offset;
+}
+
+//------------------------------------------------------------
+// Create a segment that no process has created yet, and map it for writing.
+bool createSharedSegment(const string& segmentName, unsigned long long size, MappedFile& segment) {
+	segment.data = NULL;
+	segment.size = (size_t) size;
+#ifdef _WIN32
+	segment.fileHandle = NULL;
+	string windowsName = "Local\\" + segmentName.substr(1);
+	segment.mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD) (size >> 32),
+		(DWORD) size, windowsName.c_str());
+	if (!segment.mappingHandle) {
+		return false;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(segment.mappingHandle);
+		return false;
+	}
+	segment.data = (const unsigned char*) MapViewOfFile(segment.mappingHandle, FILE_MAP_WRITE, 0, 0, 0);
+	if (!segment.data) {
+		CloseHandle(segment.mappingHandle);
+		return false;
+	}
+#else
+	segment.fileDescriptor = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (segment.fileDescriptor < 0) {
+		return false;
+	}
+	void* address = MAP_FAILED;
+	if (ftruncate(segment.fileDescriptor, (off_t) size) == 0) {
+		address = mmap(NULL, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fileDescriptor, 0);
+	}
+	if (address == MAP_FAILED) {
+		close(segment.fileDescriptor);
+		shm_unlink(segmentName.c_str());
+		return false;
+	}
+	segment.data = (const unsigned char*) address;
+#endif
+	return true;
+}
+
+//------------------------------------------------------------
+// Map an existing segment read-only, at baseAddress if that range is free. Returns false if there is no segment.
+bool openSharedSegment(const string& segmentName, MappedFile& segment, SharedSceneHeader& header) {
+	segment.data = NULL;
+	segment.size = 0;
+#ifdef _WIN32
+	segment.fileHandle = NULL;
+	string windowsName = "Local\\" + segmentName.substr(1);
+	segment.mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, windowsName.c_str());
+	if (!segment.mappingHandle) {
+		return false;
+	}
+	const void* headerView = MapViewOfFile(segment.mappingHandle, FILE_MAP_READ, 0, 0, sizeof(header));
+	if (!headerView) {
+		CloseHandle(segment.mappingHandle);
+		return false;
+	}
+	memcpy(&header, headerView, sizeof(header));
+	UnmapViewOfFile(headerView);
+	segment.size = (size_t) header.size;
+	segment.data = (const unsigned char*) MapViewOfFileEx(segment.mappingHandle, FILE_MAP_READ, 0, 0, 0, (LPVOID) (uintptr_t) header.baseAddress);
+	if (!segment.data) {
+		segment.data = (const unsigned char*) MapViewOfFile(segment.mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!segment.data) {
+		CloseHandle(segment.mappingHandle);
+		return false;
+	}
+#else
+	segment.fileDescriptor = shm_open(segmentName.c_str(), O_RDONLY, 0);
+	if (segment.fileDescriptor < 0) {
+		return false;
+	}
+	struct stat segmentStatus;
+	if (fstat(segment.fileDescriptor, &segmentStatus) != 0 || (size_t) segmentStatus.st_size < sizeof(header)
+		|| pread(segment.fileDescriptor, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+		close(segment.fileDescriptor);
+		return false;
+	}
+	segment.size = (size_t) segmentStatus.st_size;
+	void* address = mmap((void*) (uintptr_t) header.baseAddress, segment.size, PROT_READ, MAP_SHARED, segment.fileDescriptor, 0);
+	if (address == MAP_FAILED) {
+		close(segment.fileDescriptor);
+		return false;
+	}
+	segment.data = (const unsigned char*) address;
+#endif
+	memcpy(&header, segment.data, sizeof(header));
+	return true;
+}
+
+//------------------------------------------------------------
+// Make the scene of a mapped segment. The mesh and texture arrays point into the segment; the segment itself is
+// kept in the metadata of the scene, so that releaseScene() unmaps it. Returns NULL if the segment is damaged.
+aiScene* createSharedSceneView(MappedFile* segment) {
+	SharedSceneHeader header;
+	memcpy(&header, segment->data, sizeof(header));
+	if (memcmp(header.identifier, SHARED_SCENE_IDENTIFIER, 12) != 0 || header.size != segment->size
+		|| header.meshTableOffset + sizeof(SharedMeshEntry) * (unsigned long long) header.meshCount > header.size) {
+		return NULL;
+	}
+
+	aiScene* scene = new aiScene();
+	scene->mMetaData = aiMetadata::Alloc(1);
+	scene->mMetaData->Set(0, MAPPED_SCENE_METADATA_KEY, (uint64_t) (uintptr_t) segment);
+
+	OptimizedModelReader reader = { segment->data, segment->size, (size_t) header.descriptionOffset, false };
+	scene->mMaterials = new aiMaterial*[max(header.materialCount, 1u)];
+	for (unsigned int i = 0; i < header.materialCount && !reader.failed; i++) {
+		aiMaterial* material = new aiMaterial();
+		scene->mMaterials[scene->mNumMaterials++] = material;
+		aiString name = readString(reader);
+		material->AddProperty(&name, AI_MATKEY_NAME);
+		readMaterialAppearance(reader, material);
+	}
+
+	// The texture data stays in the segment.
+	if (header.textureCount > 0) {
+		scene->mTextures = new aiTexture*[header.textureCount];
+	}
+	for (unsigned int i = 0; i < header.textureCount && !reader.failed; i++) {
+		aiTexture* texture = new aiTexture();
+		scene->mTextures[scene->mNumTextures++] = texture;
+		texture->mWidth = readUint32(reader);
+		texture->mHeight = readUint32(reader);
+		char formatHint[12];
+		readBlock(reader, formatHint, sizeof(formatHint));
+		memset(texture->achFormatHint, 0, sizeof(texture->achFormatHint));
+		memcpy(texture->achFormatHint, formatHint, min(sizeof(formatHint), sizeof(texture->achFormatHint)) - 1);
+		texture->mFilename = readString(reader);
+		unsigned long long dataOffset;
+		readBlock(reader, &dataOffset, sizeof(dataOffset));
+		size_t size = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+		if (dataOffset + size > header.size) {
+			reader.failed = true;
+		} else {
+			texture->pcData = (aiTexel*) (segment->data + dataOffset);
+		}
+	}
+
+	if (header.meshCount > 0) {
+		scene->mMeshes = new aiMesh*[header.meshCount];
+	}
+	bool sameAddress = (unsigned long long) (uintptr_t) segment->data == header.baseAddress;
+	for (unsigned int i = 0; i < header.meshCount && !reader.failed; i++) {
+		SharedMeshEntry entry;
+		memcpy(&entry, segment->data + header.meshTableOffset + sizeof(entry) * i, sizeof(entry));
+		aiMesh* mesh = new aiMesh();
+		scene->mMeshes[scene->mNumMeshes++] = mesh;
+		mesh->mName = readString(reader);
+		unsigned long long vertexBytes = sizeof(aiVector3D) * (unsigned long long) entry.vertexCount;
+		if (entry.materialIndex >= header.materialCount || entry.vertexOffset + vertexBytes > header.size
+			|| entry.normalOffset + vertexBytes > header.size || entry.texCoordOffset + vertexBytes > header.size
+			|| entry.indexOffset + sizeof(unsigned int) * entry.indexCount > header.size
+			|| entry.faceOffset + sizeof(aiFace) * (unsigned long long) entry.faceCount > header.size) {
+			reader.failed = true;
+			break;
+		}
+		mesh->mMaterialIndex = entry.materialIndex;
+		mesh->mPrimitiveTypes = entry.primitiveTypes;
+		mesh->mNumVertices = entry.vertexCount;
+		mesh->mVertices = entry.vertexOffset ? (aiVector3D*) (segment->data + entry.vertexOffset) : NULL;
+		mesh->mNormals = entry.normalOffset ? (aiVector3D*) (segment->data + entry.normalOffset) : NULL;
+		if (entry.texCoordOffset) {
+			mesh->mTextureCoords[0] = (aiVector3D*) (segment->data + entry.texCoordOffset);
+			mesh->mNumUVComponents[0] = entry.uvComponents;
+		}
+
+		// The face arrays of the segment only hold valid pointers at the address the publisher used.
+		mesh->mNumFaces = entry.faceCount;
+		if (entry.faceCount == 0) {
+			continue;
+		}
+		if (sameAddress) {
+			mesh->mFaces = (aiFace*) (segment->data + entry.faceOffset);
+			continue;
+		}
+		const aiFace* sharedFaces = (const aiFace*) (segment->data + entry.faceOffset);
+		unsigned int* indices = (unsigned int*) (segment->data + entry.indexOffset);
+		mesh->mFaces = new aiFace[entry.faceCount];
+		unsigned long long next = 0;
+		for (unsigned int j = 0; j < entry.faceCount; j++) {
+			unsigned int indexCount = sharedFaces[j].mNumIndices;
+			if (next + indexCount > entry.indexCount) {
+				reader.failed = true;
+				break;
+			}
+			mesh->mFaces[j].mNumIndices = indexCount;
+			mesh->mFaces[j].mIndices = indices + next;
+			next += indexCount;
+		}
+	}
+
+	if (!reader.failed) {
+		scene->mRootNode = readNode(reader, header.meshCount, 0);
+	}
+	if (!scene->mRootNode) {
+		// releaseScene() would unmap the segment; it belongs to the caller until the scene is made.
+		scene->mMetaData->Set(0, MAPPED_SCENE_METADATA_KEY, (uint64_t) 0);
+		for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+			deleteBinaryMesh(scene->mMeshes[i], segment->data, segment->size);
+			scene->mMeshes[i] = NULL;
+		}
+		for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+			scene->mTextures[i]->pcData = NULL;
+		}
+		delete scene;
+		return NULL;
+	}
+	return scene;
+}
+
+//------------------------------------------------------------
+// Remove the name of a published segment.
+void unpublishSharedScene(const string& segmentName) {
+#ifndef _WIN32
+	shm_unlink(segmentName.c_str());
+#endif
+}
+
+//------------------------------------------------------------
+// Publish a scene. The size of every array is known up front, so the segment is laid out first and the meshes
+// are then copied into it on all the CPU cores.
+aiScene* publishSharedScene(const aiScene* scene, const string& segmentName) {
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	// The description is small, and written as it is.
+	vector<unsigned char> description;
+	vector<size_t> textureOffsetPositions(scene->mNumTextures);
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiString name;
+		scene->mMaterials[i]->Get(AI_MATKEY_NAME, name);
+		appendString(description, name.C_Str());
+		appendMaterialAppearance(description, scene, scene->mMaterials[i], "");
+	}
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		const aiTexture* texture = scene->mTextures[i];
+		appendUint32(description, texture->mWidth);
+		appendUint32(description, texture->mHeight);
+		char formatHint[12] = { 0 };
+		strncpy(formatHint, texture->achFormatHint, min(sizeof(formatHint), sizeof(texture->achFormatHint)) - 1);
+		appendBlock(description, formatHint, sizeof(formatHint));
+		appendString(description, texture->mFilename.C_Str());
+		textureOffsetPositions[i] = description.size();
+		unsigned long long dataOffset = 0;
+		appendBlock(description, &dataOffset, sizeof(dataOffset));
+	}
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		appendString(description, scene->mMeshes[i]->mName.C_Str());
+	}
+	appendNode(description, scene->mRootNode);
+
+	SharedSceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier, SHARED_SCENE_IDENTIFIER, 12);
+	header.materialCount = scene->mNumMaterials;
+	header.textureCount = scene->mNumTextures;
+	header.meshCount = scene->mNumMeshes;
+	unsigned long long size = sizeof(header);
+	header.descriptionOffset = reserveSharedRange(size, description.size());
+	header.meshTableOffset = reserveSharedRange(size, sizeof(SharedMeshEntry) * (unsigned long long) scene->mNumMeshes);
+
+	vector<SharedMeshEntry> entries(scene->mNumMeshes);
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		SharedMeshEntry& entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		entry.materialIndex = mesh->mMaterialIndex;
+		entry.primitiveTypes = mesh->mPrimitiveTypes;
+		entry.vertexCount = mesh->mNumVertices;
+		entry.faceCount = mesh->mNumFaces;
+		entry.uvComponents = mesh->mNumUVComponents[0];
+		for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
+			entry.indexCount += mesh->mFaces[j].mNumIndices;
+		}
+		unsigned long long vertexBytes = sizeof(aiVector3D) * (unsigned long long) mesh->mNumVertices;
+		if (mesh->HasPositions()) {
+			entry.vertexOffset = reserveSharedRange(size, vertexBytes);
+		}
+		if (mesh->HasNormals()) {
+			entry.normalOffset = reserveSharedRange(size, vertexBytes);
+		}
+		if (mesh->HasTextureCoords(0)) {
+			entry.texCoordOffset = reserveSharedRange(size, vertexBytes);
+		}
+		entry.indexOffset = reserveSharedRange(size, sizeof(unsigned int) * entry.indexCount);
+		entry.faceOffset = reserveSharedRange(size, sizeof(aiFace) * (unsigned long long) mesh->mNumFaces);
+	}
+	vector<unsigned long long> textureOffsets(scene->mNumTextures);
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		const aiTexture* texture = scene->mTextures[i];
+		size_t textureSize = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+		textureOffsets[i] = reserveSharedRange(size, textureSize);
+		memcpy(&description[textureOffsetPositions[i]], &textureOffsets[i], sizeof(textureOffsets[i]));
+	}
+	header.size = size;
+
+	MappedFile* segment = new MappedFile;
+	if (!createSharedSegment(segmentName, size, *segment)) {
+		delete segment;
+		return NULL;
+	}
+	unsigned char* data = (unsigned char*) segment->data;
+	header.baseAddress = (unsigned long long) (uintptr_t) data;
+
+	memcpy(data + header.descriptionOffset, description.data(), description.size());
+	memcpy(data + header.meshTableOffset, entries.data(), sizeof(SharedMeshEntry) * entries.size());
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		const aiTexture* texture = scene->mTextures[i];
+		size_t textureSize = texture->mHeight == 0 ? texture->mWidth : sizeof(aiTexel) * texture->mWidth * texture->mHeight;
+		memcpy(data + textureOffsets[i], texture->pcData, textureSize);
+	}
+	parallelFor(scene->mNumMeshes, [scene, data, &entries](unsigned int i) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		const SharedMeshEntry& entry = entries[i];
+		size_t vertexBytes = sizeof(aiVector3D) * (size_t) mesh->mNumVertices;
+		if (entry.vertexOffset) {
+			memcpy(data + entry.vertexOffset, mesh->mVertices, vertexBytes);
+		}
+		if (entry.normalOffset) {
+			memcpy(data + entry.normalOffset, mesh->mNormals, vertexBytes);
+		}
+		if (entry.texCoordOffset) {
+			memcpy(data + entry.texCoordOffset, mesh->mTextureCoords[0], vertexBytes);
+		}
+		unsigned int* indices = (unsigned int*) (data + entry.indexOffset);
+		aiFace* faces = (aiFace*) (data + entry.faceOffset);
+		for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
+			const aiFace& face = mesh->mFaces[j];
+			memcpy(indices, face.mIndices, sizeof(unsigned int) * face.mNumIndices);
+			faces[j].mNumIndices = face.mNumIndices;
+			faces[j].mIndices = indices;
+			indices += face.mNumIndices;
+		}
+	});
+
+	// The header is written last, and marked ready after everything else, for the processes that attach meanwhile.
+	memcpy(data, &header, sizeof(header));
+	atomic_thread_fence(memory_order_release);
+	((volatile SharedSceneHeader*) data)->ready = 1;
+
+	// This process draws from the segment as well, so that it does not keep a copy of its own.
+#ifdef _WIN32
+	DWORD oldProtection;
+	VirtualProtect(data, segment->size, PAGE_READONLY, &oldProtection);
+#else
+	mprotect(data, segment->size, PROT_READ);
+#endif
+	aiScene* sharedScene = createSharedSceneView(segment);
+	if (!sharedScene) {
+		unmapFile(*segment);
+		delete segment;
+		unpublishSharedScene(segmentName);
+		return NULL;
+	}
+	cout << "Shared scene: published " << segmentName << " (" << size / (1024.0 * 1024.0) << " MB) in "
+		<< elapsedMilliseconds(startTime) << " ms" << endl;
+	return sharedScene;
+}
+
+//------------------------------------------------------------
+// Attach to a published scene.
+aiScene* attachSharedScene(const string& segmentName) {
+	MappedFile* segment = new MappedFile;
+	SharedSceneHeader header;
+	if (!openSharedSegment(segmentName, *segment, header)) {
+		delete segment;
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	aiScene* scene = header.ready ? createSharedSceneView(segment) : NULL;
+	if (!scene) {
+		cout << "Shared scene: " << segmentName << (header.ready ? " is damaged" : " is still being published") << endl;
+		unmapFile(*segment);
+		delete segment;
+		return NULL;
+	}
+	cout << "Shared scene: attached to " << segmentName << " (" << segment->size / (1024.0 * 1024.0) << " MB), "
+		<< ((unsigned long long) (uintptr_t) segment->data == header.baseAddress ? "face arrays shared" : "face arrays made by this process")
+		<< endl;
+	return scene;
+}
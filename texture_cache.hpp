@@ -0,0 +1,436 @@
+/* This is a utility program that bakes texture files into block-compressed textures with full mipmap chains
+and keeps them in a cache directory, so that later runs can upload them without decoding anything.
+The following functions are provided.
+
+// Bake a texture file into the cache, unless an up-to-date cache file already exists.
+// Returns the cache file name, or "" if the texture file cannot be decoded.
+string bakeTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7 = false)
+
+// Load a texture file through the cache. The cache file is memory-mapped and passed to
+// glCompressedTexImage2D() directly. Returns 0 if the texture cannot be loaded.
+GLuint loadCachedTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7 = false)
+
+// Same as loadCachedTexture(), but upload to an existing texture object (e.g. after releaseTextureStorage()).
+bool uploadCachedTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7, GLuint texture)
+
+// Load the (first) diffuse texture of every material, embedded or external.
+// External texture files are loaded by calling loadTextureFile (e.g. a lambda that calls loadCachedTexture()).
+// Returns an array in sync with the scene->mMaterials[] array. 0 means there is no diffuse texture.
+GLuint* loadMaterialTextures(const aiScene* scene, const GLuint* textureArray, const string& modelFileName,
+	const function<GLuint(const string&)>& loadTextureFile)
+
+// Compare the time it takes to load the cached textures with decoding the texture files.
+void benchmarkTextureCache(const vector<string>& imageFileNames, const string& cacheDirectory)
+
+The cache files are modeled on KTX2: a fixed header, a level index with the byte offset and length
+of every mipmap level, and the level data stored smallest level first (so the coarse levels of a texture
+can be read without touching the rest of the file). Unlike KTX2, the format is stored as an OpenGL enum.
+
+This file requires thread_utilities.hpp, file_utilities.hpp, check_error.hpp, texture_utilities.hpp,
+bc_encoder.hpp and stb_image.h to be included first.
+
+*/
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// What a texture is used for. This decides the compressed format.
+enum TextureKind { TEXTURE_KIND_COLOR, TEXTURE_KIND_NORMAL_MAP };
+
+// The header at the beginning of a texture cache file.
+struct TextureCacheHeader {
+	unsigned char identifier[12];   // TEXTURE_CACHE_IDENTIFIER
+	unsigned int internalFormat;    // the block-compressed OpenGL format
+	unsigned int width;
+	unsigned int height;
+	unsigned int levelCount;
+	unsigned int reserved[3];
+};
+
+// One entry of the level index, which follows the header.
+struct TextureCacheLevel {
+	unsigned long long byteOffset;
+	unsigned long long byteLength;
+	unsigned long long uncompressedByteLength;
+};
+
+const unsigned char TEXTURE_CACHE_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'C', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+//------------------------------------------------------------
+// Choose the compressed format of a texture.
+// Normal maps only need two channels (z is rebuilt in the shader), so BC5 keeps them at full precision.
+// Color textures use BC7 if requested, otherwise BC1 if they are opaque and BC3 if they have alpha.
+GLenum chooseCompressedFormat(TextureKind kind, bool hasAlpha, bool useBC7) {
+	if (kind == TEXTURE_KIND_NORMAL_MAP) {
+		return GL_COMPRESSED_RG_RGTC2;
+	}
+	if (useBC7) {
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return hasAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+//------------------------------------------------------------
+// Check if the OpenGL implementation can sample a compressed format.
+bool isCompressedFormatSupported(GLenum format) {
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc;
+	case GL_COMPRESSED_RG_RGTC2:
+		return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+	default:
+		return false;
+	}
+}
+
+//------------------------------------------------------------
+// The name of the cache file of a texture file.
+// The key covers everything the cache file depends on, so a changed texture file gets a new cache file.
+string getTextureCacheFileName(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7) {
+	unsigned long long key = hashFileVersion(imageFileName);
+	key = hashBytes(&kind, sizeof(kind), key);
+	key = hashBytes(&useBC7, sizeof(useBC7), key);
+	return cacheDirectory + "/" + formatHash(key) + ".ktc";
+}
+
+//------------------------------------------------------------
+// Parse a texture cache file that is already in memory.
+// The level pointers point into the file data, as with parseCompressedTextureContainer().
+bool parseTextureCacheFile(const unsigned char* data, size_t size, TextureLevels& levels) {
+	if (size < sizeof(TextureCacheHeader) || memcmp(data, TEXTURE_CACHE_IDENTIFIER, 12) != 0) {
+		return false;
+	}
+
+	TextureCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.levelCount == 0 || header.levelCount > MAX_TEXTURE_LEVELS
+		|| size < sizeof(header) + header.levelCount * sizeof(TextureCacheLevel)) {
+		return false;
+	}
+
+	levels.compressed = true;
+	levels.internalFormat = header.internalFormat;
+	levels.format = 0;
+	levels.type = 0;
+	levels.width = header.width;
+	levels.height = header.height;
+	levels.levelCount = header.levelCount;
+
+	for (unsigned int level = 0; level < header.levelCount; level++) {
+		TextureCacheLevel levelIndex;
+		memcpy(&levelIndex, data + sizeof(header) + level * sizeof(TextureCacheLevel), sizeof(levelIndex));
+		if (levelIndex.byteOffset > size || levelIndex.byteLength > size - levelIndex.byteOffset) {
+			return false;
+		}
+		levels.levelData[level] = data + levelIndex.byteOffset;
+		levels.levelSize[level] = (unsigned int) levelIndex.byteLength;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Bake a texture file into the cache, unless an up-to-date cache file already exists.
+string bakeTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7 = false) {
+	string cacheFileName = getTextureCacheFileName(imageFileName, cacheDirectory, kind, useBC7);
+
+	unsigned long long cacheFileSize = 0;
+	long long cacheModificationTime = 0;
+	if (getFileInfo(cacheFileName, cacheFileSize, cacheModificationTime)) {
+		return cacheFileName;
+	}
+
+	// Image files store the top row first, while OpenGL expects the bottom row first.
+	stbi_set_flip_vertically_on_load(1);
+
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = stbi_load(imageFileName.c_str(), &width, &height, &channels, 4);
+	if (!pixels) {
+		cout << "bakeTexture(): unable to decode " << imageFileName << endl;
+		return "";
+	}
+
+	GLenum format = chooseCompressedFormat(kind, imageHasAlpha(pixels, width, height), useBC7);
+
+	// Work out the size of every level. Level 0 is the full-size image.
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier, TEXTURE_CACHE_IDENTIFIER, 12);
+	header.internalFormat = format;
+	header.width = width;
+	header.height = height;
+	header.levelCount = 1;
+	while (header.levelCount < MAX_TEXTURE_LEVELS && ((width >> header.levelCount) > 0 || (height >> header.levelCount) > 0)) {
+		header.levelCount++;
+	}
+
+	vector<TextureCacheLevel> levelIndex(header.levelCount);
+	for (unsigned int level = 0; level < header.levelCount; level++) {
+		unsigned int levelWidth = max(1, width >> level);
+		unsigned int levelHeight = max(1, height >> level);
+		levelIndex[level].byteLength = compressedLevelSize(format, levelWidth, levelHeight);
+		levelIndex[level].uncompressedByteLength = (unsigned long long) levelWidth * levelHeight * 4;
+	}
+
+	// The smallest level comes first. Each level starts on a 16-byte boundary.
+	unsigned long long offset = sizeof(header) + header.levelCount * sizeof(TextureCacheLevel);
+	for (int level = header.levelCount - 1; level >= 0; level--) {
+		offset = (offset + 15) & ~15ULL;
+		levelIndex[level].byteOffset = offset;
+		offset += levelIndex[level].byteLength;
+	}
+
+	vector<unsigned char> fileData(offset, 0);
+	memcpy(&fileData[0], &header, sizeof(header));
+	memcpy(&fileData[sizeof(header)], &levelIndex[0], header.levelCount * sizeof(TextureCacheLevel));
+
+	// Compress each level, then box-filter it down to the next level.
+	const unsigned char* levelPixels = pixels;
+	vector<unsigned char> currentLevel, nextLevel;
+	for (unsigned int level = 0; level < header.levelCount; level++) {
+		unsigned int levelWidth = max(1, width >> level);
+		unsigned int levelHeight = max(1, height >> level);
+		encodeBlockCompressedImage(format, levelPixels, levelWidth, levelHeight, &fileData[levelIndex[level].byteOffset]);
+
+		if (level + 1 < header.levelCount) {
+			downsampleImage(levelPixels, levelWidth, levelHeight, nextLevel);
+			currentLevel.swap(nextLevel);
+			levelPixels = &currentLevel[0];
+		}
+	}
+
+	stbi_image_free(pixels);
+
+	createDirectory(cacheDirectory);
+	if (!writeFile(cacheFileName, &fileData[0], fileData.size())) {
+		return "";
+	}
+
+	cout << "Baked " << imageFileName << " (" << width << "x" << height << ", " << header.levelCount
+		<< " levels) into " << cacheFileName << endl;
+	return cacheFileName;
+}
+
+//------------------------------------------------------------
+// Create a texture object with the default sampling parameters of this program.
+GLuint createTextureObject() {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return texture;
+}
+
+//------------------------------------------------------------
+// Decode a texture file and upload it uncompressed. This is the path the cache replaces, and the
+// fallback when the OpenGL implementation cannot sample the compressed format.
+bool uploadUncompressedTexture(const string& imageFileName, GLuint texture) {
+	stbi_set_flip_vertically_on_load(1);
+
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = stbi_load(imageFileName.c_str(), &width, &height, &channels, 4);
+	if (!pixels) {
+		cout << "uploadUncompressedTexture(): unable to decode " << imageFileName << endl;
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	stbi_image_free(pixels);
+	return true;
+}
+
+GLuint loadUncompressedTexture(const string& imageFileName) {
+	GLuint texture = createTextureObject();
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!uploadUncompressedTexture(imageFileName, texture)) {
+		glDeleteTextures(1, &texture);
+		return 0;
+	}
+	return texture;
+}
+
+//------------------------------------------------------------
+// Upload a texture file through the cache to an existing texture object.
+bool uploadCachedTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7,
+	GLuint texture) {
+	string cacheFileName = bakeTexture(imageFileName, cacheDirectory, kind, useBC7);
+	if (cacheFileName.empty()) {
+		return false;
+	}
+
+	MappedFile mappedFile;
+	if (!mapFile(cacheFileName, mappedFile)) {
+		cout << "uploadCachedTexture(): unable to open " << cacheFileName << endl;
+		return false;
+	}
+
+	TextureLevels levels;
+	if (!parseTextureCacheFile(mappedFile.data, mappedFile.size, levels)) {
+		cout << "uploadCachedTexture(): " << cacheFileName << " is not a valid texture cache file" << endl;
+		unmapFile(mappedFile);
+		return false;
+	}
+
+	if (!isCompressedFormatSupported(levels.internalFormat)) {
+		unmapFile(mappedFile);
+		return uploadUncompressedTexture(imageFileName, texture);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	uploadTextureLevels(levels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// glCompressedTexImage2D() has copied the data by the time it returns.
+	unmapFile(mappedFile);
+
+	return true;
+}
+
+//------------------------------------------------------------
+// Load a texture file through the cache.
+GLuint loadCachedTexture(const string& imageFileName, const string& cacheDirectory, TextureKind kind, bool useBC7 = false) {
+	GLuint texture = createTextureObject();
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!uploadCachedTexture(imageFileName, cacheDirectory, kind, useBC7, texture)) {
+		glDeleteTextures(1, &texture);
+		return 0;
+	}
+	return texture;
+}
+
+//------------------------------------------------------------
+// The file name of the (first) diffuse texture of each material, resolved relative to the model file.
+// The name is "" if the material has no diffuse texture or if the texture is embedded.
+vector<string> getMaterialTextureFileNames(const aiScene* scene, const string& modelFileName) {
+	vector<string> fileNames(scene->mNumMaterials);
+	string modelDirectory = getDirectoryName(modelFileName);
+
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiString texturePath;
+		if (AI_SUCCESS != scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath)) {
+			continue;
+		}
+		if (findEmbeddedTexture(scene, texturePath) >= 0 || texturePath.data[0] == '*') {
+			continue;
+		}
+
+		string path = texturePath.C_Str();
+		bool isAbsolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) || path.find(':') != string::npos;
+		fileNames[i] = isAbsolute ? path : modelDirectory + path;
+	}
+	return fileNames;
+}
+
+//------------------------------------------------------------
+// Load the (first) diffuse texture of every material.
+// Materials that share a texture file share one texture object.
+GLuint* loadMaterialTextures(const aiScene* scene, const GLuint* textureArray, const string& modelFileName,
+	const function<GLuint(const string&)>& loadTextureFile) {
+	if (!scene || !scene->HasMaterials()) {
+		return NULL;
+	}
+
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	vector<string> fileNames = getMaterialTextureFileNames(scene, modelFileName);
+	GLuint* materialTextureArray = (GLuint*) malloc(sizeof(GLuint) * scene->mNumMaterials);
+	unsigned int externalTextureCount = 0;
+
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		materialTextureArray[i] = 0;
+
+		aiString texturePath;
+		if (AI_SUCCESS != scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath)) {
+			continue;
+		}
+
+		int embeddedIndex = findEmbeddedTexture(scene, texturePath);
+		if (embeddedIndex >= 0) {
+			if (textureArray) {
+				materialTextureArray[i] = textureArray[embeddedIndex];
+			}
+			continue;
+		}
+
+		if (fileNames[i].empty()) {
+			continue;
+		}
+
+		for (unsigned int j = 0; j < i; j++) {
+			if (fileNames[j] == fileNames[i]) {
+				materialTextureArray[i] = materialTextureArray[j];
+				break;
+			}
+		}
+		if (materialTextureArray[i] == 0) {
+			materialTextureArray[i] = loadTextureFile(fileNames[i]);
+			externalTextureCount++;
+		}
+	}
+
+	if (externalTextureCount > 0) {
+		cout << "Loaded " << externalTextureCount << " texture files in "
+			<< elapsedMilliseconds(startTime) << " ms" << endl;
+	}
+
+	checkOpenGLError("loadMaterialTextures()");
+
+	return materialTextureArray;
+}
+
+//------------------------------------------------------------
+// Compare the time it takes to load the cached textures with decoding the texture files.
+// Both paths include the upload, and glFinish() makes sure the driver has really done the work.
+void benchmarkTextureCache(const vector<string>& imageFileNames, const string& cacheDirectory) {
+	double cachedMilliseconds = 0, decodedMilliseconds = 0;
+	unsigned int textureCount = 0;
+
+	for (unsigned int i = 0; i < imageFileNames.size(); i++) {
+		if (imageFileNames[i].empty()) {
+			continue;
+		}
+
+		// Make sure the cache file exists, so baking is not part of the measurement.
+		if (bakeTexture(imageFileNames[i], cacheDirectory, TEXTURE_KIND_COLOR).empty()) {
+			continue;
+		}
+
+		chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+		GLuint texture = loadCachedTexture(imageFileNames[i], cacheDirectory, TEXTURE_KIND_COLOR);
+		glFinish();
+		cachedMilliseconds += elapsedMilliseconds(startTime);
+		glDeleteTextures(1, &texture);
+
+		startTime = chrono::high_resolution_clock::now();
+		texture = loadUncompressedTexture(imageFileNames[i]);
+		glFinish();
+		decodedMilliseconds += elapsedMilliseconds(startTime);
+		glDeleteTextures(1, &texture);
+
+		textureCount++;
+	}
+
+	cout << "---------- Texture cache benchmark ----------" << endl;
+	cout << "Textures: " << textureCount << endl;
+	cout << "Memory-mapped compressed cache: " << cachedMilliseconds << " ms" << endl;
+	cout << "Decoded source images: " << decodedMilliseconds << " ms" << endl;
+	if (cachedMilliseconds > 0) {
+		cout << "Speedup: " << decodedMilliseconds / cachedMilliseconds << "x" << endl;
+	}
+}
@@ -0,0 +1,501 @@
+/* This is a utility program that streams the mipmap levels of cached textures into video memory
+as they are needed, instead of loading every texture at full resolution before the first frame.
+The following functions are provided.
+
+// Start the loading thread of a texture streamer.
+// memoryBudget is the maximum number of bytes of texture data in video memory.
+// uploadBudget is the maximum number of bytes uploaded per frame.
+void initTextureStreamer(TextureStreamer& streamer, unsigned long long memoryBudget, unsigned long long uploadBudget)
+
+// Stop the loading thread and release the cache files. Call this function before the program exits.
+void stopTextureStreamer(TextureStreamer& streamer)
+
+// Add a texture cache file (see texture_cache.hpp) to the streamer. Only the levels that are
+// at most initialSize texels wide and high are uploaded right away. Returns the texture object, or 0.
+GLuint addStreamedTexture(TextureStreamer& streamer, const string& cacheFileName, unsigned int initialSize = 64)
+
+// Stop streaming a texture and delete its texture object, e.g. when its file has been reloaded.
+void removeStreamedTexture(TextureStreamer& streamer, GLuint texture)
+
+// Compute the surface area, texture-coordinate area and bounding box of a mesh.
+// Call this function once per mesh after loading the 3D file.
+MeshTextureCoverage computeMeshTextureCoverage(const aiMesh* mesh)
+
+// Estimate the finest mipmap level a mesh needs, from its projected size and texture-coordinate density.
+float estimateTextureLevel(const MeshTextureCoverage& coverage, const aiMatrix4x4& transform,
+	int viewportWidth, int viewportHeight, unsigned int textureWidth, unsigned int textureHeight)
+
+// Tell the streamer that a texture is drawn this frame and needs the given level.
+// Call this function while building the draw list.
+void requestTextureLevel(TextureStreamer& streamer, GLuint texture, float level)
+
+// Upload the levels that have been loaded (up to the per-frame upload budget) and request new ones.
+// Call this function once per frame, after the draw list has been built.
+void updateTextureStreaming(TextureStreamer& streamer)
+
+// Check if the streamer still has work to do, i.e. more frames should be drawn.
+bool isTextureStreamingBusy(const TextureStreamer& streamer)
+
+// The full-size width and height of a streamed texture (0 if the texture is not streamed).
+void getStreamedTextureSize(const TextureStreamer& streamer, GLuint texture, unsigned int& width, unsigned int& height)
+
+// Print the residency and upload counters.
+void printTextureStreamingStatistics(const TextureStreamer& streamer)
+
+This file requires file_utilities.hpp, check_error.hpp, texture_utilities.hpp and texture_cache.hpp to be
+included first.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A texture whose levels are streamed from a memory-mapped cache file.
+// The finest levels are missing at first; GL_TEXTURE_BASE_LEVEL always points at the finest level in video memory.
+struct StreamedTexture {
+	MappedFile mappedFile;
+	TextureLevels levels;         // pointers into mappedFile
+	GLuint texture;               // 0 after the texture has been removed
+	unsigned int residentLevel;   // the finest level in video memory
+	unsigned int requestedLevel;  // the finest level in video memory or on its way there
+	float wantedLevel;            // the finest level needed by the current frame
+};
+
+// A level read from the cache file by the loading thread, waiting to be uploaded.
+struct StreamedLevel {
+	unsigned int textureIndex;
+	unsigned int level;
+	const unsigned char* source;   // the level in the memory-mapped cache file
+	unsigned int size;
+	vector<unsigned char> data;
+};
+
+struct TextureStreamer {
+	vector<StreamedTexture> textures;
+	unordered_map<GLuint, unsigned int> textureIndices;   // texture object -> index in textures
+
+	unsigned long long memoryBudget;
+	unsigned long long uploadBudget;
+	unsigned long long residentBytes;    // texture data in video memory
+	unsigned long long requestedBytes;   // texture data on its way to video memory
+	bool busy;
+
+	// The loading thread reads levels from the cache files, so that the first touch of the
+	// memory-mapped pages (i.e. the disk read) does not happen on the rendering thread.
+	thread loader;
+	mutex queueMutex;
+	condition_variable queueCondition;
+	deque<StreamedLevel> requestQueue;
+	deque<StreamedLevel> readyQueue;
+	bool stopping;
+
+	// Statistics
+	unsigned long long uploadedBytes;
+	unsigned int uploadedLevels;
+	unsigned int droppedLevels;
+};
+
+// The area and extent of a mesh, used to estimate the mipmap level it needs.
+struct MeshTextureCoverage {
+	float surfaceArea;   // in object space
+	float uvArea;        // in texture space (channel 0)
+	aiVector3D boundsMin;
+	aiVector3D boundsMax;
+};
+
+//------------------------------------------------------------
+// The loading thread. It waits for requests, reads the level data and hands it back.
+void textureStreamerLoader(TextureStreamer* streamer) {
+	while (true) {
+		StreamedLevel request;
+		{
+			unique_lock<mutex> lock(streamer->queueMutex);
+			streamer->queueCondition.wait(lock, [streamer]() {
+				return streamer->stopping || !streamer->requestQueue.empty();
+			});
+			if (streamer->stopping) {
+				return;
+			}
+			request = streamer->requestQueue.front();
+			streamer->requestQueue.pop_front();
+		}
+
+		request.data.assign(request.source, request.source + request.size);
+
+		lock_guard<mutex> lock(streamer->queueMutex);
+		streamer->readyQueue.push_back(request);
+	}
+}
+
+//------------------------------------------------------------
+// Start the loading thread of a texture streamer.
+void initTextureStreamer(TextureStreamer& streamer, unsigned long long memoryBudget, unsigned long long uploadBudget) {
+	streamer.memoryBudget = memoryBudget;
+	streamer.uploadBudget = uploadBudget;
+	streamer.residentBytes = 0;
+	streamer.requestedBytes = 0;
+	streamer.busy = false;
+	streamer.stopping = false;
+	streamer.uploadedBytes = 0;
+	streamer.uploadedLevels = 0;
+	streamer.droppedLevels = 0;
+	streamer.loader = thread(textureStreamerLoader, &streamer);
+}
+
+//------------------------------------------------------------
+// Stop the loading thread and release the cache files.
+void stopTextureStreamer(TextureStreamer& streamer) {
+	if (!streamer.loader.joinable()) {
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(streamer.queueMutex);
+		streamer.stopping = true;
+	}
+	streamer.queueCondition.notify_one();
+	streamer.loader.join();
+
+	for (unsigned int i = 0; i < streamer.textures.size(); i++) {
+		unmapFile(streamer.textures[i].mappedFile);
+	}
+}
+
+//------------------------------------------------------------
+// Add a texture cache file to the streamer.
+GLuint addStreamedTexture(TextureStreamer& streamer, const string& cacheFileName, unsigned int initialSize = 64) {
+	StreamedTexture streamedTexture;
+	if (!mapFile(cacheFileName, streamedTexture.mappedFile)) {
+		cout << "addStreamedTexture(): unable to open " << cacheFileName << endl;
+		return 0;
+	}
+
+	if (!parseTextureCacheFile(streamedTexture.mappedFile.data, streamedTexture.mappedFile.size, streamedTexture.levels)
+		|| !isCompressedFormatSupported(streamedTexture.levels.internalFormat)) {
+		unmapFile(streamedTexture.mappedFile);
+		return 0;
+	}
+
+	const TextureLevels& levels = streamedTexture.levels;
+	unsigned int coarsestLevel = levels.levelCount - 1;
+
+	// Start at the finest level that fits in initialSize x initialSize.
+	unsigned int firstLevel = 0;
+	while (firstLevel < coarsestLevel
+		&& ((levels.width >> firstLevel) > initialSize || (levels.height >> firstLevel) > initialSize)) {
+		firstLevel++;
+	}
+
+	streamedTexture.texture = createTextureObject();
+	for (unsigned int level = firstLevel; level <= coarsestLevel; level++) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, levels.internalFormat,
+			max(1u, levels.width >> level), max(1u, levels.height >> level), 0,
+			levels.levelSize[level], levels.levelData[level]);
+		streamer.residentBytes += levels.levelSize[level];
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, coarsestLevel);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	streamedTexture.residentLevel = firstLevel;
+	streamedTexture.requestedLevel = firstLevel;
+	streamedTexture.wantedLevel = (float) coarsestLevel;
+
+	streamer.textureIndices[streamedTexture.texture] = streamer.textures.size();
+	streamer.textures.push_back(streamedTexture);
+	return streamedTexture.texture;
+}
+
+//------------------------------------------------------------
+// Stop streaming a texture and delete its texture object.
+// The entry stays in textures[] and the cache file stays mapped until stopTextureStreamer(),
+// because the loading thread may still be reading a level of it.
+void removeStreamedTexture(TextureStreamer& streamer, GLuint texture) {
+	unordered_map<GLuint, unsigned int>::iterator found = streamer.textureIndices.find(texture);
+	if (found == streamer.textureIndices.end()) {
+		return;
+	}
+	StreamedTexture& streamedTexture = streamer.textures[found->second];
+	streamer.textureIndices.erase(found);
+
+	for (unsigned int level = streamedTexture.residentLevel; level < streamedTexture.levels.levelCount; level++) {
+		streamer.residentBytes -= streamedTexture.levels.levelSize[level];
+	}
+	glDeleteTextures(1, &streamedTexture.texture);
+	streamedTexture.texture = 0;
+}
+
+//------------------------------------------------------------
+// Compute the surface area, texture-coordinate area and bounding box of a mesh.
+MeshTextureCoverage computeMeshTextureCoverage(const aiMesh* mesh) {
+	MeshTextureCoverage coverage;
+	coverage.surfaceArea = 0;
+	coverage.uvArea = 0;
+	coverage.boundsMin = aiVector3D(1e30f, 1e30f, 1e30f);
+	coverage.boundsMax = aiVector3D(-1e30f, -1e30f, -1e30f);
+
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			coverage.boundsMin[c] = min(coverage.boundsMin[c], mesh->mVertices[i][c]);
+			coverage.boundsMax[c] = max(coverage.boundsMax[c], mesh->mVertices[i][c]);
+		}
+	}
+
+	if (!mesh->HasTextureCoords(0)) {
+		return coverage;
+	}
+
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3) {
+			continue;
+		}
+
+		const aiVector3D& p0 = mesh->mVertices[face.mIndices[0]];
+		const aiVector3D& p1 = mesh->mVertices[face.mIndices[1]];
+		const aiVector3D& p2 = mesh->mVertices[face.mIndices[2]];
+		coverage.surfaceArea += 0.5f * ((p1 - p0) ^ (p2 - p0)).Length();
+
+		const aiVector3D& t0 = mesh->mTextureCoords[0][face.mIndices[0]];
+		const aiVector3D& t1 = mesh->mTextureCoords[0][face.mIndices[1]];
+		const aiVector3D& t2 = mesh->mTextureCoords[0][face.mIndices[2]];
+		coverage.uvArea += 0.5f * fabs((t1.x - t0.x) * (t2.y - t0.y) - (t2.x - t0.x) * (t1.y - t0.y));
+	}
+
+	return coverage;
+}
+
+//------------------------------------------------------------
+// Estimate the finest mipmap level a mesh needs.
+// The texels the mesh covers at level 0 (uvArea * texture size) are compared with the pixels it covers on screen.
+// Each level has a quarter of the texels, so the level is half the log2 of the ratio.
+// The vertex positions are used as clip coordinates (this program has no camera), so one unit is half the viewport.
+// Returns a very coarse level for meshes that are completely outside the view.
+float estimateTextureLevel(const MeshTextureCoverage& coverage, const aiMatrix4x4& transform,
+	int viewportWidth, int viewportHeight, unsigned int textureWidth, unsigned int textureHeight) {
+	const float coarsest = 1e6f;
+
+	if (coverage.uvArea <= 0 || coverage.surfaceArea <= 0) {
+		return coarsest;
+	}
+
+	// Project the corners of the bounding box and clip the rectangle they span to the view.
+	float screenMin[2] = { 1e30f, 1e30f }, screenMax[2] = { -1e30f, -1e30f };
+	for (unsigned int corner = 0; corner < 8; corner++) {
+		aiVector3D point((corner & 1) ? coverage.boundsMax.x : coverage.boundsMin.x,
+			(corner & 2) ? coverage.boundsMax.y : coverage.boundsMin.y,
+			(corner & 4) ? coverage.boundsMax.z : coverage.boundsMin.z);
+		point = transform * point;
+		for (unsigned int c = 0; c < 2; c++) {
+			screenMin[c] = min(screenMin[c], point[c]);
+			screenMax[c] = max(screenMax[c], point[c]);
+		}
+	}
+	for (unsigned int c = 0; c < 2; c++) {
+		screenMin[c] = max(screenMin[c], -1.0f);
+		screenMax[c] = min(screenMax[c], 1.0f);
+		if (screenMin[c] >= screenMax[c]) {
+			return coarsest;
+		}
+	}
+	float pixelsPerUnitX = viewportWidth * 0.5f;
+	float pixelsPerUnitY = viewportHeight * 0.5f;
+	float boundsPixels = (screenMax[0] - screenMin[0]) * pixelsPerUnitX * (screenMax[1] - screenMin[1]) * pixelsPerUnitY;
+
+	// The scale of the transform is the length of its longest axis.
+	float scale = 0;
+	for (unsigned int c = 0; c < 3; c++) {
+		aiVector3D axis(transform[0][c], transform[1][c], transform[2][c]);
+		scale = max(scale, axis.Length());
+	}
+
+	// About half of a closed surface faces the viewer. The surface cannot cover more than its bounding rectangle.
+	float surfacePixels = 0.5f * coverage.surfaceArea * scale * scale * pixelsPerUnitX * pixelsPerUnitY;
+	surfacePixels = min(surfacePixels, boundsPixels);
+	if (surfacePixels < 1.0f) {
+		surfacePixels = 1.0f;
+	}
+
+	float texels = coverage.uvArea * textureWidth * textureHeight;
+	return max(0.0f, 0.5f * log2(texels / surfacePixels));
+}
+
+//------------------------------------------------------------
+// Tell the streamer that a texture is drawn this frame and needs the given level.
+// Textures that are not streamed are ignored.
+void requestTextureLevel(TextureStreamer& streamer, GLuint texture, float level) {
+	unordered_map<GLuint, unsigned int>::const_iterator found = streamer.textureIndices.find(texture);
+	if (found == streamer.textureIndices.end()) {
+		return;
+	}
+	StreamedTexture& streamedTexture = streamer.textures[found->second];
+	streamedTexture.wantedLevel = min(streamedTexture.wantedLevel, level);
+}
+
+//------------------------------------------------------------
+// The full-size width and height of a streamed texture, for estimateTextureLevel().
+void getStreamedTextureSize(const TextureStreamer& streamer, GLuint texture, unsigned int& width, unsigned int& height) {
+	unordered_map<GLuint, unsigned int>::const_iterator found = streamer.textureIndices.find(texture);
+	if (found == streamer.textureIndices.end()) {
+		width = height = 0;
+		return;
+	}
+	width = streamer.textures[found->second].levels.width;
+	height = streamer.textures[found->second].levels.height;
+}
+
+//------------------------------------------------------------
+// Drop the finest level of a texture from video memory.
+void dropTextureLevel(TextureStreamer& streamer, StreamedTexture& streamedTexture) {
+	unsigned int level = streamedTexture.residentLevel;
+
+	glBindTexture(GL_TEXTURE_2D, streamedTexture.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	// Redefining the level with a size of 0 releases its memory.
+	glCompressedTexImage2D(GL_TEXTURE_2D, level, streamedTexture.levels.internalFormat, 0, 0, 0, 0, NULL);
+
+	streamedTexture.residentLevel = level + 1;
+	streamedTexture.requestedLevel = level + 1;
+	streamer.residentBytes -= streamedTexture.levels.levelSize[level];
+	streamer.droppedLevels++;
+}
+
+//------------------------------------------------------------
+// Make room for neededBytes by dropping levels that are finer than the current frame needs.
+// The largest levels are dropped first. Returns true if there is enough room.
+bool makeTextureMemoryRoom(TextureStreamer& streamer, unsigned long long neededBytes) {
+	while (streamer.residentBytes + streamer.requestedBytes + neededBytes > streamer.memoryBudget) {
+		StreamedTexture* victim = NULL;
+		for (unsigned int i = 0; i < streamer.textures.size(); i++) {
+			StreamedTexture& candidate = streamer.textures[i];
+			bool overResident = candidate.residentLevel + 1 <= (unsigned int) floor(candidate.wantedLevel)
+				&& candidate.residentLevel + 1 < candidate.levels.levelCount;
+			bool inFlight = candidate.requestedLevel != candidate.residentLevel;
+			if (candidate.texture != 0 && overResident && !inFlight && (!victim
+				|| candidate.levels.levelSize[candidate.residentLevel] > victim->levels.levelSize[victim->residentLevel])) {
+				victim = &candidate;
+			}
+		}
+		if (!victim) {
+			return false;
+		}
+		dropTextureLevel(streamer, *victim);
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Upload the levels that have been loaded and request new ones.
+void updateTextureStreaming(TextureStreamer& streamer) {
+	// Step 1: upload the loaded levels, up to the per-frame upload budget.
+	// At least one level is uploaded per frame, so a level larger than the budget is not stuck forever.
+	unsigned long long frameBytes = 0;
+	while (frameBytes < streamer.uploadBudget) {
+		StreamedLevel ready;
+		{
+			lock_guard<mutex> lock(streamer.queueMutex);
+			if (streamer.readyQueue.empty()) {
+				break;
+			}
+			ready = streamer.readyQueue.front();
+			streamer.readyQueue.pop_front();
+		}
+
+		StreamedTexture& streamedTexture = streamer.textures[ready.textureIndex];
+		const TextureLevels& levels = streamedTexture.levels;
+		if (streamedTexture.texture == 0) {
+			// The texture was removed while this level was on its way.
+			streamer.requestedBytes -= ready.data.size();
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, streamedTexture.texture);
+		glCompressedTexImage2D(GL_TEXTURE_2D, ready.level, levels.internalFormat,
+			max(1u, levels.width >> ready.level), max(1u, levels.height >> ready.level), 0,
+			(GLsizei) ready.data.size(), &ready.data[0]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, ready.level);
+
+		streamedTexture.residentLevel = ready.level;
+		streamer.requestedBytes -= ready.data.size();
+		streamer.residentBytes += ready.data.size();
+		streamer.uploadedBytes += ready.data.size();
+		streamer.uploadedLevels++;
+		frameBytes += ready.data.size();
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Step 2: request the next finer level of the textures that need it, the ones furthest from
+	// their wanted level first. Each texture has at most one level on its way, so the resident levels
+	// always form a complete chain from GL_TEXTURE_BASE_LEVEL down to 1x1.
+	vector<unsigned int> order;
+	for (unsigned int i = 0; i < streamer.textures.size(); i++) {
+		StreamedTexture& streamedTexture = streamer.textures[i];
+		if (streamedTexture.texture != 0 && streamedTexture.requestedLevel == streamedTexture.residentLevel
+			&& (float) streamedTexture.residentLevel > floor(streamedTexture.wantedLevel)) {
+			order.push_back(i);
+		}
+	}
+	sort(order.begin(), order.end(), [&streamer](unsigned int a, unsigned int b) {
+		return streamer.textures[a].residentLevel - streamer.textures[a].wantedLevel
+			> streamer.textures[b].residentLevel - streamer.textures[b].wantedLevel;
+	});
+
+	for (unsigned int i = 0; i < order.size(); i++) {
+		StreamedTexture& streamedTexture = streamer.textures[order[i]];
+		unsigned int level = streamedTexture.residentLevel - 1;
+		unsigned long long levelBytes = streamedTexture.levels.levelSize[level];
+		if (!makeTextureMemoryRoom(streamer, levelBytes)) {
+			continue;
+		}
+
+		StreamedLevel request;
+		request.textureIndex = order[i];
+		request.level = level;
+		request.source = streamedTexture.levels.levelData[level];
+		request.size = streamedTexture.levels.levelSize[level];
+		streamedTexture.requestedLevel = level;
+		streamer.requestedBytes += levelBytes;
+
+		lock_guard<mutex> lock(streamer.queueMutex);
+		streamer.requestQueue.push_back(request);
+	}
+	streamer.queueCondition.notify_one();
+
+	// Step 3: the next frame starts from scratch.
+	streamer.busy = streamer.requestedBytes > 0;
+	for (unsigned int i = 0; i < streamer.textures.size(); i++) {
+		streamer.textures[i].wantedLevel = (float) (streamer.textures[i].levels.levelCount - 1);
+	}
+
+	checkOpenGLError("updateTextureStreaming()");
+}
+
+//------------------------------------------------------------
+// Check if the streamer still has levels on their way to video memory.
+bool isTextureStreamingBusy(const TextureStreamer& streamer) {
+	return streamer.busy;
+}
+
+//------------------------------------------------------------
+// Print the residency and upload counters.
+void printTextureStreamingStatistics(const TextureStreamer& streamer) {
+	cout << "---------- Texture streaming ----------" << endl;
+	cout << "Streamed textures: " << streamer.textures.size() << endl;
+	cout << "Resident bytes: " << streamer.residentBytes << " of " << streamer.memoryBudget << endl;
+	cout << "Uploaded levels: " << streamer.uploadedLevels << " (" << streamer.uploadedBytes << " bytes)" << endl;
+	cout << "Dropped levels: " << streamer.droppedLevels << endl;
+	for (unsigned int i = 0; i < streamer.textures.size(); i++) {
+		const StreamedTexture& streamedTexture = streamer.textures[i];
+		cout << "Texture " << streamedTexture.texture << ": level " << streamedTexture.residentLevel
+			<< " of " << streamedTexture.levels.levelCount << " resident" << endl;
+	}
+}
@@ -0,0 +1,380 @@
+/* This is a utility program that helps OpenGL programmers upload the textures embedded in a 3D file
+(e.g. FBX and glTF files) to OpenGL texture objects.
+The following functions are provided.
+
+// Decode (if necessary) and upload all the embedded textures of an aiScene object.
+// Call this function after Assimp::Importer.ReadFile().
+// Returns an array of texture object indices in sync with the scene->mTextures[] array.
+GLuint* loadEmbeddedTextures(const aiScene* scene)
+
+// Find the index of the embedded texture referenced by a material texture path (-1 if it is not embedded).
+int findEmbeddedTexture(const aiScene* scene, const aiString& texturePath)
+
+// Parse a DDS or KTX file that is already in memory.
+bool parseCompressedTextureContainer(const unsigned char* data, unsigned int size, TextureLevels& levels)
+
+// Upload all the mipmap levels of a parsed container to the currently bound GL_TEXTURE_2D.
+void uploadTextureLevels(const TextureLevels& levels)
+
+// Upload one embedded texture to an existing texture object (e.g. after releaseTextureStorage()).
+void uploadEmbeddedTexture(const aiTexture* embeddedTexture, GLuint texture)
+
+// Release the video memory of a texture object but keep the object.
+void releaseTextureStorage(GLuint texture)
+
+This file requires thread_utilities.hpp, check_error.hpp and stb_image.h to be included first.
+stb_image.h is not part of this repository (see load_3d_obj.cc for where to get it).
+
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// The maximum number of mipmap levels handled by TextureLevels (enough for a 32768 x 32768 texture).
+#define MAX_TEXTURE_LEVELS 16
+
+// The mipmap levels of a DDS or KTX file.
+// The level pointers point into the file data, so the file data must stay alive until the upload is done.
+struct TextureLevels {
+	bool compressed;         // true if the levels are uploaded with glCompressedTexImage2D()
+	GLenum internalFormat;
+	GLenum format;           // only used for uncompressed levels
+	GLenum type;             // only used for uncompressed levels
+	unsigned int width;
+	unsigned int height;
+	unsigned int levelCount;
+	const unsigned char* levelData[MAX_TEXTURE_LEVELS];
+	unsigned int levelSize[MAX_TEXTURE_LEVELS];
+};
+
+//------------------------------------------------------------
+// Read a little-endian 32-bit integer. memcpy() is used because the data may not be aligned.
+unsigned int readUint32(const unsigned char* data) {
+	unsigned int value;
+	memcpy(&value, data, sizeof(unsigned int));
+	return value;
+}
+
+//------------------------------------------------------------
+// The size in bytes of one 4x4 block of a block-compressed format.
+unsigned int compressedBlockSize(GLenum internalFormat) {
+	switch (internalFormat) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return 8;
+	default:
+		return 16;
+	}
+}
+
+//------------------------------------------------------------
+// The size in bytes of a mipmap level of a block-compressed format.
+// It is computed in 64 bits, because the width and height of a file header may be anything.
+unsigned long long compressedLevelSize(GLenum internalFormat, unsigned int width, unsigned int height) {
+	unsigned long long blocksWide = (width / 4) + (width % 4 != 0);
+	unsigned long long blocksHigh = (height / 4) + (height % 4 != 0);
+	return blocksWide * blocksHigh * compressedBlockSize(internalFormat);
+}
+
+//------------------------------------------------------------
+// Parse a DDS file. Only block-compressed (BC1, BC2, BC3, BC5, BC7) 2D textures are supported.
+bool parseDDS(const unsigned char* data, unsigned int size, TextureLevels& levels) {
+	// 4 bytes of magic number followed by a 124-byte header.
+	if (size < 128 || memcmp(data, "DDS ", 4) != 0) {
+		return false;
+	}
+
+	unsigned int height = readUint32(data + 12);
+	unsigned int width = readUint32(data + 16);
+	unsigned int mipMapCount = readUint32(data + 28);
+	unsigned int fourCC = readUint32(data + 84);
+	unsigned int dataOffset = 128;
+
+	GLenum internalFormat = 0;
+	if (fourCC == 0x31545844) {              // "DXT1"
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	} else if (fourCC == 0x33545844) {       // "DXT3"
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+	} else if (fourCC == 0x35545844) {       // "DXT5"
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	} else if (fourCC == 0x32495441 || fourCC == 0x55354342) {  // "ATI2" or "BC5U"
+		internalFormat = GL_COMPRESSED_RG_RGTC2;
+	} else if (fourCC == 0x30315844) {       // "DX10", followed by a 20-byte extended header
+		if (size < 148) {
+			return false;
+		}
+		unsigned int dxgiFormat = readUint32(data + 128);
+		dataOffset = 148;
+		switch (dxgiFormat) {
+		case 71: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+		case 72: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;
+		case 74: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+		case 75: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; break;
+		case 77: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+		case 78: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;
+		case 83: internalFormat = GL_COMPRESSED_RG_RGTC2; break;
+		case 98: internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+		case 99: internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;
+		default: break;
+		}
+	}
+
+	if (internalFormat == 0) {
+		cout << "parseDDS(): unsupported DDS pixel format" << endl;
+		return false;
+	}
+
+	levels.compressed = true;
+	levels.internalFormat = internalFormat;
+	levels.format = 0;
+	levels.type = 0;
+	levels.width = width;
+	levels.height = height;
+	levels.levelCount = 0;
+
+	if (mipMapCount == 0) {
+		mipMapCount = 1;
+	}
+
+	// The levels are stored one after another, largest first.
+	// The offsets are checked in 64 bits, so that a damaged header cannot wrap them around.
+	unsigned long long offset = dataOffset;
+	for (unsigned int level = 0; level < mipMapCount && level < MAX_TEXTURE_LEVELS; level++) {
+		unsigned int levelWidth = max(1u, width >> level);
+		unsigned int levelHeight = max(1u, height >> level);
+		unsigned long long levelSize = compressedLevelSize(internalFormat, levelWidth, levelHeight);
+		if (offset + levelSize > size) {
+			break;
+		}
+		levels.levelData[level] = data + offset;
+		levels.levelSize[level] = (unsigned int) levelSize;
+		levels.levelCount++;
+		offset += levelSize;
+	}
+
+	return levels.levelCount > 0;
+}
+
+//------------------------------------------------------------
+// Parse a KTX (version 1) file. Only 2D textures without array elements or cube faces are supported.
+bool parseKTX(const unsigned char* data, unsigned int size, TextureLevels& levels) {
+	static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// 12 bytes of identifier followed by 13 32-bit fields.
+	if (size < 64 || memcmp(data, identifier, 12) != 0) {
+		return false;
+	}
+
+	if (readUint32(data + 12) != 0x04030201) {
+		cout << "parseKTX(): big-endian KTX files are not supported" << endl;
+		return false;
+	}
+
+	unsigned int glType = readUint32(data + 16);
+	unsigned int glFormat = readUint32(data + 24);
+	unsigned int glInternalFormat = readUint32(data + 28);
+	unsigned int width = readUint32(data + 36);
+	unsigned int height = readUint32(data + 40);
+	unsigned int depth = readUint32(data + 44);
+	unsigned int arrayElements = readUint32(data + 48);
+	unsigned int faces = readUint32(data + 52);
+	unsigned int mipLevels = readUint32(data + 56);
+	unsigned int keyValueBytes = readUint32(data + 60);
+
+	if (depth > 1 || arrayElements > 0 || faces != 1) {
+		cout << "parseKTX(): only 2D KTX textures are supported" << endl;
+		return false;
+	}
+
+	levels.compressed = (glType == 0);
+	levels.internalFormat = glInternalFormat;
+	levels.format = glFormat;
+	levels.type = glType;
+	levels.width = width;
+	levels.height = height;
+	levels.levelCount = 0;
+
+	if (mipLevels == 0) {
+		mipLevels = 1;
+	}
+
+	// Each level is stored as a 32-bit size followed by the data, padded to 4 bytes.
+	// The offsets are checked in 64 bits, so that a damaged header cannot wrap them around.
+	unsigned long long offset = 64ULL + keyValueBytes;
+	for (unsigned int level = 0; level < mipLevels && level < MAX_TEXTURE_LEVELS; level++) {
+		if (offset + 4 > size) {
+			break;
+		}
+		unsigned long long levelSize = readUint32(data + offset);
+		offset += 4;
+		if (offset + levelSize > size) {
+			break;
+		}
+		levels.levelData[level] = data + offset;
+		levels.levelSize[level] = (unsigned int) levelSize;
+		levels.levelCount++;
+		offset += (levelSize + 3) & ~3ULL;
+	}
+
+	return levels.levelCount > 0;
+}
+
+//------------------------------------------------------------
+// Parse a DDS or KTX file that is already in memory. The file type is detected from its magic number,
+// because the format hints in 3D files are not always reliable.
+bool parseCompressedTextureContainer(const unsigned char* data, unsigned int size, TextureLevels& levels) {
+	if (size >= 4 && memcmp(data, "DDS ", 4) == 0) {
+		return parseDDS(data, size, levels);
+	}
+	if (size >= 12 && data[0] == 0xAB && memcmp(data + 1, "KTX 11", 6) == 0) {
+		return parseKTX(data, size, levels);
+	}
+	return false;
+}
+
+//------------------------------------------------------------
+// Upload all the mipmap levels of a parsed container to the currently bound GL_TEXTURE_2D.
+// The data is passed to OpenGL straight from the container memory.
+void uploadTextureLevels(const TextureLevels& levels) {
+	for (unsigned int level = 0; level < levels.levelCount; level++) {
+		GLsizei levelWidth = max(1u, levels.width >> level);
+		GLsizei levelHeight = max(1u, levels.height >> level);
+
+		if (levels.compressed) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, levels.internalFormat, levelWidth, levelHeight, 0,
+				levels.levelSize[level], levels.levelData[level]);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, level, levels.internalFormat, levelWidth, levelHeight, 0,
+				levels.format, levels.type, levels.levelData[level]);
+		}
+	}
+
+	// Don't sample from levels that are not in the file.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.levelCount - 1);
+}
+
+//------------------------------------------------------------
+// Upload one embedded texture to a texture object. An aiTexture comes in one of three forms:
+//   mHeight > 0: pcData is an array of mWidth * mHeight BGRA8 texels. It is uploaded as is.
+//   mHeight == 0 and pcData is a DDS or KTX file: the compressed levels are uploaded as is.
+//   mHeight == 0 otherwise: pcData is an mWidth-byte image file (PNG, JPEG, ...) and is decoded by stb_image.
+// If the image file has already been decoded, pass the decoded pixels; they are freed here.
+void uploadEmbeddedTexture(const aiTexture* embeddedTexture, GLuint texture,
+	unsigned char* pixels = NULL, int width = 0, int height = 0) {
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	const unsigned char* fileData = (const unsigned char*) embeddedTexture->pcData;
+	TextureLevels containerLevels;
+
+	if (embeddedTexture->mHeight != 0) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, embeddedTexture->mWidth, embeddedTexture->mHeight, 0,
+			GL_BGRA, GL_UNSIGNED_BYTE, embeddedTexture->pcData);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	} else if (parseCompressedTextureContainer(fileData, embeddedTexture->mWidth, containerLevels)) {
+		uploadTextureLevels(containerLevels);
+	} else {
+		if (!pixels) {
+			int channels = 0;
+			stbi_set_flip_vertically_on_load(1);
+			pixels = stbi_load_from_memory(fileData, embeddedTexture->mWidth, &width, &height, &channels, 4);
+		}
+
+		if (pixels) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			stbi_image_free(pixels);
+		} else {
+			cout << "uploadEmbeddedTexture(): unable to decode embedded texture (format hint "
+				<< embeddedTexture->achFormatHint << ")" << endl;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//------------------------------------------------------------
+// Decode (if necessary) and upload all the embedded textures of an aiScene object.
+// The image files are decoded in parallel across textures. OpenGL calls are made on the calling thread only.
+GLuint* loadEmbeddedTextures(const aiScene* scene) {
+	if (!scene || !scene->HasTextures()) {
+		return NULL;
+	}
+
+	unsigned int textureCount = scene->mNumTextures;
+
+	// The decoded images. pixels stays NULL for textures that don't need decoding.
+	vector<unsigned char*> pixels(textureCount, (unsigned char*) NULL);
+	vector<int> widths(textureCount, 0);
+	vector<int> heights(textureCount, 0);
+
+	// Image files store the top row first, while OpenGL expects the bottom row first.
+	stbi_set_flip_vertically_on_load(1);
+
+	parallelFor(textureCount, [&](unsigned int i) {
+		const aiTexture* currentTexture = scene->mTextures[i];
+		if (currentTexture->mHeight != 0) {
+			return;
+		}
+
+		const unsigned char* fileData = (const unsigned char*) currentTexture->pcData;
+		TextureLevels containerLevels;
+		if (parseCompressedTextureContainer(fileData, currentTexture->mWidth, containerLevels)) {
+			return;
+		}
+
+		int channels = 0;
+		pixels[i] = stbi_load_from_memory(fileData, currentTexture->mWidth, &widths[i], &heights[i], &channels, 4);
+	});
+
+	GLuint* textureArray = (GLuint*) malloc(sizeof(GLuint) * textureCount);
+	glGenTextures(textureCount, textureArray);
+
+	for (unsigned int i = 0; i < textureCount; i++) {
+		uploadEmbeddedTexture(scene->mTextures[i], textureArray[i], pixels[i], widths[i], heights[i]);
+	}
+
+	checkOpenGLError("loadEmbeddedTextures()");
+
+	return textureArray;
+}
+
+//------------------------------------------------------------
+// Release the video memory of a texture object but keep the object, so that it can be uploaded again
+// under the same name. Every level is redefined with a size of 0.
+void releaseTextureStorage(GLuint texture) {
+	glBindTexture(GL_TEXTURE_2D, texture);
+	for (GLint level = 0; level < MAX_TEXTURE_LEVELS; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//------------------------------------------------------------
+// Find the index of the embedded texture referenced by a texture path.
+// Embedded textures are referenced as "*0", "*1", etc. Some importers reference them by
+// their original file name instead. Returns -1 if the path does not refer to an embedded texture.
+int findEmbeddedTexture(const aiScene* scene, const aiString& texturePath) {
+	if (texturePath.data[0] == '*') {
+		int index = atoi(texturePath.data + 1);
+		if (index >= 0 && (unsigned int) index < scene->mNumTextures) {
+			return index;
+		}
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < scene->mNumTextures; i++) {
+		if (scene->mTextures[i]->mFilename.length > 0 && scene->mTextures[i]->mFilename == texturePath) {
+			return i;
+		}
+	}
+	return -1;
+}
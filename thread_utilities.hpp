@@ -0,0 +1,65 @@
+/* This is a utility program that helps OpenGL programmers spread CPU work across threads.
+The following functions are provided.
+
+// Number of worker threads used by the functions below.
+unsigned int getWorkerThreadCount()
+
+// Call func(i) for every i in [0, count), using all the hardware threads (or threadCount threads if it is not 0).
+// The calling thread also does work, and the function returns when every call is finished.
+void parallelFor(unsigned int count, const function<void(unsigned int)>& func, unsigned int threadCount = 0)
+
+*/
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//------------------------------------------------------------
+// Number of worker threads used by parallelFor().
+// hardware_concurrency() may return 0 if the number of cores is unknown.
+unsigned int getWorkerThreadCount() {
+	unsigned int threadCount = thread::hardware_concurrency();
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+	return threadCount;
+}
+
+//------------------------------------------------------------
+// Call func(i) for every i in [0, count).
+// The items are handed out one at a time through an atomic counter, so a few slow items
+// (e.g. one very large texture) do not leave the other threads idle.
+// threadCount limits the number of threads, e.g. to measure how work scales with the number of cores.
+void parallelFor(unsigned int count, const function<void(unsigned int)>& func, unsigned int threadCount = 0) {
+	if (count == 0) {
+		return;
+	}
+
+	if (threadCount == 0) {
+		threadCount = getWorkerThreadCount();
+	}
+	if (threadCount > count) {
+		threadCount = count;
+	}
+
+	atomic<unsigned int> nextItem(0);
+	auto worker = [&]() {
+		for (unsigned int i = nextItem++; i < count; i = nextItem++) {
+			func(i);
+		}
+	};
+
+	// The calling thread is one of the workers.
+	vector<thread> threads;
+	for (unsigned int t = 1; t < threadCount; t++) {
+		threads.push_back(thread(worker));
+	}
+	worker();
+
+	for (unsigned int t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
@@ -0,0 +1,449 @@
+/* This is a utility program that helps OpenGL programmers manage ranges inside large buffer objects.
+It is a two-level segregated fit (TLSF) allocator: free ranges are kept in lists indexed by a coarse
+(power of two) and a fine (linear subdivision) size class, and two bitmaps tell which lists are not empty.
+Allocating and freeing a range take constant time, and adjacent free ranges are merged immediately.
+The allocator only does the bookkeeping. Sizes and offsets are in units (e.g. vertices or indices);
+the caller decides what a unit is and copies the data.
+The following functions are provided.
+
+// Start managing the range [0, capacity).
+void initTlsfAllocator(TlsfAllocator& allocator, unsigned int capacity)
+
+// Allocate size units. Returns the handle of the allocated block, or TLSF_NO_BLOCK if there is no room.
+unsigned int tlsfAllocate(TlsfAllocator& allocator, unsigned int size)
+
+// Free a block returned by tlsfAllocate().
+void tlsfFree(TlsfAllocator& allocator, unsigned int handle)
+
+// The offset of an allocated block. It may change when the allocator is compacted.
+unsigned int getTlsfOffset(const TlsfAllocator& allocator, unsigned int handle)
+
+// Add the range [capacity, newCapacity) to the allocator.
+void extendTlsfAllocator(TlsfAllocator& allocator, unsigned int newCapacity)
+
+// Move allocated blocks towards the start of the range, at most maxUnits units per call.
+// moveBlock(from, to, size) must copy the data; the handles of the moved blocks stay valid.
+// Returns the number of units moved (0 when there is nothing left to compact).
+unsigned int compactTlsfAllocator(TlsfAllocator& allocator, unsigned int maxUnits,
+	const function<void(unsigned int, unsigned int, unsigned int)>& moveBlock)
+
+// Free space, largest free block and fragmentation (0 = all free space is in one block).
+TlsfStatistics getTlsfStatistics(const TlsfAllocator& allocator)
+
+*/
+
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+#define TLSF_NO_BLOCK 0xFFFFFFFFu
+
+// Each power of two size class is split into 2^TLSF_SL_LOG2 linear size classes.
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT 32
+
+// A block is a range of units, either free or allocated.
+// All the blocks form a doubly linked list in address order; the free blocks of each size class
+// also form a doubly linked list.
+struct TlsfBlock {
+	unsigned int offset;
+	unsigned int size;
+	bool free;
+	bool used;                       // false if this entry of the block table is not in use
+	unsigned int previousPhysical;
+	unsigned int nextPhysical;
+	unsigned int previousFree;
+	unsigned int nextFree;
+};
+
+struct TlsfAllocator {
+	vector<TlsfBlock> blocks;
+	vector<unsigned int> unusedBlocks;   // entries of blocks[] that can be reused
+	unsigned int firstBlock;
+	unsigned int lastBlock;
+	unsigned int capacity;
+
+	unsigned int firstLevelBitmap;
+	unsigned int secondLevelBitmaps[TLSF_FL_COUNT];
+	unsigned int freeLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+	unsigned int allocatedUnits;
+	unsigned int allocationCount;
+};
+
+struct TlsfStatistics {
+	unsigned int capacity;
+	unsigned int allocatedUnits;
+	unsigned int allocationCount;
+	unsigned int freeUnits;
+	unsigned int freeBlockCount;
+	unsigned int largestFreeBlock;
+	float fragmentation;
+};
+
+//------------------------------------------------------------
+// Index of the lowest set bit. The value must not be 0.
+unsigned int findLowestBit(unsigned int value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+//------------------------------------------------------------
+// Index of the highest set bit. The value must not be 0.
+unsigned int findHighestBit(unsigned int value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
+}
+
+//------------------------------------------------------------
+// The size class of a block size.
+void mapTlsfSize(unsigned int size, unsigned int& firstLevel, unsigned int& secondLevel) {
+	if (size < TLSF_SL_COUNT) {
+		firstLevel = 0;
+		secondLevel = size;
+	} else {
+		unsigned int highestBit = findHighestBit(size);
+		firstLevel = highestBit - TLSF_SL_LOG2 + 1;
+		secondLevel = (size >> (highestBit - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+	}
+}
+
+//------------------------------------------------------------
+// Get an entry of the block table.
+unsigned int newTlsfBlock(TlsfAllocator& allocator) {
+	unsigned int handle;
+	if (!allocator.unusedBlocks.empty()) {
+		handle = allocator.unusedBlocks.back();
+		allocator.unusedBlocks.pop_back();
+	} else {
+		handle = (unsigned int) allocator.blocks.size();
+		allocator.blocks.push_back(TlsfBlock());
+	}
+
+	TlsfBlock& block = allocator.blocks[handle];
+	block.offset = block.size = 0;
+	block.free = false;
+	block.used = true;
+	block.previousPhysical = block.nextPhysical = TLSF_NO_BLOCK;
+	block.previousFree = block.nextFree = TLSF_NO_BLOCK;
+	return handle;
+}
+
+//------------------------------------------------------------
+// Return an entry to the block table.
+void deleteTlsfBlock(TlsfAllocator& allocator, unsigned int handle) {
+	allocator.blocks[handle].used = false;
+	allocator.unusedBlocks.push_back(handle);
+}
+
+//------------------------------------------------------------
+// Put a block in the free list of its size class.
+void insertFreeTlsfBlock(TlsfAllocator& allocator, unsigned int handle) {
+	TlsfBlock& block = allocator.blocks[handle];
+	unsigned int firstLevel, secondLevel;
+	mapTlsfSize(block.size, firstLevel, secondLevel);
+
+	unsigned int head = allocator.freeLists[firstLevel][secondLevel];
+	block.free = true;
+	block.previousFree = TLSF_NO_BLOCK;
+	block.nextFree = head;
+	if (head != TLSF_NO_BLOCK) {
+		allocator.blocks[head].previousFree = handle;
+	}
+	allocator.freeLists[firstLevel][secondLevel] = handle;
+
+	allocator.firstLevelBitmap |= 1u << firstLevel;
+	allocator.secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+//------------------------------------------------------------
+// Take a block out of the free list of its size class.
+void removeFreeTlsfBlock(TlsfAllocator& allocator, unsigned int handle) {
+	TlsfBlock& block = allocator.blocks[handle];
+	unsigned int firstLevel, secondLevel;
+	mapTlsfSize(block.size, firstLevel, secondLevel);
+
+	if (block.previousFree != TLSF_NO_BLOCK) {
+		allocator.blocks[block.previousFree].nextFree = block.nextFree;
+	} else {
+		allocator.freeLists[firstLevel][secondLevel] = block.nextFree;
+		if (block.nextFree == TLSF_NO_BLOCK) {
+			allocator.secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+			if (allocator.secondLevelBitmaps[firstLevel] == 0) {
+				allocator.firstLevelBitmap &= ~(1u << firstLevel);
+			}
+		}
+	}
+	if (block.nextFree != TLSF_NO_BLOCK) {
+		allocator.blocks[block.nextFree].previousFree = block.previousFree;
+	}
+
+	block.free = false;
+	block.previousFree = block.nextFree = TLSF_NO_BLOCK;
+}
+
+//------------------------------------------------------------
+// Merge a free block with the free block right after it, if there is one.
+// Neither block may be in a free list.
+void mergeWithNextTlsfBlock(TlsfAllocator& allocator, unsigned int handle) {
+	TlsfBlock& block = allocator.blocks[handle];
+	unsigned int nextHandle = block.nextPhysical;
+	TlsfBlock& next = allocator.blocks[nextHandle];
+
+	block.size += next.size;
+	block.nextPhysical = next.nextPhysical;
+	if (next.nextPhysical != TLSF_NO_BLOCK) {
+		allocator.blocks[next.nextPhysical].previousPhysical = handle;
+	} else {
+		allocator.lastBlock = handle;
+	}
+	deleteTlsfBlock(allocator, nextHandle);
+}
+
+//------------------------------------------------------------
+// Add the range [capacity, newCapacity) to the allocator, e.g. after the buffer object has grown.
+void extendTlsfAllocator(TlsfAllocator& allocator, unsigned int newCapacity) {
+	if (newCapacity <= allocator.capacity) {
+		return;
+	}
+
+	unsigned int handle = newTlsfBlock(allocator);
+	TlsfBlock& block = allocator.blocks[handle];
+	block.offset = allocator.capacity;
+	block.size = newCapacity - allocator.capacity;
+	block.previousPhysical = allocator.lastBlock;
+	if (allocator.lastBlock != TLSF_NO_BLOCK) {
+		allocator.blocks[allocator.lastBlock].nextPhysical = handle;
+	} else {
+		allocator.firstBlock = handle;
+	}
+	allocator.lastBlock = handle;
+	allocator.capacity = newCapacity;
+
+	// Merge with the free block at the old end, if any.
+	unsigned int previous = allocator.blocks[handle].previousPhysical;
+	if (previous != TLSF_NO_BLOCK && allocator.blocks[previous].free) {
+		removeFreeTlsfBlock(allocator, previous);
+		mergeWithNextTlsfBlock(allocator, previous);
+		handle = previous;
+	}
+	insertFreeTlsfBlock(allocator, handle);
+}
+
+//------------------------------------------------------------
+// Start managing the range [0, capacity).
+void initTlsfAllocator(TlsfAllocator& allocator, unsigned int capacity) {
+	allocator.blocks.clear();
+	allocator.unusedBlocks.clear();
+	allocator.firstLevelBitmap = 0;
+	for (unsigned int i = 0; i < TLSF_FL_COUNT; i++) {
+		allocator.secondLevelBitmaps[i] = 0;
+		for (unsigned int j = 0; j < TLSF_SL_COUNT; j++) {
+			allocator.freeLists[i][j] = TLSF_NO_BLOCK;
+		}
+	}
+	allocator.capacity = 0;
+	allocator.allocatedUnits = 0;
+	allocator.allocationCount = 0;
+	allocator.firstBlock = allocator.lastBlock = TLSF_NO_BLOCK;
+
+	extendTlsfAllocator(allocator, capacity);
+}
+
+//------------------------------------------------------------
+// Allocate size units. Returns TLSF_NO_BLOCK if there is no room (or if size is 0).
+unsigned int tlsfAllocate(TlsfAllocator& allocator, unsigned int size) {
+	if (size == 0) {
+		return TLSF_NO_BLOCK;
+	}
+
+	// Round the size up to the next size class, so that any block in the chosen list is large enough.
+	unsigned int searchSize = size;
+	if (size >= TLSF_SL_COUNT) {
+		unsigned int round = (1u << (findHighestBit(size) - TLSF_SL_LOG2)) - 1;
+		if (size > 0xFFFFFFFFu - round) {
+			return TLSF_NO_BLOCK;
+		}
+		searchSize += round;
+	}
+	unsigned int firstLevel, secondLevel;
+	mapTlsfSize(searchSize, firstLevel, secondLevel);
+
+	// Find the smallest non-empty size class that is at least as large.
+	unsigned int secondLevelMap = allocator.secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (secondLevelMap == 0) {
+		unsigned int firstLevelMap = firstLevel + 1 < TLSF_FL_COUNT ? allocator.firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+		if (firstLevelMap == 0) {
+			return TLSF_NO_BLOCK;
+		}
+		firstLevel = findLowestBit(firstLevelMap);
+		secondLevelMap = allocator.secondLevelBitmaps[firstLevel];
+	}
+	secondLevel = findLowestBit(secondLevelMap);
+
+	unsigned int handle = allocator.freeLists[firstLevel][secondLevel];
+	removeFreeTlsfBlock(allocator, handle);
+
+	// Split off the rest of the block.
+	if (allocator.blocks[handle].size > size) {
+		unsigned int restHandle = newTlsfBlock(allocator);
+		TlsfBlock& block = allocator.blocks[handle];
+		TlsfBlock& rest = allocator.blocks[restHandle];
+		rest.offset = block.offset + size;
+		rest.size = block.size - size;
+		rest.previousPhysical = handle;
+		rest.nextPhysical = block.nextPhysical;
+		if (block.nextPhysical != TLSF_NO_BLOCK) {
+			allocator.blocks[block.nextPhysical].previousPhysical = restHandle;
+		} else {
+			allocator.lastBlock = restHandle;
+		}
+		block.nextPhysical = restHandle;
+		block.size = size;
+		insertFreeTlsfBlock(allocator, restHandle);
+	}
+
+	allocator.allocatedUnits += size;
+	allocator.allocationCount++;
+	return handle;
+}
+
+//------------------------------------------------------------
+// Free a block returned by tlsfAllocate(), and merge it with its free neighbors.
+void tlsfFree(TlsfAllocator& allocator, unsigned int handle) {
+	if (handle == TLSF_NO_BLOCK || handle >= allocator.blocks.size() ||
+		!allocator.blocks[handle].used || allocator.blocks[handle].free) {
+		cout << "tlsfFree(): invalid block " << handle << endl;
+		return;
+	}
+
+	allocator.allocatedUnits -= allocator.blocks[handle].size;
+	allocator.allocationCount--;
+
+	unsigned int next = allocator.blocks[handle].nextPhysical;
+	if (next != TLSF_NO_BLOCK && allocator.blocks[next].free) {
+		removeFreeTlsfBlock(allocator, next);
+		mergeWithNextTlsfBlock(allocator, handle);
+	}
+
+	unsigned int previous = allocator.blocks[handle].previousPhysical;
+	if (previous != TLSF_NO_BLOCK && allocator.blocks[previous].free) {
+		removeFreeTlsfBlock(allocator, previous);
+		mergeWithNextTlsfBlock(allocator, previous);
+		handle = previous;
+	}
+
+	insertFreeTlsfBlock(allocator, handle);
+}
+
+//------------------------------------------------------------
+// The offset of an allocated block.
+unsigned int getTlsfOffset(const TlsfAllocator& allocator, unsigned int handle) {
+	return allocator.blocks[handle].offset;
+}
+
+//------------------------------------------------------------
+// Move allocated blocks towards the start of the range, so that the free space ends up in one block
+// at the end. Each step swaps the first free block with the allocated block right after it.
+// The handle of a moved block stays the same; only its offset changes.
+unsigned int compactTlsfAllocator(TlsfAllocator& allocator, unsigned int maxUnits,
+	const function<void(unsigned int, unsigned int, unsigned int)>& moveBlock) {
+	unsigned int movedUnits = 0;
+
+	unsigned int freeHandle = allocator.firstBlock;
+	while (freeHandle != TLSF_NO_BLOCK && movedUnits < maxUnits) {
+		if (!allocator.blocks[freeHandle].free) {
+			freeHandle = allocator.blocks[freeHandle].nextPhysical;
+			continue;
+		}
+
+		unsigned int usedHandle = allocator.blocks[freeHandle].nextPhysical;
+		if (usedHandle == TLSF_NO_BLOCK) {
+			// The only free block is at the end. Nothing left to compact.
+			break;
+		}
+
+		TlsfBlock& freeBlock = allocator.blocks[freeHandle];
+		TlsfBlock& usedBlock = allocator.blocks[usedHandle];
+		moveBlock(usedBlock.offset, freeBlock.offset, usedBlock.size);
+		movedUnits += usedBlock.size;
+
+		// Swap the two blocks in the address order.
+		removeFreeTlsfBlock(allocator, freeHandle);
+		usedBlock.offset = freeBlock.offset;
+		freeBlock.offset = usedBlock.offset + usedBlock.size;
+
+		unsigned int before = freeBlock.previousPhysical;
+		unsigned int after = usedBlock.nextPhysical;
+		usedBlock.previousPhysical = before;
+		usedBlock.nextPhysical = freeHandle;
+		freeBlock.previousPhysical = usedHandle;
+		freeBlock.nextPhysical = after;
+		if (before != TLSF_NO_BLOCK) {
+			allocator.blocks[before].nextPhysical = usedHandle;
+		} else {
+			allocator.firstBlock = usedHandle;
+		}
+		if (after != TLSF_NO_BLOCK) {
+			allocator.blocks[after].previousPhysical = freeHandle;
+		} else {
+			allocator.lastBlock = freeHandle;
+		}
+
+		// The free block may now touch the next free block.
+		if (after != TLSF_NO_BLOCK && allocator.blocks[after].free) {
+			removeFreeTlsfBlock(allocator, after);
+			mergeWithNextTlsfBlock(allocator, freeHandle);
+		}
+		allocator.blocks[freeHandle].free = true;
+		insertFreeTlsfBlock(allocator, freeHandle);
+	}
+
+	return movedUnits;
+}
+
+//------------------------------------------------------------
+// Free space, largest free block and fragmentation.
+// The fragmentation is 1 - largest free block / free space: 0 means all the free space can be used by
+// a single allocation, values close to 1 mean the free space is scattered in small pieces.
+TlsfStatistics getTlsfStatistics(const TlsfAllocator& allocator) {
+	TlsfStatistics statistics;
+	statistics.capacity = allocator.capacity;
+	statistics.allocatedUnits = allocator.allocatedUnits;
+	statistics.allocationCount = allocator.allocationCount;
+	statistics.freeUnits = 0;
+	statistics.freeBlockCount = 0;
+	statistics.largestFreeBlock = 0;
+
+	for (unsigned int handle = allocator.firstBlock; handle != TLSF_NO_BLOCK; handle = allocator.blocks[handle].nextPhysical) {
+		const TlsfBlock& block = allocator.blocks[handle];
+		if (block.free) {
+			statistics.freeUnits += block.size;
+			statistics.freeBlockCount++;
+			if (block.size > statistics.largestFreeBlock) {
+				statistics.largestFreeBlock = block.size;
+			}
+		}
+	}
+
+	statistics.fragmentation = statistics.freeUnits > 0 ?
+		1.0f - (float) statistics.largestFreeBlock / statistics.freeUnits : 0.0f;
+	return statistics;
+}
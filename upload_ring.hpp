@@ -0,0 +1,317 @@
+/* This is a utility program that helps OpenGL programmers upload data to buffer objects without stalling.
+An upload ring is a staging buffer object that stays mapped for the lifetime of the program
+(glBufferStorage() with GL_MAP_PERSISTENT_BIT and GL_MAP_COHERENT_BIT, OpenGL 4.4 or ARB_buffer_storage).
+Any thread can write into a reserved region of the mapped memory; the OpenGL thread then copies the region
+into its destination buffer object on the GPU (glCopyBufferSubData()) and puts a fence after the copies.
+A region is only reused after the fence that covers it has been signaled.
+On older contexts the staging memory is ordinary process memory, and the regions are uploaded with glBufferSubData().
+The following functions are provided.
+
+// Create the staging buffer object and map it. size is rounded up to a multiple of UPLOAD_RING_ALIGNMENT.
+void initUploadRing(UploadRing& ring, unsigned long long size)
+
+// Reserve size bytes in the ring (OpenGL thread only). Waits for the GPU if the ring is full of copies
+// that are still in flight. Returns false if the region does not fit in the ring at all, or if the ring
+// is full of regions that have not been fenced yet.
+bool reserveUploadRegion(UploadRing& ring, unsigned long long size, UploadRegion& region)
+
+// Give back the regions reserved since ring.reservedPosition was position (OpenGL thread only), e.g. when
+// the other regions a mesh needs do not fit. The regions must not have been fenced yet.
+void cancelUploadRegions(UploadRing& ring, unsigned long long position)
+
+// Copy the first size bytes of a region into a destination buffer object (OpenGL thread only).
+// The region must have been written.
+void copyUploadRegion(UploadRing& ring, const UploadRegion& region, GLuint destinationBuffer, GLintptr destinationOffset,
+	unsigned long long size)
+
+// Put a fence after the copies of all the regions reserved so far (OpenGL thread only).
+void fenceUploadRegions(UploadRing& ring)
+
+// Wait for all copies and release the staging buffer object.
+void deleteUploadRing(UploadRing& ring)
+
+// Compare glBufferSubData() with the upload ring by uploading totalBytes in chunks. Prints the bandwidth of both.
+void benchmarkUploadRing(UploadRing& ring, unsigned long long totalBytes, unsigned long long chunkSize)
+
+// Print the number of bytes uploaded and how often the ring had to wait for the GPU.
+void printUploadRingStatistics(const UploadRing& ring)
+
+This file requires file_utilities.hpp to be included first.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Regions start at multiples of this many bytes, which is enough for any vertex or index type.
+#define UPLOAD_RING_ALIGNMENT 16
+
+// A reserved region of the ring. Write size bytes at pointer, then copy the region with copyUploadRegion().
+struct UploadRegion {
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned char* pointer;
+};
+
+// A fence and the ring position up to which it covers the reserved regions.
+struct UploadFence {
+	GLsync fence;
+	unsigned long long position;
+};
+
+struct UploadRing {
+	GLuint buffer;
+	unsigned char* memory;         // the mapped staging buffer, or process memory on older contexts
+	unsigned long long size;
+	bool persistent;               // true if memory is a persistent mapping of buffer
+
+	// Positions increase forever; the offset in the ring is position % size.
+	// [releasedPosition, fencedPosition) are covered by fences that may not have been signaled yet,
+	// [fencedPosition, reservedPosition) have been reserved since the last fence.
+	unsigned long long releasedPosition;
+	unsigned long long fencedPosition;
+	unsigned long long reservedPosition;
+	deque<UploadFence> fences;
+
+	// Statistics
+	unsigned long long uploadedBytes;
+	unsigned int regionCount;
+	unsigned int stallCount;
+	double stallMilliseconds;
+};
+
+//------------------------------------------------------------
+// Create the staging buffer object and map it.
+void initUploadRing(UploadRing& ring, unsigned long long size) {
+	ring.size = (size + UPLOAD_RING_ALIGNMENT - 1) / UPLOAD_RING_ALIGNMENT * UPLOAD_RING_ALIGNMENT;
+	ring.buffer = 0;
+	ring.memory = NULL;
+	ring.persistent = false;
+	ring.releasedPosition = ring.fencedPosition = ring.reservedPosition = 0;
+	ring.fences.clear();
+	ring.uploadedBytes = 0;
+	ring.regionCount = 0;
+	ring.stallCount = 0;
+	ring.stallMilliseconds = 0.0;
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &ring.buffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+		glBufferStorage(GL_COPY_READ_BUFFER, ring.size, NULL, flags);
+		ring.memory = (unsigned char*) glMapBufferRange(GL_COPY_READ_BUFFER, 0, ring.size, flags);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		if (ring.memory) {
+			ring.persistent = true;
+		} else {
+			cout << "initUploadRing(): unable to map the staging buffer. Falling back to glBufferSubData()." << endl;
+			glDeleteBuffers(1, &ring.buffer);
+			ring.buffer = 0;
+		}
+	}
+
+	if (!ring.persistent) {
+		ring.memory = (unsigned char*) malloc(ring.size);
+	}
+
+	checkOpenGLError("initUploadRing()");
+}
+
+//------------------------------------------------------------
+// Wait until the oldest fence is signaled and release the regions it covers.
+void waitForOldestUploadFence(UploadRing& ring) {
+	UploadFence oldest = ring.fences.front();
+	ring.fences.pop_front();
+
+	// Only count it as a stall if the GPU has not finished yet.
+	GLenum status = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+		while (status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		ring.stallCount++;
+		ring.stallMilliseconds += elapsedMilliseconds(startTime);
+	}
+	if (status == GL_WAIT_FAILED) {
+		cout << "waitForOldestUploadFence(): glClientWaitSync() failed" << endl;
+	}
+
+	glDeleteSync(oldest.fence);
+	ring.releasedPosition = oldest.position;
+}
+
+//------------------------------------------------------------
+// Reserve size bytes in the ring.
+bool reserveUploadRegion(UploadRing& ring, unsigned long long size, UploadRegion& region) {
+	size = (size + UPLOAD_RING_ALIGNMENT - 1) / UPLOAD_RING_ALIGNMENT * UPLOAD_RING_ALIGNMENT;
+	if (size == 0 || size > ring.size) {
+		return false;
+	}
+
+	// A region never wraps around the end of the ring. Skip the rest of the ring instead.
+	unsigned long long position = ring.reservedPosition;
+	unsigned long long offset = position % ring.size;
+	if (offset + size > ring.size) {
+		position += ring.size - offset;
+		offset = 0;
+	}
+
+	// Wait for the copies that still read the space we need.
+	while (position + size - ring.releasedPosition > ring.size) {
+		if (ring.fences.empty()) {
+			// The space is taken by regions that have not been copied and fenced yet.
+			return false;
+		}
+		waitForOldestUploadFence(ring);
+	}
+
+	ring.reservedPosition = position + size;
+	region.offset = offset;
+	region.size = size;
+	region.pointer = ring.memory + offset;
+	return true;
+}
+
+//------------------------------------------------------------
+// Give back the regions reserved since position. The regions after fencedPosition are only counted in
+// reservedPosition, so moving it back is enough.
+void cancelUploadRegions(UploadRing& ring, unsigned long long position) {
+	if (position >= ring.fencedPosition && position <= ring.reservedPosition) {
+		ring.reservedPosition = position;
+	}
+}
+
+//------------------------------------------------------------
+// Copy the first size bytes of a region into a destination buffer object. The copy happens on the GPU,
+// in order with the draw calls, so the destination can be drawn right away.
+// Regions are rounded up to UPLOAD_RING_ALIGNMENT, so pass the size of the data, not region.size.
+void copyUploadRegion(UploadRing& ring, const UploadRegion& region, GLuint destinationBuffer, GLintptr destinationOffset,
+	unsigned long long size) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destinationBuffer);
+	if (ring.persistent) {
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, region.offset, destinationOffset, size);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	} else {
+		glBufferSubData(GL_COPY_WRITE_BUFFER, destinationOffset, size, region.pointer);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	ring.uploadedBytes += size;
+	ring.regionCount++;
+}
+
+//------------------------------------------------------------
+// Put a fence after the copies of all the regions reserved so far.
+void fenceUploadRegions(UploadRing& ring) {
+	if (ring.reservedPosition == ring.fencedPosition) {
+		return;
+	}
+
+	if (ring.persistent) {
+		UploadFence fence;
+		fence.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fence.position = ring.reservedPosition;
+		ring.fences.push_back(fence);
+	} else {
+		// glBufferSubData() has already copied the data.
+		ring.releasedPosition = ring.reservedPosition;
+	}
+	ring.fencedPosition = ring.reservedPosition;
+}
+
+//------------------------------------------------------------
+// Wait for all copies and release the staging buffer object.
+void deleteUploadRing(UploadRing& ring) {
+	while (!ring.fences.empty()) {
+		waitForOldestUploadFence(ring);
+	}
+
+	if (ring.persistent) {
+		glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &ring.buffer);
+	} else {
+		free(ring.memory);
+	}
+	ring.buffer = 0;
+	ring.memory = NULL;
+}
+
+//------------------------------------------------------------
+// Compare glBufferSubData() with the upload ring.
+// Both methods upload the same data in chunks into a destination buffer object; glFinish() is included
+// in the time, so the numbers are the bandwidth to video memory rather than the speed of queueing commands.
+void benchmarkUploadRing(UploadRing& ring, unsigned long long totalBytes, unsigned long long chunkSize) {
+	if (chunkSize > ring.size) {
+		chunkSize = ring.size;
+	}
+
+	vector<unsigned char> source(chunkSize);
+	for (size_t i = 0; i < source.size(); i++) {
+		source[i] = (unsigned char) (i * 2654435761u >> 24);
+	}
+
+	GLuint destination;
+	glGenBuffers(1, &destination);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	glBufferData(GL_COPY_WRITE_BUFFER, totalBytes, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glFinish();
+
+	// glBufferSubData() in every chunk.
+	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	for (unsigned long long offset = 0; offset < totalBytes; offset += chunkSize) {
+		unsigned long long size = totalBytes - offset < chunkSize ? totalBytes - offset : chunkSize;
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, &source[0]);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glFinish();
+	double subDataMilliseconds = elapsedMilliseconds(startTime);
+
+	// Write every chunk into the ring and copy it on the GPU.
+	startTime = chrono::high_resolution_clock::now();
+	for (unsigned long long offset = 0; offset < totalBytes; offset += chunkSize) {
+		unsigned long long size = totalBytes - offset < chunkSize ? totalBytes - offset : chunkSize;
+		UploadRegion region;
+		if (!reserveUploadRegion(ring, size, region)) {
+			fenceUploadRegions(ring);
+			if (!reserveUploadRegion(ring, size, region)) {
+				cout << "benchmarkUploadRing(): unable to reserve " << size << " bytes" << endl;
+				break;
+			}
+		}
+		memcpy(region.pointer, &source[0], size);
+		copyUploadRegion(ring, region, destination, offset, size);
+		fenceUploadRegions(ring);
+	}
+	glFinish();
+	double ringMilliseconds = elapsedMilliseconds(startTime);
+
+	glDeleteBuffers(1, &destination);
+
+	double megabytes = totalBytes / (1024.0 * 1024.0);
+	cout << "---------- Upload bandwidth (" << megabytes << " MB in " << chunkSize / 1024 << " KB chunks) ----------" << endl;
+	cout << "glBufferSubData(): " << subDataMilliseconds << " ms, " << megabytes * 1000.0 / subDataMilliseconds << " MB/s" << endl;
+	cout << "Upload ring (" << (ring.persistent ? "persistent mapping" : "glBufferSubData() fallback") << "): "
+		<< ringMilliseconds << " ms, " << megabytes * 1000.0 / ringMilliseconds << " MB/s" << endl;
+}
+
+//------------------------------------------------------------
+// Print the number of bytes uploaded and how often the ring had to wait for the GPU.
+void printUploadRingStatistics(const UploadRing& ring) {
+	cout << "---------- Upload ring ----------" << endl;
+	cout << "Mode: " << (ring.persistent ? "persistent mapping" : "glBufferSubData() fallback") << ", " << ring.size << " bytes" << endl;
+	cout << "Uploaded: " << ring.uploadedBytes << " bytes in " << ring.regionCount << " regions" << endl;
+	cout << "Waited for the GPU: " << ring.stallCount << " times, " << ring.stallMilliseconds << " ms" << endl;
+}
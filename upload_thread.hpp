@@ -0,0 +1,339 @@
+/* This is a utility program that helps OpenGL programmers create buffer objects and textures on a background thread.
+The upload thread owns a second OpenGL context that shares its objects with the rendering context. It runs
+upload jobs (e.g. glBufferSubData() or glTexImage2D() calls) with that context current, puts a fence after
+each job, and hands the job id and the fence back to the rendering thread through a lock-free queue.
+The rendering thread never waits for the upload thread: once per frame it takes the finished jobs off the
+queue, and the GPU (not the CPU) waits for their fences before it draws with the new objects.
+The following functions are provided.
+
+// Create the shared context (the rendering context must be current) and start the upload thread.
+// Returns false if the shared context cannot be created or made current on the upload thread; then nothing is
+// left running.
+bool startUploadThread(UploadThread& uploadThread)
+
+// Queue a job. It runs on the upload thread with the shared context current. id is handed back when it is done.
+void queueUploadJob(UploadThread& uploadThread, unsigned int id, const function<void()>& job)
+
+// Take the next finished job off the queue (rendering thread only). Returns false if there is none.
+// Commands issued afterwards on the rendering context see the objects the job created or changed.
+bool pollFinishedUpload(UploadThread& uploadThread, unsigned int& id)
+
+// True from the time a job is queued until it is taken off the finished queue.
+bool isUploadThreadBusy(const UploadThread& uploadThread)
+
+// Wait until every queued job has run (rendering thread only). The finished jobs still have to be polled.
+void waitForUploadThread(UploadThread& uploadThread)
+
+// Stop the upload thread, dropping the jobs that have not started, and delete the shared context.
+void stopUploadThread(UploadThread& uploadThread)
+
+// Print the number of jobs and the time the upload thread spent running them.
+void printUploadThreadStatistics(const UploadThread& uploadThread)
+
+This file requires file_utilities.hpp to be included first.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <GL/glx.h>
+#endif
+
+using namespace std;
+
+// The capacity of the finished queue. It must be a power of two.
+#define FINISHED_UPLOAD_QUEUE_SIZE 1024
+
+struct UploadJob {
+	unsigned int id;
+	function<void()> run;
+};
+
+struct FinishedUpload {
+	unsigned int id;
+	GLsync fence;
+};
+
+// A single-producer, single-consumer queue. The upload thread only writes tail, the rendering thread
+// only writes head, so neither of them ever takes a lock.
+struct FinishedUploadQueue {
+	FinishedUpload items[FINISHED_UPLOAD_QUEUE_SIZE];
+	atomic<unsigned int> head;
+	atomic<unsigned int> tail;
+};
+
+struct UploadThread {
+#ifdef _WIN32
+	HDC deviceContext;
+	HGLRC context;
+#else
+	Display* display;
+	GLXContext context;
+	GLXPbuffer pbuffer;            // a tiny off-screen surface, so the upload thread does not touch the window
+#endif
+
+	thread uploader;
+	mutex jobMutex;
+	condition_variable jobCondition;
+	deque<UploadJob> jobQueue;
+	bool stopping;
+
+	FinishedUploadQueue finishedQueue;
+
+	atomic<unsigned int> unfinishedJobs;   // queued or running
+	atomic<unsigned int> pendingJobs;      // queued, running, or finished but not polled
+
+	// Statistics. jobMilliseconds is only written by the upload thread.
+	unsigned int finishedJobCount;
+	double jobMilliseconds;
+};
+
+//------------------------------------------------------------
+// Add an item to the finished queue (upload thread only). Returns false if the queue is full.
+bool pushFinishedUpload(FinishedUploadQueue& queue, const FinishedUpload& item) {
+	unsigned int tail = queue.tail.load(memory_order_relaxed);
+	if (tail - queue.head.load(memory_order_acquire) == FINISHED_UPLOAD_QUEUE_SIZE) {
+		return false;
+	}
+	queue.items[tail % FINISHED_UPLOAD_QUEUE_SIZE] = item;
+	queue.tail.store(tail + 1, memory_order_release);
+	return true;
+}
+
+//------------------------------------------------------------
+// Take an item off the finished queue (rendering thread only). Returns false if the queue is empty.
+bool popFinishedUpload(FinishedUploadQueue& queue, FinishedUpload& item) {
+	unsigned int head = queue.head.load(memory_order_relaxed);
+	if (head == queue.tail.load(memory_order_acquire)) {
+		return false;
+	}
+	item = queue.items[head % FINISHED_UPLOAD_QUEUE_SIZE];
+	queue.head.store(head + 1, memory_order_release);
+	return true;
+}
+
+//------------------------------------------------------------
+// Make the shared context current on the calling thread, or release it (current = false).
+bool makeUploadContextCurrent(UploadThread& uploadThread, bool current) {
+#ifdef _WIN32
+	return wglMakeCurrent(current ? uploadThread.deviceContext : NULL, current ? uploadThread.context : NULL) == TRUE;
+#else
+	if (current) {
+		return glXMakeContextCurrent(uploadThread.display, uploadThread.pbuffer, uploadThread.pbuffer, uploadThread.context) == True;
+	}
+	return glXMakeContextCurrent(uploadThread.display, None, None, NULL) == True;
+#endif
+}
+
+//------------------------------------------------------------
+// The upload thread. It runs the jobs in order, and fences each one.
+// started tells startUploadThread() whether the shared context could be made current. Without it, no job
+// could run, so the thread ends at once.
+void uploadThreadMain(UploadThread* uploadThread, promise<bool>* started) {
+	if (!makeUploadContextCurrent(*uploadThread, true)) {
+		cout << "uploadThreadMain(): unable to make the shared context current" << endl;
+		started->set_value(false);
+		return;
+	}
+	started->set_value(true);
+
+	while (true) {
+		UploadJob job;
+		{
+			unique_lock<mutex> lock(uploadThread->jobMutex);
+			uploadThread->jobCondition.wait(lock, [uploadThread] {
+				return uploadThread->stopping || !uploadThread->jobQueue.empty();
+			});
+			if (uploadThread->stopping) {
+				break;
+			}
+			job = uploadThread->jobQueue.front();
+			uploadThread->jobQueue.pop_front();
+		}
+
+		chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+		job.run();
+
+		// The fence must reach the GPU before another context can wait for it.
+		FinishedUpload finished;
+		finished.id = job.id;
+		finished.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		uploadThread->jobMilliseconds += elapsedMilliseconds(startTime);
+
+		// The rendering thread empties the queue every frame, so it is rarely full.
+		while (!pushFinishedUpload(uploadThread->finishedQueue, finished)) {
+			this_thread::yield();
+		}
+		uploadThread->unfinishedJobs--;
+	}
+
+	makeUploadContextCurrent(*uploadThread, false);
+}
+
+//------------------------------------------------------------
+// Create the shared context and start the upload thread.
+bool startUploadThread(UploadThread& uploadThread) {
+#ifdef _WIN32
+	// The upload context uses the pixel format of the window, but is never made current on the window
+	// by the rendering thread, so the two threads can use the same device context.
+	uploadThread.deviceContext = wglGetCurrentDC();
+	uploadThread.context = wglCreateContext(uploadThread.deviceContext);
+	if (!uploadThread.context || !wglShareLists(wglGetCurrentContext(), uploadThread.context)) {
+		cout << "startUploadThread(): unable to create a shared context" << endl;
+		if (uploadThread.context) {
+			wglDeleteContext(uploadThread.context);
+		}
+		return false;
+	}
+#else
+	uploadThread.display = glXGetCurrentDisplay();
+	GLXContext renderContext = glXGetCurrentContext();
+
+	// Use the framebuffer configuration of the rendering context.
+	int configId = 0;
+	glXQueryContext(uploadThread.display, renderContext, GLX_FBCONFIG_ID, &configId);
+	int configAttributes[] = { GLX_FBCONFIG_ID, configId, None };
+	int configCount = 0;
+	GLXFBConfig* configs = glXChooseFBConfig(uploadThread.display, DefaultScreen(uploadThread.display), configAttributes, &configCount);
+	if (!configs || configCount == 0) {
+		cout << "startUploadThread(): unable to find the framebuffer configuration" << endl;
+		return false;
+	}
+
+	uploadThread.context = glXCreateNewContext(uploadThread.display, configs[0], GLX_RGBA_TYPE, renderContext, True);
+	int pbufferAttributes[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+	uploadThread.pbuffer = uploadThread.context ? glXCreatePbuffer(uploadThread.display, configs[0], pbufferAttributes) : 0;
+	XFree(configs);
+	if (!uploadThread.context || !uploadThread.pbuffer) {
+		cout << "startUploadThread(): unable to create a shared context" << endl;
+		if (uploadThread.context) {
+			glXDestroyContext(uploadThread.display, uploadThread.context);
+		}
+		return false;
+	}
+#endif
+
+	uploadThread.finishedQueue.head = 0;
+	uploadThread.finishedQueue.tail = 0;
+	uploadThread.unfinishedJobs = 0;
+	uploadThread.pendingJobs = 0;
+	uploadThread.finishedJobCount = 0;
+	uploadThread.jobMilliseconds = 0.0;
+	uploadThread.stopping = false;
+
+	// Wait until the upload thread knows whether it has a context, so that the caller can fall back if not.
+	promise<bool> started;
+	future<bool> startedResult = started.get_future();
+	uploadThread.uploader = thread(uploadThreadMain, &uploadThread, &started);
+	if (!startedResult.get()) {
+		uploadThread.uploader.join();
+#ifdef _WIN32
+		wglDeleteContext(uploadThread.context);
+#else
+		glXDestroyPbuffer(uploadThread.display, uploadThread.pbuffer);
+		glXDestroyContext(uploadThread.display, uploadThread.context);
+#endif
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------
+// Queue a job for the upload thread.
+void queueUploadJob(UploadThread& uploadThread, unsigned int id, const function<void()>& job) {
+	uploadThread.unfinishedJobs++;
+	uploadThread.pendingJobs++;
+	{
+		lock_guard<mutex> lock(uploadThread.jobMutex);
+		UploadJob uploadJob;
+		uploadJob.id = id;
+		uploadJob.run = job;
+		uploadThread.jobQueue.push_back(uploadJob);
+	}
+	uploadThread.jobCondition.notify_one();
+}
+
+//------------------------------------------------------------
+// Take the next finished job off the queue.
+// glWaitSync() makes the GPU wait for the job's fence before it runs the commands issued after it on the
+// rendering context; the CPU does not wait.
+bool pollFinishedUpload(UploadThread& uploadThread, unsigned int& id) {
+	FinishedUpload finished;
+	if (!popFinishedUpload(uploadThread.finishedQueue, finished)) {
+		return false;
+	}
+
+	glWaitSync(finished.fence, 0, GL_TIMEOUT_IGNORED);
+	glDeleteSync(finished.fence);
+
+	id = finished.id;
+	uploadThread.finishedJobCount++;
+	uploadThread.pendingJobs--;
+	return true;
+}
+
+//------------------------------------------------------------
+// True from the time a job is queued until it is taken off the finished queue.
+bool isUploadThreadBusy(const UploadThread& uploadThread) {
+	return uploadThread.uploader.joinable() && uploadThread.pendingJobs > 0;
+}
+
+//------------------------------------------------------------
+// Wait until every queued job has run.
+void waitForUploadThread(UploadThread& uploadThread) {
+	while (uploadThread.uploader.joinable() && uploadThread.unfinishedJobs > 0) {
+		this_thread::yield();
+	}
+}
+
+//------------------------------------------------------------
+// Stop the upload thread and delete the shared context.
+void stopUploadThread(UploadThread& uploadThread) {
+	if (!uploadThread.uploader.joinable()) {
+		return;
+	}
+
+	// The dropped jobs and the finished jobs that are not polled any more no longer count as pending.
+	{
+		lock_guard<mutex> lock(uploadThread.jobMutex);
+		uploadThread.stopping = true;
+		unsigned int droppedJobCount = (unsigned int) uploadThread.jobQueue.size();
+		uploadThread.jobQueue.clear();
+		uploadThread.unfinishedJobs -= droppedJobCount;
+		uploadThread.pendingJobs -= droppedJobCount;
+	}
+	uploadThread.jobCondition.notify_one();
+	uploadThread.uploader.join();
+
+	FinishedUpload finished;
+	while (popFinishedUpload(uploadThread.finishedQueue, finished)) {
+		glDeleteSync(finished.fence);
+		uploadThread.pendingJobs--;
+	}
+
+#ifdef _WIN32
+	wglDeleteContext(uploadThread.context);
+#else
+	glXDestroyPbuffer(uploadThread.display, uploadThread.pbuffer);
+	glXDestroyContext(uploadThread.display, uploadThread.context);
+#endif
+}
+
+//------------------------------------------------------------
+// Print the number of jobs and the time the upload thread spent running them.
+void printUploadThreadStatistics(const UploadThread& uploadThread) {
+	cout << "---------- Upload thread ----------" << endl;
+	cout << "Finished jobs: " << uploadThread.finishedJobCount << ", pending: " << uploadThread.pendingJobs << endl;
+	cout << "Time spent on the upload thread: " << uploadThread.jobMilliseconds << " ms" << endl;
+}
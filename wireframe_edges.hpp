@@ -0,0 +1,148 @@
+/* This is a utility program that helps OpenGL programmers draw meshes as wireframes quickly.
+glPolygonMode(GL_FRONT_AND_BACK, GL_LINE) still sets up every triangle, and draws every edge that two triangles
+share twice. This file extracts the unique edges of a mesh once, so that the wireframe can be drawn as GL_LINES
+with about a third of the indices. The edges of a large mesh are deduplicated in parallel: the faces are split
+into chunks whose edges are sorted into buckets by hash, and then each bucket is deduplicated on its own.
+The following functions are provided.
+
+// The unique edges of a mesh, as pairs of vertex indices (smaller index first).
+vector<unsigned int> extractUniqueEdges(const aiMesh* mesh)
+
+// The unique edges of several meshes of a scene. edges[i] is filled for every i in meshIndices.
+void extractUniqueEdges(const aiScene* scene, const vector<unsigned int>& meshIndices, vector<vector<unsigned int> >& edges)
+
+// True if the edge indices of a mesh fit in 16 bits.
+bool useShortEdgeIndices(const aiMesh* mesh)
+
+// The number of indices glPolygonMode(GL_LINE) draws for a mesh, i.e. two per side of every polygon.
+unsigned long long getPolygonLineIndexCount(const aiMesh* mesh)
+
+This file requires thread_utilities.hpp to be included first.
+*/
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// Meshes with fewer faces than this are deduplicated on the calling thread.
+#define PARALLEL_EDGE_FACE_COUNT 16384
+
+//------------------------------------------------------------
+// Add the edges of a range of faces to their buckets. An edge is stored as one 64-bit key, smaller index
+// in the upper half, so that both directions of a shared edge give the same key.
+void collectFaceEdges(const aiMesh* mesh, unsigned int firstFace, unsigned int endFace, unsigned int bucketBits,
+	vector<vector<unsigned long long> >& buckets) {
+	for (unsigned int i = firstFace; i < endFace; i++) {
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices < 2) {
+			continue;
+		}
+
+		// A line has one edge; a polygon is closed.
+		unsigned int sideCount = face.mNumIndices == 2 ? 1 : face.mNumIndices;
+		for (unsigned int k = 0; k < sideCount; k++) {
+			unsigned int a = face.mIndices[k];
+			unsigned int b = face.mIndices[(k + 1) % face.mNumIndices];
+			if (a == b) {
+				continue;
+			}
+			unsigned long long key = a < b ? ((unsigned long long) a << 32) | b : ((unsigned long long) b << 32) | a;
+			unsigned int bucket = bucketBits == 0 ? 0 : (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - bucketBits));
+			buckets[bucket].push_back(key);
+		}
+	}
+}
+
+//------------------------------------------------------------
+// The unique edges of a mesh.
+// Every copy of an edge lands in the same bucket, so the buckets can be sorted and deduplicated independently.
+vector<unsigned int> extractUniqueEdges(const aiMesh* mesh) {
+	vector<unsigned int> edges;
+	if (!mesh->HasFaces()) {
+		return edges;
+	}
+
+	unsigned int chunkCount = 1;
+	unsigned int bucketBits = 0;
+	if (mesh->mNumFaces >= PARALLEL_EDGE_FACE_COUNT) {
+		chunkCount = min(getWorkerThreadCount() * 4, mesh->mNumFaces / (PARALLEL_EDGE_FACE_COUNT / 4));
+		while ((1u << bucketBits) < chunkCount) {
+			bucketBits++;
+		}
+	}
+	unsigned int bucketCount = 1u << bucketBits;
+
+	// Each chunk of faces has its own buckets, so that the chunks do not share anything while they are collected.
+	vector<vector<vector<unsigned long long> > > chunkBuckets(chunkCount, vector<vector<unsigned long long> >(bucketCount));
+	parallelFor(chunkCount, [&](unsigned int chunk) {
+		unsigned int firstFace = (unsigned int) ((unsigned long long) mesh->mNumFaces * chunk / chunkCount);
+		unsigned int endFace = (unsigned int) ((unsigned long long) mesh->mNumFaces * (chunk + 1) / chunkCount);
+		collectFaceEdges(mesh, firstFace, endFace, bucketBits, chunkBuckets[chunk]);
+	});
+
+	vector<vector<unsigned long long> > uniqueBuckets(bucketCount);
+	parallelFor(bucketCount, [&](unsigned int bucket) {
+		vector<unsigned long long>& keys = uniqueBuckets[bucket];
+		for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+			keys.insert(keys.end(), chunkBuckets[chunk][bucket].begin(), chunkBuckets[chunk][bucket].end());
+			vector<unsigned long long>().swap(chunkBuckets[chunk][bucket]);
+		}
+		sort(keys.begin(), keys.end());
+		keys.erase(unique(keys.begin(), keys.end()), keys.end());
+	});
+
+	size_t edgeCount = 0;
+	for (unsigned int bucket = 0; bucket < bucketCount; bucket++) {
+		edgeCount += uniqueBuckets[bucket].size();
+	}
+	edges.reserve(edgeCount * 2);
+	for (unsigned int bucket = 0; bucket < bucketCount; bucket++) {
+		const vector<unsigned long long>& keys = uniqueBuckets[bucket];
+		for (size_t i = 0; i < keys.size(); i++) {
+			edges.push_back((unsigned int) (keys[i] >> 32));
+			edges.push_back((unsigned int) (keys[i] & 0xFFFFFFFFu));
+		}
+	}
+	return edges;
+}
+
+//------------------------------------------------------------
+// The unique edges of several meshes of a scene.
+// Small meshes are handed to the threads one mesh at a time. Large meshes are done one after the other,
+// each with all the threads, so that parallelFor() is never called from inside parallelFor().
+void extractUniqueEdges(const aiScene* scene, const vector<unsigned int>& meshIndices, vector<vector<unsigned int> >& edges) {
+	vector<unsigned int> smallMeshes;
+	for (unsigned int i = 0; i < meshIndices.size(); i++) {
+		const aiMesh* mesh = scene->mMeshes[meshIndices[i]];
+		if (mesh->mNumFaces >= PARALLEL_EDGE_FACE_COUNT) {
+			edges[meshIndices[i]] = extractUniqueEdges(mesh);
+		} else {
+			smallMeshes.push_back(meshIndices[i]);
+		}
+	}
+
+	parallelFor((unsigned int) smallMeshes.size(), [&](unsigned int i) {
+		edges[smallMeshes[i]] = extractUniqueEdges(scene->mMeshes[smallMeshes[i]]);
+	});
+}
+
+//------------------------------------------------------------
+// True if the edge indices of a mesh fit in 16 bits.
+// The indices are relative to the mesh's vertex range (base vertex), so only the mesh's own vertex count matters.
+bool useShortEdgeIndices(const aiMesh* mesh) {
+	return mesh->mNumVertices <= 65536;
+}
+
+//------------------------------------------------------------
+// The number of indices glPolygonMode(GL_LINE) draws for a mesh.
+// The polygon mode only changes polygons, so the point and line faces, which are drawn as they are, do not count.
+unsigned long long getPolygonLineIndexCount(const aiMesh* mesh) {
+	unsigned long long count = 0;
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		if (mesh->mFaces[i].mNumIndices >= 3) {
+			count += 2 * mesh->mFaces[i].mNumIndices;
+		}
+	}
+	return count;
+}